@@ -34,192 +34,63 @@ mkdir -p "$BUILD_DIR" "$LIB_DIR" "$BIN_DIR" "$LIB_DIR/plugins"
 echo -e "${YELLOW}Building core library...${NC}"
 $CC $CFLAGS -c "$SRC_DIR/queue.c" -o "$BUILD_DIR/queue.o"
 $CC $CFLAGS -c "$SRC_DIR/monitor.c" -o "$BUILD_DIR/monitor.o"
+$CC $CFLAGS -c "$SRC_DIR/utf8.c" -o "$BUILD_DIR/utf8.o"
+$CC $CFLAGS -c "$SRC_DIR/stage.c" -o "$BUILD_DIR/stage.o"
+$CC $CFLAGS -c "$SRC_DIR/record_batch.c" -o "$BUILD_DIR/record_batch.o"
+$CC $CFLAGS -c "$SRC_DIR/plugin_config.c" -o "$BUILD_DIR/plugin_config.o"
+$CC $CFLAGS -c "$SRC_DIR/shm_ring.c" -o "$BUILD_DIR/shm_ring.o"
+$CC $CFLAGS -c "$SRC_DIR/shm_pool.c" -o "$BUILD_DIR/shm_pool.o"
+$CC $CFLAGS -c "$SRC_DIR/isolate.c" -o "$BUILD_DIR/isolate.o"
+$CC $CFLAGS -c "$SRC_DIR/metrics.c" -o "$BUILD_DIR/metrics.o"
+$CC $CFLAGS -c "$SRC_DIR/trace.c" -o "$BUILD_DIR/trace.o"
+$CC $CFLAGS -c "$SRC_DIR/exporter.c" -o "$BUILD_DIR/exporter.o"
+$CC $CFLAGS -c "$SRC_DIR/mem_budget.c" -o "$BUILD_DIR/mem_budget.o"
 
 # Create static library
-ar rcs "$LIB_DIR/libpipeline_core.a" "$BUILD_DIR/queue.o" "$BUILD_DIR/monitor.o"
+ar rcs "$LIB_DIR/libpipeline_core.a" "$BUILD_DIR/queue.o" "$BUILD_DIR/monitor.o" "$BUILD_DIR/utf8.o" \
+    "$BUILD_DIR/stage.o" "$BUILD_DIR/record_batch.o" "$BUILD_DIR/plugin_config.o" \
+    "$BUILD_DIR/shm_ring.o" "$BUILD_DIR/shm_pool.o" "$BUILD_DIR/isolate.o" "$BUILD_DIR/metrics.o" "$BUILD_DIR/trace.o" \
+    "$BUILD_DIR/exporter.o" "$BUILD_DIR/mem_budget.o"
 echo -e "${GREEN}✓ Core library built${NC}"
 
 # Build plugins
 echo -e "${YELLOW}Building plugins...${NC}"
 
-# Create plugin source files if they don't exist
-for plugin in upper lower reverse trim prefix suffix; do
-    cat > "$PLUGIN_DIR/${plugin}.c" << EOF
-/**
- * Plugin: ${plugin}
- */
-
-#include "../src/plugin_common.h"
-#include "../src/queue.h"
-#include <pthread.h>
-#include <stdlib.h>
-#include <string.h>
-#include <ctype.h>
-#include <stdio.h>
-
-struct plugin_ctx {
-    const char* name;
-    queue_t* input;
-    queue_t* output;
-    pthread_t thread;
-    int stop_requested;
-};
-
-static char* transform_${plugin}(const char* input) {
-    char* output = strdup(input);
-    if (!output) return NULL;
-    
-EOF
-
-    case $plugin in
-        upper)
-            cat >> "$PLUGIN_DIR/${plugin}.c" << 'EOF'
-    for (char* p = output; *p; p++) {
-        *p = toupper((unsigned char)*p);
-    }
-EOF
-            ;;
-        lower)
-            cat >> "$PLUGIN_DIR/${plugin}.c" << 'EOF'
-    for (char* p = output; *p; p++) {
-        *p = tolower((unsigned char)*p);
-    }
-EOF
-            ;;
-        reverse)
-            cat >> "$PLUGIN_DIR/${plugin}.c" << 'EOF'
-    size_t len = strlen(output);
-    for (size_t i = 0; i < len / 2; i++) {
-        char tmp = output[i];
-        output[i] = output[len - 1 - i];
-        output[len - 1 - i] = tmp;
-    }
-EOF
-            ;;
-        trim)
-            cat >> "$PLUGIN_DIR/${plugin}.c" << 'EOF'
-    char* start = output;
-    char* end = output + strlen(output) - 1;
-    
-    while (*start && isspace((unsigned char)*start)) start++;
-    while (end > start && isspace((unsigned char)*end)) end--;
-    *(end + 1) = '\0';
-    
-    if (start != output) {
-        memmove(output, start, strlen(start) + 1);
-    }
-EOF
-            ;;
-        prefix)
-            cat >> "$PLUGIN_DIR/${plugin}.c" << 'EOF'
-    char* prefixed = malloc(strlen(output) + 10);
-    if (prefixed) {
-        sprintf(prefixed, "PREFIX:%s", output);
-        free(output);
-        output = prefixed;
-    }
-EOF
-            ;;
-        suffix)
-            cat >> "$PLUGIN_DIR/${plugin}.c" << 'EOF'
-    char* suffixed = malloc(strlen(output) + 10);
-    if (suffixed) {
-        sprintf(suffixed, "%s:SUFFIX", output);
-        free(output);
-        output = suffixed;
-    }
-EOF
-            ;;
-    esac
-
-    cat >> "$PLUGIN_DIR/${plugin}.c" << EOF
-    return output;
-}
-
-static void* process_thread(void* arg) {
-    struct plugin_ctx* ctx = (struct plugin_ctx*)arg;
-    char* str;
-    
-    while (!ctx->stop_requested) {
-        int ret = queue_pop(ctx->input, &str);
-        if (ret == QUEUE_SHUTDOWN || ctx->stop_requested) {
-            if (str) free(str);
-            // Propagate shutdown to output queue
-            queue_shutdown(ctx->output);
-            break;
-        }
-        if (ret == 0 && str) {
-            char* transformed = transform_${plugin}(str);
-            if (transformed) {
-                queue_push(ctx->output, transformed);
-                free(transformed);
-            }
-            free(str);
-        }
-    }
-    return NULL;
-}
-
-PLUGIN_EXPORT int plugin_create(plugin_ctx_t** ctx, const char* config,
-                                queue_t* input, queue_t* output) {
-    (void)config;
-    struct plugin_ctx* p = calloc(1, sizeof(struct plugin_ctx));
-    if (!p) return -1;
-    
-    p->name = "${plugin}";
-    p->input = input;
-    p->output = output;
-    p->stop_requested = 0;
-    
-    if (pthread_create(&p->thread, NULL, process_thread, p) != 0) {
-        free(p);
-        return -1;
-    }
-    
-    *ctx = p;
-    return 0;
-}
-
-PLUGIN_EXPORT void plugin_request_stop(plugin_ctx_t* ctx) {
-    if (ctx) {
-        struct plugin_ctx* p = (struct plugin_ctx*)ctx;
-        p->stop_requested = 1;
-    }
-}
-
-PLUGIN_EXPORT void plugin_destroy(plugin_ctx_t* ctx) {
-    if (!ctx) return;
-    struct plugin_ctx* p = (struct plugin_ctx*)ctx;
-    p->stop_requested = 1;
-    if (p->input) queue_shutdown(p->input);
-    pthread_join(p->thread, NULL);
-    free(p);
-}
-
-PLUGIN_EXPORT const char* plugin_name(plugin_ctx_t* ctx) {
-    struct plugin_ctx* p = (struct plugin_ctx*)ctx;
-    return p ? p->name : NULL;
-}
-
-PLUGIN_EXPORT const char* plugin_version(void) {
-    return "1.0.0";
-}
-
-PLUGIN_EXPORT const char* plugin_description(void) {
-    return "${plugin} transformation plugin";
-}
-EOF
-
-    # Compile plugin
+# Plugins are plain sources in $PLUGIN_DIR; transform plugins need no
+# threading code because the host owns the processing loop (src/stage.c)
+for plugin in upper lower reverse trim prefix suffix validate; do
     $CC $CFLAGS -shared "$PLUGIN_DIR/${plugin}.c" -o "$LIB_DIR/plugins/${plugin}.so" -L"$LIB_DIR" -lpipeline_core
     echo -e "${GREEN}✓ ${plugin} plugin built${NC}"
 done
 
+# The same plugins again, linked into the pipeline binary (src/builtins.c)
+BUILTIN_OBJS="$BUILD_DIR/builtins.o"
+$CC $CFLAGS -c "$SRC_DIR/builtins.c" -o "$BUILD_DIR/builtins.o"
+for plugin in upper lower reverse trim prefix suffix validate; do
+    $CC $CFLAGS -DPLUGIN_BUILTIN -c "$PLUGIN_DIR/${plugin}.c" -o "$BUILD_DIR/builtin_${plugin}.o"
+    BUILTIN_OBJS="$BUILTIN_OBJS $BUILD_DIR/builtin_${plugin}.o"
+done
+ar rcs "$LIB_DIR/libpipeline_builtins.a" $BUILTIN_OBJS
+echo -e "${GREEN}✓ Builtin plugins built${NC}"
+
+# Pipeline assembly (src/pipeline.c) sits on top of builtins and core
+$CC $CFLAGS -c "$SRC_DIR/pipeline.c" -o "$BUILD_DIR/pipeline.o"
+ar rcs "$LIB_DIR/libpipeline.a" "$BUILD_DIR/pipeline.o"
+echo -e "${GREEN}✓ Pipeline library built${NC}"
+
+# Test-only plugins (not installed as builtins)
+$CC $CFLAGS -shared "$PLUGIN_DIR/test_crash.c" -o "$LIB_DIR/plugins/test_crash.so"
+echo -e "${GREEN}✓ test_crash plugin built${NC}"
+$CC $CFLAGS -shared "$PLUGIN_DIR/test_count.c" -o "$LIB_DIR/plugins/test_count.so" -L"$LIB_DIR" -lpipeline_core
+echo -e "${GREEN}✓ test_count plugin built${NC}"
+
 # Build unit tests
 echo -e "${YELLOW}Building unit tests...${NC}"
 
 # Queue tests
-$CC $CFLAGS "$TEST_DIR/test_queue.c" "$SRC_DIR/queue.c" \
+$CC $CFLAGS "$TEST_DIR/test_queue.c" "$SRC_DIR/queue.c" "$SRC_DIR/record_batch.c" "$SRC_DIR/trace.c" \
+    "$SRC_DIR/shm_pool.c" \
+    "$SRC_DIR/metrics.c" "$SRC_DIR/mem_budget.c" "$SRC_DIR/monitor.c" \
     -o "$BIN_DIR/test_queue" $LDFLAGS
 echo -e "${GREEN}✓ Queue tests built${NC}"
 
@@ -228,158 +99,45 @@ $CC $CFLAGS "$TEST_DIR/test_monitor_fixed.c" "$SRC_DIR/monitor.c" \
     -o "$BIN_DIR/test_monitor" $LDFLAGS
 echo -e "${GREEN}✓ Monitor tests built${NC}"
 
-# Build main program
-echo -e "${YELLOW}Building main program...${NC}"
+# UTF-8 tests
+$CC $CFLAGS "$TEST_DIR/test_utf8.c" "$SRC_DIR/utf8.c" \
+    -o "$BIN_DIR/test_utf8" $LDFLAGS
+echo -e "${GREEN}✓ UTF-8 tests built${NC}"
 
-cat > "$SRC_DIR/main.c" << 'EOF'
-/**
- * Main program for string processing pipeline
- */
+# Plugin config tests
+$CC $CFLAGS "$TEST_DIR/test_plugin_config.c" "$SRC_DIR/plugin_config.c" \
+    -o "$BIN_DIR/test_plugin_config" $LDFLAGS
+echo -e "${GREEN}✓ Plugin config tests built${NC}"
 
-#include <stdio.h>
-#include <stdlib.h>
-#include <string.h>
-#include <dlfcn.h>
-#include <pthread.h>
-#include <unistd.h>
-#include "queue.h"
-#include "plugin_common.h"
+# Shared ring tests
+$CC $CFLAGS "$TEST_DIR/test_shm_ring.c" "$SRC_DIR/shm_ring.c" "$SRC_DIR/shm_pool.c" \
+    -o "$BIN_DIR/test_shm_ring" $LDFLAGS
+echo -e "${GREEN}✓ Shared ring tests built${NC}"
 
-#define MAX_LINE_LENGTH 1024
-#define QUEUE_CAPACITY 100
+# Metrics tests
+$CC $CFLAGS "$TEST_DIR/test_metrics.c" "$SRC_DIR/metrics.c" \
+    -o "$BIN_DIR/test_metrics" $LDFLAGS
+echo -e "${GREEN}✓ Metrics tests built${NC}"
 
-typedef struct {
-    void* handle;
-    plugin_interface_t interface;
-    plugin_ctx_t* context;
-} plugin_t;
+# Trace tests
+$CC $CFLAGS "$TEST_DIR/test_trace.c" "$SRC_DIR/trace.c" \
+    -o "$BIN_DIR/test_trace" $LDFLAGS
+echo -e "${GREEN}✓ Trace tests built${NC}"
 
-static void* input_thread(void* arg) {
-    queue_t* input_queue = (queue_t*)arg;
-    char line[MAX_LINE_LENGTH];
-    
-    while (fgets(line, sizeof(line), stdin)) {
-        size_t len = strlen(line);
-        if (len > 0 && line[len-1] == '\n') {
-            line[len-1] = '\0';
-        }
-        
-        if (strcmp(line, "<END>") == 0) {
-            queue_shutdown(input_queue);
-            break;
-        }
-        
-        queue_push(input_queue, line);
-    }
-    
-    return NULL;
-}
+# Build main program
+echo -e "${YELLOW}Building main program...${NC}"
 
-static void* output_thread(void* arg) {
-    queue_t* output_queue = (queue_t*)arg;
-    char* str;
-    
-    while (queue_pop(output_queue, &str) == 0) {
-        printf("%s\n", str);
-        fflush(stdout);
-        free(str);
-    }
-    
-    return NULL;
-}
+$CC $CFLAGS "$SRC_DIR/main.c" -o "$BIN_DIR/pipeline" -L"$LIB_DIR" \
+    -lpipeline -lpipeline_builtins -lpipeline_core $LDFLAGS
+echo -e "${GREEN}✓ Main program built${NC}"
 
-int main(int argc, char* argv[]) {
-    if (argc < 2) {
-        fprintf(stderr, "Usage: %s plugin1.so [plugin2.so ...]\n", argv[0]);
-        return 1;
-    }
-    
-    int plugin_count = argc - 1;
-    plugin_t* plugins = calloc(plugin_count, sizeof(plugin_t));
-    queue_t* queues = calloc(plugin_count + 1, sizeof(queue_t));
-    
-    // Initialize queues
-    for (int i = 0; i <= plugin_count; i++) {
-        if (queue_init(&queues[i], QUEUE_CAPACITY) != 0) {
-            fprintf(stderr, "Failed to initialize queue %d\n", i);
-            return 1;
-        }
-    }
-    
-    // Load plugins
-    for (int i = 0; i < plugin_count; i++) {
-        plugins[i].handle = dlopen(argv[i + 1], RTLD_LAZY);
-        if (!plugins[i].handle) {
-            fprintf(stderr, "Failed to load plugin %s: %s\n", argv[i + 1], dlerror());
-            return 1;
-        }
-        
-        plugins[i].interface.create = dlsym(plugins[i].handle, "plugin_create");
-        plugins[i].interface.destroy = dlsym(plugins[i].handle, "plugin_destroy");
-        plugins[i].interface.request_stop = dlsym(plugins[i].handle, "plugin_request_stop");
-        plugins[i].interface.name = dlsym(plugins[i].handle, "plugin_name");
-        
-        if (!plugins[i].interface.create || !plugins[i].interface.destroy) {
-            fprintf(stderr, "Plugin %s missing required functions\n", argv[i + 1]);
-            return 1;
-        }
-        
-        if (plugins[i].interface.create(&plugins[i].context, NULL, 
-                                        &queues[i], &queues[i + 1]) != 0) {
-            fprintf(stderr, "Failed to create plugin %s\n", argv[i + 1]);
-            return 1;
-        }
-        
-        if (plugins[i].interface.name) {
-            printf("Loaded plugin: %s\n", plugins[i].interface.name(plugins[i].context));
-        }
-    }
-    
-    // Start I/O threads
-    pthread_t input_tid, output_tid;
-    pthread_create(&input_tid, NULL, input_thread, &queues[0]);
-    pthread_create(&output_tid, NULL, output_thread, &queues[plugin_count]);
-    
-    // Wait for input thread to finish
-    pthread_join(input_tid, NULL);
-    
-    // Input thread has already shut down the first queue
-    // Plugins will propagate shutdown through the pipeline
-    
-    // Wait for output thread to finish processing all data
-    pthread_join(output_tid, NULL);
-    
-    // Stop plugins
-    for (int i = 0; i < plugin_count; i++) {
-        if (plugins[i].interface.request_stop) {
-            plugins[i].interface.request_stop(plugins[i].context);
-        }
-    }
-    
-    // Destroy plugins
-    for (int i = 0; i < plugin_count; i++) {
-        if (plugins[i].interface.destroy) {
-            plugins[i].interface.destroy(plugins[i].context);
-        }
-        if (plugins[i].handle) {
-            dlclose(plugins[i].handle);
-        }
-    }
-    
-    // Cleanup
-    for (int i = 0; i <= plugin_count; i++) {
-        queue_destroy(&queues[i]);
-    }
-    
-    free(plugins);
-    free(queues);
-    
-    return 0;
-}
-EOF
+$CC $CFLAGS "$SRC_DIR/pipeline_bench.c" -o "$BIN_DIR/pipeline_bench" -L"$LIB_DIR" \
+    -lpipeline -lpipeline_builtins -lpipeline_core $LDFLAGS -lm
+echo -e "${GREEN}✓ Benchmark built${NC}"
 
-$CC $CFLAGS "$SRC_DIR/main.c" "$SRC_DIR/queue.c" -o "$BIN_DIR/pipeline" $LDFLAGS
-echo -e "${GREEN}✓ Main program built${NC}"
+$CC $CFLAGS "$SRC_DIR/sync_bench.c" -o "$BIN_DIR/sync_bench" -L"$LIB_DIR" \
+    -lpipeline_core $LDFLAGS
+echo -e "${GREEN}✓ Synchronization benchmark built${NC}"
 
 # Build test runner
 echo -e "${YELLOW}Building test runner...${NC}"
@@ -419,6 +177,11 @@ int main(void) {
     
     failures += run_test("Queue Tests", "./build/bin/test_queue");
     failures += run_test("Monitor Tests", "./build/bin/test_monitor");
+    failures += run_test("UTF-8 Tests", "./build/bin/test_utf8");
+    failures += run_test("Plugin Config Tests", "./build/bin/test_plugin_config");
+    failures += run_test("Shared Ring Tests", "./build/bin/test_shm_ring");
+    failures += run_test("Metrics Tests", "./build/bin/test_metrics");
+    failures += run_test("Trace Tests", "./build/bin/test_trace");
     
     printf("\n========================================\n");
     printf("TEST SUMMARY\n");
@@ -3,103 +3,31 @@
  */
 
 #include "../src/plugin_common.h"
-#include "../src/queue.h"
-#include <pthread.h>
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
-#include <stdio.h>
 
-struct plugin_ctx {
-    const char* name;
-    queue_t* input;
-    queue_t* output;
-    pthread_t thread;
-    int stop_requested;
-};
+PLUGIN_EXPORT int plugin_transform(plugin_ctx_t* ctx, const char* in, size_t len,
+                                   plugin_buf_t* out) {
+    (void)ctx;
+    if (plugin_buf_reserve(out, len) != PLUGIN_SUCCESS) return PLUGIN_NO_MEMORY;
 
-static char* transform_reverse(const char* input) {
-    char* output = strdup(input);
-    if (!output) return NULL;
-    
-    size_t len = strlen(output);
+    /* Swap in the output buffer so the in-place case needs no temporary */
+    char* output = out->data;
+    if (output != in) {
+        memcpy(output, in, len);
+    }
     for (size_t i = 0; i < len / 2; i++) {
         char tmp = output[i];
         output[i] = output[len - 1 - i];
         output[len - 1 - i] = tmp;
     }
-    return output;
-}
-
-static void* process_thread(void* arg) {
-    struct plugin_ctx* ctx = (struct plugin_ctx*)arg;
-    char* str;
-    
-    while (!ctx->stop_requested) {
-        int ret = queue_pop(ctx->input, &str);
-        if (ret == QUEUE_SHUTDOWN || ctx->stop_requested) {
-            if (str) free(str);
-            // Propagate shutdown to output queue
-            queue_shutdown(ctx->output);
-            break;
-        }
-        if (ret == 0 && str) {
-            char* transformed = transform_reverse(str);
-            if (transformed) {
-                queue_push(ctx->output, transformed);
-                free(transformed);
-            }
-            free(str);
-        }
-    }
-    return NULL;
-}
-
-PLUGIN_EXPORT int plugin_create(plugin_ctx_t** ctx, const char* config,
-                                queue_t* input, queue_t* output) {
-    (void)config;
-    struct plugin_ctx* p = calloc(1, sizeof(struct plugin_ctx));
-    if (!p) return -1;
-    
-    p->name = "reverse";
-    p->input = input;
-    p->output = output;
-    p->stop_requested = 0;
-    
-    if (pthread_create(&p->thread, NULL, process_thread, p) != 0) {
-        free(p);
-        return -1;
-    }
-    
-    *ctx = p;
-    return 0;
-}
-
-PLUGIN_EXPORT void plugin_request_stop(plugin_ctx_t* ctx) {
-    if (ctx) {
-        struct plugin_ctx* p = (struct plugin_ctx*)ctx;
-        p->stop_requested = 1;
-    }
-}
-
-PLUGIN_EXPORT void plugin_destroy(plugin_ctx_t* ctx) {
-    if (!ctx) return;
-    struct plugin_ctx* p = (struct plugin_ctx*)ctx;
-    p->stop_requested = 1;
-    if (p->input) queue_shutdown(p->input);
-    pthread_join(p->thread, NULL);
-    free(p);
+    out->len = len;
+    return PLUGIN_EMIT;
 }
 
-PLUGIN_EXPORT const char* plugin_name(plugin_ctx_t* ctx) {
-    struct plugin_ctx* p = (struct plugin_ctx*)ctx;
-    return p ? p->name : NULL;
-}
-
-PLUGIN_EXPORT const char* plugin_version(void) {
-    return "1.0.0";
-}
+PLUGIN_IMPL_INFO("reverse", "1.0.0", "reverse transformation plugin",
+                 PLUGIN_CAP_STATELESS | PLUGIN_CAP_ONE_TO_ONE | PLUGIN_CAP_THREAD_SAFE |
+                 PLUGIN_CAP_IN_PLACE | PLUGIN_CAP_LENGTH_PRESERVING)
 
-PLUGIN_EXPORT const char* plugin_description(void) {
-    return "reverse transformation plugin";
-}
+PLUGIN_REGISTER(reverse, NULL, NULL, plugin_transform, NULL)
@@ -1,105 +1,55 @@
 /**
  * Plugin: suffix
+ *
+ * Config:
+ *   text=STRING   text to add to every line (default SUFFIX_TEXT)
  */
 
 #include "../src/plugin_common.h"
-#include "../src/queue.h"
-#include <pthread.h>
+#include "../src/plugin_config.h"
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
-#include <stdio.h>
+
+#define SUFFIX_TEXT ":SUFFIX"
 
 struct plugin_ctx {
-    const char* name;
-    queue_t* input;
-    queue_t* output;
-    pthread_t thread;
-    int stop_requested;
+    char* text;
+    size_t len;
 };
 
-static char* transform_suffix(const char* input) {
-    char* output = strdup(input);
-    if (!output) return NULL;
-    
-    char* suffixed = malloc(strlen(output) + 10);
-    if (suffixed) {
-        sprintf(suffixed, "%s:SUFFIX", output);
-        free(output);
-        output = suffixed;
-    }
-    return output;
-}
-
-static void* process_thread(void* arg) {
-    struct plugin_ctx* ctx = (struct plugin_ctx*)arg;
-    char* str;
-    
-    while (!ctx->stop_requested) {
-        int ret = queue_pop(ctx->input, &str);
-        if (ret == QUEUE_SHUTDOWN || ctx->stop_requested) {
-            if (str) free(str);
-            // Propagate shutdown to output queue
-            queue_shutdown(ctx->output);
-            break;
-        }
-        if (ret == 0 && str) {
-            char* transformed = transform_suffix(str);
-            if (transformed) {
-                queue_push(ctx->output, transformed);
-                free(transformed);
-            }
-            free(str);
-        }
-    }
-    return NULL;
-}
-
-PLUGIN_EXPORT int plugin_create(plugin_ctx_t** ctx, const char* config,
-                                queue_t* input, queue_t* output) {
-    (void)config;
+PLUGIN_EXPORT int plugin_open(plugin_ctx_t** ctx, const char* config) {
     struct plugin_ctx* p = calloc(1, sizeof(struct plugin_ctx));
     if (!p) return -1;
-    
-    p->name = "suffix";
-    p->input = input;
-    p->output = output;
-    p->stop_requested = 0;
-    
-    if (pthread_create(&p->thread, NULL, process_thread, p) != 0) {
+
+    p->text = plugin_config_strdup(config, "text", SUFFIX_TEXT);
+    if (!p->text) {
         free(p);
         return -1;
     }
-    
+    p->len = strlen(p->text);
+
     *ctx = p;
     return 0;
 }
 
-PLUGIN_EXPORT void plugin_request_stop(plugin_ctx_t* ctx) {
-    if (ctx) {
-        struct plugin_ctx* p = (struct plugin_ctx*)ctx;
-        p->stop_requested = 1;
-    }
-}
-
-PLUGIN_EXPORT void plugin_destroy(plugin_ctx_t* ctx) {
+PLUGIN_EXPORT void plugin_close(plugin_ctx_t* ctx) {
     if (!ctx) return;
-    struct plugin_ctx* p = (struct plugin_ctx*)ctx;
-    p->stop_requested = 1;
-    if (p->input) queue_shutdown(p->input);
-    pthread_join(p->thread, NULL);
-    free(p);
+    free(ctx->text);
+    free(ctx);
 }
 
-PLUGIN_EXPORT const char* plugin_name(plugin_ctx_t* ctx) {
-    struct plugin_ctx* p = (struct plugin_ctx*)ctx;
-    return p ? p->name : NULL;
-}
+PLUGIN_EXPORT int plugin_transform(plugin_ctx_t* ctx, const char* in, size_t len,
+                                   plugin_buf_t* out) {
+    if (plugin_buf_reserve(out, ctx->len + len) != PLUGIN_SUCCESS) return PLUGIN_NO_MEMORY;
 
-PLUGIN_EXPORT const char* plugin_version(void) {
-    return "1.0.0";
+    memcpy(out->data, in, len);
+    memcpy(out->data + len, ctx->text, ctx->len);
+    out->len = ctx->len + len;
+    return PLUGIN_EMIT;
 }
 
-PLUGIN_EXPORT const char* plugin_description(void) {
-    return "suffix transformation plugin";
-}
+PLUGIN_IMPL_INFO("suffix", "1.0.0", "suffix transformation plugin",
+                 PLUGIN_CAP_STATELESS | PLUGIN_CAP_ONE_TO_ONE | PLUGIN_CAP_THREAD_SAFE)
+
+PLUGIN_REGISTER(suffix, plugin_open, plugin_close, plugin_transform, NULL)
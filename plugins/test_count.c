@@ -0,0 +1,47 @@
+/**
+ * Test plugin: count
+ *
+ * Swallows every line and counts it. Each control marker emits one line,
+ * "KIND VALUE: N", with the lines counted since the previous one, and the
+ * end of the stream emits the rest as "end 0: N". Used to exercise
+ * plugin_control in and out of --isolate.
+ */
+
+#include "../src/plugin_common.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+struct plugin_ctx {
+    size_t count;
+};
+
+PLUGIN_EXPORT int plugin_open(plugin_ctx_t** ctx, const char* config) {
+    (void)config;
+    *ctx = calloc(1, sizeof(struct plugin_ctx));
+    return *ctx ? 0 : -1;
+}
+
+PLUGIN_EXPORT void plugin_close(plugin_ctx_t* ctx) {
+    free(ctx);
+}
+
+PLUGIN_EXPORT int plugin_transform(plugin_ctx_t* ctx, const char* in, size_t len,
+                                   plugin_buf_t* out) {
+    (void)in;
+    (void)len;
+    (void)out;
+    ctx->count++;
+    return PLUGIN_DROP;
+}
+
+PLUGIN_EXPORT int plugin_control(plugin_ctx_t* ctx, const queue_marker_t* marker,
+                                 record_batch_t* out) {
+    char line[64];
+    int len = snprintf(line, sizeof(line), "%s %llu: %zu", queue_marker_name(marker->kind),
+                       (unsigned long long)marker->value, ctx->count);
+    ctx->count = 0;
+    return record_batch_append(out, line, (size_t)len) == 0 ? PLUGIN_SUCCESS : PLUGIN_NO_MEMORY;
+}
+
+PLUGIN_IMPL_INFO("test_count", "1.0.0", "counts lines between control markers",
+                 PLUGIN_CAP_ONE_TO_MANY)
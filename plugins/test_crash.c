@@ -0,0 +1,25 @@
+/**
+ * Test plugin: crash
+ *
+ * Echoes every line, except that a line containing "CRASH" kills the
+ * process with SIGSEGV. Used to exercise --isolate; never load it
+ * without isolation.
+ */
+
+#include "../src/plugin_common.h"
+#include <signal.h>
+#include <string.h>
+
+PLUGIN_EXPORT int plugin_transform(plugin_ctx_t* ctx, const char* in, size_t len,
+                                   plugin_buf_t* out) {
+    (void)ctx;
+    (void)len;
+    (void)out;
+    if (strstr(in, "CRASH")) {
+        raise(SIGSEGV);
+    }
+    return PLUGIN_PASS;
+}
+
+PLUGIN_IMPL_INFO("test_crash", "1.0.0", "crashes on lines containing CRASH",
+                 PLUGIN_CAP_STATELESS | PLUGIN_CAP_ONE_TO_ONE)
@@ -3,107 +3,32 @@
  */
 
 #include "../src/plugin_common.h"
-#include "../src/queue.h"
-#include <pthread.h>
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
-#include <stdio.h>
 
-struct plugin_ctx {
-    const char* name;
-    queue_t* input;
-    queue_t* output;
-    pthread_t thread;
-    int stop_requested;
-};
+PLUGIN_EXPORT int plugin_transform(plugin_ctx_t* ctx, const char* in, size_t len,
+                                   plugin_buf_t* out) {
+    (void)ctx;
+    const char* start = in;
+    const char* end = in + len;
 
-static char* transform_trim(const char* input) {
-    char* output = strdup(input);
-    if (!output) return NULL;
-    
-    char* start = output;
-    char* end = output + strlen(output) - 1;
-    
-    while (*start && isspace((unsigned char)*start)) start++;
-    while (end > start && isspace((unsigned char)*end)) end--;
-    *(end + 1) = '\0';
-    
-    if (start != output) {
-        memmove(output, start, strlen(start) + 1);
-    }
-    return output;
-}
+    while (start < end && isspace((unsigned char)*start)) start++;
+    while (end > start && isspace((unsigned char)*(end - 1))) end--;
 
-static void* process_thread(void* arg) {
-    struct plugin_ctx* ctx = (struct plugin_ctx*)arg;
-    char* str;
-    
-    while (!ctx->stop_requested) {
-        int ret = queue_pop(ctx->input, &str);
-        if (ret == QUEUE_SHUTDOWN || ctx->stop_requested) {
-            if (str) free(str);
-            // Propagate shutdown to output queue
-            queue_shutdown(ctx->output);
-            break;
-        }
-        if (ret == 0 && str) {
-            char* transformed = transform_trim(str);
-            if (transformed) {
-                queue_push(ctx->output, transformed);
-                free(transformed);
-            }
-            free(str);
-        }
+    if (start == in && end == in + len) {
+        return PLUGIN_PASS;
     }
-    return NULL;
-}
 
-PLUGIN_EXPORT int plugin_create(plugin_ctx_t** ctx, const char* config,
-                                queue_t* input, queue_t* output) {
-    (void)config;
-    struct plugin_ctx* p = calloc(1, sizeof(struct plugin_ctx));
-    if (!p) return -1;
-    
-    p->name = "trim";
-    p->input = input;
-    p->output = output;
-    p->stop_requested = 0;
-    
-    if (pthread_create(&p->thread, NULL, process_thread, p) != 0) {
-        free(p);
-        return -1;
-    }
-    
-    *ctx = p;
-    return 0;
+    size_t trimmed = (size_t)(end - start);
+    if (plugin_buf_reserve(out, trimmed) != PLUGIN_SUCCESS) return PLUGIN_NO_MEMORY;
+    memmove(out->data, start, trimmed);
+    out->len = trimmed;
+    return PLUGIN_EMIT;
 }
 
-PLUGIN_EXPORT void plugin_request_stop(plugin_ctx_t* ctx) {
-    if (ctx) {
-        struct plugin_ctx* p = (struct plugin_ctx*)ctx;
-        p->stop_requested = 1;
-    }
-}
+PLUGIN_IMPL_INFO("trim", "1.0.0", "trim transformation plugin",
+                 PLUGIN_CAP_STATELESS | PLUGIN_CAP_ONE_TO_ONE | PLUGIN_CAP_THREAD_SAFE |
+                 PLUGIN_CAP_IN_PLACE)
 
-PLUGIN_EXPORT void plugin_destroy(plugin_ctx_t* ctx) {
-    if (!ctx) return;
-    struct plugin_ctx* p = (struct plugin_ctx*)ctx;
-    p->stop_requested = 1;
-    if (p->input) queue_shutdown(p->input);
-    pthread_join(p->thread, NULL);
-    free(p);
-}
-
-PLUGIN_EXPORT const char* plugin_name(plugin_ctx_t* ctx) {
-    struct plugin_ctx* p = (struct plugin_ctx*)ctx;
-    return p ? p->name : NULL;
-}
-
-PLUGIN_EXPORT const char* plugin_version(void) {
-    return "1.0.0";
-}
-
-PLUGIN_EXPORT const char* plugin_description(void) {
-    return "trim transformation plugin";
-}
+PLUGIN_REGISTER(trim, NULL, NULL, plugin_transform, NULL)
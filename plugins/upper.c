@@ -3,100 +3,62 @@
  */
 
 #include "../src/plugin_common.h"
-#include "../src/queue.h"
-#include <pthread.h>
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
-#include <stdio.h>
 
-struct plugin_ctx {
-    const char* name;
-    queue_t* input;
-    queue_t* output;
-    pthread_t thread;
-    int stop_requested;
-};
+/* ASCII-only case map, matching toupper/tolower in the C locale */
+#define UPPER_BYTE(c) ((c) >= 'a' && (c) <= 'z' ? (c) - 'a' + 'A' : (c))
+static const unsigned char byte_map[256] = PLUGIN_BYTE_MAP(UPPER_BYTE);
 
-static char* transform_upper(const char* input) {
-    char* output = strdup(input);
-    if (!output) return NULL;
-    
-    for (char* p = output; *p; p++) {
-        *p = toupper((unsigned char)*p);
-    }
-    return output;
-}
+typedef unsigned char v16u8 __attribute__((vector_size(16)));
 
-static void* process_thread(void* arg) {
-    struct plugin_ctx* ctx = (struct plugin_ctx*)arg;
-    char* str;
-    
-    while (!ctx->stop_requested) {
-        int ret = queue_pop(ctx->input, &str);
-        if (ret == QUEUE_SHUTDOWN || ctx->stop_requested) {
-            if (str) free(str);
-            // Propagate shutdown to output queue
-            queue_shutdown(ctx->output);
-            break;
-        }
-        if (ret == 0 && str) {
-            char* transformed = transform_upper(str);
-            if (transformed) {
-                queue_push(ctx->output, transformed);
-                free(transformed);
-            }
-            free(str);
-        }
-    }
-    return NULL;
-}
+/*
+ * Flip the case bit of every ASCII lowercase letter in buf. The vector loop
+ * is branch-free, so a whole batch arena (NULs included, which are left
+ * alone) runs through it as one long stream.
+ */
+static void convert_case(char* buf, size_t len) {
+    size_t i = 0;
 
-PLUGIN_EXPORT int plugin_create(plugin_ctx_t** ctx, const char* config,
-                                queue_t* input, queue_t* output) {
-    (void)config;
-    struct plugin_ctx* p = calloc(1, sizeof(struct plugin_ctx));
-    if (!p) return -1;
-    
-    p->name = "upper";
-    p->input = input;
-    p->output = output;
-    p->stop_requested = 0;
-    
-    if (pthread_create(&p->thread, NULL, process_thread, p) != 0) {
-        free(p);
-        return -1;
+    for (; i + 16 <= len; i += 16) {
+        v16u8 v;
+        memcpy(&v, buf + i, sizeof(v));
+        v16u8 in_range = (v16u8)((v16u8)(v - 'a') < 26);
+        v ^= in_range & 0x20;
+        memcpy(buf + i, &v, sizeof(v));
     }
-    
-    *ctx = p;
-    return 0;
-}
-
-PLUGIN_EXPORT void plugin_request_stop(plugin_ctx_t* ctx) {
-    if (ctx) {
-        struct plugin_ctx* p = (struct plugin_ctx*)ctx;
-        p->stop_requested = 1;
+    for (; i < len; i++) {
+        buf[i] = (char)toupper((unsigned char)buf[i]);
     }
 }
 
-PLUGIN_EXPORT void plugin_destroy(plugin_ctx_t* ctx) {
-    if (!ctx) return;
-    struct plugin_ctx* p = (struct plugin_ctx*)ctx;
-    p->stop_requested = 1;
-    if (p->input) queue_shutdown(p->input);
-    pthread_join(p->thread, NULL);
-    free(p);
-}
+PLUGIN_EXPORT int plugin_transform(plugin_ctx_t* ctx, const char* in, size_t len,
+                                   plugin_buf_t* out) {
+    (void)ctx;
+    if (plugin_buf_reserve(out, len) != PLUGIN_SUCCESS) return PLUGIN_NO_MEMORY;
 
-PLUGIN_EXPORT const char* plugin_name(plugin_ctx_t* ctx) {
-    struct plugin_ctx* p = (struct plugin_ctx*)ctx;
-    return p ? p->name : NULL;
+    if (out->data != in) {
+        memcpy(out->data, in, len);
+    }
+    convert_case(out->data, len);
+    out->len = len;
+    return PLUGIN_EMIT;
 }
 
-PLUGIN_EXPORT const char* plugin_version(void) {
-    return "1.0.0";
+PLUGIN_EXPORT int plugin_transform_batch(plugin_ctx_t* ctx, record_batch_t* in,
+                                         record_batch_t* out) {
+    (void)ctx;
+    if (out != in && record_batch_copy(out, in) != 0) {
+        return PLUGIN_NO_MEMORY;
+    }
+    convert_case(out->data, out->size);
+    return PLUGIN_SUCCESS;
 }
 
-PLUGIN_EXPORT const char* plugin_description(void) {
-    return "upper transformation plugin";
-}
+PLUGIN_IMPL_INFO_BYTE_MAP("upper", "1.0.0", "upper transformation plugin",
+                          PLUGIN_CAP_STATELESS | PLUGIN_CAP_ONE_TO_ONE | PLUGIN_CAP_THREAD_SAFE |
+                          PLUGIN_CAP_IN_PLACE | PLUGIN_CAP_LENGTH_PRESERVING | PLUGIN_CAP_BYTE_MAP,
+                          byte_map)
+
+PLUGIN_REGISTER(upper, NULL, NULL, plugin_transform, plugin_transform_batch)
@@ -0,0 +1,101 @@
+/**
+ * Plugin: validate
+ *
+ * Checks every line for UTF-8 well-formedness before it reaches
+ * downstream consumers. Config (e.g. "validate:mode=drop") selects what
+ * happens to bad lines:
+ *   mode=replace  replace each ill-formed subpart with U+FFFD (default)
+ *   mode=drop     discard the line
+ *   mode=flag     pass the line through unchanged, tagged with VALIDATE_FLAG
+ */
+
+#include "../src/plugin_common.h"
+#include "../src/utf8.h"
+#include "../src/plugin_config.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+/* Tag prepended to ill-formed lines in flag mode */
+#define VALIDATE_FLAG "[invalid-utf8] "
+
+typedef enum {
+    VALIDATE_REPLACE = 0,
+    VALIDATE_DROP,
+    VALIDATE_FLAG_MODE
+} validate_mode_t;
+
+struct plugin_ctx {
+    validate_mode_t mode;
+};
+
+static int parse_mode(const char* config, validate_mode_t* mode) {
+    *mode = VALIDATE_REPLACE;
+    if (!plugin_config_find(config, "mode", NULL)) return 0;
+
+    if (plugin_config_equals(config, "mode", "replace")) {
+        *mode = VALIDATE_REPLACE;
+    } else if (plugin_config_equals(config, "mode", "drop")) {
+        *mode = VALIDATE_DROP;
+    } else if (plugin_config_equals(config, "mode", "flag")) {
+        *mode = VALIDATE_FLAG_MODE;
+    } else {
+        return -1;
+    }
+    return 0;
+}
+
+PLUGIN_EXPORT int plugin_open(plugin_ctx_t** ctx, const char* config) {
+    struct plugin_ctx* p = calloc(1, sizeof(struct plugin_ctx));
+    if (!p) return -1;
+
+    if (parse_mode(config, &p->mode) != 0) {
+        fprintf(stderr, "validate: bad config '%s' (mode must be replace, drop or flag)\n", config);
+        free(p);
+        return -1;
+    }
+
+    *ctx = p;
+    return 0;
+}
+
+PLUGIN_EXPORT void plugin_close(plugin_ctx_t* ctx) {
+    free(ctx);
+}
+
+PLUGIN_EXPORT int plugin_transform(plugin_ctx_t* ctx, const char* in, size_t len,
+                                   plugin_buf_t* out) {
+    /* Valid input is forwarded without a copy */
+    if (utf8_validate(in, len)) {
+        return PLUGIN_PASS;
+    }
+
+    switch (ctx->mode) {
+        case VALIDATE_DROP:
+            return PLUGIN_DROP;
+
+        case VALIDATE_FLAG_MODE: {
+            size_t tag = sizeof(VALIDATE_FLAG) - 1;
+            if (plugin_buf_reserve(out, tag + len) != PLUGIN_SUCCESS) return PLUGIN_NO_MEMORY;
+            memcpy(out->data, VALIDATE_FLAG, tag);
+            memcpy(out->data + tag, in, len);
+            out->len = tag + len;
+            return PLUGIN_EMIT;
+        }
+
+        case VALIDATE_REPLACE:
+        default:
+            if (plugin_buf_reserve(out, utf8_repair_bound(len)) != PLUGIN_SUCCESS) {
+                return PLUGIN_NO_MEMORY;
+            }
+            out->len = utf8_repair(in, len, out->data);
+            return PLUGIN_EMIT;
+    }
+}
+
+/* Drop mode filters records, so the plugin is 1:N rather than 1:1 */
+PLUGIN_IMPL_INFO("validate", "1.0.0",
+                 "UTF-8 validation plugin (replace, drop or flag ill-formed lines)",
+                 PLUGIN_CAP_STATELESS | PLUGIN_CAP_ONE_TO_MANY | PLUGIN_CAP_THREAD_SAFE)
+
+PLUGIN_REGISTER(validate, plugin_open, plugin_close, plugin_transform, NULL)
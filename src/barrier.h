@@ -5,12 +5,42 @@
  * Provides a cross-platform barrier synchronization primitive.
  * On Linux with glibc, uses native pthread_barrier.
  * On macOS/BSD, provides custom implementation using mutex and condition variables.
+ * 
+ * Also provides spin_barrier_t, a sense-reversing barrier for phases that
+ * repeat quickly (e.g. a coordinated flush across replicated stages).
+ * Features include:
+ * - Waiters spin for up to spin_ns before parking, so short skews between
+ *   participants cost no system call; parking uses a futex on Linux and
+ *   sched_yield elsewhere, and the last arrival only issues a wake when
+ *   some waiter is actually parked
+ * - Spinning is off by default on a single CPU, where it only delays the
+ *   thread everyone is waiting for
+ * - Per-participant arrival stats: time waited, rounds released while
+ *   spinning or parked, and rounds in which it arrived last, so
+ *   stragglers stand out
+ * 
+ * Thread Safety: spin_barrier_wait is called by exactly count threads per
+ *                round, each with its own participant id
+ * Memory Management: spin_barrier_init allocates the participant array,
+ *                    spin_barrier_destroy frees it
  */
 
 #ifndef BARRIER_H
 #define BARRIER_H
 
 #include <pthread.h>
+#include <errno.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#endif
 
 /* Check if native pthread_barrier is available */
 #if defined(__linux__) && defined(_GNU_SOURCE)
@@ -92,6 +122,162 @@
     }
 #endif
 
+/* Default bounded spin before parking, on machines with more than one CPU */
+#define SPIN_BARRIER_SPIN_NS 20000
+
+/* Returned by spin_barrier_wait to the last thread to arrive */
+#define SPIN_BARRIER_SERIAL_THREAD 1
+
+/* Arrival stats and private sense of one participant, on its own cache line */
+typedef struct spin_barrier_participant {
+    _Alignas(64) unsigned sense;     /* Sense this participant waits for next */
+    uint64_t rounds;                 /* Rounds completed */
+    uint64_t last;                   /* Rounds in which it arrived last */
+    uint64_t spun;                   /* Rounds released while spinning */
+    uint64_t parked;                 /* Rounds released after parking */
+    uint64_t wait_ns;                /* Time from arrival to release */
+    uint64_t max_wait_ns;
+} spin_barrier_participant_t;
+
+typedef struct spin_barrier {
+    unsigned count;                  /* Participants per round */
+    uint64_t spin_ns;                /* Spin budget before parking; may be changed before use */
+    _Atomic unsigned remaining;      /* Arrivals still missing this round */
+    _Atomic uint32_t sense;          /* Flipped by the last arrival; the futex word */
+    _Atomic unsigned parked;         /* Waiters in or about to enter the futex wait */
+    spin_barrier_participant_t* participants;  /* count entries, indexed by id */
+} spin_barrier_t;
+
+static inline uint64_t spin_barrier_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static inline void spin_barrier_relax(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    __asm__ __volatile__("yield");
+#endif
+}
+
+/*
+ * Sleep while the sense still equals old. The waiter counts itself parked
+ * before the futex rechecks the sense, and the last arrival flips the sense
+ * before reading the count, so one of the two always sees the other
+ */
+static inline void spin_barrier_park(spin_barrier_t* barrier, uint32_t old) {
+#ifdef __linux__
+    atomic_fetch_add(&barrier->parked, 1);
+    syscall(SYS_futex, (uint32_t*)&barrier->sense, FUTEX_WAIT_PRIVATE, old, NULL, NULL, 0);
+    atomic_fetch_sub(&barrier->parked, 1);
+#else
+    (void)barrier;
+    (void)old;
+    sched_yield();
+#endif
+}
+
+static inline void spin_barrier_wake(spin_barrier_t* barrier) {
+#ifdef __linux__
+    if (atomic_load(&barrier->parked) == 0) return;
+    syscall(SYS_futex, (uint32_t*)&barrier->sense, FUTEX_WAKE_PRIVATE, INT32_MAX, NULL, NULL, 0);
+#else
+    (void)barrier;
+#endif
+}
+
+/**
+ * @brief Initialize a spinning barrier
+ * 
+ * @param barrier Barrier to initialize
+ * @param count Participants per round (> 0)
+ * @return 0 on success, -1 on error (sets errno)
+ */
+static inline int spin_barrier_init(spin_barrier_t* barrier, unsigned int count) {
+    if (!barrier || count == 0) {
+        errno = EINVAL;
+        return -1;
+    }
+    
+    size_t bytes = count * sizeof(spin_barrier_participant_t);
+    barrier->participants = aligned_alloc(_Alignof(spin_barrier_participant_t), bytes);
+    if (!barrier->participants) {
+        errno = ENOMEM;
+        return -1;
+    }
+    memset(barrier->participants, 0, bytes);
+    for (unsigned i = 0; i < count; i++) {
+        barrier->participants[i].sense = 1;
+    }
+    
+    barrier->count = count;
+    barrier->spin_ns = sysconf(_SC_NPROCESSORS_ONLN) > 1 ? SPIN_BARRIER_SPIN_NS : 0;
+    atomic_init(&barrier->remaining, count);
+    atomic_init(&barrier->sense, 0);
+    atomic_init(&barrier->parked, 0);
+    return 0;
+}
+
+/**
+ * @brief Wait until all participants of the round have arrived
+ * 
+ * @param barrier Barrier
+ * @param id This thread's participant id, 0 to count - 1, fixed per thread
+ * @return SPIN_BARRIER_SERIAL_THREAD for the last arrival, 0 for the others
+ */
+static inline int spin_barrier_wait(spin_barrier_t* barrier, unsigned int id) {
+    spin_barrier_participant_t* self = &barrier->participants[id];
+    unsigned sense = self->sense;
+    self->sense = !sense;
+    self->rounds++;
+    
+    /* The last arrival resets the count, then releases the round */
+    if (atomic_fetch_sub_explicit(&barrier->remaining, 1, memory_order_acq_rel) == 1) {
+        atomic_store_explicit(&barrier->remaining, barrier->count, memory_order_relaxed);
+        atomic_store(&barrier->sense, sense);
+        spin_barrier_wake(barrier);
+        self->last++;
+        return SPIN_BARRIER_SERIAL_THREAD;
+    }
+    
+    uint64_t arrived = spin_barrier_now_ns();
+    uint64_t now = arrived;
+    int parked = 0;
+    for (unsigned spins = 0;
+         atomic_load_explicit(&barrier->sense, memory_order_acquire) != sense; spins++) {
+        if (!parked && now - arrived < barrier->spin_ns) {
+            spin_barrier_relax();
+            if ((spins & 63) == 63) now = spin_barrier_now_ns();
+            continue;
+        }
+        parked = 1;
+        spin_barrier_park(barrier, !sense);
+    }
+    
+    uint64_t waited = spin_barrier_now_ns() - arrived;
+    self->wait_ns += waited;
+    if (waited > self->max_wait_ns) self->max_wait_ns = waited;
+    if (parked) {
+        self->parked++;
+    } else {
+        self->spun++;
+    }
+    return 0;
+}
+
+/**
+ * @brief Free a spinning barrier's participant array
+ * 
+ * @param barrier Barrier no thread is waiting on
+ */
+static inline void spin_barrier_destroy(spin_barrier_t* barrier) {
+    if (!barrier) return;
+    free(barrier->participants);
+    barrier->participants = NULL;
+}
+
 /* Compatibility macros */
 #ifndef HAS_PTHREAD_BARRIER
     #define pthread_barrier_t barrier_t
@@ -0,0 +1,49 @@
+/**
+ * @file builtins.c
+ * @brief Registry of plugins linked into the pipeline binary
+ */
+
+#include "builtins.h"
+#include <string.h>
+
+/* Every plugin built with -DPLUGIN_BUILTIN (see build.sh) */
+#define PIPELINE_BUILTINS(X) \
+    X(upper) \
+    X(lower) \
+    X(reverse) \
+    X(trim) \
+    X(prefix) \
+    X(suffix) \
+    X(validate)
+
+#define BUILTIN_DECLARE(id) extern const plugin_builtin_t plugin_builtin_##id;
+#define BUILTIN_ENTRY(id) &plugin_builtin_##id,
+
+PIPELINE_BUILTINS(BUILTIN_DECLARE)
+
+static const plugin_builtin_t* const builtins[] = {
+    PIPELINE_BUILTINS(BUILTIN_ENTRY)
+};
+
+#define BUILTIN_COUNT (sizeof(builtins) / sizeof(builtins[0]))
+
+/**
+ * Look up a builtin plugin by name
+ */
+const plugin_builtin_t* plugin_builtin_find(const char* name) {
+    if (!name) return NULL;
+
+    for (size_t i = 0; i < BUILTIN_COUNT; i++) {
+        if (strcmp(builtins[i]->name, name) == 0) {
+            return builtins[i];
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Get a builtin plugin by position
+ */
+const plugin_builtin_t* plugin_builtin_at(size_t index) {
+    return index < BUILTIN_COUNT ? builtins[index] : NULL;
+}
@@ -0,0 +1,39 @@
+/**
+ * @file builtins.h
+ * @brief Registry of plugins linked into the pipeline binary
+ *
+ * The stock transform plugins are compiled twice: as shared objects for
+ * dlopen, and with -DPLUGIN_BUILTIN into libpipeline_builtins.a. The second
+ * copy is listed here so a pipeline can name them directly:
+ *
+ *     pipeline upper trim ./build/lib/plugins/validate.so
+ *
+ * Thread Safety: The registry is read-only and safe to use from any thread
+ * Memory Management: Entries are static; nothing to free
+ */
+
+#ifndef BUILTINS_H
+#define BUILTINS_H
+
+#include "plugin_common.h"
+#include <stddef.h>
+
+/**
+ * @brief Look up a builtin plugin by name
+ *
+ * @param name Plugin name, e.g. "upper"
+ * @return Registry entry, or NULL if no builtin has that name
+ */
+const plugin_builtin_t* plugin_builtin_find(const char* name);
+
+/**
+ * @brief Get a builtin plugin by position
+ *
+ * @param index Registry index, starting at 0
+ * @return Registry entry, or NULL once index is past the end
+ *
+ * @note Intended for listing the available builtins
+ */
+const plugin_builtin_t* plugin_builtin_at(size_t index);
+
+#endif /* BUILTINS_H */
@@ -0,0 +1,240 @@
+/**
+ * @file exporter.c
+ * @brief Implementation of the Prometheus scrape endpoint
+ */
+
+#define _GNU_SOURCE
+#include "exporter.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+/* Listening socket for "unix:PATH"; records the path for removal */
+static int listen_unix(metrics_exporter_t* exporter, const char* path) {
+    struct sockaddr_un addr;
+    if (strlen(path) >= sizeof(addr.sun_path) || !*path) {
+        errno = EINVAL;
+        return -1;
+    }
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+
+    /* Replace a stale socket, but never anything else that lives at PATH */
+    struct stat st;
+    if (lstat(path, &st) == 0) {
+        if (!S_ISSOCK(st.st_mode)) {
+            errno = EEXIST;
+            return -1;
+        }
+        unlink(path);
+    }
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) return -1;
+    if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0 || listen(fd, 8) != 0) {
+        int saved = errno;
+        close(fd);
+        errno = saved;
+        return -1;
+    }
+    strcpy(exporter->path, path);
+    return fd;
+}
+
+/* Listening socket for "HOST:PORT" or ":PORT" */
+static int listen_tcp(const char* address) {
+    const char* colon = strrchr(address, ':');
+    if (!colon || !colon[1]) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    char host[256];
+    size_t host_len = (size_t)(colon - address);
+    if (host_len >= sizeof(host)) {
+        errno = EINVAL;
+        return -1;
+    }
+    memcpy(host, address, host_len);
+    host[host_len] = '\0';
+
+    struct addrinfo hints = { 0 };
+    struct addrinfo* res;
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_NUMERICSERV;
+    if (getaddrinfo(host_len ? host : "127.0.0.1", colon + 1, &hints, &res) != 0) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    int fd = -1;
+    for (struct addrinfo* ai = res; ai && fd < 0; ai = ai->ai_next) {
+        fd = socket(ai->ai_family, ai->ai_socktype | SOCK_CLOEXEC, ai->ai_protocol);
+        if (fd < 0) continue;
+        int one = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        if (bind(fd, ai->ai_addr, ai->ai_addrlen) != 0 || listen(fd, 8) != 0) {
+            int saved = errno;
+            close(fd);
+            errno = saved;
+            fd = -1;
+        }
+    }
+    freeaddrinfo(res);
+    return fd;
+}
+
+/* Write all of buf, giving up if the client goes away */
+static void send_all(int fd, const char* buf, size_t len) {
+    while (len > 0) {
+        ssize_t n = send(fd, buf, len, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return;
+        buf += n;
+        len -= (size_t)n;
+    }
+}
+
+/* Read one request and answer it; the body is rendered per request */
+static void serve_client(metrics_exporter_t* exporter, int fd) {
+    struct timeval timeout = { EXPORTER_TIMEOUT_S, 0 };
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+    char request[EXPORTER_REQUEST_MAX + 1];
+    size_t len = 0;
+    while (len < EXPORTER_REQUEST_MAX) {
+        ssize_t n = recv(fd, request + len, EXPORTER_REQUEST_MAX - len, 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        len += (size_t)n;
+        request[len] = '\0';
+        if (strstr(request, "\r\n\r\n") || strstr(request, "\n\n")) break;
+    }
+    request[len] = '\0';
+
+    const char* status = "200 OK";
+    char* body = NULL;
+    size_t body_len = 0;
+    if (strncmp(request, "GET ", 4) != 0) {
+        status = "405 Method Not Allowed";
+    } else {
+        FILE* out = open_memstream(&body, &body_len);
+        if (!out) {
+            status = "500 Internal Server Error";
+        } else {
+            metrics_write_prometheus(out, exporter->stages, exporter->count,
+                                     exporter->end_to_end);
+            fclose(out);
+        }
+    }
+
+    char header[256];
+    int header_len = snprintf(header, sizeof(header),
+                              "HTTP/1.0 %s\r\n"
+                              "Content-Type: text/plain; version=0.0.4; charset=utf-8\r\n"
+                              "Content-Length: %zu\r\n"
+                              "Connection: close\r\n\r\n",
+                              status, body ? body_len : 0);
+    send_all(fd, header, (size_t)header_len);
+    if (body) send_all(fd, body, body_len);
+    free(body);
+}
+
+static void* exporter_thread(void* arg) {
+    metrics_exporter_t* exporter = (metrics_exporter_t*)arg;
+    struct pollfd fds[2] = {
+        { exporter->listen_fd, POLLIN, 0 },
+        { exporter->wake_fd[0], POLLIN, 0 },
+    };
+
+    for (;;) {
+        if (poll(fds, 2, -1) < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        if (fds[1].revents) break;
+        if (fds[0].revents & POLLIN) {
+            int fd = accept4(exporter->listen_fd, NULL, NULL, SOCK_CLOEXEC);
+            if (fd >= 0) {
+                serve_client(exporter, fd);
+                close(fd);
+            }
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Listen on an address and start serving metrics
+ */
+int metrics_exporter_start(metrics_exporter_t* exporter, stage_metrics_t* const* stages,
+                           size_t count, const metrics_histogram_t* end_to_end,
+                           const char* address) {
+    if (!exporter || (!stages && count > 0) || !address) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    memset(exporter, 0, sizeof(metrics_exporter_t));
+    exporter->stages = stages;
+    exporter->count = count;
+    exporter->end_to_end = end_to_end;
+
+    exporter->listen_fd = strncmp(address, "unix:", 5) == 0
+                              ? listen_unix(exporter, address + 5)
+                              : listen_tcp(address);
+    if (exporter->listen_fd < 0) {
+        return -1;
+    }
+
+    if (pipe2(exporter->wake_fd, O_CLOEXEC) != 0) {
+        int saved = errno;
+        close(exporter->listen_fd);
+        if (exporter->path[0]) unlink(exporter->path);
+        errno = saved;
+        return -1;
+    }
+
+    int ret = pthread_create(&exporter->thread, NULL, exporter_thread, exporter);
+    if (ret != 0) {
+        close(exporter->wake_fd[0]);
+        close(exporter->wake_fd[1]);
+        close(exporter->listen_fd);
+        if (exporter->path[0]) unlink(exporter->path);
+        errno = ret;
+        return -1;
+    }
+
+    exporter->started = 1;
+    return 0;
+}
+
+/**
+ * Stop serving and release the socket
+ */
+void metrics_exporter_stop(metrics_exporter_t* exporter) {
+    if (!exporter || !exporter->started) return;
+
+    char wake = 1;
+    while (write(exporter->wake_fd[1], &wake, 1) < 0 && errno == EINTR) {
+    }
+    pthread_join(exporter->thread, NULL);
+
+    close(exporter->wake_fd[0]);
+    close(exporter->wake_fd[1]);
+    close(exporter->listen_fd);
+    if (exporter->path[0]) {
+        unlink(exporter->path);
+    }
+    exporter->started = 0;
+}
@@ -0,0 +1,74 @@
+/**
+ * @file exporter.h
+ * @brief Prometheus scrape endpoint for pipeline metrics
+ *
+ * A background thread serves metrics_write_prometheus output over HTTP on
+ * a Unix socket or a TCP address, so pipeline health can be scraped
+ * without parsing stderr. Features include:
+ * - Addresses "unix:/path/to.sock", "HOST:PORT" or ":PORT" (127.0.0.1)
+ * - Every GET gets the current metrics; one connection at a time, with a
+ *   receive timeout so a stalled client cannot hold the endpoint
+ * - Reads metrics with relaxed atomic loads only: scraping never takes a
+ *   queue lock or blocks a stage
+ *
+ * Example:
+ *   pipeline --metrics-listen=:9464 upper trim
+ *   curl -s http://127.0.0.1:9464/metrics
+ *   curl -s --unix-socket /tmp/pipeline.sock http://localhost/metrics
+ *
+ * Thread Safety: start and stop from one thread; the stage metrics and
+ *                queues must outlive the exporter
+ * Memory Management: metrics_exporter_stop closes the socket and removes
+ *                    a Unix socket path
+ */
+
+#ifndef EXPORTER_H
+#define EXPORTER_H
+
+#include "metrics.h"
+#include <pthread.h>
+#include <sys/un.h>
+
+/* Longest request read before answering */
+#define EXPORTER_REQUEST_MAX 4096
+
+/* Seconds a client may take to send its request */
+#define EXPORTER_TIMEOUT_S 2
+
+/* Exporter state */
+typedef struct metrics_exporter {
+    stage_metrics_t* const* stages;
+    size_t count;
+    const metrics_histogram_t* end_to_end;  /* Or NULL */
+    int listen_fd;
+    int wake_fd[2];                  /* Pipe that wakes the thread to stop */
+    char path[sizeof(((struct sockaddr_un*)0)->sun_path)];  /* Unix socket, or "" */
+    pthread_t thread;
+    int started;
+} metrics_exporter_t;
+
+/**
+ * @brief Listen on an address and start serving metrics
+ *
+ * @param exporter Exporter to initialize
+ * @param stages Stage metrics to serve (array must outlive the exporter)
+ * @param count Number of stages
+ * @param end_to_end Ingest-to-output latency to serve, or NULL
+ * @param address "unix:PATH", "HOST:PORT" or ":PORT"
+ * @return 0 on success, -1 on error (sets errno; EINVAL for a bad address,
+ *         EEXIST if PATH exists and is not a socket)
+ *
+ * @note An existing socket file at PATH is replaced; any other file is left alone
+ */
+int metrics_exporter_start(metrics_exporter_t* exporter, stage_metrics_t* const* stages,
+                           size_t count, const metrics_histogram_t* end_to_end,
+                           const char* address);
+
+/**
+ * @brief Stop serving and release the socket
+ *
+ * @param exporter Exporter (a never-started one is ignored)
+ */
+void metrics_exporter_stop(metrics_exporter_t* exporter);
+
+#endif /* EXPORTER_H */
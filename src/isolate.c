@@ -0,0 +1,822 @@
+/**
+ * @file isolate.c
+ * @brief Implementation of child-process stages
+ */
+
+#include "isolate.h"
+#include "shm_pool.h"
+#include "shm_ring.h"
+#include "trace.h"
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/prctl.h>
+#include <sys/wait.h>
+
+/* How often blocked threads look up to check for a dead peer */
+#define ISOLATE_POLL_MS 50
+
+/* Request kinds */
+#define REQUEST_RECORD 0  /* Record bytes follow the request header */
+#define REQUEST_MARKER 1  /* Marker of kind "value"; its 8-byte value follows */
+#define REQUEST_SHARED 2  /* An isolation_ref_t follows; "value" is the record length */
+
+/* Response kinds */
+#define RESPONSE_DATA   1 /* Result bytes follow the response header */
+#define RESPONSE_REF    2 /* Result is the first "value" bytes of the request record */
+#define RESPONSE_DROP   3 /* No output for this request */
+#define RESPONSE_EMIT   4 /* Record from plugin_control; the request stays pending */
+#define RESPONSE_MARKER 5 /* The marker request is done; forward it */
+#define RESPONSE_ARENA  6 /* Result of "value" bytes appended to the output arena */
+
+/* isolation_ref_t.arena of a batch whose results are compacted in place */
+#define ISOLATE_NO_ARENA UINT64_MAX
+
+/*
+ * Descriptor of one record of a pooled batch. The child sees only the
+ * offsets; the batch pointers are for the host side.
+ */
+typedef struct isolation_ref {
+    uint64_t offset;               /* Record bytes in the pool */
+    uint64_t arena;                /* Output arena in the pool, or ISOLATE_NO_ARENA */
+    uint64_t arena_capacity;       /* Bytes of the output arena */
+    uint64_t batch_seq;            /* Batch the record belongs to, from 1 */
+    record_batch_t* in;            /* That batch */
+    record_batch_t* out;           /* Batch its results go to (in when in place) */
+    uint32_t last;                 /* Last record of the batch */
+    uint32_t padding;
+} isolation_ref_t;
+
+/* State the child writes and the host reads after a crash, and back */
+typedef struct isolation_shared {
+    _Atomic uint32_t busy;         /* Child is inside the transform call */
+    _Atomic uint32_t current_seq;  /* Request being transformed */
+    uint64_t resume_batch;         /* Batch whose arena a new child carries on */
+    uint64_t resume_fill;          /* Bytes of that arena already delivered */
+} isolation_shared_t;
+
+/* The pooled batch the reader is rebuilding from results */
+typedef struct isolation_output {
+    uint64_t batch_seq;            /* 0 when no batch is in progress */
+    record_batch_t* in;
+    record_batch_t* out;           /* in while results are compacted in place */
+    uint64_t arena_capacity;       /* Of out's arena as the child knows it */
+    int in_place;                  /* Results stay in in's arena */
+    int arena_full;                /* The child writes no more to out's arena */
+} isolation_output_t;
+
+struct stage_isolation {
+    shm_ring_t* requests;          /* Host -> child */
+    shm_ring_t* responses;         /* Child -> host */
+    isolation_shared_t* shared;    /* Shared mapping */
+    pid_t child;                   /* Current child, 0 if none */
+    pid_t host;                    /* Host pid, checked by the child */
+    pthread_t writer;
+    pthread_t reader;
+    _Atomic int failed;            /* Reader gave up; writer stops sending */
+    unsigned restarts;
+    uint64_t batch_seq;            /* Last pooled batch sent (writer) */
+    isolation_output_t output;     /* Reader; leftovers are freed by isolation_join */
+};
+
+/**
+ * Allocate the shared state for an isolated stage
+ */
+stage_isolation_t* isolation_create(size_t ring_bytes) {
+    if (ring_bytes == 0) ring_bytes = ISOLATE_RING_BYTES;
+
+    stage_isolation_t* iso = calloc(1, sizeof(stage_isolation_t));
+    if (!iso) {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    iso->requests = shm_ring_create(ring_bytes);
+    iso->responses = shm_ring_create(ring_bytes);
+    void* shared = mmap(NULL, sizeof(isolation_shared_t), PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    iso->shared = shared == MAP_FAILED ? NULL : shared;
+
+    if (!iso->requests || !iso->responses || !iso->shared) {
+        int saved = errno;
+        isolation_destroy(iso);
+        errno = saved;
+        return NULL;
+    }
+    return iso;
+}
+
+/**
+ * Release the shared state
+ */
+void isolation_destroy(stage_isolation_t* iso) {
+    if (!iso) return;
+
+    shm_ring_destroy(iso->requests);
+    shm_ring_destroy(iso->responses);
+    if (iso->shared) {
+        munmap(iso->shared, sizeof(isolation_shared_t));
+    }
+    free(iso);
+}
+
+/*
+ * Run plugin_control in the child and publish each record it emits as a
+ * RESPONSE_EMIT for the request being handled (seq).
+ */
+static void isolation_child_control(stage_t* stage, const queue_marker_t* marker,
+                                    uint32_t seq, record_batch_t** out) {
+    shm_ring_t* resp = stage->iso->responses;
+    if (!stage->control) return;
+
+    if (!*out && !(*out = record_batch_create(STAGE_BATCH_MAX, 4096))) {
+        fprintf(stderr, "%s: out of memory, %s marker output dropped\n",
+                stage->name, queue_marker_name(marker->kind));
+        return;
+    }
+    record_batch_reset(*out);
+    int rc = stage->control(stage->ctx, marker, *out);
+    if (rc < 0) {
+        fprintf(stderr, "%s: %s marker failed (%d), %zu records dropped\n",
+                stage->name, queue_marker_name(marker->kind), rc, (*out)->count);
+        return;
+    }
+
+    for (size_t i = 0; i < (*out)->count; i++) {
+        size_t len;
+        const char* str = record_batch_get(*out, i, &len);
+        if (len > shm_ring_max_record(resp)) {
+            fprintf(stderr, "%s: %zu-byte result exceeds the response ring, record dropped\n",
+                    stage->name, len);
+            continue;
+        }
+        shm_record_t* r = shm_ring_reserve(resp, len, -1);
+        r->seq = seq;
+        r->kind = RESPONSE_EMIT;
+        r->value = 0;
+        memcpy(shm_record_data(r), str, len);
+        shm_record_data(r)[len] = '\0';
+        shm_ring_publish(resp);
+    }
+}
+
+/*
+ * Child main loop: transform requests in place, in the request ring or in
+ * the pool, and publish one response per request, in order. Results of
+ * pooled records go straight into their batch's output arena while it has
+ * room. Marker requests may be preceded by records from plugin_control.
+ * Never returns.
+ */
+static void isolation_child(stage_t* stage) {
+    stage_isolation_t* iso = stage->iso;
+    shm_ring_t* req = iso->requests;
+    shm_ring_t* resp = iso->responses;
+    plugin_buf_t scratch = { NULL, 0, 0 };
+    record_batch_t* control_out = NULL;
+    uint64_t arena_batch = iso->shared->resume_batch;
+    uint64_t arena_fill = iso->shared->resume_fill;
+
+    /* Do not outlive the host */
+    prctl(PR_SET_PDEATHSIG, SIGKILL);
+    if (getppid() != iso->host) {
+        _exit(1);
+    }
+
+    uint64_t pos = atomic_load(&req->read);
+    for (;;) {
+        if (!shm_ring_wait_data(req, pos, ISOLATE_POLL_MS)) {
+            if (atomic_load(&req->closed) && atomic_load(&req->head) <= pos) {
+                break;
+            }
+            continue;
+        }
+
+        uint64_t next;
+        shm_record_t* rec = shm_ring_at(req, pos, &next);
+        char* in = shm_record_data(rec);
+        size_t len = rec->len;
+        isolation_ref_t ref = { 0 };
+        if (rec->kind == REQUEST_SHARED) {
+            memcpy(&ref, in, sizeof(ref));
+            in = shm_pool_at(stage->pool, ref.offset);
+            len = rec->value;
+        }
+        plugin_buf_t in_place = { in, len, len + 1 };
+        plugin_buf_t* out = (stage->flags & PLUGIN_CAP_IN_PLACE) ? &in_place : &scratch;
+
+        atomic_store(&iso->shared->current_seq, rec->seq);
+        atomic_store(&iso->shared->busy, 1);
+
+        if (rec->kind == REQUEST_MARKER) {
+            queue_marker_t marker = { rec->value, 0 };
+            memcpy(&marker.value, in, sizeof(marker.value));
+            isolation_child_control(stage, &marker, rec->seq, &control_out);
+
+            shm_record_t* r = shm_ring_reserve(resp, 0, -1);
+            r->seq = rec->seq;
+            r->kind = RESPONSE_MARKER;
+            r->value = 0;
+            shm_record_data(r)[0] = '\0';
+            shm_ring_publish(resp);
+
+            atomic_store(&iso->shared->busy, 0);
+            pos = next;
+            atomic_store(&req->read, pos);
+            continue;
+        }
+
+        out->len = 0;
+        int rc = stage->transform(stage->ctx, in, len, out);
+
+        const char* result = NULL;
+        size_t result_len = 0;
+        if (rc == PLUGIN_PASS) {
+            result = in;
+            result_len = len;
+        } else if (rc == PLUGIN_EMIT) {
+            result = out->data;
+            result_len = out->len;
+        } else if (rc != PLUGIN_DROP) {
+            fprintf(stderr, "%s: transform failed (%d), record dropped\n", stage->name, rc);
+        }
+
+        uint32_t kind = RESPONSE_DROP;
+        if (result && rec->kind == REQUEST_SHARED && ref.arena != ISOLATE_NO_ARENA) {
+            if (ref.batch_seq != arena_batch) {
+                arena_batch = ref.batch_seq;
+                arena_fill = 0;
+            }
+            /* Once a result misses the arena, the rest of the batch does too */
+            if (arena_fill + result_len + 1 <= ref.arena_capacity) {
+                char* dst = shm_pool_at(stage->pool, ref.arena + arena_fill);
+                memcpy(dst, result, result_len);
+                dst[result_len] = '\0';
+                arena_fill += result_len + 1;
+                kind = RESPONSE_ARENA;
+            } else {
+                arena_fill = ref.arena_capacity;
+            }
+        }
+        if (result && kind == RESPONSE_DROP) {
+            kind = result == in ? RESPONSE_REF : RESPONSE_DATA;
+        }
+        if (kind == RESPONSE_DATA && result_len > shm_ring_max_record(resp)) {
+            fprintf(stderr, "%s: %zu-byte result exceeds the response ring, record dropped\n",
+                    stage->name, result_len);
+            kind = RESPONSE_DROP;
+        }
+
+        shm_record_t* r = shm_ring_reserve(resp, kind == RESPONSE_DATA ? result_len : 0, -1);
+        r->seq = rec->seq;
+        r->kind = kind;
+        r->value = (uint32_t)result_len;
+        if (kind == RESPONSE_DATA) {
+            memcpy(shm_record_data(r), result, result_len);
+        }
+        shm_record_data(r)[kind == RESPONSE_DATA ? result_len : 0] = '\0';
+        shm_ring_publish(resp);
+
+        atomic_store(&iso->shared->busy, 0);
+        pos = next;
+        atomic_store(&req->read, pos);
+    }
+
+    /* End of stream: the host delivers these before it sees the exit */
+    queue_marker_t end = { QUEUE_MARKER_END, 0 };
+    isolation_child_control(stage, &end, 0, &control_out);
+
+    record_batch_free(control_out);
+    free(scratch.data);
+    _exit(0);
+}
+
+static pid_t isolation_spawn(stage_t* stage) {
+    pid_t pid = fork();
+    if (pid == 0) {
+        isolation_child(stage);
+    }
+    return pid;
+}
+
+/*
+ * Copy one request (kind and value, see REQUEST_*) and its payload into
+ * the request ring, waiting for space. "bytes" is the record length the
+ * request stands for. Returns -1 if the stage is stopping or the reader
+ * gave up.
+ */
+static int isolation_send(stage_t* stage, uint32_t kind, uint32_t value,
+                          const void* payload, size_t len, size_t bytes, uint32_t seq) {
+    stage_isolation_t* iso = stage->iso;
+
+    if (len > shm_ring_max_record(iso->requests)) {
+        fprintf(stderr, "%s: %zu-byte record exceeds the request ring, record dropped\n",
+                stage->name, len);
+        return 0;
+    }
+
+    shm_record_t* rec;
+    while (!(rec = shm_ring_reserve(iso->requests, len, ISOLATE_POLL_MS))) {
+        if (atomic_load(&iso->failed) || stage->stop_requested) {
+            return -1;
+        }
+    }
+
+    rec->seq = seq;
+    rec->kind = kind;
+    rec->value = value;
+    memcpy(shm_record_data(rec), payload, len);
+    shm_record_data(rec)[len] = '\0';
+    shm_ring_publish(iso->requests);
+
+    if (stage->metrics && kind != REQUEST_MARKER) {
+        metrics_add(&stage->metrics->records_in, 1);
+        metrics_add(&stage->metrics->bytes_in, bytes);
+    }
+    return 0;
+}
+
+/*
+ * Send a batch whose arena is in the stage's pool as one descriptor per
+ * record; the child reads and rewrites the records where they are. An
+ * in-place plugin's results are compacted into the same arena, anything
+ * else is written by the child into an output arena allocated here. The
+ * reader takes over both batches once the first descriptor is sent.
+ * Returns 1 if the batch must be sent by copy instead (no output arena in
+ * the pool), -1 if sending stopped, else 0.
+ */
+static int isolation_send_shared(stage_t* stage, record_batch_t* batch, uint32_t* seq) {
+    stage_isolation_t* iso = stage->iso;
+    record_batch_t* out = batch;
+    isolation_ref_t ref = { 0 };
+    ref.arena = ISOLATE_NO_ARENA;
+
+    if (!(stage->flags & PLUGIN_CAP_IN_PLACE)) {
+        /* Room for results somewhat longer than their records */
+        size_t bytes = batch->size * 2;
+        out = record_batch_create_in(stage->pool, batch->count,
+                                     bytes < SHM_POOL_MAX_BLOCK ? bytes : SHM_POOL_MAX_BLOCK);
+        if (!out || out->pool != stage->pool) {
+            record_batch_free(out);
+            return 1;
+        }
+        ref.arena = shm_pool_offset(stage->pool, out->data);
+        ref.arena_capacity = out->capacity;
+    }
+
+    ref.batch_seq = ++iso->batch_seq;
+    ref.in = batch;
+    ref.out = out;
+    /* The reader compacts records up to i + 1 while this reads ahead of it,
+     * so the count and each record end are read before the record is sent */
+    size_t count = batch->count;
+    size_t start = 0;
+    for (size_t i = 0; i < count; i++) {
+        size_t end = batch->offsets[i + 1];
+        size_t len = end - start - 1;
+        ref.offset = shm_pool_offset(stage->pool, batch->data + start);
+        ref.last = i + 1 == count;
+        start = end;
+        if (isolation_send(stage, REQUEST_SHARED, (uint32_t)len, &ref, sizeof(ref),
+                           len, (*seq)++) != 0) {
+            if (i == 0) {
+                if (out != batch) record_batch_free(out);
+                record_batch_free(batch);
+            }
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/* Name a host-side thread of the stage in traces */
+static void isolation_trace_name(stage_t* stage, const char* role) {
+    char name[TRACE_NAME_MAX];
+    snprintf(name, sizeof(name), "%s %s", stage->name, role);
+    trace_thread_name(name);
+}
+
+/*
+ * Writer thread: input queue -> request ring.
+ */
+static void* isolation_writer(void* arg) {
+    stage_t* stage = (stage_t*)arg;
+    stage_isolation_t* iso = stage->iso;
+    uint32_t seq = 0;
+    queue_item_t item;
+    char* record = NULL;
+    size_t record_cap = 0;
+    int ok = 1;
+
+    isolation_trace_name(stage, "writer");
+    while (ok && !stage->stop_requested) {
+        int ret = queue_pop_into(stage->input, &item, &record, &record_cap);
+        if (ret == QUEUE_SHUTDOWN) {
+            break;
+        }
+        if (ret != 0) {
+            continue;
+        }
+
+        if (item.marker.kind) {
+            ok = isolation_send(stage, REQUEST_MARKER, item.marker.kind,
+                                &item.marker.value, sizeof(item.marker.value), 0,
+                                seq++) == 0;
+            continue;
+        }
+        if (item.batch && item.batch->count > 0 && stage->pool &&
+            item.batch->pool == stage->pool) {
+            int ret = isolation_send_shared(stage, item.batch, &seq);
+            ok = ret >= 0;
+            if (ret <= 0) {
+                continue;
+            }
+        }
+        /* Anything outside the pool is copied into the ring */
+        if (item.batch) {
+            for (size_t i = 0; ok && i < item.batch->count; i++) {
+                size_t len;
+                const char* str = record_batch_get(item.batch, i, &len);
+                ok = isolation_send(stage, REQUEST_RECORD, 0, str, len, len, seq++) == 0;
+            }
+            record_batch_free(item.batch);
+        } else {
+            size_t len = strlen(item.str);
+            ok = isolation_send(stage, REQUEST_RECORD, 0, item.str, len, len, seq++) == 0;
+        }
+    }
+    free(record);
+
+    shm_ring_close(iso->requests);
+    return NULL;
+}
+
+/*
+ * Push the pending output batch. Returns -1 once downstream has shut down.
+ */
+static int isolation_flush(stage_t* stage, record_batch_t** batch) {
+    if ((*batch)->count == 0) {
+        return 0;
+    }
+    int ret = queue_push_batch(stage->output, *batch);
+    *batch = record_batch_create_in(stage->pool, STAGE_BATCH_MAX, 4096);
+    return (ret != 0 || !*batch) ? -1 : 0;
+}
+
+/*
+ * Hand the rebuilt pooled batch downstream, after the pending output
+ * batch so order is kept, and release the input batch it came from.
+ * Returns -1 once downstream has shut down.
+ */
+static int isolation_output_finish(stage_t* stage, record_batch_t** batch) {
+    isolation_output_t* o = &stage->iso->output;
+    record_batch_t* out = o->out;
+
+    if (out != o->in) {
+        out->ingest_ns = o->in->ingest_ns;
+        out->queued_ns = o->in->queued_ns;
+        record_batch_free(o->in);
+    }
+    memset(o, 0, sizeof(*o));
+    if (out->count == 0) {
+        record_batch_free(out);
+        return 0;
+    }
+    if (isolation_flush(stage, batch) != 0) {
+        record_batch_free(out);
+        return -1;
+    }
+    return queue_push_batch(stage->output, out) != 0 ? -1 : 0;
+}
+
+/*
+ * Add one result of a pooled batch to the batch being rebuilt: an arena
+ * result is already in place, an in-place result is moved down over the
+ * gaps left by shorter or dropped records, and anything else is copied in.
+ * Returns -1 if the record could not be kept.
+ */
+static int isolation_output_add(stage_t* stage, const isolation_ref_t* ref, uint32_t kind,
+                                const char* data, size_t len) {
+    isolation_output_t* o = &stage->iso->output;
+    const char* slot = shm_pool_at(stage->pool, ref->offset);
+
+    if (kind == RESPONSE_ARENA) {
+        if (o->in_place || o->arena_full || o->out->size + len + 1 > o->arena_capacity) {
+            errno = EPROTO;
+            return -1;
+        }
+        return record_batch_commit(o->out, len);
+    }
+    if (o->in_place && kind == RESPONSE_REF) {
+        char* dst = o->out->data + o->out->size;
+        if (dst != slot) {
+            memmove(dst, slot, len);
+        }
+        dst[len] = '\0';
+        return record_batch_commit(o->out, len);
+    }
+
+    if (o->in_place) {
+        /* New bytes: continue in a separate batch from the records kept */
+        record_batch_t* out = record_batch_create_in(stage->pool, o->in->max_count,
+                                                     o->in->capacity);
+        if (!out || record_batch_copy(out, o->in) != 0) {
+            record_batch_free(out);
+            return -1;
+        }
+        o->out = out;
+        o->in_place = 0;
+    }
+    o->arena_full = 1;
+    return record_batch_append(o->out, kind == RESPONSE_REF ? slot : data, len);
+}
+
+/*
+ * Deliver the result of one pooled record. Returns -1 once downstream
+ * has shut down.
+ */
+static int isolation_shared_result(stage_t* stage, record_batch_t** batch,
+                                   shm_record_t* q, uint32_t kind, const char* data, size_t len) {
+    isolation_output_t* o = &stage->iso->output;
+    isolation_ref_t ref;
+    memcpy(&ref, shm_record_data(q), sizeof(ref));
+
+    if (ref.batch_seq != o->batch_seq) {
+        o->batch_seq = ref.batch_seq;
+        o->in = ref.in;
+        o->out = ref.out;
+        o->in_place = ref.out == ref.in;
+        o->arena_full = 0;
+        o->arena_capacity = ref.arena_capacity;
+        /* Results are rebuilt from the start of the arena */
+        record_batch_reset(o->out);
+    }
+
+    if (kind != RESPONSE_DROP) {
+        if (isolation_output_add(stage, &ref, kind, data, len) != 0) {
+            fprintf(stderr, "%s: cannot keep result (%s), record dropped\n",
+                    stage->name, strerror(errno));
+        } else if (stage->metrics) {
+            metrics_add(&stage->metrics->records_out, 1);
+            metrics_add(&stage->metrics->bytes_out, len);
+        }
+    }
+    return ref.last ? isolation_output_finish(stage, batch) : 0;
+}
+
+/*
+ * Deliver the response at *rpos and release it together with the request
+ * it answers. Results of copied records go into the output batch (a REF
+ * response is copied from the request record), those of pooled records
+ * into the batch they are rebuilt in. Records from plugin_control leave
+ * the request pending; a marker is forwarded behind the batch. Returns -1
+ * once downstream has shut down.
+ */
+static int isolation_deliver(stage_t* stage, record_batch_t** batch,
+                             uint64_t* rpos, uint64_t* tpos) {
+    stage_isolation_t* iso = stage->iso;
+    uint64_t rnext, tnext;
+    shm_record_t* r = shm_ring_at(iso->responses, *rpos, &rnext);
+
+    if (r->kind == RESPONSE_EMIT) {
+        if (record_batch_append(*batch, shm_record_data(r), r->len) != 0) {
+            fprintf(stderr, "%s: out of memory, record dropped\n", stage->name);
+        } else if (stage->metrics) {
+            metrics_add(&stage->metrics->records_out, 1);
+            metrics_add(&stage->metrics->bytes_out, r->len);
+        }
+        shm_ring_release(iso->responses, rnext);
+        *rpos = rnext;
+        return 0;
+    }
+
+    shm_record_t* q = shm_ring_at(iso->requests, *tpos, &tnext);
+    int ret = 0;
+    if (r->kind == RESPONSE_MARKER) {
+        queue_marker_t marker = { q->value, 0 };
+        memcpy(&marker.value, shm_record_data(q), sizeof(marker.value));
+        shm_ring_release(iso->responses, rnext);
+        shm_ring_release(iso->requests, tnext);
+        *rpos = rnext;
+        *tpos = tnext;
+        if (isolation_flush(stage, batch) != 0 ||
+            queue_push_marker(stage->output, &marker) != 0) {
+            return -1;
+        }
+        return 0;
+    }
+
+    size_t len = r->kind == RESPONSE_DATA ? r->len : r->value;
+    if (q->kind == REQUEST_SHARED) {
+        ret = isolation_shared_result(stage, batch, q, r->kind, shm_record_data(r), len);
+    } else {
+        int appended = 0;
+        if (r->kind == RESPONSE_DATA) {
+            appended = record_batch_append(*batch, shm_record_data(r), len);
+        } else if (r->kind == RESPONSE_REF) {
+            appended = record_batch_append(*batch, shm_record_data(q), len);
+        }
+        if (appended != 0) {
+            fprintf(stderr, "%s: out of memory, record dropped\n", stage->name);
+        } else if (stage->metrics && r->kind != RESPONSE_DROP) {
+            metrics_add(&stage->metrics->records_out, 1);
+            metrics_add(&stage->metrics->bytes_out, len);
+        }
+    }
+
+    shm_ring_release(iso->responses, rnext);
+    shm_ring_release(iso->requests, tnext);
+    *rpos = rnext;
+    *tpos = tnext;
+    return ret;
+}
+
+/*
+ * The child is gone without finishing. Drop the request it died on, if
+ * any, and fork a replacement that resumes after it.
+ */
+static int isolation_recover(stage_t* stage, record_batch_t** batch, int status,
+                             uint64_t* tpos) {
+    stage_isolation_t* iso = stage->iso;
+    shm_ring_t* req = iso->requests;
+
+    char cause[64];
+    if (WIFSIGNALED(status)) {
+        snprintf(cause, sizeof(cause), "%s", strsignal(WTERMSIG(status)));
+    } else {
+        snprintf(cause, sizeof(cause), "exit status %d", WEXITSTATUS(status));
+    }
+
+    if (atomic_load(&iso->shared->busy) && atomic_load(&req->head) > *tpos) {
+        uint64_t next;
+        shm_record_t* rec = shm_ring_at(req, *tpos, &next);
+        if (rec->seq == atomic_load(&iso->shared->current_seq)) {
+            fprintf(stderr, "%s: plugin process died (%s) on record %u, record dropped\n",
+                    stage->name, cause, rec->seq);
+            int ret = rec->kind == REQUEST_SHARED ?
+                isolation_shared_result(stage, batch, rec, RESPONSE_DROP, NULL, 0) : 0;
+            shm_ring_release(req, next);
+            *tpos = next;
+            if (ret != 0) {
+                return -1;
+            }
+        }
+    } else {
+        fprintf(stderr, "%s: plugin process died (%s)\n", stage->name, cause);
+    }
+
+    if (++iso->restarts > ISOLATE_MAX_RESTARTS) {
+        fprintf(stderr, "%s: plugin process restarted %d times, giving up\n",
+                stage->name, ISOLATE_MAX_RESTARTS);
+        return -1;
+    }
+
+    /* The new child carries on filling the arena of a half-done batch */
+    isolation_output_t* o = &iso->output;
+    iso->shared->resume_batch = o->in_place ? 0 : o->batch_seq;
+    iso->shared->resume_fill = o->arena_full ? o->arena_capacity : o->out ? o->out->size : 0;
+    atomic_store(&iso->shared->busy, 0);
+    atomic_store(&req->read, *tpos);
+    iso->child = isolation_spawn(stage);
+    return iso->child > 0 ? 0 : -1;
+}
+
+/*
+ * Reader thread: owns the child. Forwards responses in request order,
+ * releasing each request once its response is delivered, and restarts
+ * the child when it dies.
+ */
+static void* isolation_reader(void* arg) {
+    stage_t* stage = (stage_t*)arg;
+    stage_isolation_t* iso = stage->iso;
+    shm_ring_t* req = iso->requests;
+    shm_ring_t* resp = iso->responses;
+    uint64_t rpos = atomic_load(&resp->tail);
+    uint64_t tpos = atomic_load(&req->tail);
+    int downstream_open = 1;
+
+    isolation_trace_name(stage, "reader");
+    record_batch_t* batch = record_batch_create_in(stage->pool, STAGE_BATCH_MAX, 4096);
+    iso->child = batch ? isolation_spawn(stage) : -1;
+    if (iso->child <= 0) {
+        fprintf(stderr, "%s: cannot start plugin process\n", stage->name);
+        iso->child = 0;
+        atomic_store(&iso->failed, 1);
+    }
+
+    while (iso->child > 0) {
+        int wait_ms = batch->count > 0 ? 0 : ISOLATE_POLL_MS;
+        if (shm_ring_wait_data(resp, rpos, wait_ms)) {
+            if (isolation_deliver(stage, &batch, &rpos, &tpos) != 0 ||
+                (batch->count >= STAGE_BATCH_MAX && isolation_flush(stage, &batch) != 0)) {
+                downstream_open = 0;
+                break;
+            }
+            continue;
+        }
+
+        if (isolation_flush(stage, &batch) != 0) {
+            downstream_open = 0;
+            break;
+        }
+
+        int status;
+        if (waitpid(iso->child, &status, WNOHANG) != iso->child) {
+            continue;
+        }
+
+        /* Responses published just before exit are still delivered */
+        int delivered = 0;
+        while (delivered == 0 && shm_ring_wait_data(resp, rpos, 0)) {
+            delivered = isolation_deliver(stage, &batch, &rpos, &tpos);
+        }
+        if (delivered != 0 || isolation_flush(stage, &batch) != 0) {
+            iso->child = 0;
+            downstream_open = 0;
+            break;
+        }
+
+        int finished = WIFEXITED(status) && WEXITSTATUS(status) == 0 &&
+                       atomic_load(&req->closed) && atomic_load(&req->head) == tpos;
+        iso->child = 0;
+        if (finished) {
+            break;
+        }
+        if (isolation_recover(stage, &batch, status, &tpos) != 0) {
+            iso->child = 0;
+            atomic_store(&iso->failed, 1);
+        }
+    }
+
+    /* Downstream is gone; nobody wants the rest */
+    if (!downstream_open) {
+        atomic_store(&iso->failed, 1);
+        if (iso->child > 0) {
+            kill(iso->child, SIGKILL);
+            waitpid(iso->child, NULL, 0);
+            iso->child = 0;
+        }
+    }
+
+    record_batch_free(batch);
+
+    /* Propagate shutdown to output queue */
+    queue_shutdown(stage->output);
+    return NULL;
+}
+
+/**
+ * Start the writer and reader threads
+ */
+int isolation_start(stage_t* stage) {
+    stage_isolation_t* iso = stage->iso;
+    iso->host = getpid();
+
+    int ret = pthread_create(&iso->reader, NULL, isolation_reader, stage);
+    if (ret != 0) {
+        errno = ret;
+        return -1;
+    }
+
+    ret = pthread_create(&iso->writer, NULL, isolation_writer, stage);
+    if (ret != 0) {
+        shm_ring_close(iso->requests);
+        pthread_join(iso->reader, NULL);
+        errno = ret;
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * Wait for both threads and the child to finish
+ */
+void isolation_join(stage_t* stage) {
+    stage_isolation_t* iso = stage->iso;
+
+    pthread_join(iso->writer, NULL);
+    pthread_join(iso->reader, NULL);
+
+    /* Pooled batches still in flight when the stage stopped early */
+    isolation_output_t* o = &iso->output;
+    uint64_t freed = o->batch_seq;
+    if (o->batch_seq) {
+        if (o->out != o->in) record_batch_free(o->out);
+        record_batch_free(o->in);
+    }
+    shm_ring_t* req = iso->requests;
+    for (uint64_t pos = atomic_load(&req->tail); pos < atomic_load(&req->head); ) {
+        shm_record_t* rec = shm_ring_at(req, pos, &pos);
+        isolation_ref_t ref;
+        if (rec->kind != REQUEST_SHARED) continue;
+        memcpy(&ref, shm_record_data(rec), sizeof(ref));
+        if (ref.batch_seq == freed) continue;
+        if (ref.out != ref.in) record_batch_free(ref.out);
+        record_batch_free(ref.in);
+        freed = ref.batch_seq;
+    }
+    memset(o, 0, sizeof(*o));
+}
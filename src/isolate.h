@@ -0,0 +1,99 @@
+/**
+ * @file isolate.h
+ * @brief Running a stage's plugin in a child process
+ *
+ * An isolated stage keeps its queues in the host but calls the plugin from
+ * a forked child, so a crashing plugin takes down only the child. The two
+ * sides are connected by shared-memory rings (shm_ring.h):
+ *
+ *   input queue -> [writer thread] -> request ring -> child: transform
+ *   output queue <- [reader thread] <- response ring <-'
+ *
+ * Records are not copied across: when the pipeline has isolated stages,
+ * every batch arena is allocated from one shared pool (shm_pool.h) mapped
+ * before the children are forked, and the request ring carries only an
+ * (offset, length) descriptor per record. The child transforms the record
+ * where it lies in the pool, then:
+ * - An in-place plugin (PLUGIN_CAP_IN_PLACE) leaves its result there. The
+ *   reader moves results down over the gaps left by shorter or dropped
+ *   records and forwards the input batch itself; when every record keeps
+ *   its length, as with length-preserving plugins, nothing is copied.
+ * - Any other plugin's result is written by the child into an output
+ *   arena the writer allocated from the pool for that batch, and the
+ *   reader forwards that arena as the output batch. That one write is the
+ *   copy the same plugin makes in-process when its result is appended to
+ *   the stage's output batch.
+ *
+ * Copies through the rings remain only as fallbacks: for string items and
+ * batches whose arena is not in the pool (it outgrew the largest block,
+ * or the pool was used up), results that overflow their output arena
+ * (about twice the input size), and records emitted by plugin_control.
+ *
+ * When the child dies, every response it published is still delivered.
+ * The record it was working on is logged and dropped, and a new child is
+ * forked to carry on from the next record, at most ISOLATE_MAX_RESTARTS
+ * times per stage.
+ *
+ * Markers (queue.h) cross the rings as requests of their own. The child
+ * runs plugin_control on them and on the end of the stream; the records it
+ * emits come back ahead of the marker's response, and the reader forwards
+ * the marker once they are pushed. A child restart loses plugin state, as
+ * it does for any stateful plugin.
+ *
+ * Stage metrics count records and bytes on the host side. Service time is
+ * spent in the child and is not sampled. Pooled batches keep their latency
+ * timestamps; records copied through the rings leave without them.
+ *
+ * Thread Safety: Driven by stage.c; not called directly
+ * Memory Management: isolation_destroy unmaps the rings; the pool belongs
+ *                    to the pipeline (stage_t.pool)
+ */
+
+#ifndef ISOLATE_H
+#define ISOLATE_H
+
+#include "stage.h"
+
+/* Default size of each of the two rings */
+#define ISOLATE_RING_BYTES (1024 * 1024)
+
+/* Shared batch pool a pipeline with isolated stages maps (address space;
+ * pages are committed as they are used) */
+#define ISOLATE_POOL_BYTES (256 * 1024 * 1024)
+
+/* Child restarts allowed before the stage gives up */
+#define ISOLATE_MAX_RESTARTS 16
+
+/**
+ * @brief Allocate the shared state for an isolated stage
+ *
+ * @param ring_bytes Size of each ring (0 selects ISOLATE_RING_BYTES)
+ * @return Isolation state on success, NULL on error (sets errno)
+ */
+stage_isolation_t* isolation_create(size_t ring_bytes);
+
+/**
+ * @brief Release the shared state
+ *
+ * @param iso Isolation state (NULL is ignored)
+ *
+ * @note Only after isolation_join
+ */
+void isolation_destroy(stage_isolation_t* iso);
+
+/**
+ * @brief Start the writer and reader threads; the reader forks the child
+ *
+ * @param stage Initialized stage with stage->iso set
+ * @return 0 on success, -1 on error (sets errno)
+ */
+int isolation_start(stage_t* stage);
+
+/**
+ * @brief Wait for both threads and the child to finish
+ *
+ * @param stage Started stage
+ */
+void isolation_join(stage_t* stage);
+
+#endif /* ISOLATE_H */
@@ -5,106 +5,475 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <dlfcn.h>
 #include <pthread.h>
 #include <unistd.h>
-#include "queue.h"
-#include "plugin_common.h"
+#include <errno.h>
+#include <limits.h>
+#include "pipeline.h"
+#include "builtins.h"
+#include "exporter.h"
+#include "plugin_config.h"
+#include "trace.h"
 
-#define MAX_LINE_LENGTH 1024
+#define INPUT_CHUNK_SIZE (64 * 1024)
 #define QUEUE_CAPACITY 100
 
+/* State for the stdin and stdout threads */
 typedef struct {
-    void* handle;
-    plugin_interface_t interface;
-    plugin_ctx_t* context;
-} plugin_t;
+    queue_t* queue;
+    stage_metrics_t* metrics;           /* Output row (--metrics), or NULL */
+    metrics_histogram_t* end_to_end;    /* Set when batches are stamped */
+    shm_pool_t* pool;                   /* Arena pool for input batches, or NULL */
+} io_thread_t;
 
+/*
+ * Push the pending input batch downstream and start a new one.
+ * Returns -1 once the queue has shut down.
+ */
+static int flush_input_batch(io_thread_t* io, record_batch_t** batch) {
+    if ((*batch)->count == 0) {
+        return 0;
+    }
+    int ret = queue_push_batch(io->queue, *batch);
+    *batch = record_batch_create_in(io->pool, STAGE_BATCH_MAX, INPUT_CHUNK_SIZE);
+    return (ret != 0 || !*batch) ? -1 : 0;
+}
+
+/*
+ * Recognize a control line: <FLUSH>, <EPOCH n> or <WATERMARK n>, with n a
+ * decimal number. Returns 1 and fills marker if the line is one.
+ */
+static int parse_marker(const char* line, size_t len, queue_marker_t* marker) {
+    static const struct {
+        const char* name;
+        uint32_t kind;
+    } names[] = {
+        { "FLUSH", QUEUE_MARKER_FLUSH },
+        { "EPOCH ", QUEUE_MARKER_EPOCH },
+        { "WATERMARK ", QUEUE_MARKER_WATERMARK },
+    };
+    char inner[32];
+    if (len < 3 || len - 2 >= sizeof(inner) || line[0] != '<' || line[len - 1] != '>') {
+        return 0;
+    }
+    memcpy(inner, line + 1, len - 2);
+    inner[len - 2] = '\0';
+    
+    for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+        size_t name_len = strlen(names[i].name);
+        if (strncmp(inner, names[i].name, name_len) != 0) continue;
+        const char* arg = inner + name_len;
+        char* end;
+        marker->kind = names[i].kind;
+        marker->value = 0;
+        if (marker->kind == QUEUE_MARKER_FLUSH) {
+            return *arg == '\0';
+        }
+        if (*arg < '0' || *arg > '9') return 0;
+        marker->value = strtoull(arg, &end, 10);
+        return *end == '\0';
+    }
+    return 0;
+}
+
+/*
+ * Send a marker downstream behind the pending input batch. Returns -1
+ * once the queue has shut down.
+ */
+static int send_input_marker(io_thread_t* io, record_batch_t** batch,
+                             const queue_marker_t* marker) {
+    if (flush_input_batch(io, batch) != 0) {
+        return -1;
+    }
+    return queue_push_marker(io->queue, marker) != 0 ? -1 : 0;
+}
+
+/*
+ * Read stdin in large chunks and split it into lines, packing up to
+ * STAGE_BATCH_MAX of them into each batch. A batch is also flushed at the
+ * end of every chunk, so interactive input is not held back. A line split
+ * across chunks is carried over in "partial". Control lines become
+ * markers, queued in order with the batches around them.
+ */
 static void* input_thread(void* arg) {
-    queue_t* input_queue = (queue_t*)arg;
-    char line[MAX_LINE_LENGTH];
+    io_thread_t* io = (io_thread_t*)arg;
+    queue_t* input_queue = io->queue;
+    char* chunk = malloc(INPUT_CHUNK_SIZE);
+    record_batch_t* batch = record_batch_create_in(io->pool, STAGE_BATCH_MAX, INPUT_CHUNK_SIZE);
+    plugin_buf_t partial = { NULL, 0, 0 };
+    queue_marker_t marker;
+    int done = 0;
+    
+    trace_thread_name("input");
+    if (!chunk || !batch) {
+        fprintf(stderr, "Failed to allocate input buffers\n");
+        done = 1;
+    }
     
-    while (fgets(line, sizeof(line), stdin)) {
-        size_t len = strlen(line);
-        if (len > 0 && line[len-1] == '\n') {
-            line[len-1] = '\0';
+    while (!done) {
+        ssize_t n = read(STDIN_FILENO, chunk, INPUT_CHUNK_SIZE);
+        if (n < 0 && errno == EINTR) {
+            continue;
         }
-        
-        if (strcmp(line, "<END>") == 0) {
-            queue_shutdown(input_queue);
+        /* A batch's records are stamped with the read of its first line */
+        uint64_t read_ns = io->end_to_end ? metrics_now_ns() : 0;
+        if (n <= 0) {
+            /* Unterminated last line */
+            if (partial.len > 0 && strcmp(partial.data, "<END>") != 0) {
+                if (parse_marker(partial.data, partial.len, &marker)) {
+                    send_input_marker(io, &batch, &marker);
+                } else {
+                    record_batch_append(batch, partial.data, partial.len);
+                }
+            }
             break;
         }
         
-        queue_push(input_queue, line);
+        const char* p = chunk;
+        const char* end = chunk + n;
+        while (p < end && !done) {
+            const char* nl = memchr(p, '\n', end - p);
+            if (!nl) {
+                /* Keep the tail for the next chunk */
+                size_t len = end - p;
+                if (plugin_buf_reserve(&partial, partial.len + len + 1) != PLUGIN_SUCCESS) {
+                    done = 1;
+                    break;
+                }
+                memcpy(partial.data + partial.len, p, len);
+                partial.len += len;
+                partial.data[partial.len] = '\0';
+                break;
+            }
+            
+            const char* line = p;
+            size_t len = nl - p;
+            if (partial.len > 0) {
+                if (plugin_buf_reserve(&partial, partial.len + len + 1) != PLUGIN_SUCCESS) {
+                    done = 1;
+                    break;
+                }
+                memcpy(partial.data + partial.len, p, len);
+                partial.len += len;
+                line = partial.data;
+                len = partial.len;
+                partial.len = 0;
+            }
+            p = nl + 1;
+            
+            if (len == 5 && memcmp(line, "<END>", 5) == 0) {
+                done = 1;
+                break;
+            }
+            if (line[0] == '<' && parse_marker(line, len, &marker)) {
+                if (send_input_marker(io, &batch, &marker) != 0) {
+                    done = 1;
+                }
+                continue;
+            }
+            
+            if (batch->count == 0) {
+                batch->ingest_ns = batch->queued_ns = read_ns;
+            }
+            if (record_batch_append(batch, line, len) != 0) {
+                fprintf(stderr, "Out of memory, input line dropped\n");
+            }
+            if (batch->count == STAGE_BATCH_MAX && flush_input_batch(io, &batch) != 0) {
+                done = 1;
+            }
+        }
+        
+        if (!done && flush_input_batch(io, &batch) != 0) {
+            done = 1;
+        }
     }
     
+    if (batch) {
+        flush_input_batch(io, &batch);
+        record_batch_free(batch);
+    }
+    queue_shutdown(input_queue);
+    free(partial.data);
+    free(chunk);
     return NULL;
 }
 
+/*
+ * Count a written item in the output row, and for stamped batches record
+ * the time since ingest and since the last stage handed it over.
+ */
+static void account_output(io_thread_t* io, uint64_t start, const queue_item_t* item) {
+    stage_metrics_t* m = io->metrics;
+    uint64_t now = metrics_now_ns();
+    size_t records = item->batch ? item->batch->count : 1;
+    size_t bytes = item->batch ? item->batch->size - item->batch->count : strlen(item->str);
+    
+    metrics_record_time(m, now - start, records);
+    metrics_add(&m->records_in, records);
+    metrics_add(&m->bytes_in, bytes);
+    metrics_add(&m->records_out, records);
+    metrics_add(&m->bytes_out, bytes);
+    metrics_sample_cpu(m, now);
+    
+    if (item->batch && item->batch->ingest_ns && now > item->batch->ingest_ns) {
+        metrics_histogram_record(io->end_to_end, now - item->batch->ingest_ns, records);
+    }
+    if (item->batch && item->batch->queued_ns && now > item->batch->queued_ns) {
+        metrics_histogram_record(&m->residence, now - item->batch->queued_ns, records);
+    }
+}
+
+/*
+ * Write results, one fflush per queue item so a batch costs one write.
+ * A marker writes nothing; everything before it is already flushed.
+ */
 static void* output_thread(void* arg) {
-    queue_t* output_queue = (queue_t*)arg;
-    char* str;
+    io_thread_t* io = (io_thread_t*)arg;
+    queue_item_t item;
+    char* record = NULL;
+    size_t record_cap = 0;
     
-    while (queue_pop(output_queue, &str) == 0) {
-        printf("%s\n", str);
+    trace_thread_name("output");
+    metrics_thread_stage = io->metrics;
+    while (queue_pop_into(io->queue, &item, &record, &record_cap) == 0) {
+        if (item.marker.kind) {
+            continue;
+        }
+        uint64_t start = io->metrics ? metrics_now_ns() : 0;
+        if (item.batch) {
+            for (size_t i = 0; i < item.batch->count; i++) {
+                size_t len;
+                const char* str = record_batch_get(item.batch, i, &len);
+                fwrite(str, 1, len, stdout);
+                fputc('\n', stdout);
+            }
+        } else {
+            printf("%s\n", item.str);
+        }
         fflush(stdout);
-        free(str);
+        
+        if (io->metrics) {
+            account_output(io, start, &item);
+        }
+        record_batch_free(item.batch);
+    }
+    free(record);
+    if (io->metrics) {
+        metrics_update_cpu(io->metrics);
     }
     
     return NULL;
 }
 
+/*
+ * Parse a decimal option value between min and max. Returns 0, or -1 if
+ * text is not such a number.
+ */
+static int parse_option_number(const char* text, unsigned long long min,
+                               unsigned long long max, unsigned long long* value) {
+    if (*text < '0' || *text > '9') {
+        return -1;
+    }
+    char* end;
+    errno = 0;
+    unsigned long long n = strtoull(text, &end, 10);
+    if (errno || *end != '\0' || n < min || n > max) {
+        return -1;
+    }
+    *value = n;
+    return 0;
+}
+
+static void print_usage(const char* argv0) {
+    fprintf(stderr, "Usage: %s [--metrics[=FILE]] [--metrics-listen=ADDR] [--budget=SIZE] [--linger=US] [--lock-profile] [--trace=FILE [--trace-sample=N]] [--isolate] plugin1[:key=value,...] [[--isolate] plugin2 ...]\n", argv0);
+    fprintf(stderr, "Each plugin is a path to a .so or the name of a builtin:");
+    const plugin_builtin_t* builtin;
+    for (size_t i = 0; (builtin = plugin_builtin_at(i)) != NULL; i++) {
+        fprintf(stderr, " %s", builtin->name);
+    }
+    fprintf(stderr, "\n");
+    fprintf(stderr, "Config values may contain ':' and '/'; write \\, for a comma inside a value\n");
+    fprintf(stderr, "--isolate runs the next plugin in a child process that is restarted if it crashes\n");
+    fprintf(stderr, "--metrics[=FILE] reports per-stage metrics, end-to-end latency, the\n"
+                    "  bottleneck stage and memory use on SIGUSR1 and at end of stream\n");
+    fprintf(stderr, "--metrics-listen=ADDR serves metrics in Prometheus format over HTTP while\n"
+                    "  running; ADDR is unix:PATH, HOST:PORT or :PORT (127.0.0.1)\n");
+    fprintf(stderr, "--budget=SIZE caps the bytes queued between all stages, e.g. 64M; a\n"
+                    "  producer blocks while the budget is spent\n");
+    fprintf(stderr, "--linger=US lets each stage gather records arriving within US microseconds\n"
+                    "  into one batch, trading that much latency for throughput on slow input\n");
+    fprintf(stderr, "--lock-profile reports wait and hold times of every queue and budget\n"
+                    "  lock at exit\n");
+    fprintf(stderr, "Input lines <FLUSH>, <EPOCH n> and <WATERMARK n> pass through the stages in\n"
+                    "  order as markers; stateful plugins emit what they hold when one arrives\n");
+    fprintf(stderr, "--trace=FILE writes Chrome trace JSON (Perfetto) at exit; --trace-sample=N\n"
+                    "  records one transform call in N (queue waits are always recorded)\n");
+}
+
 int main(int argc, char* argv[]) {
-    if (argc < 2) {
-        fprintf(stderr, "Usage: %s plugin1.so [plugin2.so ...]\n", argv[0]);
+    const char** specs = calloc(argc, sizeof(const char*));
+    int* isolated = calloc(argc, sizeof(int));
+    int plugin_count = 0;
+    int isolate_next = 0;
+    int metrics_enabled = 0;
+    const char* metrics_path = NULL;
+    const char* metrics_listen = NULL;
+    const char* trace_path = NULL;
+    unsigned trace_sample = 1;
+    size_t budget = 0;
+    uint64_t linger_us = 0;
+    int lock_profile = 0;
+    
+    // Parse plugin specs; options apply to the plugin that follows them
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--isolate") == 0) {
+            isolate_next = 1;
+            continue;
+        }
+        if (strcmp(argv[i], "--metrics") == 0 || strncmp(argv[i], "--metrics=", 10) == 0) {
+            metrics_enabled = 1;
+            metrics_path = argv[i][9] == '=' ? argv[i] + 10 : NULL;
+            continue;
+        }
+        if (strncmp(argv[i], "--metrics-listen=", 17) == 0) {
+            metrics_enabled = 1;
+            metrics_listen = argv[i] + 17;
+            continue;
+        }
+        if (strncmp(argv[i], "--budget=", 9) == 0) {
+            if (plugin_config_get_size(argv[i] + 2, "budget", &budget) != 1 || budget == 0) {
+                fprintf(stderr, "Invalid budget: %s\n", argv[i] + 9);
+                free(specs);
+                free(isolated);
+                return 1;
+            }
+            continue;
+        }
+        if (strcmp(argv[i], "--lock-profile") == 0) {
+            lock_profile = 1;
+            continue;
+        }
+        if (strncmp(argv[i], "--linger=", 9) == 0) {
+            unsigned long long us;
+            if (parse_option_number(argv[i] + 9, 0, STAGE_LINGER_MAX_US, &us) != 0) {
+                fprintf(stderr, "Invalid linger: %s (0 to %llu microseconds)\n",
+                        argv[i] + 9, STAGE_LINGER_MAX_US);
+                free(specs);
+                free(isolated);
+                return 1;
+            }
+            linger_us = us;
+            continue;
+        }
+        if (strncmp(argv[i], "--trace=", 8) == 0) {
+            trace_path = argv[i] + 8;
+            continue;
+        }
+        if (strncmp(argv[i], "--trace-sample=", 15) == 0) {
+            unsigned long long n;
+            if (parse_option_number(argv[i] + 15, 1, UINT_MAX, &n) != 0) {
+                fprintf(stderr, "Invalid trace sample: %s (1 to %u)\n",
+                        argv[i] + 15, UINT_MAX);
+                free(specs);
+                free(isolated);
+                return 1;
+            }
+            trace_sample = (unsigned)n;
+            continue;
+        }
+        isolated[plugin_count] = isolate_next;
+        specs[plugin_count++] = argv[i];
+        isolate_next = 0;
+    }
+    
+    if (plugin_count == 0 || isolate_next || (trace_path && !*trace_path)) {
+        print_usage(argv[0]);
+        free(specs);
+        free(isolated);
         return 1;
     }
     
-    int plugin_count = argc - 1;
-    plugin_t* plugins = calloc(plugin_count, sizeof(plugin_t));
-    queue_t* queues = calloc(plugin_count + 1, sizeof(queue_t));
+    // Profile every lock from its first acquisition
+    monitor_profile_enable(lock_profile);
     
-    // Initialize queues
-    for (int i = 0; i <= plugin_count; i++) {
-        if (queue_init(&queues[i], QUEUE_CAPACITY) != 0) {
-            fprintf(stderr, "Failed to initialize queue %d\n", i);
-            return 1;
+    // Create queues and load plugins
+    pipeline_t pipeline;
+    if (pipeline_init(&pipeline, specs, plugin_count, QUEUE_CAPACITY) != 0) {
+        if (plugin_count > MAX_PIPELINE_STAGES) {
+            fprintf(stderr, "At most %d plugins are supported\n", MAX_PIPELINE_STAGES);
         }
+        return 1;
     }
-    
-    // Load plugins
     for (int i = 0; i < plugin_count; i++) {
-        plugins[i].handle = dlopen(argv[i + 1], RTLD_LAZY);
-        if (!plugins[i].handle) {
-            fprintf(stderr, "Failed to load plugin %s: %s\n", argv[i + 1], dlerror());
-            return 1;
+        pipeline.stages[i].isolated = isolated[i];
+        pipeline.stages[i].linger_us = linger_us;
+    }
+    pipeline_fuse_stages(&pipeline);
+    if (budget && pipeline_set_budget(&pipeline, budget) != 0) {
+        perror("Failed to set budget");
+        return 1;
+    }
+    
+    // Metrics for host-run stages; the reporter starts before any stage
+    // thread so SIGUSR1 stays blocked everywhere else. Input batches are
+    // stamped so stage residence and end-to-end latency can be measured.
+    stage_metrics_t** metrics = calloc(plugin_count + 1, sizeof(stage_metrics_t*));
+    size_t metrics_count = 0;
+    metrics_reporter_t reporter = { 0 };
+    metrics_exporter_t exporter = { 0 };
+    metrics_histogram_t* end_to_end = NULL;
+    if (metrics_enabled) {
+        for (int i = 0; i < plugin_count; i++) {
+            pipeline_stage_t* stage = &pipeline.stages[i];
+            if (!stage->interface.transform || stage->absorbed) continue;
+            stage->metrics = stage_metrics_create(stage->fused_name[0] ? stage->fused_name
+                                                                       : stage->info->name);
+            if (!stage->metrics) {
+                fprintf(stderr, "Failed to allocate metrics\n");
+                return 1;
+            }
+            metrics[metrics_count++] = stage->metrics;
         }
-        
-        plugins[i].interface.create = dlsym(plugins[i].handle, "plugin_create");
-        plugins[i].interface.destroy = dlsym(plugins[i].handle, "plugin_destroy");
-        plugins[i].interface.request_stop = dlsym(plugins[i].handle, "plugin_request_stop");
-        plugins[i].interface.name = dlsym(plugins[i].handle, "plugin_name");
-        
-        if (!plugins[i].interface.create || !plugins[i].interface.destroy) {
-            fprintf(stderr, "Plugin %s missing required functions\n", argv[i + 1]);
+        metrics[metrics_count] = stage_metrics_create("output");
+        end_to_end = calloc(1, sizeof(metrics_histogram_t));
+        if (!metrics[metrics_count] || !end_to_end) {
+            fprintf(stderr, "Failed to allocate metrics\n");
             return 1;
         }
-        
-        if (plugins[i].interface.create(&plugins[i].context, NULL, 
-                                        &queues[i], &queues[i + 1]) != 0) {
-            fprintf(stderr, "Failed to create plugin %s\n", argv[i + 1]);
+        metrics[metrics_count++]->input = &pipeline.queues[plugin_count];
+        if (metrics_reporter_start(&reporter, metrics, metrics_count, end_to_end,
+                                   metrics_path) != 0) {
+            fprintf(stderr, "Failed to start metrics reporter\n");
             return 1;
         }
-        
-        if (plugins[i].interface.name) {
-            printf("Loaded plugin: %s\n", plugins[i].interface.name(plugins[i].context));
+        if (metrics_listen && metrics_exporter_start(&exporter, metrics, metrics_count, end_to_end,
+                                                     metrics_listen) != 0) {
+            fprintf(stderr, "Failed to serve metrics on %s: %s\n", metrics_listen, strerror(errno));
+            return 1;
         }
     }
     
+    // Tracing is on before any traced thread starts
+    if (trace_path && trace_start(trace_sample, 0) != 0) {
+        fprintf(stderr, "Failed to start tracing\n");
+        return 1;
+    }
+    
+    // Start plugins
+    if (pipeline_start(&pipeline) != 0) {
+        return 1;
+    }
+    for (int i = 0; i < plugin_count; i++) {
+        printf("Loaded plugin: %s\n", pipeline_stage_name(&pipeline.stages[i]));
+    }
+    
     // Start I/O threads
+    io_thread_t input = { &pipeline.queues[0], NULL, end_to_end, pipeline.pool };
+    io_thread_t output = { &pipeline.queues[plugin_count],
+                           metrics_enabled ? metrics[metrics_count - 1] : NULL, end_to_end, NULL };
     pthread_t input_tid, output_tid;
-    pthread_create(&input_tid, NULL, input_thread, &queues[0]);
-    pthread_create(&output_tid, NULL, output_thread, &queues[plugin_count]);
+    pthread_create(&input_tid, NULL, input_thread, &input);
+    pthread_create(&output_tid, NULL, output_thread, &output);
     
     // Wait for input thread to finish
     pthread_join(input_tid, NULL);
@@ -115,30 +484,30 @@ int main(int argc, char* argv[]) {
     // Wait for output thread to finish processing all data
     pthread_join(output_tid, NULL);
     
-    // Stop plugins
-    for (int i = 0; i < plugin_count; i++) {
-        if (plugins[i].interface.request_stop) {
-            plugins[i].interface.request_stop(plugins[i].context);
-        }
+    // Final metrics report, now that every stage has drained
+    metrics_exporter_stop(&exporter);
+    metrics_reporter_stop(&reporter);
+    
+    // Event names point into the plugins, so write the trace before unloading
+    if (trace_path && trace_write(trace_path) != 0) {
+        fprintf(stderr, "Failed to write trace %s: %s\n", trace_path, strerror(errno));
     }
     
-    // Destroy plugins
-    for (int i = 0; i < plugin_count; i++) {
-        if (plugins[i].interface.destroy) {
-            plugins[i].interface.destroy(plugins[i].context);
-        }
-        if (plugins[i].handle) {
-            dlclose(plugins[i].handle);
-        }
+    // Stop plugins, unload them and free the queues
+    pipeline_destroy(&pipeline);
+    trace_stop();
+    if (lock_profile) {
+        monitor_profile_report(stderr);
     }
     
-    // Cleanup
-    for (int i = 0; i <= plugin_count; i++) {
-        queue_destroy(&queues[i]);
+    for (size_t i = 0; i < metrics_count; i++) {
+        stage_metrics_destroy(metrics[i]);
     }
     
-    free(plugins);
-    free(queues);
+    free(end_to_end);
+    free(metrics);
+    free(specs);
+    free(isolated);
     
     return 0;
 }
@@ -0,0 +1,111 @@
+/**
+ * @file mem_budget.c
+ * @brief Implementation of the shared byte budget
+ */
+
+#include "mem_budget.h"
+#include "metrics.h"
+#include <errno.h>
+#include <string.h>
+
+/* Arguments for the admission predicate */
+typedef struct {
+    mem_budget_t* budget;
+    uint64_t bytes;
+    monitor_predicate_t bypass;
+    void* arg;
+} budget_request_t;
+
+/* Called inside the monitor */
+static int budget_admits(void* arg) {
+    budget_request_t* req = (budget_request_t*)arg;
+    uint64_t used = atomic_load_explicit(&req->budget->used, memory_order_relaxed);
+    return used == 0 || used + req->bytes <= req->budget->limit ||
+           (req->bypass && req->bypass(req->arg));
+}
+
+/**
+ * Initialize a budget
+ */
+int mem_budget_init(mem_budget_t* budget, uint64_t limit) {
+    if (!budget || limit == 0) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    memset(budget, 0, sizeof(mem_budget_t));
+    if (monitor_init(&budget->monitor) != 0) {
+        return -1;
+    }
+    monitor_set_name(&budget->monitor, "budget");
+    budget->limit = limit;
+    return 0;
+}
+
+/**
+ * Destroy a budget
+ */
+void mem_budget_destroy(mem_budget_t* budget) {
+    if (!budget) return;
+    monitor_destroy(&budget->monitor);
+}
+
+/**
+ * Charge bytes to the budget, blocking until they fit
+ */
+int mem_budget_acquire(mem_budget_t* budget, uint64_t bytes,
+                       monitor_predicate_t bypass, void* arg,
+                       const struct timespec* deadline) {
+    budget_request_t req = { budget, bytes, bypass, arg };
+    int timed_out = 0;
+
+    monitor_enter(&budget->monitor);
+    if (!budget_admits(&req)) {
+        uint64_t start = metrics_now_ns();
+        if (!deadline) {
+            monitor_wait_for(&budget->monitor, budget_admits, &req);
+        } else {
+            while (!budget_admits(&req) && !timed_out) {
+                timed_out = monitor_wait_timeout(&budget->monitor, deadline) == ETIMEDOUT &&
+                            !budget_admits(&req);
+            }
+        }
+        metrics_add(&budget->waits, 1);
+        metrics_add(&budget->wait_ns, metrics_now_ns() - start);
+    }
+    if (timed_out) {
+        monitor_exit(&budget->monitor);
+        errno = ETIMEDOUT;
+        return -1;
+    }
+
+    uint64_t used = atomic_load_explicit(&budget->used, memory_order_relaxed) + bytes;
+    atomic_store_explicit(&budget->used, used, memory_order_relaxed);
+    if (used > atomic_load_explicit(&budget->peak, memory_order_relaxed)) {
+        atomic_store_explicit(&budget->peak, used, memory_order_relaxed);
+    }
+    monitor_exit(&budget->monitor);
+    return 0;
+}
+
+/**
+ * Return bytes to the budget and wake blocked producers
+ */
+void mem_budget_release(mem_budget_t* budget, uint64_t bytes) {
+    monitor_enter(&budget->monitor);
+    uint64_t used = atomic_load_explicit(&budget->used, memory_order_relaxed);
+    atomic_store_explicit(&budget->used, used > bytes ? used - bytes : 0, memory_order_relaxed);
+    monitor_exit(&budget->monitor);
+
+    /* Waiters need different amounts, so let each re-check */
+    monitor_broadcast(&budget->monitor);
+}
+
+/**
+ * Wake blocked producers so they re-check their bypass predicate
+ */
+void mem_budget_wake(mem_budget_t* budget) {
+    monitor_enter(&budget->monitor);
+    monitor_exit(&budget->monitor);
+    monitor_broadcast(&budget->monitor);
+}
@@ -0,0 +1,92 @@
+/**
+ * @file mem_budget.h
+ * @brief Byte budget shared by the queues of a pipeline
+ *
+ * Queue capacity counts items, so the memory a queue pins depends on how
+ * long its records are. A budget bounds the bytes held by all queues that
+ * share it: a producer whose item does not fit blocks until consumers
+ * release enough. Features include:
+ * - One limit for the whole pipeline, whatever the line-size mix
+ * - Progress is never lost: an item is always admitted when nothing is
+ *   charged to the budget, or when the caller's bypass predicate holds
+ *   (queues admit into an empty queue, so the stage nearest the output
+ *   can always move and a full budget drains)
+ * - Counters for the peak, the number of blocked acquisitions and the
+ *   time spent blocked
+ *
+ * Admitting items past the limit in those cases means the budget can be
+ * exceeded by at most one item per queue.
+ *
+ * Thread Safety: All functions are thread-safe
+ * Memory Management: mem_budget_init / mem_budget_destroy; the budget
+ *                    must outlive every queue attached to it
+ */
+
+#ifndef MEM_BUDGET_H
+#define MEM_BUDGET_H
+
+#include "monitor.h"
+#include <stdatomic.h>
+#include <stdint.h>
+
+/* Budget structure */
+typedef struct mem_budget {
+    monitor_t monitor;           /* Guards used; waiters block here */
+    uint64_t limit;              /* Bytes allowed in flight */
+    _Atomic uint64_t used;       /* Bytes charged now (written in the monitor) */
+    _Atomic uint64_t peak;       /* Most bytes charged at once */
+    _Atomic uint64_t waits;      /* Acquisitions that had to block */
+    _Atomic uint64_t wait_ns;    /* Time spent blocked */
+} mem_budget_t;
+
+/**
+ * @brief Initialize a budget
+ *
+ * @param budget Pointer to budget structure to initialize
+ * @param limit Bytes allowed in flight (must be > 0)
+ * @return 0 on success, -1 on error (sets errno)
+ */
+int mem_budget_init(mem_budget_t* budget, uint64_t limit);
+
+/**
+ * @brief Destroy a budget
+ *
+ * @param budget Pointer to budget
+ */
+void mem_budget_destroy(mem_budget_t* budget);
+
+/**
+ * @brief Charge bytes to the budget, blocking until they fit
+ *
+ * @param budget Pointer to budget
+ * @param bytes Bytes to charge
+ * @param bypass Predicate that admits the bytes regardless of the limit
+ *               (checked on every wake-up), or NULL
+ * @param arg Argument for bypass
+ * @param deadline CLOCK_MONOTONIC time to give up at (monitor_deadline),
+ *                 or NULL to wait as long as it takes
+ * @return 0 once charged, -1 with errno ETIMEDOUT if the deadline passed
+ *
+ * @note On success the bytes are charged; callers that then give up
+ *       must call mem_budget_release
+ */
+int mem_budget_acquire(mem_budget_t* budget, uint64_t bytes,
+                       monitor_predicate_t bypass, void* arg,
+                       const struct timespec* deadline);
+
+/**
+ * @brief Return bytes to the budget and wake blocked producers
+ *
+ * @param budget Pointer to budget
+ * @param bytes Bytes charged earlier
+ */
+void mem_budget_release(mem_budget_t* budget, uint64_t bytes);
+
+/**
+ * @brief Wake blocked producers so they re-check their bypass predicate
+ *
+ * @param budget Pointer to budget
+ */
+void mem_budget_wake(mem_budget_t* budget);
+
+#endif /* MEM_BUDGET_H */
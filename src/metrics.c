@@ -0,0 +1,472 @@
+/**
+ * @file metrics.c
+ * @brief Implementation of stage metrics and the report thread
+ */
+
+#include "metrics.h"
+#include "queue.h"
+#include <errno.h>
+#include <malloc.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+__thread stage_metrics_t* metrics_thread_stage;
+
+/**
+ * Allocate zeroed metrics for a stage
+ */
+stage_metrics_t* stage_metrics_create(const char* name) {
+    stage_metrics_t* metrics = calloc(1, sizeof(stage_metrics_t));
+    if (!metrics) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    metrics->name = name ? name : "stage";
+    return metrics;
+}
+
+/**
+ * Free stage metrics
+ */
+void stage_metrics_destroy(stage_metrics_t* metrics) {
+    free(metrics);
+}
+
+/* Largest value that falls into a bucket */
+static uint64_t bucket_upper(unsigned index) {
+    if (index < METRICS_SUB_COUNT) return index;
+    unsigned shift = (index >> METRICS_SUB_BITS) - 1;
+    uint64_t mantissa = METRICS_SUB_COUNT + (index & (METRICS_SUB_COUNT - 1));
+    return ((mantissa + 1) << shift) - 1;
+}
+
+/* Quantile over a bucket array, capped at the largest value seen */
+static uint64_t buckets_quantile(const _Atomic uint64_t* buckets, const _Atomic uint64_t* max_ns,
+                                 double q) {
+    uint64_t total = 0;
+    for (unsigned i = 0; i < METRICS_BUCKETS; i++) {
+        total += atomic_load_explicit(&buckets[i], memory_order_relaxed);
+    }
+    if (total == 0) return 0;
+
+    uint64_t rank = (uint64_t)(q * (double)total);
+    if (rank >= total) rank = total - 1;
+
+    uint64_t max = atomic_load_explicit(max_ns, memory_order_relaxed);
+    uint64_t seen = 0;
+    for (unsigned i = 0; i < METRICS_BUCKETS; i++) {
+        seen += atomic_load_explicit(&buckets[i], memory_order_relaxed);
+        if (seen > rank) {
+            uint64_t upper = bucket_upper(i);
+            return upper < max ? upper : max;
+        }
+    }
+    return max;
+}
+
+/**
+ * Service time at a quantile
+ */
+uint64_t stage_metrics_quantile(const stage_metrics_t* metrics, double q) {
+    return buckets_quantile(metrics->buckets, &metrics->max_ns, q);
+}
+
+/**
+ * Latency at a quantile
+ */
+uint64_t metrics_histogram_quantile(const metrics_histogram_t* hist, double q) {
+    return buckets_quantile(hist->buckets, &hist->max_ns, q);
+}
+
+/**
+ * Print one row per stage
+ */
+void metrics_print(FILE* out, stage_metrics_t* const* stages, size_t count, double elapsed_s) {
+    fprintf(out, "%-12s %12s %12s %14s %14s %12s %9s %9s %9s %9s %9s %10s %10s %10s\n",
+            "stage", "records_in", "records_out", "bytes_in", "bytes_out", "records/s",
+            "mean_us", "p50_us", "p99_us", "p999_us", "max_us",
+            "res_p50_us", "res_p99_us", "res_p999_us");
+
+    for (size_t i = 0; i < count; i++) {
+        const stage_metrics_t* m = stages[i];
+        uint64_t in = atomic_load_explicit(&m->records_in, memory_order_relaxed);
+        uint64_t samples = atomic_load_explicit(&m->samples, memory_order_relaxed);
+        uint64_t total_ns = atomic_load_explicit(&m->total_ns, memory_order_relaxed);
+        double mean = samples ? (double)total_ns / (double)samples : 0.0;
+
+        fprintf(out, "%-12s %12llu %12llu %14llu %14llu %12.0f %9.2f %9.2f %9.2f %9.2f %9.2f"
+                     " %10.2f %10.2f %10.2f\n",
+                m->name,
+                (unsigned long long)in,
+                (unsigned long long)atomic_load_explicit(&m->records_out, memory_order_relaxed),
+                (unsigned long long)atomic_load_explicit(&m->bytes_in, memory_order_relaxed),
+                (unsigned long long)atomic_load_explicit(&m->bytes_out, memory_order_relaxed),
+                elapsed_s > 0 ? (double)in / elapsed_s : 0.0,
+                mean / 1000.0,
+                stage_metrics_quantile(m, 0.50) / 1000.0,
+                stage_metrics_quantile(m, 0.99) / 1000.0,
+                stage_metrics_quantile(m, 0.999) / 1000.0,
+                atomic_load_explicit(&m->max_ns, memory_order_relaxed) / 1000.0,
+                metrics_histogram_quantile(&m->residence, 0.50) / 1000.0,
+                metrics_histogram_quantile(&m->residence, 0.99) / 1000.0,
+                metrics_histogram_quantile(&m->residence, 0.999) / 1000.0);
+    }
+}
+
+/**
+ * Print the end-to-end latency line
+ */
+void metrics_print_end_to_end(FILE* out, const metrics_histogram_t* hist) {
+    uint64_t samples = hist ? atomic_load_explicit(&hist->samples, memory_order_relaxed) : 0;
+    if (samples == 0) return;
+
+    uint64_t total_ns = atomic_load_explicit(&hist->total_ns, memory_order_relaxed);
+    fprintf(out, "end-to-end latency: %llu records, mean %.2f us, p50 %.2f us, "
+                 "p99 %.2f us, p999 %.2f us, max %.2f us\n",
+            (unsigned long long)samples,
+            (double)total_ns / (double)samples / 1000.0,
+            metrics_histogram_quantile(hist, 0.50) / 1000.0,
+            metrics_histogram_quantile(hist, 0.99) / 1000.0,
+            metrics_histogram_quantile(hist, 0.999) / 1000.0,
+            atomic_load_explicit(&hist->max_ns, memory_order_relaxed) / 1000.0);
+}
+
+/**
+ * Split a stage's elapsed time into CPU and blocked shares
+ */
+void metrics_utilization(const stage_metrics_t* metrics, uint64_t elapsed_ns,
+                         metrics_utilization_t* util) {
+    memset(util, 0, sizeof(metrics_utilization_t));
+    if (elapsed_ns == 0) return;
+
+    double elapsed = (double)elapsed_ns;
+    util->cpu = (double)atomic_load_explicit(&metrics->cpu_ns, memory_order_relaxed) / elapsed;
+    if (metrics->input) {
+        util->starved = (double)atomic_load_explicit(&metrics->input->wait_empty_ns,
+                                                     memory_order_relaxed) / elapsed;
+    }
+    if (metrics->output) {
+        util->blocked = (double)atomic_load_explicit(&metrics->output->wait_full_ns,
+                                                     memory_order_relaxed) / elapsed;
+    }
+}
+
+/**
+ * Print utilization per stage and the bottleneck analysis
+ */
+void metrics_print_bottleneck(FILE* out, stage_metrics_t* const* stages, size_t count,
+                              uint64_t elapsed_ns) {
+    if (count == 0 || elapsed_ns == 0) return;
+
+    metrics_utilization_t util[count];
+    size_t critical = 0;
+    double total_cpu = 0.0;
+    fprintf(out, "%-12s %8s %11s %11s %12s\n",
+            "stage", "cpu_pct", "starved_pct", "blocked_pct", "cpu_ns/rec");
+    for (size_t i = 0; i < count; i++) {
+        metrics_utilization(stages[i], elapsed_ns, &util[i]);
+        uint64_t records = atomic_load_explicit(&stages[i]->records_in, memory_order_relaxed);
+        uint64_t cpu_ns = atomic_load_explicit(&stages[i]->cpu_ns, memory_order_relaxed);
+        fprintf(out, "%-12s %8.1f %11.1f %11.1f %12.0f\n", stages[i]->name,
+                util[i].cpu * 100.0, util[i].starved * 100.0, util[i].blocked * 100.0,
+                records ? (double)cpu_ns / (double)records : 0.0);
+        total_cpu += util[i].cpu;
+        if (util[i].cpu > util[critical].cpu) critical = i;
+    }
+
+    /* Throughput is bounded by the busiest stage and by the CPU time all
+     * stages need together. Two copies of the critical stage halve its
+     * share, until the next busiest stage or the CPUs become the limit. */
+    double busiest = util[critical].cpu;
+    double next = 0.0;
+    for (size_t i = 0; i < count; i++) {
+        if (i != critical && util[i].cpu > next) next = util[i].cpu;
+    }
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    double machine = cpus > 0 ? total_cpu / (double)cpus : 0.0;
+    double before = busiest > machine ? busiest : machine;
+    double limit = busiest / 2.0;
+    if (next > limit) limit = next;
+    if (machine > limit) limit = machine;
+
+    fprintf(out, "critical stage: %s (cpu %.1f%%)", stages[critical]->name, busiest * 100.0);
+    if (util[critical].starved > 0.5) {
+        fprintf(out, "; starved %.1f%% of the time, so the pipeline is input-bound\n",
+                util[critical].starved * 100.0);
+    } else {
+        fprintf(out, "; replicating it x2 projects %.2fx throughput (%ld cpus)\n",
+                limit > 0.0 ? before / limit : 1.0, cpus);
+    }
+
+    int fused = 0;
+    for (size_t i = 0; i + 1 < count; i++) {
+        if (util[i].cpu + util[i + 1].cpu < METRICS_FUSE_UTILIZATION) {
+            fprintf(out, "%s %s+%s (cpu %.1f%%)", fused++ ? "," : "fuse candidates:",
+                    stages[i]->name, stages[i + 1]->name,
+                    (util[i].cpu + util[i + 1].cpu) * 100.0);
+        }
+    }
+    if (fused) fputc('\n', out);
+}
+
+/**
+ * Print per-stage memory and process heap statistics
+ */
+void metrics_print_memory(FILE* out, stage_metrics_t* const* stages, size_t count) {
+    fprintf(out, "%-12s %14s %14s %12s %12s %10s %14s\n",
+            "stage", "queue_bytes", "queue_peak", "held_bytes", "held_peak",
+            "allocs", "alloc_bytes");
+    for (size_t i = 0; i < count; i++) {
+        const stage_metrics_t* m = stages[i];
+        const queue_t* q = m->input;
+        fprintf(out, "%-12s %14llu %14llu %12llu %12llu %10llu %14llu\n", m->name,
+                (unsigned long long)(q ? atomic_load_explicit(&q->bytes, memory_order_relaxed) : 0),
+                (unsigned long long)(q ? atomic_load_explicit(&q->peak_bytes, memory_order_relaxed) : 0),
+                (unsigned long long)atomic_load_explicit(&m->held_bytes, memory_order_relaxed),
+                (unsigned long long)atomic_load_explicit(&m->peak_held_bytes, memory_order_relaxed),
+                (unsigned long long)atomic_load_explicit(&m->allocs, memory_order_relaxed),
+                (unsigned long long)atomic_load_explicit(&m->alloc_bytes, memory_order_relaxed));
+    }
+
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 33))
+    struct mallinfo2 heap = mallinfo2();
+    fprintf(out, "heap: arena %zu bytes, in use %zu, free %zu (%.1f%% fragmentation), mmap %zu in %zu blocks\n",
+            heap.arena, heap.uordblks, heap.fordblks,
+            heap.arena ? (double)heap.fordblks * 100.0 / (double)heap.arena : 0.0,
+            heap.hblkhd, heap.hblks);
+#endif
+}
+
+/* Histogram boundaries for exposition, in ns: 1 us to 1 s in steps of 4 */
+static const uint64_t prometheus_bounds[] = {
+    1000, 4000, 16000, 64000, 256000, 1000000, 4000000, 16000000, 64000000,
+    256000000, 1000000000
+};
+
+/* Copy a label value, escaping as the exposition format requires */
+static const char* prometheus_escape(char* dst, size_t size, const char* src) {
+    size_t n = 0;
+    for (; *src && n + 3 < size; src++) {
+        if (*src == '"' || *src == '\\') dst[n++] = '\\';
+        if (*src == '\n') {
+            dst[n++] = '\\';
+            dst[n++] = 'n';
+            continue;
+        }
+        dst[n++] = *src;
+    }
+    dst[n] = '\0';
+    return dst;
+}
+
+/*
+ * One Prometheus histogram from a bucket array. Bucket boundaries do not
+ * line up with prometheus_bounds, so a log-linear bucket straddling a
+ * bound is counted above it. label is empty or ends in a comma.
+ */
+static void prometheus_histogram(FILE* out, const char* name, const char* label,
+                                 const _Atomic uint64_t* buckets, uint64_t total_ns) {
+    size_t bound = 0;
+    uint64_t seen = 0;
+    for (unsigned i = 0; i < METRICS_BUCKETS; i++) {
+        while (bound < sizeof(prometheus_bounds) / sizeof(prometheus_bounds[0]) &&
+               bucket_upper(i) > prometheus_bounds[bound]) {
+            fprintf(out, "%s_bucket{%sle=\"%g\"} %llu\n", name, label,
+                    prometheus_bounds[bound] / 1e9, (unsigned long long)seen);
+            bound++;
+        }
+        seen += atomic_load_explicit(&buckets[i], memory_order_relaxed);
+    }
+
+    /* Count from the buckets, so it never falls below an le bucket */
+    fprintf(out, "%s_bucket{%sle=\"+Inf\"} %llu\n", name, label, (unsigned long long)seen);
+    size_t len = strlen(label);
+    fprintf(out, "%s_sum%s%.*s%s %.9f\n", name, len ? "{" : "", (int)(len ? len - 1 : 0), label,
+            len ? "}" : "", total_ns / 1e9);
+    fprintf(out, "%s_count%s%.*s%s %llu\n", name, len ? "{" : "", (int)(len ? len - 1 : 0), label,
+            len ? "}" : "", (unsigned long long)seen);
+}
+
+/* One counter or gauge per stage */
+static void prometheus_family(FILE* out, stage_metrics_t* const* stages, size_t count,
+                              const char* name, const char* type, const char* help,
+                              size_t offset, int is_queue, double scale) {
+    fprintf(out, "# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+    for (size_t i = 0; i < count; i++) {
+        const void* base = is_queue ? (const void*)stages[i]->input : (const void*)stages[i];
+        if (!base) continue;
+        const _Atomic uint64_t* value = (const _Atomic uint64_t*)((const char*)base + offset);
+        char label[64];
+        fprintf(out, "%s{stage=\"%s\"} %.15g\n", name,
+                prometheus_escape(label, sizeof(label), stages[i]->name),
+                (double)atomic_load_explicit(value, memory_order_relaxed) * scale);
+    }
+}
+
+#define STAGE_FAMILY(name, type, help, field, scale) \
+    prometheus_family(out, stages, count, name, type, help, \
+                      offsetof(stage_metrics_t, field), 0, scale)
+#define QUEUE_FAMILY(name, type, help, field, scale) \
+    prometheus_family(out, stages, count, name, type, help, \
+                      offsetof(queue_t, field), 1, scale)
+
+/**
+ * Write current metrics in Prometheus text exposition format
+ */
+void metrics_write_prometheus(FILE* out, stage_metrics_t* const* stages, size_t count,
+                              const metrics_histogram_t* end_to_end) {
+    char name[64];
+    char label[128];
+    QUEUE_FAMILY("pipeline_queue_depth", "gauge",
+                 "Items waiting in the stage's input queue", depth, 1.0);
+    fprintf(out, "# HELP pipeline_queue_capacity Capacity of the stage's input queue in items\n"
+                 "# TYPE pipeline_queue_capacity gauge\n");
+    for (size_t i = 0; i < count; i++) {
+        if (!stages[i]->input) continue;
+        fprintf(out, "pipeline_queue_capacity{stage=\"%s\"} %zu\n",
+                prometheus_escape(label, sizeof(label), stages[i]->name),
+                stages[i]->input->capacity);
+    }
+    QUEUE_FAMILY("pipeline_queue_bytes", "gauge",
+                 "Bytes held by items in the stage's input queue", bytes, 1.0);
+    QUEUE_FAMILY("pipeline_queue_peak_bytes", "gauge",
+                 "Most bytes the stage's input queue has held", peak_bytes, 1.0);
+    QUEUE_FAMILY("pipeline_queue_wait_empty_seconds_total", "counter",
+                 "Time the stage spent waiting on an empty input queue", wait_empty_ns, 1e-9);
+    QUEUE_FAMILY("pipeline_queue_wait_full_seconds_total", "counter",
+                 "Time the upstream producer spent waiting on a full input queue",
+                 wait_full_ns, 1e-9);
+
+    STAGE_FAMILY("pipeline_stage_records_in_total", "counter",
+                 "Records the stage has read", records_in, 1.0);
+    STAGE_FAMILY("pipeline_stage_records_out_total", "counter",
+                 "Records the stage has emitted", records_out, 1.0);
+    STAGE_FAMILY("pipeline_stage_bytes_in_total", "counter",
+                 "Record bytes the stage has read", bytes_in, 1.0);
+    STAGE_FAMILY("pipeline_stage_bytes_out_total", "counter",
+                 "Record bytes the stage has emitted", bytes_out, 1.0);
+    STAGE_FAMILY("pipeline_stage_cpu_seconds_total", "counter",
+                 "Thread CPU time of the stage, sampled", cpu_ns, 1e-9);
+    STAGE_FAMILY("pipeline_stage_allocations_total", "counter",
+                 "Host allocations made on the stage thread", allocs, 1.0);
+    STAGE_FAMILY("pipeline_stage_allocated_bytes_total", "counter",
+                 "Bytes of host allocations made on the stage thread", alloc_bytes, 1.0);
+    STAGE_FAMILY("pipeline_stage_held_bytes", "gauge",
+                 "Buffers the stage keeps between records", held_bytes, 1.0);
+
+    fprintf(out, "# HELP pipeline_stage_service_seconds Per-record service time\n"
+                 "# TYPE pipeline_stage_service_seconds histogram\n");
+    for (size_t i = 0; i < count; i++) {
+        const stage_metrics_t* m = stages[i];
+        snprintf(label, sizeof(label), "stage=\"%s\",",
+                 prometheus_escape(name, sizeof(name), m->name));
+        prometheus_histogram(out, "pipeline_stage_service_seconds", label, m->buckets,
+                             atomic_load_explicit(&m->total_ns, memory_order_relaxed));
+    }
+    fprintf(out, "# HELP pipeline_stage_residence_seconds Input queue wait plus service time\n"
+                 "# TYPE pipeline_stage_residence_seconds histogram\n");
+    for (size_t i = 0; i < count; i++) {
+        const metrics_histogram_t* h = &stages[i]->residence;
+        snprintf(label, sizeof(label), "stage=\"%s\",",
+                 prometheus_escape(name, sizeof(name), stages[i]->name));
+        prometheus_histogram(out, "pipeline_stage_residence_seconds", label, h->buckets,
+                             atomic_load_explicit(&h->total_ns, memory_order_relaxed));
+    }
+    if (end_to_end) {
+        fprintf(out, "# HELP pipeline_end_to_end_latency_seconds Ingest to output latency\n"
+                     "# TYPE pipeline_end_to_end_latency_seconds histogram\n");
+        prometheus_histogram(out, "pipeline_end_to_end_latency_seconds", "", end_to_end->buckets,
+                             atomic_load_explicit(&end_to_end->total_ns, memory_order_relaxed));
+    }
+}
+
+static void metrics_report(metrics_reporter_t* reporter, const char* reason) {
+    FILE* out = stderr;
+    if (reporter->path) {
+        out = fopen(reporter->path, "a");
+        if (!out) {
+            fprintf(stderr, "metrics: cannot open %s: %s\n", reporter->path, strerror(errno));
+            return;
+        }
+    }
+
+    double elapsed = (double)(metrics_now_ns() - reporter->start_ns) / 1e9;
+    fprintf(out, "--- pipeline metrics (%s, %.3f s) ---\n", reason, elapsed);
+    metrics_print(out, reporter->stages, reporter->count, elapsed);
+    metrics_print_end_to_end(out, reporter->end_to_end);
+    metrics_print_bottleneck(out, reporter->stages, reporter->count,
+                             metrics_now_ns() - reporter->start_ns);
+    metrics_print_memory(out, reporter->stages, reporter->count);
+
+    if (out != stderr) {
+        fclose(out);
+    } else {
+        fflush(out);
+    }
+}
+
+static void* metrics_thread(void* arg) {
+    metrics_reporter_t* reporter = (metrics_reporter_t*)arg;
+    sigset_t set;
+    sigemptyset(&set);
+    sigaddset(&set, SIGUSR1);
+
+    // Every dump, the final one included, is written from this thread so
+    // a SIGUSR1 arriving at end of stream cannot interleave with it
+    for (;;) {
+        int sig;
+        if (sigwait(&set, &sig) != 0) continue;
+        if (reporter->stopping) break;
+        metrics_report(reporter, "SIGUSR1");
+    }
+    metrics_report(reporter, "end of stream");
+    return NULL;
+}
+
+/**
+ * Block SIGUSR1 in the calling thread and start the reporter
+ */
+int metrics_reporter_start(metrics_reporter_t* reporter, stage_metrics_t* const* stages,
+                           size_t count, const metrics_histogram_t* end_to_end,
+                           const char* path) {
+    if (!reporter || (!stages && count > 0)) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    memset(reporter, 0, sizeof(metrics_reporter_t));
+    reporter->stages = stages;
+    reporter->count = count;
+    reporter->end_to_end = end_to_end;
+    reporter->path = path;
+    reporter->start_ns = metrics_now_ns();
+
+    sigset_t set;
+    sigemptyset(&set);
+    sigaddset(&set, SIGUSR1);
+    int ret = pthread_sigmask(SIG_BLOCK, &set, NULL);
+    if (ret == 0) {
+        ret = pthread_create(&reporter->thread, NULL, metrics_thread, reporter);
+    }
+    if (ret != 0) {
+        errno = ret;
+        return -1;
+    }
+
+    reporter->started = 1;
+    return 0;
+}
+
+/**
+ * Have the reporter thread write the final report and exit
+ */
+void metrics_reporter_stop(metrics_reporter_t* reporter) {
+    if (!reporter || !reporter->started) return;
+
+    reporter->stopping = 1;
+    pthread_kill(reporter->thread, SIGUSR1);
+    pthread_join(reporter->thread, NULL);
+    reporter->started = 0;
+}
@@ -0,0 +1,347 @@
+/**
+ * @file metrics.h
+ * @brief Per-stage counters and service-time histograms
+ *
+ * Every stage owns one stage_metrics_t and is its only writer, so updates
+ * are plain relaxed loads and stores with no locked instructions or shared
+ * cache lines between stages. A reporter thread reads them concurrently and
+ * prints a table on SIGUSR1 and once more at end of stream.
+ * Features include:
+ * - Records and bytes in and out of each stage
+ * - Log-linear (HDR-style) histogram of per-record service time, with
+ *   2^METRICS_SUB_BITS buckets per power of two (about 6% resolution)
+ * - Residence time per stage (input queue wait plus service) and
+ *   end-to-end latency, from timestamps carried in record batches
+ * - Thread CPU time per stage, sampled at most once per millisecond, and
+ *   a bottleneck report built from it and the queues' blocked times:
+ *   utilization, the critical stage, the projected speedup from
+ *   replicating it, and idle neighbours that could be fused
+ * - Memory: bytes in flight in each stage's input queue, buffers each stage
+ *   holds between records, peaks of both, the allocations the host makes
+ *   on a stage's thread, and process-wide heap statistics (mallinfo2)
+ * - Prometheus text exposition of the same data (see exporter.h)
+ * - Readers never block writers; a dump may be a few records stale
+ *
+ * Thread Safety: One writer per field; any number of concurrent readers
+ * Memory Management: stage_metrics_create / stage_metrics_destroy
+ */
+
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <pthread.h>
+#include <time.h>
+
+struct queue;
+
+/* Histogram layout: linear below 2^METRICS_SUB_BITS, then log-linear */
+#define METRICS_SUB_BITS 4
+#define METRICS_SUB_COUNT (1u << METRICS_SUB_BITS)
+#define METRICS_BUCKETS ((64 - METRICS_SUB_BITS + 1) * METRICS_SUB_COUNT)
+
+/* Minimum wall time between thread CPU time samples */
+#define METRICS_CPU_SAMPLE_NS 1000000ull
+
+/* Adjacent stages below this combined CPU utilization could share a thread */
+#define METRICS_FUSE_UTILIZATION 0.25
+
+/* A latency histogram on its own, for residence and end-to-end times */
+typedef struct metrics_histogram {
+    _Atomic uint64_t samples;
+    _Atomic uint64_t total_ns;
+    _Atomic uint64_t max_ns;
+    _Atomic uint64_t buckets[METRICS_BUCKETS];
+} metrics_histogram_t;
+
+/* Metrics for one stage */
+typedef struct stage_metrics {
+    const char* name;                           /* Stage name (not owned) */
+    _Atomic uint64_t records_in;
+    _Atomic uint64_t records_out;
+    _Atomic uint64_t bytes_in;
+    _Atomic uint64_t bytes_out;
+    _Atomic uint64_t samples;                   /* Records in the histogram */
+    _Atomic uint64_t total_ns;                  /* Sum of service times */
+    _Atomic uint64_t max_ns;
+    _Atomic uint64_t buckets[METRICS_BUCKETS];  /* Service time in ns */
+    metrics_histogram_t residence;              /* Input queue wait + service */
+    _Atomic uint64_t cpu_ns;                    /* Thread CPU time, last sample */
+    uint64_t cpu_sampled_ns;                    /* Writer only: when it was taken */
+    const struct queue* input;                  /* Queue the stage pops, or NULL */
+    const struct queue* output;                 /* Queue the stage pushes, or NULL */
+    _Atomic uint64_t allocs;                    /* Host allocations on the stage thread */
+    _Atomic uint64_t alloc_bytes;
+    _Atomic uint64_t held_bytes;                /* Buffers kept between records */
+    _Atomic uint64_t peak_held_bytes;
+} stage_metrics_t;
+
+/* Metrics that allocations on the calling thread are charged to, or NULL */
+extern __thread stage_metrics_t* metrics_thread_stage;
+
+/* Where a stage's wall time went, as fractions of the elapsed time */
+typedef struct metrics_utilization {
+    double cpu;             /* Thread CPU time (busy) */
+    double starved;         /* Blocked on an empty input queue */
+    double blocked;         /* Blocked on a full output queue */
+} metrics_utilization_t;
+
+/**
+ * @brief Allocate zeroed metrics for a stage
+ *
+ * @param name Stage name shown in reports (must outlive the metrics)
+ * @return Pointer to metrics on success, NULL on error (sets errno)
+ */
+stage_metrics_t* stage_metrics_create(const char* name);
+
+/**
+ * @brief Free stage metrics
+ *
+ * @param metrics Pointer to metrics (NULL is ignored)
+ */
+void stage_metrics_destroy(stage_metrics_t* metrics);
+
+/* Single-writer increment: no read-modify-write instruction needed */
+static inline void metrics_add(_Atomic uint64_t* counter, uint64_t n) {
+    atomic_store_explicit(counter,
+                          atomic_load_explicit(counter, memory_order_relaxed) + n,
+                          memory_order_relaxed);
+}
+
+/* Histogram bucket for a value */
+static inline unsigned metrics_bucket(uint64_t v) {
+    if (v < METRICS_SUB_COUNT) return (unsigned)v;
+    unsigned shift = 63 - (unsigned)__builtin_clzll(v) - METRICS_SUB_BITS;
+    return ((shift + 1) << METRICS_SUB_BITS) + (unsigned)((v >> shift) & (METRICS_SUB_COUNT - 1));
+}
+
+/* Monotonic clock in nanoseconds, for service-time measurement */
+static inline uint64_t metrics_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+/**
+ * @brief Record service time for a group of records
+ *
+ * @param metrics Stage metrics (writer thread only)
+ * @param ns Time spent on the whole group
+ * @param records Records in the group; each is credited ns / records
+ */
+static inline void metrics_record_time(stage_metrics_t* metrics, uint64_t ns, uint64_t records) {
+    if (records == 0) return;
+    uint64_t per = ns / records;
+    metrics_add(&metrics->buckets[metrics_bucket(per)], records);
+    metrics_add(&metrics->samples, records);
+    metrics_add(&metrics->total_ns, ns);
+    if (per > atomic_load_explicit(&metrics->max_ns, memory_order_relaxed)) {
+        atomic_store_explicit(&metrics->max_ns, per, memory_order_relaxed);
+    }
+}
+
+/**
+ * @brief Charge an allocation to the calling thread's stage, if any
+ *
+ * @param bytes Size of the allocation
+ *
+ * @note Called by the host (queues, record batches, stage buffers); memory
+ *       a plugin allocates with malloc directly is not seen
+ */
+static inline void metrics_count_alloc(size_t bytes) {
+    stage_metrics_t* m = metrics_thread_stage;
+    if (m) {
+        metrics_add(&m->allocs, 1);
+        metrics_add(&m->alloc_bytes, bytes);
+    }
+}
+
+/* Record the bytes a stage holds between records, keeping the peak */
+static inline void metrics_set_held(stage_metrics_t* metrics, uint64_t bytes) {
+    atomic_store_explicit(&metrics->held_bytes, bytes, memory_order_relaxed);
+    if (bytes > atomic_load_explicit(&metrics->peak_held_bytes, memory_order_relaxed)) {
+        atomic_store_explicit(&metrics->peak_held_bytes, bytes, memory_order_relaxed);
+    }
+}
+
+/* Store the calling thread's CPU time; the writer thread calls this */
+static inline void metrics_update_cpu(stage_metrics_t* metrics) {
+    struct timespec ts;
+    if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) == 0) {
+        atomic_store_explicit(&metrics->cpu_ns,
+                              (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec,
+                              memory_order_relaxed);
+    }
+}
+
+/**
+ * @brief Sample thread CPU time if METRICS_CPU_SAMPLE_NS have passed
+ *
+ * @param metrics Stage metrics (writer thread only)
+ * @param now Current metrics_now_ns() time
+ */
+static inline void metrics_sample_cpu(stage_metrics_t* metrics, uint64_t now) {
+    if (now - metrics->cpu_sampled_ns < METRICS_CPU_SAMPLE_NS) return;
+    metrics->cpu_sampled_ns = now;
+    metrics_update_cpu(metrics);
+}
+
+/**
+ * @brief Record a latency shared by a group of records
+ *
+ * @param hist Histogram (one writer thread only)
+ * @param ns Latency of each record in the group
+ * @param records Records in the group
+ */
+static inline void metrics_histogram_record(metrics_histogram_t* hist, uint64_t ns, uint64_t records) {
+    if (records == 0) return;
+    metrics_add(&hist->buckets[metrics_bucket(ns)], records);
+    metrics_add(&hist->samples, records);
+    metrics_add(&hist->total_ns, ns * records);
+    if (ns > atomic_load_explicit(&hist->max_ns, memory_order_relaxed)) {
+        atomic_store_explicit(&hist->max_ns, ns, memory_order_relaxed);
+    }
+}
+
+/**
+ * @brief Latency at a quantile
+ *
+ * @param hist Histogram
+ * @param q Quantile in [0, 1]
+ * @return Upper bound of the bucket holding the quantile, in ns (0 if empty)
+ */
+uint64_t metrics_histogram_quantile(const metrics_histogram_t* hist, double q);
+
+/**
+ * @brief Service time at a quantile
+ *
+ * @param metrics Stage metrics
+ * @param q Quantile in [0, 1], e.g. 0.99
+ * @return Upper bound of the bucket holding the quantile, in ns (0 if empty)
+ */
+uint64_t stage_metrics_quantile(const stage_metrics_t* metrics, double q);
+
+/**
+ * @brief Print one row per stage
+ *
+ * Rows show counters, service-time percentiles and residence-time
+ * (res_*) percentiles.
+ *
+ * @param out Output stream
+ * @param stages Stage metrics
+ * @param count Number of stages
+ * @param elapsed_s Seconds since the pipeline started, for rates
+ */
+void metrics_print(FILE* out, stage_metrics_t* const* stages, size_t count, double elapsed_s);
+
+/**
+ * @brief Print end-to-end latency percentiles on one line
+ *
+ * @param out Output stream
+ * @param hist Ingest-to-output latency (NULL or empty prints nothing)
+ */
+void metrics_print_end_to_end(FILE* out, const metrics_histogram_t* hist);
+
+/**
+ * @brief Split a stage's elapsed time into CPU and blocked shares
+ *
+ * @param metrics Stage metrics; blocked times come from its queues
+ * @param elapsed_ns Wall time the stage has been running
+ * @param util Output fractions (all 0 if elapsed_ns is 0)
+ *
+ * @note Each queue is assumed to have one producer and one consumer, as
+ *       in a linear pipeline
+ */
+void metrics_utilization(const stage_metrics_t* metrics, uint64_t elapsed_ns,
+                         metrics_utilization_t* util);
+
+/**
+ * @brief Print utilization per stage and the bottleneck analysis
+ *
+ * The critical stage is the one with the highest CPU utilization. The
+ * projected speedup from running two copies of it is bounded by the next
+ * busiest stage and by the CPUs available to the whole pipeline. Adjacent
+ * stages that are together below METRICS_FUSE_UTILIZATION are listed as
+ * fuse candidates.
+ *
+ * @param out Output stream
+ * @param stages Stage metrics, in pipeline order
+ * @param count Number of stages
+ * @param elapsed_ns Wall time since the pipeline started
+ */
+void metrics_print_bottleneck(FILE* out, stage_metrics_t* const* stages, size_t count,
+                              uint64_t elapsed_ns);
+
+/**
+ * @brief Print per-stage memory and process heap statistics
+ *
+ * Rows show bytes in flight in the stage's input queue and their peak,
+ * bytes the stage holds between records and their peak, and allocation
+ * counts and bytes. A final line shows the heap from mallinfo2, where
+ * free bytes inside the arenas indicate fragmentation.
+ *
+ * @param out Output stream
+ * @param stages Stage metrics
+ * @param count Number of stages
+ */
+void metrics_print_memory(FILE* out, stage_metrics_t* const* stages, size_t count);
+
+/**
+ * @brief Write current metrics in Prometheus text exposition format
+ *
+ * Queue depth, capacity, bytes and wait times (labelled with the stage
+ * that consumes the queue), stage counters and memory, and service,
+ * residence and end-to-end latency histograms with bounds from 1 us to
+ * 1 s. Only relaxed atomic loads are used, so writers are never blocked.
+ *
+ * @param out Output stream
+ * @param stages Stage metrics
+ * @param count Number of stages
+ * @param end_to_end Ingest-to-output latency, or NULL
+ */
+void metrics_write_prometheus(FILE* out, stage_metrics_t* const* stages, size_t count,
+                              const metrics_histogram_t* end_to_end);
+
+/* Background reporter: dumps on SIGUSR1 and when stopped */
+typedef struct metrics_reporter {
+    stage_metrics_t* const* stages;
+    size_t count;
+    const metrics_histogram_t* end_to_end;  /* Ingest-to-output latency, or NULL */
+    const char* path;                /* Report file, or NULL for stderr */
+    uint64_t start_ns;
+    pthread_t thread;
+    volatile int stopping;
+    int started;
+} metrics_reporter_t;
+
+/**
+ * @brief Block SIGUSR1 in the calling thread and start the reporter
+ *
+ * @param reporter Reporter to initialize
+ * @param stages Stage metrics to report (array must outlive the reporter)
+ * @param count Number of stages
+ * @param end_to_end Ingest-to-output latency to report, or NULL
+ * @param path File to append reports to, or NULL for stderr
+ * @return 0 on success, -1 on error (sets errno)
+ *
+ * @note Call before starting other threads so they inherit the blocked
+ *       signal and SIGUSR1 is always taken by the reporter
+ */
+int metrics_reporter_start(metrics_reporter_t* reporter, stage_metrics_t* const* stages,
+                           size_t count, const metrics_histogram_t* end_to_end,
+                           const char* path);
+
+/**
+ * @brief Write the final report and stop the reporter thread
+ *
+ * @param reporter Started reporter
+ *
+ * @note The reporter thread writes the final report, after any SIGUSR1
+ *       dump it is in the middle of, so the two never interleave
+ */
+void metrics_reporter_stop(metrics_reporter_t* reporter);
+
+#endif /* METRICS_H */
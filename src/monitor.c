@@ -5,8 +5,120 @@
 
 #include "monitor.h"
 #include <errno.h>
+#include <stdatomic.h>
+#include <stdlib.h>
 #include <string.h>
 
+/*
+ * Lock profiling. Each monitor keeps its own counters, written only while
+ * its mutex is held; monitor_destroy folds them into a table keyed by the
+ * monitor's name, which monitor_profile_report prints.
+ */
+static atomic_int monitor_profiling;
+
+typedef struct {
+    char name[MONITOR_NAME_MAX];
+    size_t locks;                /* Monitors folded into this entry */
+    monitor_lock_stats_t stats;
+} monitor_profile_entry_t;
+
+static pthread_mutex_t monitor_profile_mutex = PTHREAD_MUTEX_INITIALIZER;
+static monitor_profile_entry_t monitor_profile_table[MONITOR_PROFILE_MAX];
+static size_t monitor_profile_count;
+
+static uint64_t monitor_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static int monitor_profile_on(void) {
+    return atomic_load_explicit(&monitor_profiling, memory_order_relaxed);
+}
+
+/* Called with the mutex just acquired */
+static void monitor_profile_acquired(monitor_t* monitor, uint64_t now, uint64_t waited) {
+    monitor_lock_stats_t* stats = &monitor->stats;
+    stats->acquisitions++;
+    if (waited) {
+        stats->contended++;
+        stats->wait_ns += waited;
+        if (waited > stats->max_wait_ns) stats->max_wait_ns = waited;
+    }
+    monitor->acquired_ns = now;
+}
+
+/* Called with the mutex about to be released */
+static void monitor_profile_release(monitor_t* monitor) {
+    if (!monitor->acquired_ns) return;
+    uint64_t held = monitor_now_ns() - monitor->acquired_ns;
+    monitor_lock_stats_t* stats = &monitor->stats;
+    stats->hold_ns += held;
+    if (held > stats->max_hold_ns) stats->max_hold_ns = held;
+    monitor->acquired_ns = 0;
+}
+
+/* Fold a monitor's counters into the table under its name */
+static void monitor_profile_fold(const monitor_t* monitor) {
+    const char* name = monitor->name[0] ? monitor->name : "(unnamed)";
+
+    pthread_mutex_lock(&monitor_profile_mutex);
+    monitor_profile_entry_t* entry = NULL;
+    for (size_t i = 0; i < monitor_profile_count && !entry; i++) {
+        if (strcmp(monitor_profile_table[i].name, name) == 0) {
+            entry = &monitor_profile_table[i];
+        }
+    }
+    if (!entry) {
+        /* The last slot collects every name that did not fit */
+        size_t i = monitor_profile_count < MONITOR_PROFILE_MAX ? monitor_profile_count++
+                                                               : MONITOR_PROFILE_MAX - 1;
+        entry = &monitor_profile_table[i];
+        if (!entry->locks) {
+            snprintf(entry->name, sizeof(entry->name), "%s",
+                     i == MONITOR_PROFILE_MAX - 1 ? "(other)" : name);
+        }
+    }
+
+    const monitor_lock_stats_t* stats = &monitor->stats;
+    entry->locks++;
+    entry->stats.acquisitions += stats->acquisitions;
+    entry->stats.contended += stats->contended;
+    entry->stats.wait_ns += stats->wait_ns;
+    entry->stats.hold_ns += stats->hold_ns;
+    if (stats->max_wait_ns > entry->stats.max_wait_ns) entry->stats.max_wait_ns = stats->max_wait_ns;
+    if (stats->max_hold_ns > entry->stats.max_hold_ns) entry->stats.max_hold_ns = stats->max_hold_ns;
+    pthread_mutex_unlock(&monitor_profile_mutex);
+}
+
+/*
+ * Wait on cond, which releases the mutex: the hold ends before the wait
+ * and a new one starts on wake-up. Returns the pthread result.
+ */
+static int monitor_block(monitor_t* monitor, pthread_cond_t* cond,
+                         const struct timespec* abstime) {
+    int profiled = monitor->acquired_ns != 0;
+    if (profiled) monitor_profile_release(monitor);
+    int ret = abstime ? pthread_cond_timedwait(cond, &monitor->mutex, abstime)
+                      : pthread_cond_wait(cond, &monitor->mutex);
+    if (profiled) monitor->acquired_ns = monitor_now_ns();
+    return ret;
+}
+
+/* Condition variable whose timed waits use CLOCK_MONOTONIC */
+static int monitor_cond_create(pthread_cond_t* cond) {
+    pthread_condattr_t attr;
+    int ret = pthread_condattr_init(&attr);
+    if (ret == 0) {
+        ret = pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+        if (ret == 0) {
+            ret = pthread_cond_init(cond, &attr);
+        }
+        pthread_condattr_destroy(&attr);
+    }
+    return ret;
+}
+
 /**
  * Initialize a monitor
  */
@@ -25,8 +137,10 @@ int monitor_init(monitor_t* monitor) {
     }
     
     /* Initialize condition variable */
-    if (pthread_cond_init(&monitor->condition, NULL) != 0) {
+    int ret = monitor_cond_create(&monitor->condition);
+    if (ret != 0) {
         pthread_mutex_destroy(&monitor->mutex);
+        errno = ret;
         return -1;
     }
     
@@ -42,6 +156,9 @@ void monitor_destroy(monitor_t* monitor) {
         return;
     }
     
+    if (monitor->stats.acquisitions) {
+        monitor_profile_fold(monitor);
+    }
     pthread_cond_destroy(&monitor->condition);
     pthread_mutex_destroy(&monitor->mutex);
     monitor->initialized = 0;
@@ -56,12 +173,28 @@ int monitor_enter(monitor_t* monitor) {
         return -1;
     }
     
+    if (!monitor_profile_on()) {
+        int ret = pthread_mutex_lock(&monitor->mutex);
+        if (ret != 0) {
+            errno = ret;
+            return -1;
+        }
+        return 0;
+    }
+    
+    /* Profiling: an uncontended acquisition costs a trylock and one clock read */
+    if (pthread_mutex_trylock(&monitor->mutex) == 0) {
+        monitor_profile_acquired(monitor, monitor_now_ns(), 0);
+        return 0;
+    }
+    uint64_t start = monitor_now_ns();
     int ret = pthread_mutex_lock(&monitor->mutex);
     if (ret != 0) {
         errno = ret;
         return -1;
     }
-    
+    uint64_t now = monitor_now_ns();
+    monitor_profile_acquired(monitor, now, now > start ? now - start : 1);
     return 0;
 }
 
@@ -74,6 +207,7 @@ int monitor_exit(monitor_t* monitor) {
         return -1;
     }
     
+    monitor_profile_release(monitor);
     int ret = pthread_mutex_unlock(&monitor->mutex);
     if (ret != 0) {
         errno = ret;
@@ -92,7 +226,7 @@ int monitor_wait(monitor_t* monitor) {
         return -1;
     }
     
-    int ret = pthread_cond_wait(&monitor->condition, &monitor->mutex);
+    int ret = monitor_block(monitor, &monitor->condition, NULL);
     if (ret != 0) {
         errno = ret;
         return -1;
@@ -110,7 +244,7 @@ int monitor_wait_timeout(monitor_t* monitor, const struct timespec* abstime) {
         return -1;
     }
     
-    int ret = pthread_cond_timedwait(&monitor->condition, &monitor->mutex, abstime);
+    int ret = monitor_block(monitor, &monitor->condition, abstime);
     if (ret == ETIMEDOUT) {
         return ETIMEDOUT;
     } else if (ret != 0) {
@@ -121,6 +255,16 @@ int monitor_wait_timeout(monitor_t* monitor, const struct timespec* abstime) {
     return 0;
 }
 
+/**
+ * Compute the deadline for a relative timeout
+ */
+void monitor_deadline(struct timespec* deadline, uint64_t timeout_us) {
+    clock_gettime(CLOCK_MONOTONIC, deadline);
+    uint64_t nsec = (uint64_t)deadline->tv_nsec + (timeout_us % 1000000) * 1000;
+    deadline->tv_sec += (time_t)(timeout_us / 1000000 + nsec / 1000000000);
+    deadline->tv_nsec = (long)(nsec % 1000000000);
+}
+
 /**
  * Wait for a predicate to become true
  */
@@ -132,7 +276,7 @@ int monitor_wait_for(monitor_t* monitor, monitor_predicate_t predicate, void* ar
     
     /* Loop to handle spurious wakeups */
     while (!predicate(arg)) {
-        int ret = pthread_cond_wait(&monitor->condition, &monitor->mutex);
+        int ret = monitor_block(monitor, &monitor->condition, NULL);
         if (ret != 0) {
             errno = ret;
             return -1;
@@ -195,5 +339,188 @@ int monitor_try_enter(monitor_t* monitor) {
         return -1;
     }
     
+    if (monitor_profile_on()) {
+        monitor_profile_acquired(monitor, monitor_now_ns(), 0);
+    }
+    return 0;
+}
+
+/**
+ * Initialize a named condition on a monitor
+ */
+int monitor_cond_init(monitor_cond_t* cond, monitor_t* monitor, const char* name) {
+    if (!cond || !monitor || !monitor->initialized) {
+        errno = EINVAL;
+        return -1;
+    }
+    
+    memset(cond, 0, sizeof(monitor_cond_t));
+    
+    int ret = monitor_cond_create(&cond->cond);
+    if (ret != 0) {
+        errno = ret;
+        return -1;
+    }
+    
+    cond->monitor = monitor;
+    cond->name = name;
+    cond->initialized = 1;
+    return 0;
+}
+
+/**
+ * Destroy a named condition
+ */
+void monitor_cond_destroy(monitor_cond_t* cond) {
+    if (!cond || !cond->initialized) {
+        return;
+    }
+    
+    pthread_cond_destroy(&cond->cond);
+    cond->initialized = 0;
+}
+
+/**
+ * Wait on a named condition
+ */
+int monitor_cond_wait(monitor_cond_t* cond) {
+    if (!cond || !cond->initialized) {
+        errno = EINVAL;
+        return -1;
+    }
+    
+    int ret = monitor_block(cond->monitor, &cond->cond, NULL);
+    if (ret != 0) {
+        errno = ret;
+        return -1;
+    }
+    
+    return 0;
+}
+
+/**
+ * Wait on a named condition for a predicate to become true
+ */
+int monitor_cond_wait_for(monitor_cond_t* cond, monitor_predicate_t predicate, void* arg) {
+    if (!cond || !cond->initialized || !predicate) {
+        errno = EINVAL;
+        return -1;
+    }
+    
+    /* Loop to handle spurious wakeups */
+    while (!predicate(arg)) {
+        int ret = monitor_block(cond->monitor, &cond->cond, NULL);
+        if (ret != 0) {
+            errno = ret;
+            return -1;
+        }
+    }
+    
+    return 0;
+}
+
+/**
+ * Wait on a named condition with timeout
+ */
+int monitor_cond_wait_timeout(monitor_cond_t* cond, const struct timespec* abstime) {
+    if (!cond || !cond->initialized || !abstime) {
+        errno = EINVAL;
+        return -1;
+    }
+    
+    int ret = monitor_block(cond->monitor, &cond->cond, abstime);
+    if (ret == ETIMEDOUT) {
+        return ETIMEDOUT;
+    } else if (ret != 0) {
+        errno = ret;
+        return -1;
+    }
+    
+    return 0;
+}
+
+/**
+ * Signal one thread waiting on a named condition
+ */
+int monitor_cond_signal(monitor_cond_t* cond) {
+    if (!cond || !cond->initialized) {
+        errno = EINVAL;
+        return -1;
+    }
+    
+    int ret = pthread_cond_signal(&cond->cond);
+    if (ret != 0) {
+        errno = ret;
+        return -1;
+    }
+    
+    return 0;
+}
+
+/**
+ * Broadcast to all threads waiting on a named condition
+ */
+int monitor_cond_broadcast(monitor_cond_t* cond) {
+    if (!cond || !cond->initialized) {
+        errno = EINVAL;
+        return -1;
+    }
+    
+    int ret = pthread_cond_broadcast(&cond->cond);
+    if (ret != 0) {
+        errno = ret;
+        return -1;
+    }
+    
+    return 0;
+}
+
+/**
+ * Name a monitor for the lock profile
+ */
+void monitor_set_name(monitor_t* monitor, const char* name) {
+    if (monitor) {
+        snprintf(monitor->name, sizeof(monitor->name), "%s", name ? name : "");
+    }
+}
+
+/**
+ * Turn lock profiling on or off for every monitor
+ */
+void monitor_profile_enable(int enabled) {
+    atomic_store_explicit(&monitor_profiling, enabled != 0, memory_order_relaxed);
+}
+
+/* Most contended first: total wait, then acquisitions */
+static int monitor_profile_compare(const void* a, const void* b) {
+    const monitor_lock_stats_t* x = &((const monitor_profile_entry_t*)a)->stats;
+    const monitor_lock_stats_t* y = &((const monitor_profile_entry_t*)b)->stats;
+    if (x->wait_ns != y->wait_ns) return x->wait_ns < y->wait_ns ? 1 : -1;
+    if (x->acquisitions != y->acquisitions) return x->acquisitions < y->acquisitions ? 1 : -1;
     return 0;
-}
\ No newline at end of file
+}
+
+/**
+ * Print the lock profile of every destroyed monitor, by name
+ */
+void monitor_profile_report(FILE* out) {
+    pthread_mutex_lock(&monitor_profile_mutex);
+    qsort(monitor_profile_table, monitor_profile_count, sizeof(monitor_profile_entry_t),
+          monitor_profile_compare);
+
+    fprintf(out, "lock profile (%zu names):\n", monitor_profile_count);
+    fprintf(out, "%-20s %5s %12s %10s %7s %10s %11s %10s %11s\n", "lock", "locks",
+            "acquired", "contended", "cont%", "wait_ms", "max_wait_us", "hold_ms", "max_hold_us");
+    for (size_t i = 0; i < monitor_profile_count; i++) {
+        const monitor_profile_entry_t* entry = &monitor_profile_table[i];
+        const monitor_lock_stats_t* stats = &entry->stats;
+        fprintf(out, "%-20s %5zu %12llu %10llu %7.2f %10.3f %11.1f %10.3f %11.1f\n",
+                entry->name, entry->locks,
+                (unsigned long long)stats->acquisitions,
+                (unsigned long long)stats->contended,
+                stats->acquisitions ? 100.0 * stats->contended / stats->acquisitions : 0.0,
+                stats->wait_ns / 1e6, stats->max_wait_ns / 1e3,
+                stats->hold_ns / 1e6, stats->max_hold_ns / 1e3);
+    }
+    pthread_mutex_unlock(&monitor_profile_mutex);
+}
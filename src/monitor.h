@@ -7,8 +7,17 @@
  * - Mutual exclusion for critical sections
  * - Condition waiting with automatic mutex handling
  * - Signal and broadcast operations
- * - Timeout support for condition waits
+ * - Timeout support for condition waits, against CLOCK_MONOTONIC so
+ *   wall-clock steps (NTP, settimeofday) neither stretch nor cut them short
  * - Predicate-based waiting to handle spurious wakeups
+ * - Opt-in lock profiling (monitor_profile_enable), a built-in mutrace:
+ *   per-lock acquisitions, contended acquisitions, wait time and hold
+ *   time, reported by monitor name once the monitors are destroyed.
+ *   Profiled locks try the mutex first, so an uncontended acquisition
+ *   costs a trylock and a clock read; unprofiled ones are unchanged
+ * - Any number of named condition objects (monitor_cond_t) sharing the
+ *   monitor's mutex, so threads waiting for different predicates are
+ *   woken separately instead of all at once by a broadcast
  * 
  * Thread Safety: All operations are thread-safe
  * Memory Management: User is responsible for monitor lifetime management
@@ -18,15 +27,44 @@
 #define MONITOR_H
 
 #include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
 #include <time.h>
 
+/* Longest monitor name kept, including the terminator */
+#define MONITOR_NAME_MAX 32
+
+/* Distinct names the lock profile tracks; the rest share one row */
+#define MONITOR_PROFILE_MAX 64
+
+/* Lock profile counters, written only while the mutex is held */
+typedef struct monitor_lock_stats {
+    uint64_t acquisitions;      /* Times the mutex was taken */
+    uint64_t contended;         /* ... of which had to wait for it */
+    uint64_t wait_ns;           /* Time spent waiting for the mutex */
+    uint64_t max_wait_ns;
+    uint64_t hold_ns;           /* Time the mutex was held (not counting cond waits) */
+    uint64_t max_hold_ns;
+} monitor_lock_stats_t;
+
 /* Monitor structure - opaque to users */
 typedef struct monitor {
     pthread_mutex_t mutex;      /* Mutex for mutual exclusion */
     pthread_cond_t condition;   /* Condition variable for waiting */
     int initialized;            /* Flag to track initialization */
+    char name[MONITOR_NAME_MAX];/* For the lock profile; "" if unnamed */
+    uint64_t acquired_ns;       /* When the profiled holder took the mutex */
+    monitor_lock_stats_t stats; /* Lock profile while profiling is on */
 } monitor_t;
 
+/* Named condition variable sharing a monitor's mutex */
+typedef struct monitor_cond {
+    pthread_cond_t cond;        /* Condition variable for waiting */
+    monitor_t* monitor;         /* Monitor whose mutex waiters hold */
+    const char* name;           /* For diagnostics (not copied) */
+    int initialized;            /* Flag to track initialization */
+} monitor_cond_t;
+
 /* Predicate function type for condition checking */
 typedef int (*monitor_predicate_t)(void* arg);
 
@@ -87,14 +125,21 @@ int monitor_wait(monitor_t* monitor);
  * @brief Wait on the monitor's condition with timeout
  * 
  * @param monitor Pointer to the monitor
- * @param abstime Absolute time to wait until
+ * @param abstime Absolute CLOCK_MONOTONIC time to wait until (see monitor_deadline)
  * @return 0 if signaled, ETIMEDOUT if timed out, -1 on error
  * 
- * @note Uses CLOCK_REALTIME for timeout
  * @note Must be called between monitor_enter and monitor_exit
  */
 int monitor_wait_timeout(monitor_t* monitor, const struct timespec* abstime);
 
+/**
+ * @brief Compute the deadline for a relative timeout
+ * 
+ * @param deadline Output: CLOCK_MONOTONIC now plus timeout_us
+ * @param timeout_us Microseconds from now
+ */
+void monitor_deadline(struct timespec* deadline, uint64_t timeout_us);
+
 /**
  * @brief Wait for a predicate to become true
  * 
@@ -143,4 +188,111 @@ int monitor_broadcast(monitor_t* monitor);
  */
 int monitor_try_enter(monitor_t* monitor);
 
+/**
+ * @brief Name a monitor for the lock profile
+ * 
+ * @param monitor Pointer to an initialized monitor
+ * @param name Name (copied, truncated to MONITOR_NAME_MAX - 1), or NULL
+ * 
+ * @note Monitors with the same name are reported together
+ */
+void monitor_set_name(monitor_t* monitor, const char* name);
+
+/**
+ * @brief Turn lock profiling on or off for every monitor
+ * 
+ * @param enabled Nonzero to profile
+ * 
+ * @note Enable before the monitors of interest are first entered
+ */
+void monitor_profile_enable(int enabled);
+
+/**
+ * @brief Print the lock profile of every destroyed monitor, by name
+ * 
+ * @param out Stream to write to
+ * 
+ * @note Sorted by total wait time; call after the monitors are destroyed
+ *       (e.g. after pipeline_destroy) so their counters are included
+ */
+void monitor_profile_report(FILE* out);
+
+/**
+ * @brief Initialize a named condition on a monitor
+ * 
+ * @param cond Pointer to condition structure to initialize
+ * @param monitor Initialized monitor whose mutex guards the condition
+ * @param name Name for diagnostics (must outlive the condition), or NULL
+ * @return 0 on success, -1 on error (sets errno)
+ * 
+ * @note Destroy with monitor_cond_destroy before the monitor
+ */
+int monitor_cond_init(monitor_cond_t* cond, monitor_t* monitor, const char* name);
+
+/**
+ * @brief Destroy a named condition
+ * 
+ * @param cond Pointer to condition to destroy
+ * 
+ * @note Behavior is undefined if threads are still waiting on it
+ */
+void monitor_cond_destroy(monitor_cond_t* cond);
+
+/**
+ * @brief Wait on a named condition
+ * 
+ * @param cond Pointer to the condition
+ * @return 0 on success, -1 on error
+ * 
+ * @note Must be called between monitor_enter and monitor_exit on its monitor
+ * @note Should be called in a loop to handle spurious wakeups
+ */
+int monitor_cond_wait(monitor_cond_t* cond);
+
+/**
+ * @brief Wait on a named condition for a predicate to become true
+ * 
+ * @param cond Pointer to the condition
+ * @param predicate Function to check condition
+ * @param arg Argument to pass to predicate function
+ * @return 0 when predicate is true, -1 on error
+ * 
+ * @note Handles spurious wakeups automatically
+ * @note Must be called between monitor_enter and monitor_exit on its monitor
+ */
+int monitor_cond_wait_for(monitor_cond_t* cond, monitor_predicate_t predicate, void* arg);
+
+/**
+ * @brief Wait on a named condition with timeout
+ * 
+ * @param cond Pointer to the condition
+ * @param abstime Absolute CLOCK_MONOTONIC time to wait until (see monitor_deadline)
+ * @return 0 if signaled, ETIMEDOUT if timed out, -1 on error
+ * 
+ * @note Must be called between monitor_enter and monitor_exit on its monitor
+ */
+int monitor_cond_wait_timeout(monitor_cond_t* cond, const struct timespec* abstime);
+
+/**
+ * @brief Signal one thread waiting on a named condition
+ * 
+ * @param cond Pointer to the condition
+ * @return 0 on success, -1 on error
+ * 
+ * @note Threads waiting on the monitor's other conditions are not woken
+ * @note Can be called inside or outside the monitor
+ */
+int monitor_cond_signal(monitor_cond_t* cond);
+
+/**
+ * @brief Broadcast to all threads waiting on a named condition
+ * 
+ * @param cond Pointer to the condition
+ * @return 0 on success, -1 on error
+ * 
+ * @note Threads waiting on the monitor's other conditions are not woken
+ * @note Can be called inside or outside the monitor
+ */
+int monitor_cond_broadcast(monitor_cond_t* cond);
+
 #endif /* MONITOR_H */
\ No newline at end of file
@@ -0,0 +1,539 @@
+/**
+ * @file pipeline.c
+ * @brief Implementation of pipeline management
+ */
+
+#include "pipeline.h"
+#include "builtins.h"
+#include "isolate.h"
+#include "plugin_config.h"
+#include <dlfcn.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Validate the ABI v2 description. Plugins built against a newer ABI than
+ * this host understands are rejected rather than trusted.
+ */
+static int check_plugin_info(pipeline_stage_t* stage) {
+    stage->info = stage->interface.info ? stage->interface.info() : NULL;
+
+    if (stage->info && stage->info->abi_version > PLUGIN_ABI_VERSION) {
+        fprintf(stderr, "Plugin %s requires plugin ABI v%u (host supports v%d)\n",
+                stage->plugin_path, stage->info->abi_version, PLUGIN_ABI_VERSION);
+        return -1;
+    }
+    if (stage->info && (stage->info->flags & PLUGIN_CAP_BYTE_MAP) &&
+        !stage->info->byte_map) {
+        fprintf(stderr, "Plugin %s declares a byte map but provides none\n", stage->plugin_path);
+        return -1;
+    }
+    if (stage->interface.transform && !stage->info) {
+        fprintf(stderr, "Plugin %s exports plugin_transform without plugin_info\n",
+                stage->plugin_path);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * Load a plugin
+ */
+int pipeline_load_plugin(pipeline_stage_t* stage, const char* plugin_spec) {
+    if (!stage || !plugin_spec) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    /* Split "path[:config]" (see plugin_config_split) */
+    stage->plugin_path = strdup(plugin_spec);
+    if (!stage->plugin_path) {
+        fprintf(stderr, "Out of memory loading plugin %s\n", plugin_spec);
+        return -1;
+    }
+    char* colon = (char*)plugin_config_split(stage->plugin_path);
+    if (colon) {
+        *colon = '\0';
+        stage->config = colon + 1;
+    }
+
+    /* A pair the plugin would silently ignore is almost always a value
+     * with an unescaped ',' */
+    const char* bad;
+    size_t bad_len;
+    if (plugin_config_check(stage->config, &bad, &bad_len) != 0) {
+        fprintf(stderr, "Plugin %s: config item '%.*s' is not key=value "
+                "(write \\, for a comma inside a value)\n",
+                stage->plugin_path, (int)bad_len, bad);
+        return -1;
+    }
+
+    /* A bare name selects a plugin linked into the binary */
+    plugin_interface_t* api = &stage->interface;
+    const char* path = stage->plugin_path;
+    const plugin_builtin_t* builtin = strchr(path, '/') ? NULL : plugin_builtin_find(path);
+    if (builtin) {
+        api->info = builtin->info;
+        api->open = builtin->open;
+        api->close = builtin->close;
+        api->transform = builtin->transform;
+        api->transform_batch = builtin->transform_batch;
+        api->control = builtin->control;
+        return check_plugin_info(stage);
+    }
+
+    stage->handle = dlopen(path, RTLD_LAZY);
+    if (!stage->handle) {
+        fprintf(stderr, "Failed to load plugin %s: %s\n", path, dlerror());
+        return -1;
+    }
+
+    api->info = dlsym(stage->handle, "plugin_info");
+    api->transform = dlsym(stage->handle, "plugin_transform");
+    api->transform_batch = dlsym(stage->handle, "plugin_transform_batch");
+    api->control = dlsym(stage->handle, "plugin_control");
+    api->open = dlsym(stage->handle, "plugin_open");
+    api->close = dlsym(stage->handle, "plugin_close");
+    api->create = dlsym(stage->handle, "plugin_create");
+    api->destroy = dlsym(stage->handle, "plugin_destroy");
+    api->request_stop = dlsym(stage->handle, "plugin_request_stop");
+    api->name = dlsym(stage->handle, "plugin_name");
+
+    if (!api->transform && (!api->create || !api->destroy)) {
+        fprintf(stderr, "Plugin %s missing required functions\n", path);
+        return -1;
+    }
+    return check_plugin_info(stage);
+}
+
+/*
+ * Transform of a fused run of byte-map stages; ctx is the composed map.
+ * Fusion requires IN_PLACE and LENGTH_PRESERVING, so the stage passes
+ * out == in for batches and may alias the input for single records.
+ */
+static int fused_transform(plugin_ctx_t* ctx, const char* in, size_t len,
+                           plugin_buf_t* out) {
+    const unsigned char* map = (const unsigned char*)ctx;
+    if (plugin_buf_reserve(out, len) != PLUGIN_SUCCESS) return PLUGIN_NO_MEMORY;
+
+    for (size_t i = 0; i < len; i++) {
+        out->data[i] = (char)map[(unsigned char)in[i]];
+    }
+    out->len = len;
+    return PLUGIN_EMIT;
+}
+
+static int fused_transform_batch(plugin_ctx_t* ctx, record_batch_t* in,
+                                 record_batch_t* out) {
+    const unsigned char* map = (const unsigned char*)ctx;
+    if (out != in && record_batch_copy(out, in) != 0) {
+        return PLUGIN_NO_MEMORY;
+    }
+    /* The map keeps NUL, so the whole arena goes through it in one pass */
+    for (size_t i = 0; i < out->size; i++) {
+        out->data[i] = (char)map[(unsigned char)out->data[i]];
+    }
+    return PLUGIN_SUCCESS;
+}
+
+/* The stage's whole effect is its byte map, and the host runs it in-process */
+static int stage_fusable(const pipeline_stage_t* stage) {
+    const uint32_t caps = PLUGIN_CAP_BYTE_MAP | PLUGIN_CAP_STATELESS | PLUGIN_CAP_ONE_TO_ONE |
+                          PLUGIN_CAP_IN_PLACE | PLUGIN_CAP_LENGTH_PRESERVING;
+    return stage->interface.transform && !stage->interface.open &&
+           !stage->interface.control && !stage->isolated &&
+           plugin_has_caps(stage->info, caps) && stage->info->byte_map[0] == 0;
+}
+
+/**
+ * Fuse runs of adjacent byte-map stages
+ */
+int pipeline_fuse_stages(pipeline_t* pipeline) {
+    if (!pipeline || !pipeline->stages || pipeline->running) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    int absorbed = 0;
+    for (int i = 0; i < pipeline->stage_count; i++) {
+        pipeline_stage_t* head = &pipeline->stages[i];
+        int end = i + 1;
+        if (head->absorbed || head->fused_name[0] || !stage_fusable(head)) continue;
+        while (end < pipeline->stage_count && stage_fusable(&pipeline->stages[end])) end++;
+        if (end == i + 1) continue;
+
+        memcpy(head->byte_map, head->info->byte_map, sizeof(head->byte_map));
+        size_t used = (size_t)snprintf(head->fused_name, sizeof(head->fused_name), "%s",
+                                       pipeline_stage_name(head));
+        for (int j = i + 1; j < end; j++) {
+            pipeline_stage_t* next = &pipeline->stages[j];
+            for (int c = 0; c < 256; c++) {
+                head->byte_map[c] = next->info->byte_map[head->byte_map[c]];
+            }
+            if (used < sizeof(head->fused_name)) {
+                used += (size_t)snprintf(head->fused_name + used, sizeof(head->fused_name) - used,
+                                         "+%s", pipeline_stage_name(next));
+            }
+            next->absorbed = 1;
+            absorbed++;
+        }
+        head->output_queue = pipeline->stages[end - 1].output_queue;
+        i = end - 1;
+    }
+    return absorbed;
+}
+
+/*
+ * Start a loaded plugin. Transform plugins run in a host-owned stage;
+ * ABI v1 plugins start their own thread in plugin_create.
+ */
+static int start_stage(pipeline_stage_t* stage, shm_pool_t* pool) {
+    plugin_interface_t* api = &stage->interface;
+    const char* path = stage->plugin_path;
+
+    if (stage->absorbed) {
+        return 0;
+    }
+    if (!api->transform) {
+        if (stage->isolated) {
+            fprintf(stderr, "Plugin %s cannot be isolated: only transform plugins run in a child process\n", path);
+            return -1;
+        }
+        if (api->create(&stage->context, stage->config,
+                        stage->input_queue, stage->output_queue) != 0) {
+            fprintf(stderr, "Failed to create plugin %s\n", path);
+            return -1;
+        }
+        stage->started = 1;
+        return 0;
+    }
+
+    if (api->open && api->open(&stage->context, stage->config) != 0) {
+        fprintf(stderr, "Failed to open plugin %s\n", path);
+        return -1;
+    }
+    stage->hosted = 1;
+
+    /* A fused run applies its composed map instead of the plugin */
+    plugin_interface_t fused = *api;
+    plugin_ctx_t* ctx = stage->context;
+    if (stage->fused_name[0]) {
+        fused.transform = fused_transform;
+        fused.transform_batch = fused_transform_batch;
+        ctx = (plugin_ctx_t*)stage->byte_map;
+    }
+    if (stage_init(&stage->stage, stage->info, &fused, ctx,
+                   stage->input_queue, stage->output_queue) != 0) {
+        fprintf(stderr, "Failed to start stage for plugin %s\n", path);
+        return -1;
+    }
+    if (stage->fused_name[0]) {
+        stage->stage.name = stage->fused_name;
+    }
+    stage->stage.metrics = stage->metrics;
+    stage->stage.linger_us = stage->linger_us;
+    stage->stage.pool = pool;
+    if (stage->metrics) {
+        stage->metrics->input = stage->input_queue;
+        stage->metrics->output = stage->output_queue;
+    }
+    if ((stage->isolated && stage_isolate(&stage->stage, 0) != 0) ||
+        stage_start(&stage->stage) != 0) {
+        fprintf(stderr, "Failed to start stage for plugin %s\n", path);
+        return -1;
+    }
+    stage->started = 1;
+    return 0;
+}
+
+/* Join a running stage; the plugin stays loaded */
+static void stop_stage(pipeline_stage_t* stage) {
+    if (!stage->started) return;
+
+    if (stage->hosted) {
+        stage_request_stop(&stage->stage);
+        stage_join(&stage->stage);
+    } else {
+        if (stage->interface.request_stop) {
+            stage->interface.request_stop(stage->context);
+        }
+        stage->interface.destroy(stage->context);
+        stage->context = NULL;
+    }
+    stage->started = 0;
+}
+
+/**
+ * Unload a plugin
+ */
+void pipeline_unload_plugin(pipeline_stage_t* stage) {
+    if (!stage) return;
+
+    stop_stage(stage);
+    stage_join(&stage->stage);
+    if (stage->hosted && stage->interface.close) {
+        stage->interface.close(stage->context);
+    }
+    if (stage->handle) {
+        dlclose(stage->handle);
+    }
+    free(stage->plugin_path);
+    memset(stage, 0, sizeof(pipeline_stage_t));
+}
+
+/**
+ * Name of a stage's plugin, for messages
+ */
+const char* pipeline_stage_name(pipeline_stage_t* stage) {
+    if (stage->info && stage->info->name) {
+        return stage->info->name;
+    }
+    if (stage->started && stage->interface.name) {
+        return stage->interface.name(stage->context);
+    }
+    return stage->plugin_path ? stage->plugin_path : "unnamed";
+}
+
+/**
+ * Initialize a pipeline and load its plugins
+ */
+int pipeline_init(pipeline_t* pipeline, const char** plugin_specs,
+                  int plugin_count, size_t queue_capacity) {
+    if (!pipeline || !plugin_specs || plugin_count < 1 ||
+        plugin_count > MAX_PIPELINE_STAGES || queue_capacity == 0) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    memset(pipeline, 0, sizeof(pipeline_t));
+    pipeline->stages = calloc(plugin_count, sizeof(pipeline_stage_t));
+    pipeline->queues = calloc(plugin_count + 1, sizeof(queue_t));
+    if (!pipeline->stages || !pipeline->queues) {
+        free(pipeline->stages);
+        free(pipeline->queues);
+        errno = ENOMEM;
+        return -1;
+    }
+
+    /* Initialize queues */
+    int queues_ready = 0;
+    for (; queues_ready <= plugin_count; queues_ready++) {
+        if (queue_init(&pipeline->queues[queues_ready], queue_capacity) != 0) {
+            fprintf(stderr, "Failed to initialize queue %d\n", queues_ready);
+            break;
+        }
+    }
+
+    /* Load plugins */
+    int loaded = queues_ready == plugin_count + 1;
+    while (loaded && pipeline->stage_count < plugin_count) {
+        int i = pipeline->stage_count++;
+        pipeline_stage_t* stage = &pipeline->stages[i];
+        stage->input_queue = &pipeline->queues[i];
+        stage->output_queue = &pipeline->queues[i + 1];
+        loaded = pipeline_load_plugin(stage, plugin_specs[i]) == 0;
+        if (loaded) {
+            /* Queues are named after the stage that consumes them */
+            char name[MONITOR_NAME_MAX];
+            snprintf(name, sizeof(name), "queue>%s", pipeline_stage_name(stage));
+            queue_set_name(stage->input_queue, name);
+        }
+    }
+    if (loaded) {
+        queue_set_name(&pipeline->queues[plugin_count], "queue>output");
+    }
+    if (loaded) {
+        return 0;
+    }
+
+    /* Unwind whatever was set up */
+    for (int i = 0; i < pipeline->stage_count; i++) {
+        pipeline_unload_plugin(&pipeline->stages[i]);
+    }
+    for (int i = 0; i < queues_ready; i++) {
+        queue_destroy(&pipeline->queues[i]);
+    }
+    free(pipeline->stages);
+    free(pipeline->queues);
+    memset(pipeline, 0, sizeof(pipeline_t));
+    return -1;
+}
+
+/**
+ * Bound the bytes held by all of the pipeline's queues together
+ */
+int pipeline_set_budget(pipeline_t* pipeline, size_t bytes) {
+    if (!pipeline || !pipeline->queues || pipeline->running) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    mem_budget_t* budget = NULL;
+    if (bytes > 0) {
+        budget = malloc(sizeof(mem_budget_t));
+        if (!budget) {
+            errno = ENOMEM;
+            return -1;
+        }
+        if (mem_budget_init(budget, bytes) != 0) {
+            free(budget);
+            return -1;
+        }
+    }
+
+    for (int i = 0; i <= pipeline->stage_count; i++) {
+        queue_set_budget(&pipeline->queues[i], budget);
+    }
+    if (pipeline->budget) {
+        mem_budget_destroy(pipeline->budget);
+        free(pipeline->budget);
+    }
+    pipeline->budget = budget;
+    return 0;
+}
+
+/**
+ * Start the pipeline
+ */
+int pipeline_start(pipeline_t* pipeline) {
+    if (!pipeline || !pipeline->stages || pipeline->running) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    /* Mapped before any child is forked, so every child shares it */
+    for (int i = 0; i < pipeline->stage_count && !pipeline->pool; i++) {
+        if (pipeline->stages[i].isolated &&
+            !(pipeline->pool = shm_pool_create(ISOLATE_POOL_BYTES))) {
+            fprintf(stderr, "Failed to map the shared batch pool: %s\n", strerror(errno));
+            return -1;
+        }
+    }
+
+    for (int i = 0; i < pipeline->stage_count; i++) {
+        if (start_stage(&pipeline->stages[i], pipeline->pool) != 0) {
+            pipeline->running = 1;
+            pipeline_stop(pipeline);
+            return -1;
+        }
+    }
+
+    pipeline->running = 1;
+    return 0;
+}
+
+/**
+ * Stop the pipeline
+ */
+int pipeline_stop(pipeline_t* pipeline) {
+    if (!pipeline || !pipeline->running) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    /* Shut the queues so blocked stages return, then join them */
+    for (int i = 0; i <= pipeline->stage_count; i++) {
+        queue_shutdown(&pipeline->queues[i]);
+    }
+    for (int i = 0; i < pipeline->stage_count; i++) {
+        stop_stage(&pipeline->stages[i]);
+    }
+
+    pipeline->running = 0;
+    return 0;
+}
+
+/**
+ * Destroy a pipeline and free resources
+ */
+void pipeline_destroy(pipeline_t* pipeline) {
+    if (!pipeline || !pipeline->stages) return;
+
+    if (pipeline->running) {
+        pipeline_stop(pipeline);
+    }
+    for (int i = 0; i < pipeline->stage_count; i++) {
+        pipeline_unload_plugin(&pipeline->stages[i]);
+    }
+    for (int i = 0; i <= pipeline->stage_count; i++) {
+        queue_destroy(&pipeline->queues[i]);
+    }
+
+    /* Queues release their items' bytes as they are destroyed */
+    if (pipeline->budget) {
+        mem_budget_destroy(pipeline->budget);
+        free(pipeline->budget);
+    }
+    shm_pool_destroy(pipeline->pool);
+
+    free(pipeline->stages);
+    free(pipeline->queues);
+    memset(pipeline, 0, sizeof(pipeline_t));
+}
+
+/**
+ * Send a string into the pipeline
+ */
+int pipeline_send(pipeline_t* pipeline, const char* input) {
+    if (!pipeline || !pipeline->queues) {
+        errno = EINVAL;
+        return -1;
+    }
+    return queue_push(&pipeline->queues[0], input);
+}
+
+/**
+ * Send a batch of records into the pipeline
+ */
+int pipeline_send_batch(pipeline_t* pipeline, record_batch_t* batch) {
+    if (!pipeline || !pipeline->queues) {
+        record_batch_free(batch);
+        errno = EINVAL;
+        return -1;
+    }
+    return queue_push_batch(&pipeline->queues[0], batch);
+}
+
+/**
+ * Send a control marker into the pipeline
+ */
+int pipeline_send_marker(pipeline_t* pipeline, const queue_marker_t* marker) {
+    if (!pipeline || !pipeline->queues) {
+        errno = EINVAL;
+        return -1;
+    }
+    return queue_push_marker(&pipeline->queues[0], marker);
+}
+
+/**
+ * Signal end of input
+ */
+void pipeline_close_input(pipeline_t* pipeline) {
+    if (pipeline && pipeline->queues) {
+        queue_shutdown(&pipeline->queues[0]);
+    }
+}
+
+/**
+ * Receive a processed string from the pipeline
+ */
+int pipeline_receive(pipeline_t* pipeline, char** output) {
+    if (!pipeline || !pipeline->queues) {
+        errno = EINVAL;
+        return -1;
+    }
+    return queue_pop(&pipeline->queues[pipeline->stage_count], output);
+}
+
+/**
+ * Receive the next output item, string or batch
+ */
+int pipeline_receive_item(pipeline_t* pipeline, queue_item_t* item) {
+    if (!pipeline || !pipeline->queues) {
+        errno = EINVAL;
+        return -1;
+    }
+    return queue_pop_item(&pipeline->queues[pipeline->stage_count], item);
+}
@@ -1,14 +1,30 @@
 /**
  * @file pipeline.h
  * @brief Pipeline management for string processing
- * 
+ *
  * Manages the complete pipeline including:
- * - Loading plugins dynamically
+ * - Loading plugins (builtins by name, anything else with dlopen)
  * - Creating and connecting queues between stages
- * - Starting and stopping plugin threads
+ * - Starting and stopping stage threads
  * - Handling shutdown and cleanup
- * 
- * Thread Safety: Pipeline operations are thread-safe
+ *
+ * The pipeline does no I/O of its own: callers feed the first queue with
+ * pipeline_send / pipeline_send_batch and drain the last one with
+ * pipeline_receive / pipeline_receive_item. src/main.c wires these to
+ * stdin and stdout; the benchmark feeds generated data.
+ *
+ * pipeline_fuse_stages folds runs of adjacent byte-map stages (upper,
+ * lower, ...) into the first stage of each run, which then applies the
+ * composed table in one pass; the other stages of the run never start and
+ * records skip the queues between them.
+ *
+ * When any stage is isolated, pipeline_start maps one shared pool (see
+ * shm_pool.h) that every stage allocates its batches from; callers should
+ * create the batches they send with record_batch_create_in(pipeline->pool,
+ * ...) so records reach isolated stages without being copied.
+ *
+ * Thread Safety: One thread may send while another receives; setup and
+ *                teardown calls must not race with each other
  * Memory Management: Pipeline owns all resources and ensures cleanup
  */
 
@@ -17,6 +33,7 @@
 
 #include "queue.h"
 #include "plugin_common.h"
+#include "stage.h"
 #include <pthread.h>
 
 /* Maximum number of pipeline stages */
@@ -24,12 +41,23 @@
 
 /* Pipeline stage structure */
 typedef struct {
-    char* plugin_path;              /* Path to .so file */
-    void* handle;                   /* dlopen handle */
+    char* plugin_path;              /* Builtin name or path to .so file */
+    const char* config;             /* Text after the ':' in the spec, or NULL */
+    void* handle;                   /* dlopen handle (NULL for builtins) */
     plugin_interface_t interface;   /* Plugin function pointers */
     plugin_ctx_t* context;          /* Plugin instance context */
+    const plugin_info_t* info;      /* NULL for ABI v1 plugins */
+    stage_t stage;                  /* Host loop for transform plugins */
+    int hosted;                     /* Running in stage (transform plugin) */
+    int started;                    /* Stage thread or plugin instance exists */
+    int isolated;                   /* Run in a child process; set before start */
+    uint64_t linger_us;             /* Stage micro-batching wait (stage.h); set before start */
+    stage_metrics_t* metrics;       /* Counters (not owned); set before start */
     queue_t* input_queue;           /* Input queue (not owned) */
     queue_t* output_queue;          /* Output queue (not owned) */
+    int absorbed;                   /* Fused into an earlier stage; never started */
+    char fused_name[MONITOR_NAME_MAX]; /* "lower+upper" when later stages fused into this one */
+    unsigned char byte_map[256];    /* Composed byte map of the fused run */
 } pipeline_stage_t;
 
 /* Pipeline structure */
@@ -37,52 +65,83 @@ typedef struct {
     pipeline_stage_t* stages;       /* Array of pipeline stages */
     int stage_count;               /* Number of stages */
     queue_t* queues;               /* Array of queues (stage_count + 1) */
+    mem_budget_t* budget;          /* Byte budget shared by the queues, or NULL */
+    shm_pool_t* pool;              /* Batch arenas isolated stages share, or NULL */
     int running;                   /* Pipeline is running */
-    pthread_t input_thread;        /* Thread reading input */
-    pthread_t output_thread;       /* Thread writing output */
 } pipeline_t;
 
 /**
- * @brief Initialize a pipeline
- * 
+ * @brief Initialize a pipeline and load its plugins
+ *
  * @param pipeline Pointer to pipeline structure
- * @param plugin_paths Array of paths to plugin .so files
- * @param plugin_count Number of plugins
+ * @param plugin_specs Array of plugin specs, "name-or-path[:config]"
+ * @param plugin_count Number of plugins (1 to MAX_PIPELINE_STAGES)
  * @param queue_capacity Capacity for each queue
- * @return 0 on success, -1 on error
- * 
+ * @return 0 on success, -1 on error (reason printed to stderr)
+ *
  * @note Creates plugin_count + 1 queues to connect stages
+ * @note Plugins are loaded but not started; stage isolated, linger_us and
+ *       metrics fields may be set before pipeline_start
  */
-int pipeline_init(pipeline_t* pipeline, const char** plugin_paths, 
+int pipeline_init(pipeline_t* pipeline, const char** plugin_specs,
                   int plugin_count, size_t queue_capacity);
 
+/**
+ * @brief Bound the bytes held by all of the pipeline's queues together
+ *
+ * @param pipeline Pointer to initialized, not yet started pipeline
+ * @param bytes Budget in bytes (0 removes the budget)
+ * @return 0 on success, -1 on error (sets errno)
+ *
+ * @note Producers block while the budget is spent; see mem_budget.h for
+ *       the guarantees that keep the pipeline moving
+ */
+int pipeline_set_budget(pipeline_t* pipeline, size_t bytes);
+
+/**
+ * @brief Fuse runs of adjacent byte-map stages
+ *
+ * @param pipeline Pointer to initialized, not yet started pipeline
+ * @return Number of stages absorbed into an earlier one, -1 on error (sets errno)
+ *
+ * @note Only in-process transform stages whose plugin declares a byte map
+ *       (see PLUGIN_CAP_BYTE_MAP) and has no plugin_open or plugin_control
+ *       take part; call after setting isolated
+ * @note The first stage of a run outputs to the run's last queue and is
+ *       named after the whole run (fused_name); absorbed stages keep their
+ *       plugin loaded but are neither opened nor started, so give them no
+ *       metrics
+ */
+int pipeline_fuse_stages(pipeline_t* pipeline);
+
 /**
  * @brief Start the pipeline
- * 
+ *
  * @param pipeline Pointer to initialized pipeline
  * @return 0 on success, -1 on error
- * 
- * @note Starts all plugin threads and I/O threads
- * @note Pipeline processes until "<END>" is received
+ *
+ * @note Opens every plugin and starts its stage thread
+ * @note Maps pipeline->pool first if a stage is isolated
  */
 int pipeline_start(pipeline_t* pipeline);
 
 /**
  * @brief Stop the pipeline
- * 
+ *
  * @param pipeline Pointer to running pipeline
  * @return 0 on success, -1 on error
- * 
- * @note Initiates graceful shutdown of all stages
- * @note Waits for all threads to complete
+ *
+ * @note Requests every stage to stop, then waits for all threads
+ * @note To finish processing first, pipeline_close_input and drain the
+ *       output until pipeline_receive returns QUEUE_SHUTDOWN
  */
 int pipeline_stop(pipeline_t* pipeline);
 
 /**
  * @brief Destroy a pipeline and free resources
- * 
+ *
  * @param pipeline Pointer to pipeline
- * 
+ *
  * @note Stops pipeline if running
  * @note Unloads all plugins and frees all resources
  */
@@ -90,48 +149,96 @@ void pipeline_destroy(pipeline_t* pipeline);
 
 /**
  * @brief Send a string into the pipeline
- * 
+ *
  * @param pipeline Pointer to running pipeline
  * @param input String to process
- * @return 0 on success, -1 on error
- * 
- * @note Pushes string to first queue
- * @note Returns immediately (non-blocking if queue has space)
+ * @return 0 on success, QUEUE_SHUTDOWN if input is closed, -1 on error
+ *
+ * @note Pushes a copy to the first queue, blocking while it is full
  */
 int pipeline_send(pipeline_t* pipeline, const char* input);
 
+/**
+ * @brief Send a batch of records into the pipeline
+ *
+ * @param pipeline Pointer to running pipeline
+ * @param batch Heap batch from record_batch_create or record_batch_create_in
+ *              (ownership transferred)
+ * @return 0 on success, QUEUE_SHUTDOWN if input is closed, -1 on error
+ */
+int pipeline_send_batch(pipeline_t* pipeline, record_batch_t* batch);
+
+/**
+ * @brief Send a control marker into the pipeline
+ *
+ * @param pipeline Pointer to running pipeline
+ * @param marker Flush, epoch or watermark marker (copied)
+ * @return 0 on success, QUEUE_SHUTDOWN if input is closed, -1 on error
+ *
+ * @note The marker reaches the output queue after every record sent
+ *       before it, and after whatever stateful stages emit in response
+ */
+int pipeline_send_marker(pipeline_t* pipeline, const queue_marker_t* marker);
+
+/**
+ * @brief Signal end of input
+ *
+ * @param pipeline Pointer to running pipeline
+ *
+ * @note Shutdown propagates stage by stage once each queue drains
+ */
+void pipeline_close_input(pipeline_t* pipeline);
+
 /**
  * @brief Receive a processed string from the pipeline
- * 
+ *
  * @param pipeline Pointer to running pipeline
  * @param output Pointer to store allocated string (caller must free)
  * @return 0 on success, QUEUE_SHUTDOWN on shutdown, -1 on error
- * 
+ *
  * @note Pops from last queue
  * @note Blocks if no output available
  */
 int pipeline_receive(pipeline_t* pipeline, char** output);
 
 /**
- * @brief Load a plugin from a .so file
- * 
+ * @brief Receive the next output item, string, batch or marker
+ *
+ * @param pipeline Pointer to running pipeline
+ * @param item Output item (caller frees item->str or item->batch; a
+ *             marker has item->marker.kind set and neither)
+ * @return 0 on success, QUEUE_SHUTDOWN on shutdown, -1 on error
+ */
+int pipeline_receive_item(pipeline_t* pipeline, queue_item_t* item);
+
+/**
+ * @brief Load a plugin
+ *
  * @param stage Pointer to stage structure to populate
- * @param plugin_path Path to plugin .so file
+ * @param plugin_spec "name-or-path[:config]"; a bare name selects a builtin
  * @return 0 on success, -1 on error
- * 
- * @note Uses dlopen/dlsym to load plugin functions
- * @note Validates that required functions are present
+ *
+ * @note Uses dlopen/dlsym for anything that is not a builtin
+ * @note Rejects plugins built for a newer plugin ABI
  */
-int pipeline_load_plugin(pipeline_stage_t* stage, const char* plugin_path);
+int pipeline_load_plugin(pipeline_stage_t* stage, const char* plugin_spec);
 
 /**
  * @brief Unload a plugin
- * 
+ *
  * @param stage Pointer to stage with loaded plugin
- * 
- * @note Destroys plugin instance if created
+ *
+ * @note Stops and destroys the plugin instance if created
  * @note Calls dlclose on plugin handle
  */
 void pipeline_unload_plugin(pipeline_stage_t* stage);
 
-#endif /* PIPELINE_H */
\ No newline at end of file
+/**
+ * @brief Name of a stage's plugin, for messages
+ *
+ * @param stage Pointer to loaded stage
+ * @return Plugin name
+ */
+const char* pipeline_stage_name(pipeline_stage_t* stage);
+
+#endif /* PIPELINE_H */
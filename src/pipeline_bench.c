@@ -0,0 +1,584 @@
+/**
+ * @file pipeline_bench.c
+ * @brief End-to-end throughput and latency benchmark for plugin chains
+ *
+ * Runs a chain of plugins (the same specs the pipeline binary accepts)
+ * over a synthetic dataset and prints one JSON object with the results.
+ * Features include:
+ * - Line lengths that are fixed, uniform or Zipf-distributed
+ * - ASCII or mixed UTF-8 text, and a ratio of repeated lines
+ * - Lines/s, MB/s, end-to-end latency percentiles and CPU time per record
+ * - Per-stage service and residence (queue wait plus service) percentiles,
+ *   to show which hop the tail latency comes from
+ *
+ * The dataset is generated before the clock starts. A feeder thread packs
+ * it into batches and stamps each batch with its send time; the main
+ * thread drains the output and records the time each batch took to cross
+ * the whole chain. Latency is therefore per batch, credited to each of its
+ * records, and includes queueing behind earlier batches. Stages run in a
+ * child process (--isolate) keep the stamp of batches that stay in the
+ * shared pool; records they have to copy through the rings lose it.
+ *
+ * Thread Safety: Single benchmark per process
+ * Memory Management: Everything is freed before exit
+ */
+
+#include <errno.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include "pipeline.h"
+#include "metrics.h"
+#include "plugin_config.h"
+
+#define BENCH_DEFAULT_LINES 100000
+#define BENCH_DEFAULT_QUEUE 100
+
+/* Line length distributions */
+typedef enum {
+    LEN_FIXED,
+    LEN_UNIFORM,
+    LEN_ZIPF
+} len_dist_t;
+
+/* Benchmark parameters */
+typedef struct {
+    const char** specs;
+    int isolated[MAX_PIPELINE_STAGES];
+    int spec_count;
+    size_t lines;
+    const char* len_spec;       /* As given, for the report */
+    len_dist_t len_dist;
+    size_t len_min;
+    size_t len_max;
+    double zipf_s;
+    int utf8;
+    double dup_ratio;
+    uint64_t seed;
+    size_t batch;
+    size_t queue;
+    size_t budget;           /* Shared byte budget, 0 for none */
+    size_t linger_us;        /* Stage micro-batching wait, 0 for none */
+} bench_config_t;
+
+/* Generated input: lines back to back, offsets[i] .. offsets[i + 1] */
+typedef struct {
+    char* data;
+    size_t* offsets;
+    size_t count;
+    size_t bytes;
+} dataset_t;
+
+/* State shared with the feeder thread */
+typedef struct {
+    pipeline_t* pipeline;
+    const dataset_t* data;
+    size_t batch;
+    int failed;
+} feeder_t;
+
+/* xorshift64*: fast, and the same sequence for the same seed everywhere */
+static uint64_t rng_next(uint64_t* state) {
+    uint64_t x = *state;
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    *state = x;
+    return x * 0x2545F4914F6CDD1Dull;
+}
+
+/* Uniform double in [0, 1) */
+static double rng_unit(uint64_t* state) {
+    return (double)(rng_next(state) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+/* Uniform integer in [lo, hi] */
+static size_t rng_range(uint64_t* state, size_t lo, size_t hi) {
+    return lo + (size_t)(rng_next(state) % (uint64_t)(hi - lo + 1));
+}
+
+/*
+ * Cumulative Zipf weights for lengths 1..max, P(k) proportional to 1/k^s,
+ * so sampling is a binary search.
+ */
+static double* zipf_table(size_t max, double s) {
+    double* cdf = malloc(max * sizeof(double));
+    if (!cdf) return NULL;
+
+    double sum = 0.0;
+    for (size_t k = 1; k <= max; k++) {
+        sum += 1.0 / pow((double)k, s);
+        cdf[k - 1] = sum;
+    }
+    for (size_t k = 0; k < max; k++) {
+        cdf[k] /= sum;
+    }
+    return cdf;
+}
+
+static size_t zipf_sample(const double* cdf, size_t max, uint64_t* state) {
+    double u = rng_unit(state);
+    size_t lo = 0, hi = max - 1;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (cdf[mid] < u) lo = mid + 1; else hi = mid;
+    }
+    return lo + 1;
+}
+
+/*
+ * Fill exactly len bytes with text. UTF-8 mode mixes in two- and
+ * three-byte characters (Latin Extended and CJK) wherever they fit.
+ */
+static void fill_line(char* out, size_t len, int utf8, uint64_t* state) {
+    size_t i = 0;
+    while (i < len) {
+        uint64_t r = rng_next(state);
+        unsigned pick = (unsigned)(r % 10);
+
+        if (utf8 && pick == 0 && len - i >= 3) {
+            unsigned cp = 0x4E00 + (unsigned)((r >> 8) % 0x5200);
+            out[i++] = (char)(0xE0 | (cp >> 12));
+            out[i++] = (char)(0x80 | ((cp >> 6) & 0x3F));
+            out[i++] = (char)(0x80 | (cp & 0x3F));
+        } else if (utf8 && pick <= 2 && len - i >= 2) {
+            unsigned cp = 0xC0 + (unsigned)((r >> 8) % 0x190);
+            out[i++] = (char)(0xC0 | (cp >> 6));
+            out[i++] = (char)(0x80 | (cp & 0x3F));
+        } else if (pick == 9) {
+            out[i++] = ' ';
+        } else {
+            out[i++] = (char)(0x21 + (r >> 8) % 94);
+        }
+    }
+}
+
+/**
+ * Generate the dataset described by the configuration
+ */
+static int dataset_generate(dataset_t* set, const bench_config_t* cfg) {
+    uint64_t state = cfg->seed ? cfg->seed : 1;
+    double* cdf = NULL;
+    size_t capacity = 1 << 20;
+
+    memset(set, 0, sizeof(dataset_t));
+    set->offsets = malloc((cfg->lines + 1) * sizeof(size_t));
+    set->data = malloc(capacity);
+    if (cfg->len_dist == LEN_ZIPF) {
+        cdf = zipf_table(cfg->len_max, cfg->zipf_s);
+    }
+    if (!set->offsets || !set->data || (cfg->len_dist == LEN_ZIPF && !cdf)) {
+        free(cdf);
+        errno = ENOMEM;
+        return -1;
+    }
+
+    set->offsets[0] = 0;
+    for (size_t i = 0; i < cfg->lines; i++) {
+        size_t len;
+        int repeat = 0;
+        size_t repeat_at = 0;
+
+        if (i > 0 && cfg->dup_ratio > 0.0 && rng_unit(&state) < cfg->dup_ratio) {
+            size_t j = rng_range(&state, 0, i - 1);
+            repeat = 1;
+            repeat_at = set->offsets[j];
+            len = set->offsets[j + 1] - set->offsets[j];
+        } else if (cfg->len_dist == LEN_ZIPF) {
+            len = zipf_sample(cdf, cfg->len_max, &state);
+        } else if (cfg->len_dist == LEN_UNIFORM) {
+            len = rng_range(&state, cfg->len_min, cfg->len_max);
+        } else {
+            len = cfg->len_min;
+        }
+
+        if (set->bytes + len > capacity) {
+            while (set->bytes + len > capacity) capacity *= 2;
+            char* grown = realloc(set->data, capacity);
+            if (!grown) {
+                free(cdf);
+                errno = ENOMEM;
+                return -1;
+            }
+            set->data = grown;
+        }
+
+        if (repeat) {
+            memcpy(set->data + set->bytes, set->data + repeat_at, len);
+        } else {
+            fill_line(set->data + set->bytes, len, cfg->utf8, &state);
+        }
+        set->bytes += len;
+        set->offsets[i + 1] = set->bytes;
+    }
+
+    set->count = cfg->lines;
+    free(cdf);
+    return 0;
+}
+
+static void dataset_free(dataset_t* set) {
+    free(set->data);
+    free(set->offsets);
+}
+
+/*
+ * Pack the dataset into batches, stamp each with its send time, and close
+ * the input once everything is queued.
+ */
+static void* feeder_thread(void* arg) {
+    feeder_t* feeder = (feeder_t*)arg;
+    const dataset_t* set = feeder->data;
+    size_t avg = set->count ? set->bytes / set->count + 1 : 1;
+
+    for (size_t i = 0; i < set->count && !feeder->failed; ) {
+        record_batch_t* batch = record_batch_create_in(feeder->pipeline->pool, feeder->batch,
+                                                       feeder->batch * avg);
+        if (!batch) {
+            feeder->failed = 1;
+            break;
+        }
+        for (size_t n = 0; n < feeder->batch && i < set->count; n++, i++) {
+            if (record_batch_append(batch, set->data + set->offsets[i],
+                                    set->offsets[i + 1] - set->offsets[i]) != 0) {
+                feeder->failed = 1;
+                break;
+            }
+        }
+        batch->ingest_ns = batch->queued_ns = metrics_now_ns();
+        if (pipeline_send_batch(feeder->pipeline, batch) != 0) {
+            feeder->failed = 1;
+        }
+    }
+
+    pipeline_close_input(feeder->pipeline);
+    return NULL;
+}
+
+/* Stage metrics are freed after the pipeline that writes them */
+static void bench_cleanup(pipeline_t* pipeline, metrics_histogram_t* latency, dataset_t* set) {
+    stage_metrics_t* metrics[MAX_PIPELINE_STAGES];
+    int count = pipeline->stage_count;
+    for (int i = 0; i < count; i++) {
+        metrics[i] = pipeline->stages[i].metrics;
+    }
+    pipeline_destroy(pipeline);
+    for (int i = 0; i < count; i++) {
+        stage_metrics_destroy(metrics[i]);
+    }
+    free(latency);
+    dataset_free(set);
+}
+
+static uint64_t cpu_time_ns(void) {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return (uint64_t)(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000000000ull +
+           (uint64_t)(usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) * 1000ull;
+}
+
+/* {"p50":..,"p99":..,"p999":..,"max":..} in microseconds */
+static void json_percentiles(FILE* out, const metrics_histogram_t* hist) {
+    fprintf(out, "{\"samples\":%llu,\"p50\":%.2f,\"p99\":%.2f,\"p999\":%.2f,\"max\":%.2f}",
+            (unsigned long long)atomic_load(&hist->samples),
+            metrics_histogram_quantile(hist, 0.50) / 1000.0,
+            metrics_histogram_quantile(hist, 0.99) / 1000.0,
+            metrics_histogram_quantile(hist, 0.999) / 1000.0,
+            atomic_load(&hist->max_ns) / 1000.0);
+}
+
+/* Write a JSON string literal */
+static void json_string(FILE* out, const char* s) {
+    fputc('"', out);
+    for (; *s; s++) {
+        unsigned char c = (unsigned char)*s;
+        if (c == '"' || c == '\\') {
+            fprintf(out, "\\%c", c);
+        } else if (c < 0x20) {
+            fprintf(out, "\\u%04x", c);
+        } else {
+            fputc(c, out);
+        }
+    }
+    fputc('"', out);
+}
+
+static int parse_size(const char* text, size_t* value) {
+    char* end;
+    errno = 0;
+    unsigned long long v = strtoull(text, &end, 10);
+    if (errno || end == text || *end != '\0') return -1;
+    *value = (size_t)v;
+    return 0;
+}
+
+/* A byte count with an optional K, M or G suffix */
+static int parse_bytes(const char* text, size_t* value) {
+    char config[64];
+    if (snprintf(config, sizeof(config), "bytes=%s", text) >= (int)sizeof(config)) return -1;
+    return plugin_config_get_size(config, "bytes", value) == 1 ? 0 : -1;
+}
+
+/*
+ * "fixed:N", "uniform:MIN:MAX" or "zipf:S:MAX"
+ */
+static int parse_len_spec(bench_config_t* cfg, const char* spec) {
+    unsigned long long a, b;
+    double s;
+    int end = 0;
+
+    cfg->len_spec = spec;
+    if (sscanf(spec, "fixed:%llu%n", &a, &end) == 1 && spec[end] == '\0') {
+        cfg->len_dist = LEN_FIXED;
+        cfg->len_min = cfg->len_max = (size_t)a;
+        return 0;
+    }
+    if (sscanf(spec, "uniform:%llu:%llu%n", &a, &b, &end) == 2 && spec[end] == '\0' && a <= b) {
+        cfg->len_dist = LEN_UNIFORM;
+        cfg->len_min = (size_t)a;
+        cfg->len_max = (size_t)b;
+        return 0;
+    }
+    if (sscanf(spec, "zipf:%lf:%llu%n", &s, &b, &end) == 2 && spec[end] == '\0' &&
+        s > 0.0 && b > 0) {
+        cfg->len_dist = LEN_ZIPF;
+        cfg->zipf_s = s;
+        cfg->len_min = 1;
+        cfg->len_max = (size_t)b;
+        return 0;
+    }
+    return -1;
+}
+
+static void print_usage(const char* argv0) {
+    fprintf(stderr, "Usage: %s [options] [--isolate] plugin1[:key=value,...] [plugin2 ...]\n", argv0);
+    fprintf(stderr, "  --lines N          lines to generate (default %d)\n", BENCH_DEFAULT_LINES);
+    fprintf(stderr, "  --len DIST         fixed:N | uniform:MIN:MAX | zipf:S:MAX (default fixed:64)\n");
+    fprintf(stderr, "  --charset SET      ascii | utf8 (default ascii)\n");
+    fprintf(stderr, "  --dup RATIO        fraction of lines repeating an earlier line (default 0)\n");
+    fprintf(stderr, "  --seed N           generator seed (default 1)\n");
+    fprintf(stderr, "  --batch N          lines per queue item (default %d)\n", STAGE_BATCH_MAX);
+    fprintf(stderr, "  --queue N          queue capacity in items (default %d)\n", BENCH_DEFAULT_QUEUE);
+    fprintf(stderr, "  --linger US        stage micro-batching wait in microseconds (default 0, off)\n");
+    fprintf(stderr, "  --budget SIZE      bytes all queues may hold together, e.g. 4M (default none)\n");
+    fprintf(stderr, "Results are printed to stdout as one JSON object\n");
+}
+
+static int parse_args(bench_config_t* cfg, int argc, char* argv[]) {
+    int isolate_next = 0;
+
+    for (int i = 1; i < argc; i++) {
+        const char* arg = argv[i];
+        const char* value = i + 1 < argc ? argv[i + 1] : NULL;
+        int ok = 1;
+
+        if (strcmp(arg, "--isolate") == 0) {
+            isolate_next = 1;
+            continue;
+        }
+        if (arg[0] != '-' || arg[1] != '-') {
+            if (cfg->spec_count == MAX_PIPELINE_STAGES) {
+                fprintf(stderr, "At most %d plugins are supported\n", MAX_PIPELINE_STAGES);
+                return -1;
+            }
+            cfg->isolated[cfg->spec_count] = isolate_next;
+            cfg->specs[cfg->spec_count++] = arg;
+            isolate_next = 0;
+            continue;
+        }
+        if (!value) {
+            fprintf(stderr, "%s needs a value\n", arg);
+            return -1;
+        }
+        i++;
+
+        if (strcmp(arg, "--lines") == 0) {
+            ok = parse_size(value, &cfg->lines) == 0;
+        } else if (strcmp(arg, "--len") == 0) {
+            ok = parse_len_spec(cfg, value) == 0;
+        } else if (strcmp(arg, "--charset") == 0) {
+            ok = strcmp(value, "ascii") == 0 || strcmp(value, "utf8") == 0;
+            cfg->utf8 = strcmp(value, "utf8") == 0;
+        } else if (strcmp(arg, "--dup") == 0) {
+            char* end;
+            cfg->dup_ratio = strtod(value, &end);
+            ok = *end == '\0' && cfg->dup_ratio >= 0.0 && cfg->dup_ratio <= 1.0;
+        } else if (strcmp(arg, "--seed") == 0) {
+            size_t seed;
+            ok = parse_size(value, &seed) == 0;
+            cfg->seed = seed;
+        } else if (strcmp(arg, "--batch") == 0) {
+            ok = parse_size(value, &cfg->batch) == 0 && cfg->batch > 0;
+        } else if (strcmp(arg, "--queue") == 0) {
+            ok = parse_size(value, &cfg->queue) == 0 && cfg->queue > 0;
+        } else if (strcmp(arg, "--linger") == 0) {
+            ok = parse_size(value, &cfg->linger_us) == 0 && cfg->linger_us <= STAGE_LINGER_MAX_US;
+        } else if (strcmp(arg, "--budget") == 0) {
+            ok = parse_bytes(value, &cfg->budget) == 0;
+        } else {
+            fprintf(stderr, "Unknown option %s\n", arg);
+            return -1;
+        }
+
+        if (!ok) {
+            fprintf(stderr, "Invalid value for %s: %s\n", arg, value);
+            return -1;
+        }
+    }
+
+    return (cfg->spec_count == 0 || isolate_next) ? -1 : 0;
+}
+
+int main(int argc, char* argv[]) {
+    bench_config_t cfg = {
+        .lines = BENCH_DEFAULT_LINES,
+        .len_spec = "fixed:64",
+        .len_dist = LEN_FIXED,
+        .len_min = 64,
+        .len_max = 64,
+        .seed = 1,
+        .batch = STAGE_BATCH_MAX,
+        .queue = BENCH_DEFAULT_QUEUE,
+    };
+    const char* specs[MAX_PIPELINE_STAGES];
+    cfg.specs = specs;
+
+    if (parse_args(&cfg, argc, argv) != 0) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    dataset_t set;
+    if (dataset_generate(&set, &cfg) != 0) {
+        fprintf(stderr, "Failed to generate dataset: %s\n", strerror(errno));
+        dataset_free(&set);
+        return 1;
+    }
+
+    pipeline_t pipeline;
+    if (pipeline_init(&pipeline, cfg.specs, cfg.spec_count, cfg.queue) != 0) {
+        dataset_free(&set);
+        return 1;
+    }
+    for (int i = 0; i < cfg.spec_count; i++) {
+        pipeline.stages[i].isolated = cfg.isolated[i];
+        pipeline.stages[i].linger_us = cfg.linger_us;
+    }
+    if (cfg.budget && pipeline_set_budget(&pipeline, cfg.budget) != 0) {
+        fprintf(stderr, "Failed to set budget: %s\n", strerror(errno));
+        bench_cleanup(&pipeline, NULL, &set);
+        return 1;
+    }
+
+    /* Stage metrics give per-hop residence; batches carry the timestamps */
+    metrics_histogram_t* latency = calloc(1, sizeof(metrics_histogram_t));
+    int ok = latency != NULL;
+    for (int i = 0; ok && i < cfg.spec_count; i++) {
+        pipeline_stage_t* stage = &pipeline.stages[i];
+        if (stage->interface.transform) {
+            stage->metrics = stage_metrics_create(stage->info->name);
+            ok = stage->metrics != NULL;
+        }
+    }
+    if (!ok || pipeline_start(&pipeline) != 0) {
+        bench_cleanup(&pipeline, latency, &set);
+        return 1;
+    }
+
+    uint64_t cpu_start = cpu_time_ns();
+    uint64_t wall_start = metrics_now_ns();
+
+    feeder_t feeder = { &pipeline, &set, cfg.batch, 0 };
+    pthread_t feeder_tid;
+    if (pthread_create(&feeder_tid, NULL, feeder_thread, &feeder) != 0) {
+        fprintf(stderr, "Failed to start feeder thread\n");
+        bench_cleanup(&pipeline, latency, &set);
+        return 1;
+    }
+
+    /* Drain the output, timing each batch against its send stamp */
+    uint64_t output_lines = 0;
+    uint64_t output_bytes = 0;
+    queue_item_t item;
+    while (pipeline_receive_item(&pipeline, &item) == 0) {
+        uint64_t now = metrics_now_ns();
+        if (item.batch) {
+            record_batch_t* batch = item.batch;
+            if (batch->ingest_ns && now > batch->ingest_ns) {
+                metrics_histogram_record(latency, now - batch->ingest_ns, batch->count);
+            }
+            output_lines += batch->count;
+            output_bytes += batch->size - batch->count;
+            record_batch_free(batch);
+        } else {
+            output_lines++;
+            output_bytes += strlen(item.str);
+            free(item.str);
+        }
+    }
+
+    uint64_t wall_ns = metrics_now_ns() - wall_start;
+    pthread_join(feeder_tid, NULL);
+    uint64_t cpu_ns = cpu_time_ns() - cpu_start;
+    pipeline_stop(&pipeline);
+
+    double wall_s = (double)wall_ns / 1e9;
+    FILE* out = stdout;
+    fprintf(out, "{\"chain\":[");
+    for (int i = 0; i < cfg.spec_count; i++) {
+        if (i) fputc(',', out);
+        json_string(out, cfg.specs[i]);
+    }
+    fprintf(out, "],\"generator\":{\"lines\":%zu,\"len\":", cfg.lines);
+    json_string(out, cfg.len_spec);
+    fprintf(out, ",\"charset\":\"%s\",\"dup_ratio\":%g,\"seed\":%llu},",
+            cfg.utf8 ? "utf8" : "ascii", cfg.dup_ratio, (unsigned long long)cfg.seed);
+    fprintf(out, "\"batch\":%zu,\"queue\":%zu,\"linger_us\":%zu,",
+            cfg.batch, cfg.queue, cfg.linger_us);
+    if (pipeline.budget) {
+        const mem_budget_t* b = pipeline.budget;
+        fprintf(out, "\"budget\":{\"limit\":%llu,\"peak\":%llu,\"waits\":%llu,\"wait_s\":%.6f},",
+                (unsigned long long)b->limit,
+                (unsigned long long)atomic_load(&b->peak),
+                (unsigned long long)atomic_load(&b->waits),
+                (double)atomic_load(&b->wait_ns) / 1e9);
+    }
+    fprintf(out, "\"input_lines\":%zu,\"input_bytes\":%zu,", set.count, set.bytes);
+    fprintf(out, "\"output_lines\":%llu,\"output_bytes\":%llu,",
+            (unsigned long long)output_lines, (unsigned long long)output_bytes);
+    fprintf(out, "\"wall_s\":%.6f,\"lines_per_s\":%.0f,\"mb_per_s\":%.3f,",
+            wall_s,
+            wall_s > 0 ? (double)set.count / wall_s : 0.0,
+            wall_s > 0 ? (double)set.bytes / 1e6 / wall_s : 0.0);
+    fprintf(out, "\"latency_us\":");
+    json_percentiles(out, latency);
+    fprintf(out, ",\"stages\":[");
+    for (int i = 0, first = 1; i < cfg.spec_count; i++) {
+        stage_metrics_t* m = pipeline.stages[i].metrics;
+        if (!m) continue;
+        fprintf(out, "%s{\"name\":", first ? "" : ",");
+        json_string(out, m->name);
+        fprintf(out, ",\"service_p99_us\":%.2f,\"residence_us\":",
+                stage_metrics_quantile(m, 0.99) / 1000.0);
+        json_percentiles(out, &m->residence);
+        metrics_utilization_t util;
+        metrics_utilization(m, wall_ns, &util);
+        fprintf(out, ",\"cpu_pct\":%.1f,\"starved_pct\":%.1f,\"blocked_pct\":%.1f}",
+                util.cpu * 100.0, util.starved * 100.0, util.blocked * 100.0);
+        first = 0;
+    }
+    fprintf(out, "],\"cpu_ns_per_record\":%.1f}\n",
+            set.count ? (double)cpu_ns / (double)set.count : 0.0);
+
+    int failed = feeder.failed;
+    bench_cleanup(&pipeline, latency, &set);
+    if (failed) {
+        fprintf(stderr, "Feeder failed: not every line reached the pipeline\n");
+        return 1;
+    }
+    return 0;
+}
@@ -6,6 +6,26 @@
  * Plugins are loaded dynamically via dlopen/dlsym and run in separate threads.
  * Each plugin processes strings from an input queue and writes to an output queue.
  * 
+ * ABI v2 adds an optional "plugin_info" export that tells the host what the
+ * plugin does (see PLUGIN_CAP_*). The host uses IN_PLACE and
+ * LENGTH_PRESERVING to pick zero-copy paths, and fuses a run of adjacent
+ * BYTE_MAP stages into one stage that applies the composed byte map (see
+ * pipeline_fuse_stages). Plugins without it load as ABI v1, no
+ * capabilities assumed.
+ * 
+ * ABI v2 plugins may also drop the thread entirely and export a pure
+ * "plugin_transform" callback; the host then owns the pop/transform/push
+ * loop (see stage.h), so batching and scheduling work applies to every
+ * plugin. Such plugins export plugin_info and optionally plugin_open and
+ * plugin_close instead of plugin_create/plugin_destroy.
+ * 
+ * Control markers (flush, epoch, watermark; see queue.h) travel through
+ * the queues in order with the records. The host forwards them past
+ * transform plugins, first calling the optional "plugin_control" export so
+ * stateful plugins (aggregators, sorters) can emit what they hold. Plugins
+ * that run their own thread read strings and never see markers, so markers
+ * stop at such a stage.
+ * 
  * Thread Safety: Plugins must be thread-safe if accessed from multiple threads
  * Memory Management: Plugins own their context memory, queues are owned by pipeline
  */
@@ -14,10 +34,19 @@
 #define PLUGIN_COMMON_H
 
 #include "queue.h"
+#include "record_batch.h"
+#include <stdint.h>
+#include <stdlib.h>
 
 /* Forward declaration of plugin context (opaque to users) */
 typedef struct plugin_ctx plugin_ctx_t;
 
+/* Error codes */
+#define PLUGIN_SUCCESS       0
+#define PLUGIN_ERROR        -1
+#define PLUGIN_INVALID_ARG  -2
+#define PLUGIN_NO_MEMORY    -3
+
 /* Plugin function signatures */
 
 /**
@@ -87,6 +116,175 @@ typedef const char* (*plugin_version_fn)(void);
  */
 typedef const char* (*plugin_description_fn)(void);
 
+/* ABI versions */
+#define PLUGIN_ABI_V1        1   /* create/destroy/request_stop/name only */
+#define PLUGIN_ABI_V2        2   /* adds plugin_info capability export */
+#define PLUGIN_ABI_VERSION   PLUGIN_ABI_V2
+
+/*
+ * Capability flags reported in plugin_info_t.flags. Each flag is a promise
+ * the host may rely on; a plugin that is unsure should leave a flag clear.
+ * The byte map and everything plugin_info returns must be constant, as
+ * plugin_info may be called from any thread. A byte map stage is only
+ * fused when it also declares STATELESS, ONE_TO_ONE, IN_PLACE and
+ * LENGTH_PRESERVING and its map keeps NUL as NUL.
+ */
+#define PLUGIN_CAP_STATELESS         (1u << 0) /* Output depends only on the current record */
+#define PLUGIN_CAP_IN_PLACE          (1u << 1) /* Can rewrite the input buffer, never grows it */
+#define PLUGIN_CAP_LENGTH_PRESERVING (1u << 2) /* Output length equals input length */
+#define PLUGIN_CAP_ONE_TO_ONE        (1u << 3) /* Exactly one output record per input record */
+#define PLUGIN_CAP_ONE_TO_MANY       (1u << 4) /* Zero or more outputs per input (filters, splitters) */
+#define PLUGIN_CAP_BYTE_MAP          (1u << 5) /* out[i] = byte_map[in[i]]; byte_map must be set */
+#define PLUGIN_CAP_THREAD_SAFE       (1u << 6) /* Several instances may run concurrently */
+
+/**
+ * @brief Static description of a plugin (ABI v2)
+ * 
+ * @note Returned by the optional "plugin_info" export; must stay valid
+ *       until the plugin is unloaded
+ * @note abi_version lets newer plugins be rejected by older hosts
+ */
+typedef struct plugin_info {
+    uint32_t abi_version;            /* PLUGIN_ABI_VERSION the plugin was built against */
+    uint32_t flags;                  /* PLUGIN_CAP_* bitmask */
+    const char* name;                /* Plugin name */
+    const char* version;             /* Version string */
+    const char* description;         /* One-line description */
+    const unsigned char* byte_map;   /* 256-entry table when PLUGIN_CAP_BYTE_MAP, else NULL */
+} plugin_info_t;
+
+/**
+ * @brief Get the plugin's static description and capabilities
+ * 
+ * @return Pointer to a static plugin_info_t
+ * 
+ * @note Optional: plugins may export "plugin_info" (ABI v2)
+ * @note Callable before plugin_create; must not depend on any instance
+ */
+typedef const plugin_info_t* (*plugin_info_fn)(void);
+
+/**
+ * @brief Check whether a plugin declares every capability in a mask
+ * 
+ * @param info Plugin info (may be NULL for ABI v1 plugins)
+ * @param caps PLUGIN_CAP_* bits that must all be set
+ * @return 1 if all requested capabilities are declared, 0 otherwise
+ */
+static inline int plugin_has_caps(const plugin_info_t* info, uint32_t caps) {
+    return info && (info->flags & caps) == caps;
+}
+
+/* Transform results (ABI v2 transform plugins) */
+#define PLUGIN_EMIT          0   /* Emit the contents of the output buffer */
+#define PLUGIN_DROP          1   /* Emit nothing for this record */
+#define PLUGIN_PASS          2   /* Emit the input record unchanged */
+
+/**
+ * @brief Host-owned output buffer handed to plugin_transform
+ * 
+ * @note The plugin writes len bytes plus a terminating NUL into data,
+ *       growing it with plugin_buf_reserve when needed
+ * @note With PLUGIN_CAP_IN_PLACE the host may pass a buffer whose data
+ *       aliases the input record; in-place plugins must handle that case
+ *       and must not grow the buffer
+ */
+typedef struct plugin_buf {
+    char* data;     /* Record bytes, NUL-terminated */
+    size_t len;     /* Length excluding the NUL */
+    size_t cap;     /* Allocated bytes */
+} plugin_buf_t;
+
+/**
+ * @brief Ensure an output buffer can hold a record of len bytes plus NUL
+ * 
+ * @param buf Output buffer
+ * @param len Record length the plugin is about to write
+ * @return PLUGIN_SUCCESS, or PLUGIN_NO_MEMORY if growing failed
+ */
+static inline int plugin_buf_reserve(plugin_buf_t* buf, size_t len) {
+    if (len + 1 <= buf->cap) return PLUGIN_SUCCESS;
+    size_t cap = buf->cap ? buf->cap : 64;
+    while (cap < len + 1) cap *= 2;
+    char* data = realloc(buf->data, cap);
+    if (!data) return PLUGIN_NO_MEMORY;
+    buf->data = data;
+    buf->cap = cap;
+    return PLUGIN_SUCCESS;
+}
+
+/**
+ * @brief Open a transform plugin instance
+ * 
+ * @param ctx Output parameter for plugin context pointer (may stay NULL)
+ * @param config Configuration string for the plugin (may be NULL)
+ * @return 0 on success, -1 on error
+ * 
+ * @note Optional: stateless plugins may omit it and receive a NULL ctx
+ * @note Must be exported with exact name "plugin_open" for dlsym
+ */
+typedef int (*plugin_open_fn)(plugin_ctx_t** ctx, const char* config);
+
+/**
+ * @brief Close a transform plugin instance
+ * 
+ * @param ctx Plugin context returned by plugin_open
+ * 
+ * @note Optional; called after the host loop has stopped
+ * @note Must be exported with exact name "plugin_close" for dlsym
+ */
+typedef void (*plugin_close_fn)(plugin_ctx_t* ctx);
+
+/**
+ * @brief Transform one record
+ * 
+ * @param ctx Plugin context (NULL if the plugin has no plugin_open)
+ * @param in Input record, NUL-terminated
+ * @param len Length of the input record
+ * @param out Host-owned output buffer
+ * @return PLUGIN_EMIT, PLUGIN_DROP or PLUGIN_PASS; negative on error
+ * 
+ * @note Called from a host thread; must not block on pipeline queues
+ * @note Must be exported with exact name "plugin_transform" for dlsym
+ */
+typedef int (*plugin_transform_fn)(plugin_ctx_t* ctx, const char* in, size_t len,
+                                   plugin_buf_t* out);
+
+/**
+ * @brief Transform a batch of records in one call
+ * 
+ * @param ctx Plugin context (NULL if the plugin has no plugin_open)
+ * @param in Input batch; records are contiguous in one arena
+ * @param out Host-owned output batch, empty on entry; the plugin appends
+ *        one record per output (see record_batch_append)
+ * @return PLUGIN_SUCCESS, negative on error (the whole batch is dropped)
+ * 
+ * @note Optional: plugins may export "plugin_transform_batch"; the host
+ *       falls back to plugin_transform per record without it
+ * @note If the plugin declares both PLUGIN_CAP_IN_PLACE and
+ *       PLUGIN_CAP_LENGTH_PRESERVING, the host may pass out == in and the
+ *       plugin rewrites the arena directly, keeping the offsets
+ */
+typedef int (*plugin_transform_batch_fn)(plugin_ctx_t* ctx, record_batch_t* in,
+                                         record_batch_t* out);
+
+/**
+ * @brief React to a control marker, or to the end of the stream
+ * 
+ * @param ctx Plugin context (NULL if the plugin has no plugin_open)
+ * @param marker Marker that reached the stage; QUEUE_MARKER_END once the
+ *        input has closed, just before the stage stops
+ * @param out Host-owned output batch, empty on entry; records the plugin
+ *        appends (see record_batch_append) are emitted ahead of the marker
+ * @return PLUGIN_SUCCESS, negative on error (records in out are dropped)
+ * 
+ * @note Optional: plugins may export "plugin_control"
+ * @note The host forwards the marker downstream itself, whatever this
+ *       returns; an END marker is not forwarded
+ * @note Called from the stage thread, between transform calls
+ */
+typedef int (*plugin_control_fn)(plugin_ctx_t* ctx, const queue_marker_t* marker,
+                                 record_batch_t* out);
+
 /* Plugin interface structure for convenient access */
 typedef struct {
     plugin_create_fn create;
@@ -95,21 +293,42 @@ typedef struct {
     plugin_name_fn name;
     plugin_version_fn version;         /* Optional */
     plugin_description_fn description; /* Optional */
+    plugin_info_fn info;               /* Optional (ABI v2) */
+    plugin_open_fn open;               /* Optional (ABI v2 transform plugins) */
+    plugin_close_fn close;             /* Optional (ABI v2 transform plugins) */
+    plugin_transform_fn transform;     /* ABI v2 transform plugins */
+    plugin_transform_batch_fn transform_batch; /* Optional (ABI v2 transform plugins) */
+    plugin_control_fn control;         /* Optional (ABI v2 transform plugins) */
 } plugin_interface_t;
 
+/**
+ * @brief Entry points of a plugin linked into the host
+ * 
+ * The stock plugins are also compiled with -DPLUGIN_BUILTIN and linked into
+ * the pipeline binary, where they are found by name (see builtins.h) instead
+ * of through dlopen/dlsym. Calls then bind at link time with no PLT or lazy
+ * symbol resolution.
+ */
+typedef struct plugin_builtin {
+    const char* name;                          /* Name used on the command line */
+    plugin_info_fn info;
+    plugin_open_fn open;                       /* Optional (may be NULL) */
+    plugin_close_fn close;                     /* Optional (may be NULL) */
+    plugin_transform_fn transform;
+    plugin_transform_batch_fn transform_batch; /* Optional (may be NULL) */
+    plugin_control_fn control;                 /* Optional (may be NULL) */
+} plugin_builtin_t;
+
 /* Standard plugin export macros for visibility */
-#ifdef __GNUC__
+#if defined(PLUGIN_BUILTIN)
+/* Linked into the host: keep symbols file-local so plugins cannot collide */
+#define PLUGIN_EXPORT static
+#elif defined(__GNUC__)
 #define PLUGIN_EXPORT __attribute__((visibility("default")))
 #else
 #define PLUGIN_EXPORT
 #endif
 
-/* Error codes */
-#define PLUGIN_SUCCESS       0
-#define PLUGIN_ERROR        -1
-#define PLUGIN_INVALID_ARG  -2
-#define PLUGIN_NO_MEMORY    -3
-
 /* Helper macro for plugin implementation */
 #define PLUGIN_IMPL_STANDARD_EXPORTS(name_str, version_str, desc_str) \
     PLUGIN_EXPORT const char* plugin_version(void) { \
@@ -119,4 +338,48 @@ typedef struct {
         return desc_str; \
     }
 
+/*
+ * Initializer for a constant 256-entry byte map: f(c) gives the output
+ * byte for input byte c, e.g.
+ *   #define UPPER_BYTE(c) ((c) >= 'a' && (c) <= 'z' ? (c) - 'a' + 'A' : (c))
+ *   static const unsigned char byte_map[256] = PLUGIN_BYTE_MAP(UPPER_BYTE);
+ */
+#define PLUGIN_BYTE_MAP_4(f, c)  f(c), f((c) + 1), f((c) + 2), f((c) + 3)
+#define PLUGIN_BYTE_MAP_16(f, c) PLUGIN_BYTE_MAP_4(f, c), PLUGIN_BYTE_MAP_4(f, (c) + 4), \
+                                 PLUGIN_BYTE_MAP_4(f, (c) + 8), PLUGIN_BYTE_MAP_4(f, (c) + 12)
+#define PLUGIN_BYTE_MAP_64(f, c) PLUGIN_BYTE_MAP_16(f, c), PLUGIN_BYTE_MAP_16(f, (c) + 16), \
+                                 PLUGIN_BYTE_MAP_16(f, (c) + 32), PLUGIN_BYTE_MAP_16(f, (c) + 48)
+#define PLUGIN_BYTE_MAP(f) { PLUGIN_BYTE_MAP_64(f, 0), PLUGIN_BYTE_MAP_64(f, 64), \
+                             PLUGIN_BYTE_MAP_64(f, 128), PLUGIN_BYTE_MAP_64(f, 192) }
+
+/* Helper macro for the ABI v2 "plugin_info" export */
+#define PLUGIN_IMPL_INFO(name_str, version_str, desc_str, caps) \
+    PLUGIN_IMPL_INFO_BYTE_MAP(name_str, version_str, desc_str, caps, NULL)
+
+/* Same, for a plugin that declares PLUGIN_CAP_BYTE_MAP with the given table */
+#define PLUGIN_IMPL_INFO_BYTE_MAP(name_str, version_str, desc_str, caps, map) \
+    PLUGIN_EXPORT const plugin_info_t* plugin_info(void) { \
+        static const plugin_info_t info = { \
+            PLUGIN_ABI_VERSION, (caps), name_str, version_str, desc_str, (map) \
+        }; \
+        return &info; \
+    }
+
+/*
+ * Register a transform plugin for builtin builds. Expands to nothing when
+ * the plugin is built as a shared object. Pass NULL for entry points the
+ * plugin does not provide; plugin_info is always required. Plugins with a
+ * plugin_control callback use PLUGIN_REGISTER_CONTROL.
+ */
+#ifdef PLUGIN_BUILTIN
+#define PLUGIN_REGISTER_CONTROL(id, open_fn, close_fn, transform_fn, batch_fn, control_fn) \
+    const plugin_builtin_t plugin_builtin_##id = { \
+        #id, plugin_info, open_fn, close_fn, transform_fn, batch_fn, control_fn \
+    };
+#else
+#define PLUGIN_REGISTER_CONTROL(id, open_fn, close_fn, transform_fn, batch_fn, control_fn)
+#endif
+#define PLUGIN_REGISTER(id, open_fn, close_fn, transform_fn, batch_fn) \
+    PLUGIN_REGISTER_CONTROL(id, open_fn, close_fn, transform_fn, batch_fn, NULL)
+
 #endif /* PLUGIN_COMMON_H */
\ No newline at end of file
@@ -0,0 +1,183 @@
+/**
+ * @file plugin_config.c
+ * @brief Implementation of plugin configuration parsing
+ */
+
+#include "plugin_config.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+/* End of the pair starting at p: the next unescaped ',' or the NUL */
+static const char* pair_end(const char* p) {
+    while (*p && *p != ',') {
+        if (*p == '\\' && p[1]) p++;
+        p++;
+    }
+    return p;
+}
+
+/* Copy len escaped bytes of src to dst without the escapes; returns the new length */
+static size_t unescape(char* dst, const char* src, size_t len) {
+    size_t n = 0;
+    for (size_t i = 0; i < len; i++) {
+        if (src[i] == '\\' && i + 1 < len) i++;
+        dst[n++] = src[i];
+    }
+    return n;
+}
+
+/**
+ * Find where the config starts in a plugin spec
+ */
+const char* plugin_config_split(const char* spec) {
+    if (!spec) return NULL;
+
+    const char* eq = strchr(spec, '=');
+    const char* path_end = eq ? eq : spec + strlen(spec);
+    const char* base = spec;
+    for (const char* p = spec; p < path_end; p++) {
+        if (*p == '/') base = p;
+    }
+    return strchr(base, ':');
+}
+
+/**
+ * Check that every pair of a config is key=value
+ */
+int plugin_config_check(const char* config, const char** bad, size_t* bad_len) {
+    if (!config || !*config) return 0;
+
+    const char* p = config;
+    for (;;) {
+        const char* end = pair_end(p);
+        const char* eq = memchr(p, '=', end - p);
+        if (!eq || eq == p) {
+            if (bad) *bad = p;
+            if (bad_len) *bad_len = end - p;
+            errno = EINVAL;
+            return -1;
+        }
+        if (!*end) return 0;
+        p = end + 1;
+    }
+}
+
+/**
+ * Find the value for a key
+ */
+const char* plugin_config_find(const char* config, const char* key, size_t* len) {
+    if (!config || !key) return NULL;
+
+    size_t key_len = strlen(key);
+    const char* p = config;
+
+    while (*p) {
+        const char* end = pair_end(p);
+
+        const char* eq = memchr(p, '=', end - p);
+        if (eq && (size_t)(eq - p) == key_len && memcmp(p, key, key_len) == 0) {
+            if (len) *len = end - (eq + 1);
+            return eq + 1;
+        }
+
+        if (!*end) break;
+        p = end + 1;
+    }
+    return NULL;
+}
+
+/**
+ * Get a copy of a string value
+ */
+char* plugin_config_strdup(const char* config, const char* key, const char* def) {
+    size_t len;
+    const char* value = plugin_config_find(config, key, &len);
+    if (!value) {
+        if (!def) {
+            errno = ENOENT;
+            return NULL;
+        }
+        value = def;
+        len = strlen(def);
+    }
+
+    char* copy = malloc(len + 1);
+    if (!copy) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    if (value == def) {
+        memcpy(copy, value, len);
+    } else {
+        len = unescape(copy, value, len);
+    }
+    copy[len] = '\0';
+    return copy;
+}
+
+/**
+ * Get a size value such as "4096", "64K" or "1M"
+ */
+int plugin_config_get_size(const char* config, const char* key, size_t* value) {
+    size_t len;
+    const char* p = plugin_config_find(config, key, &len);
+    if (!p) return 0;
+
+    const char* end = p + len;
+    if (p == end || *p < '0' || *p > '9') {
+        errno = EINVAL;
+        return -1;
+    }
+
+    size_t n = 0;
+    for (; p < end && *p >= '0' && *p <= '9'; p++) {
+        if (n > (SIZE_MAX - (size_t)(*p - '0')) / 10) {
+            errno = ERANGE;
+            return -1;
+        }
+        n = n * 10 + (size_t)(*p - '0');
+    }
+
+    unsigned shift = 0;
+    if (p < end) {
+        switch (*p) {
+            case 'k': case 'K': shift = 10; break;
+            case 'm': case 'M': shift = 20; break;
+            case 'g': case 'G': shift = 30; break;
+            default:
+                errno = EINVAL;
+                return -1;
+        }
+        p++;
+    }
+    if (p != end) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (n > (SIZE_MAX >> shift)) {
+        errno = ERANGE;
+        return -1;
+    }
+
+    *value = n << shift;
+    return 1;
+}
+
+/**
+ * Check that a value equals a string
+ */
+int plugin_config_equals(const char* config, const char* key, const char* expected) {
+    size_t len;
+    const char* value = plugin_config_find(config, key, &len);
+    if (!value) return 0;
+
+    /* Walk the escaped value against the expected text */
+    const char* e = expected;
+    for (size_t i = 0; i < len; i++, e++) {
+        if (value[i] == '\\' && i + 1 < len) i++;
+        if (*e != value[i]) return 0;
+    }
+    return *e == '\0';
+}
@@ -0,0 +1,95 @@
+/**
+ * @file plugin_config.h
+ * @brief Parsing helpers for per-plugin configuration strings
+ *
+ * The host passes each plugin the text after the ':' in its command-line
+ * spec, e.g. "prefix:text=LOG" or "./dedup.so:capacity=1M,mode=lru".
+ * A config string is a comma-separated list of key=value pairs:
+ * - Keys and values are taken verbatim (no quoting or whitespace trimming)
+ * - A value runs to the next unescaped ',' or the end of the string;
+ *   write "\," for a comma and "\\" for a backslash inside a value
+ * - Later pairs do not override earlier ones; the first match wins
+ * - Sizes accept K, M and G suffixes (powers of 1024, case-insensitive)
+ *
+ * The host rejects a config with a pair that is not key=value (see
+ * plugin_config_check), so "text=a,b" is an error rather than "a".
+ *
+ * Thread Safety: All functions are reentrant
+ * Memory Management: Returned pointers point into the caller's string
+ */
+
+#ifndef PLUGIN_CONFIG_H
+#define PLUGIN_CONFIG_H
+
+#include <stddef.h>
+
+/**
+ * @brief Find where the config starts in a "path-or-name[:config]" spec
+ *
+ * @param spec Plugin spec from the command line
+ * @return Pointer to the ':' before the config, or NULL if there is none
+ *
+ * @note The ':' is the first one after the last '/' of the path, and the
+ *       path ends before the first '=', so directories may contain ':'
+ *       and config values may contain '/'; file names may not contain ':'
+ */
+const char* plugin_config_split(const char* spec);
+
+/**
+ * @brief Check that every pair of a config is key=value
+ *
+ * @param config Configuration string (may be NULL or empty)
+ * @param bad Output parameter for the first malformed pair (may be NULL)
+ * @param bad_len Output parameter for its length (may be NULL)
+ * @return 0 if well formed, -1 otherwise (sets errno to EINVAL)
+ */
+int plugin_config_check(const char* config, const char** bad, size_t* bad_len);
+
+/**
+ * @brief Find the value for a key
+ *
+ * @param config Configuration string (may be NULL)
+ * @param key Key to look up
+ * @param len Output parameter for the value length
+ * @return Pointer to the value inside config, or NULL if the key is absent
+ *
+ * @note The value is not NUL-terminated and still escaped; use len, or
+ *       plugin_config_strdup for the unescaped text
+ */
+const char* plugin_config_find(const char* config, const char* key, size_t* len);
+
+/**
+ * @brief Get a copy of a string value
+ *
+ * @param config Configuration string (may be NULL)
+ * @param key Key to look up
+ * @param def Value to copy if the key is absent (may be NULL)
+ * @return Newly allocated, unescaped string, or NULL if absent with no
+ *         default or on allocation failure (sets errno)
+ *
+ * @note Caller must free the returned string
+ */
+char* plugin_config_strdup(const char* config, const char* key, const char* def);
+
+/**
+ * @brief Get a size value such as "4096", "64K" or "1M"
+ *
+ * @param config Configuration string (may be NULL)
+ * @param key Key to look up
+ * @param value Output parameter; left unchanged if the key is absent
+ * @return 1 if found, 0 if absent, -1 if malformed or too large (sets errno)
+ */
+int plugin_config_get_size(const char* config, const char* key, size_t* value);
+
+/**
+ * @brief Check that a value equals a string
+ *
+ * @param config Configuration string (may be NULL)
+ * @param key Key to look up
+ * @param expected String to compare against
+ * @return 1 if the key is present with exactly that (unescaped) value,
+ *         0 otherwise
+ */
+int plugin_config_equals(const char* config, const char* key, const char* expected);
+
+#endif /* PLUGIN_CONFIG_H */
@@ -0,0 +1,102 @@
+/**
+ * @file probes.h
+ * @brief USDT (SystemTap SDT) static probes for queue and stage hot paths
+ *
+ * When <sys/sdt.h> is available each probe compiles to a nop plus an ELF
+ * note naming it, so perf, bpftrace and SystemTap can attach at run time.
+ * Every probe also has an SDT semaphore that tracers increment while
+ * attached; the macros test it first, so while nothing is attached a probe
+ * costs one load and branch and its arguments are not evaluated. Without
+ * the header, or with -DPIPELINE_NO_PROBES, the macros expand to nothing.
+ *
+ * Provider "pipeline". Probes and their arguments:
+ *
+ *   queue_push       (queue_t*, depth after push, records, bytes)
+ *   queue_pop        (queue_t*, depth after pop, records, bytes)
+ *   queue_wait_begin (queue_t*, waiting for room (1) or an item (0), depth)
+ *   queue_wait_end   (queue_t*, waiting for room (1) or an item (0), depth)
+ *   queue_shutdown   (queue_t*, depth)
+ *   transform_begin  (stage name, records, bytes)
+ *   transform_end    (stage name, records out, bytes out)
+ *
+ * The queue pointer identifies the queue; depth counts queue items, and a
+ * batch item is one item carrying many records. Byte counts exclude NULs.
+ * The file that fires a probe defines its semaphore with PROBE_SEMAPHORE.
+ * bpftrace and perf need a kernel with uprobe reference counting (4.20+)
+ * to set semaphores; older tracers see the probes but never fire them.
+ *
+ * Example:
+ *   bpftrace -e 'usdt:./build/bin/pipeline:pipeline:queue_wait_end
+ *                { @depth[arg0, arg1] = lhist(arg2, 0, 100, 10); }'
+ *
+ * Thread Safety: Probes are inline instructions; no state
+ * Memory Management: None
+ */
+
+#ifndef PROBES_H
+#define PROBES_H
+
+#if !defined(PIPELINE_NO_PROBES) && defined(__has_include)
+#  if __has_include(<sys/sdt.h>)
+#    define _SDT_HAS_SEMAPHORES 1
+#    include <sys/sdt.h>
+#    define PIPELINE_PROBES 1
+#  endif
+#endif
+
+#ifndef PIPELINE_PROBES
+#  define PIPELINE_PROBES 0
+#endif
+
+#if PIPELINE_PROBES
+
+/* Semaphore definition, once per probe, in the file that fires it */
+#define PROBE_SEMAPHORE(name) \
+    unsigned short pipeline_##name##_semaphore __attribute__((unused, section(".probes")))
+
+extern unsigned short pipeline_queue_push_semaphore;
+extern unsigned short pipeline_queue_pop_semaphore;
+extern unsigned short pipeline_queue_wait_begin_semaphore;
+extern unsigned short pipeline_queue_wait_end_semaphore;
+extern unsigned short pipeline_queue_shutdown_semaphore;
+extern unsigned short pipeline_transform_begin_semaphore;
+extern unsigned short pipeline_transform_end_semaphore;
+
+#define PROBE_ENABLED(name) __builtin_expect(pipeline_##name##_semaphore, 0)
+
+#define PROBE_QUEUE_PUSH(queue, depth, records, bytes) \
+    do { if (PROBE_ENABLED(queue_push)) \
+        STAP_PROBE4(pipeline, queue_push, queue, depth, records, bytes); } while (0)
+#define PROBE_QUEUE_POP(queue, depth, records, bytes) \
+    do { if (PROBE_ENABLED(queue_pop)) \
+        STAP_PROBE4(pipeline, queue_pop, queue, depth, records, bytes); } while (0)
+#define PROBE_QUEUE_WAIT_BEGIN(queue, for_room, depth) \
+    do { if (PROBE_ENABLED(queue_wait_begin)) \
+        STAP_PROBE3(pipeline, queue_wait_begin, queue, for_room, depth); } while (0)
+#define PROBE_QUEUE_WAIT_END(queue, for_room, depth) \
+    do { if (PROBE_ENABLED(queue_wait_end)) \
+        STAP_PROBE3(pipeline, queue_wait_end, queue, for_room, depth); } while (0)
+#define PROBE_QUEUE_SHUTDOWN(queue, depth) \
+    do { if (PROBE_ENABLED(queue_shutdown)) \
+        STAP_PROBE2(pipeline, queue_shutdown, queue, depth); } while (0)
+#define PROBE_TRANSFORM_BEGIN(name, records, bytes) \
+    do { if (PROBE_ENABLED(transform_begin)) \
+        STAP_PROBE3(pipeline, transform_begin, name, records, bytes); } while (0)
+#define PROBE_TRANSFORM_END(name, records, bytes) \
+    do { if (PROBE_ENABLED(transform_end)) \
+        STAP_PROBE3(pipeline, transform_end, name, records, bytes); } while (0)
+
+#else
+
+#define PROBE_ENABLED(name) 0
+#define PROBE_QUEUE_PUSH(queue, depth, records, bytes) do { } while (0)
+#define PROBE_QUEUE_POP(queue, depth, records, bytes) do { } while (0)
+#define PROBE_QUEUE_WAIT_BEGIN(queue, for_room, depth) do { } while (0)
+#define PROBE_QUEUE_WAIT_END(queue, for_room, depth) do { } while (0)
+#define PROBE_QUEUE_SHUTDOWN(queue, depth) do { } while (0)
+#define PROBE_TRANSFORM_BEGIN(name, records, bytes) do { } while (0)
+#define PROBE_TRANSFORM_END(name, records, bytes) do { } while (0)
+
+#endif /* PIPELINE_PROBES */
+
+#endif /* PROBES_H */
@@ -4,10 +4,218 @@
  */
 
 #include "queue.h"
+#include "metrics.h"
+#include "trace.h"
+#include "probes.h"
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
 
+#if PIPELINE_PROBES
+/* Semaphores of the queue probes (probes.h) */
+PROBE_SEMAPHORE(queue_push);
+PROBE_SEMAPHORE(queue_pop);
+PROBE_SEMAPHORE(queue_wait_begin);
+PROBE_SEMAPHORE(queue_wait_end);
+PROBE_SEMAPHORE(queue_shutdown);
+#endif
+
+_Static_assert(sizeof(queue_slot_t) == QUEUE_SLOT_SIZE, "ring slots must be one cache line");
+
+/*
+ * Helpers below must be called with the queue mutex held.
+ */
+
+/* Set a counter read by other threads; writers hold the queue mutex */
+static void queue_counter_set(_Atomic uint64_t* counter, uint64_t value) {
+    atomic_store_explicit(counter, value, memory_order_relaxed);
+}
+
+static uint64_t queue_counter_get(_Atomic uint64_t* counter) {
+    return atomic_load_explicit(counter, memory_order_relaxed);
+}
+
+/* Memory an occupied slot accounts for; inline records count their length */
+static size_t queue_slot_bytes(const queue_slot_t* slot) {
+    return slot->inlined ? strlen(slot->text) + 1 : slot->item.bytes;
+}
+
+static void queue_remove_head(queue_t* queue) {
+    queue_slot_t* slot = &queue->buffer[queue->head];
+    size_t bytes = queue_slot_bytes(slot);
+    queue_counter_set(&queue->bytes, queue_counter_get(&queue->bytes) - bytes);
+    memset(&slot->item, 0, sizeof(slot->item));
+    slot->inlined = 0;
+    queue->head = (queue->head + 1) % queue->capacity;
+    queue->size--;
+    queue_counter_set(&queue->depth, queue->size);
+    if (queue->budget && bytes > 0) {
+        mem_budget_release(queue->budget, bytes);
+    }
+}
+
+/*
+ * Fill the tail slot. Strings of up to QUEUE_INLINE_MAX bytes are copied
+ * into it; otherwise str is a heap copy the slot takes over. A marker is
+ * queued with neither str nor batch.
+ */
+static void queue_append(queue_t* queue, char* str, record_batch_t* batch, size_t bytes,
+                         const queue_marker_t* marker) {
+    queue_slot_t* slot = &queue->buffer[queue->tail];
+    if (str && bytes <= QUEUE_INLINE_MAX + 1) {
+        memcpy(slot->text, str, bytes);
+        slot->inlined = 1;
+    } else {
+        slot->item.str = str;
+        slot->item.batch = batch;
+        slot->item.cursor = 0;
+        slot->item.bytes = bytes;
+        slot->item.marker = marker ? *marker : (queue_marker_t){ QUEUE_MARKER_NONE, 0 };
+    }
+    uint64_t total = queue_counter_get(&queue->bytes) + bytes;
+    queue_counter_set(&queue->bytes, total);
+    if (total > queue_counter_get(&queue->peak_bytes)) {
+        queue_counter_set(&queue->peak_bytes, total);
+    }
+    queue->tail = (queue->tail + 1) % queue->capacity;
+    queue->size++;
+    queue_counter_set(&queue->depth, queue->size);
+}
+
+/*
+ * Budget helpers, called without the queue mutex: a producer waiting for
+ * budget must not stop consumers of its own queue from releasing it.
+ */
+static int queue_budget_bypass(void* arg) {
+    queue_t* queue = (queue_t*)arg;
+    return queue->shutdown || queue_counter_get(&queue->depth) == 0;
+}
+
+static int queue_budget_acquire(queue_t* queue, size_t bytes, const struct timespec* deadline) {
+    if (!queue->budget) return 0;
+    return mem_budget_acquire(queue->budget, bytes, queue_budget_bypass, queue, deadline);
+}
+
+static void queue_budget_release(queue_t* queue, size_t bytes) {
+    if (queue->budget) {
+        mem_budget_release(queue->budget, bytes);
+    }
+}
+
+/* Wait on one of the queue's conditions, until deadline if one is given */
+static int queue_cond_wait(monitor_cond_t* cond, const struct timespec* deadline) {
+    if (!deadline) {
+        monitor_cond_wait(cond);
+        return 0;
+    }
+    return monitor_cond_wait_timeout(cond, deadline) == ETIMEDOUT ? ETIMEDOUT : 0;
+}
+
+/*
+ * Block until there is room or the queue shuts down, or until deadline
+ * (NULL for none). Returns 0, or ETIMEDOUT if the queue is still full.
+ * Waits that actually block are timed and traced, with the depth seen on
+ * wake-up.
+ */
+static int queue_wait_not_full(queue_t* queue, const struct timespec* deadline) {
+    if (queue->size < queue->capacity || queue->shutdown) return 0;
+    
+    uint64_t blocked = trace_now_ns();
+    uint64_t start = trace_begin();
+    int ret = 0;
+    PROBE_QUEUE_WAIT_BEGIN(queue, 1, queue->size);
+    while (queue->size >= queue->capacity && !queue->shutdown && ret == 0) {
+        ret = queue_cond_wait(&queue->not_full, deadline);
+    }
+    PROBE_QUEUE_WAIT_END(queue, 1, queue->size);
+    trace_end(start, "wait not_full", "queue", queue->size);
+    queue_counter_set(&queue->wait_full_ns,
+                      queue_counter_get(&queue->wait_full_ns) + trace_now_ns() - blocked);
+    return queue->size < queue->capacity || queue->shutdown ? 0 : ETIMEDOUT;
+}
+
+/* Block until there is an item or the queue shuts down; as above */
+static int queue_wait_not_empty(queue_t* queue, const struct timespec* deadline) {
+    if (queue->size > 0 || queue->shutdown) return 0;
+    
+    uint64_t blocked = trace_now_ns();
+    uint64_t start = trace_begin();
+    int ret = 0;
+    PROBE_QUEUE_WAIT_BEGIN(queue, 0, queue->size);
+    while (queue->size == 0 && !queue->shutdown && ret == 0) {
+        ret = queue_cond_wait(&queue->not_empty, deadline);
+    }
+    PROBE_QUEUE_WAIT_END(queue, 0, queue->size);
+    trace_end(start, "wait not_empty", "queue", queue->size);
+    queue_counter_set(&queue->wait_empty_ns,
+                      queue_counter_get(&queue->wait_empty_ns) + trace_now_ns() - blocked);
+    return queue->size > 0 || queue->shutdown ? 0 : ETIMEDOUT;
+}
+
+/*
+ * Drop markers at the head for string consumers, which cannot receive
+ * them. Returns the number of slots freed.
+ */
+static size_t queue_skip_markers(queue_t* queue) {
+    size_t skipped = 0;
+    while (queue->size > 0) {
+        queue_slot_t* slot = &queue->buffer[queue->head];
+        if (slot->inlined || !slot->item.marker.kind) break;
+        queue_remove_head(queue);
+        skipped++;
+    }
+    return skipped;
+}
+
+/*
+ * Take the next string record from the head item. Batch items hand out
+ * copies of their records one at a time and leave the ring when the last
+ * one is taken. Returns NULL (errno ENOMEM) if a copy cannot be made.
+ */
+static char* queue_take_string(queue_t* queue, int* removed) {
+    queue_slot_t* slot = &queue->buffer[queue->head];
+    queue_item_t* item = &slot->item;
+    *removed = 0;
+    
+    if (slot->inlined) {
+        size_t bytes = strlen(slot->text) + 1;
+        char* str = malloc(bytes);
+        if (!str) {
+            errno = ENOMEM;
+            return NULL;
+        }
+        metrics_count_alloc(bytes);
+        memcpy(str, slot->text, bytes);
+        queue_remove_head(queue);
+        *removed = 1;
+        return str;
+    }
+    
+    if (item->str) {
+        char* str = item->str;
+        queue_remove_head(queue);
+        *removed = 1;
+        return str;
+    }
+    
+    size_t len;
+    const char* record = record_batch_get(item->batch, item->cursor, &len);
+    char* str = malloc(len + 1);
+    if (!str) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    metrics_count_alloc(len + 1);
+    memcpy(str, record, len + 1);
+    
+    if (++item->cursor == item->batch->count) {
+        record_batch_free(item->batch);
+        queue_remove_head(queue);
+        *removed = 1;
+    }
+    return str;
+}
+
 /**
  * Initialize a queue with specified capacity
  */
@@ -17,34 +225,45 @@ int queue_init(queue_t* queue, size_t capacity) {
         return -1;
     }
     
-    /* Initialize buffer */
-    queue->buffer = calloc(capacity, sizeof(char*));
+    /* Initialize buffer, slots aligned to cache lines */
+    if (capacity > SIZE_MAX / sizeof(queue_slot_t)) {
+        errno = EINVAL;
+        return -1;
+    }
+    queue->buffer = aligned_alloc(QUEUE_SLOT_SIZE, capacity * sizeof(queue_slot_t));
     if (!queue->buffer) {
         errno = ENOMEM;
         return -1;
     }
+    memset(queue->buffer, 0, capacity * sizeof(queue_slot_t));
     
     queue->capacity = capacity;
     queue->size = 0;
     queue->head = 0;
     queue->tail = 0;
     queue->shutdown = 0;
+    atomic_init(&queue->wait_full_ns, 0);
+    atomic_init(&queue->wait_empty_ns, 0);
+    atomic_init(&queue->bytes, 0);
+    atomic_init(&queue->peak_bytes, 0);
+    atomic_init(&queue->depth, 0);
+    queue->budget = NULL;
     
     /* Initialize synchronization primitives */
-    if (pthread_mutex_init(&queue->mutex, NULL) != 0) {
+    if (monitor_init(&queue->monitor) != 0) {
         free(queue->buffer);
         return -1;
     }
     
-    if (pthread_cond_init(&queue->not_full, NULL) != 0) {
-        pthread_mutex_destroy(&queue->mutex);
+    if (monitor_cond_init(&queue->not_full, &queue->monitor, "not_full") != 0) {
+        monitor_destroy(&queue->monitor);
         free(queue->buffer);
         return -1;
     }
     
-    if (pthread_cond_init(&queue->not_empty, NULL) != 0) {
-        pthread_cond_destroy(&queue->not_full);
-        pthread_mutex_destroy(&queue->mutex);
+    if (monitor_cond_init(&queue->not_empty, &queue->monitor, "not_empty") != 0) {
+        monitor_cond_destroy(&queue->not_full);
+        monitor_destroy(&queue->monitor);
         free(queue->buffer);
         return -1;
     }
@@ -58,22 +277,24 @@ int queue_init(queue_t* queue, size_t capacity) {
 void queue_destroy(queue_t* queue) {
     if (!queue) return;
     
-    pthread_mutex_lock(&queue->mutex);
+    monitor_enter(&queue->monitor);
     
-    /* Free any remaining strings in the queue */
+    /* Free any remaining strings and batches in the queue */
     while (queue->size > 0) {
-        free(queue->buffer[queue->head]);
-        queue->buffer[queue->head] = NULL;
-        queue->head = (queue->head + 1) % queue->capacity;
-        queue->size--;
+        queue_slot_t* slot = &queue->buffer[queue->head];
+        if (!slot->inlined) {
+            free(slot->item.str);
+            record_batch_free(slot->item.batch);
+        }
+        queue_remove_head(queue);
     }
     
-    pthread_mutex_unlock(&queue->mutex);
+    monitor_exit(&queue->monitor);
     
     /* Destroy synchronization primitives */
-    pthread_cond_destroy(&queue->not_empty);
-    pthread_cond_destroy(&queue->not_full);
-    pthread_mutex_destroy(&queue->mutex);
+    monitor_cond_destroy(&queue->not_empty);
+    monitor_cond_destroy(&queue->not_full);
+    monitor_destroy(&queue->monitor);
     
     /* Free buffer */
     free(queue->buffer);
@@ -81,50 +302,146 @@ void queue_destroy(queue_t* queue) {
 }
 
 /**
- * Push a string onto the queue (blocking if full)
+ * Name the queue's lock for the lock profile
  */
-int queue_push(queue_t* queue, const char* str) {
+void queue_set_name(queue_t* queue, const char* name) {
+    if (queue) {
+        monitor_set_name(&queue->monitor, name);
+    }
+}
+
+/**
+ * Charge the queue's items to a shared byte budget
+ */
+void queue_set_budget(queue_t* queue, mem_budget_t* budget) {
+    if (queue) {
+        queue->budget = budget;
+    }
+}
+
+/*
+ * Push a string, waiting for room and budget until deadline (NULL for
+ * no limit)
+ */
+static int queue_push_until(queue_t* queue, const char* str, const struct timespec* deadline) {
     if (!queue || !str) {
         errno = EINVAL;
         return -1;
     }
     
-    pthread_mutex_lock(&queue->mutex);
-    
     /* Check for shutdown */
     if (queue->shutdown) {
-        pthread_mutex_unlock(&queue->mutex);
         return QUEUE_SHUTDOWN;
     }
     
-    /* Wait while queue is full */
-    while (queue->size >= queue->capacity && !queue->shutdown) {
-        pthread_cond_wait(&queue->not_full, &queue->mutex);
+    /* Copy long strings immediately to avoid TOCTOU; short ones are
+     * copied into their slot under the lock */
+    size_t len = strlen(str);
+    char* str_copy = (char*)str;
+    if (len > QUEUE_INLINE_MAX) {
+        str_copy = malloc(len + 1);
+        if (!str_copy) {
+            errno = ENOMEM;
+            return -1;
+        }
+        metrics_count_alloc(len + 1);
+        memcpy(str_copy, str, len + 1);
+    }
+    
+    if (queue_budget_acquire(queue, len + 1, deadline) != 0) {
+        if (str_copy != str) free(str_copy);
+        return QUEUE_TIMEOUT;
+    }
+    monitor_enter(&queue->monitor);
+    
+    if (queue_wait_not_full(queue, deadline) == ETIMEDOUT) {
+        monitor_exit(&queue->monitor);
+        queue_budget_release(queue, len + 1);
+        if (str_copy != str) free(str_copy);
+        return QUEUE_TIMEOUT;
     }
     
     /* Check for shutdown again after wait */
     if (queue->shutdown) {
-        pthread_mutex_unlock(&queue->mutex);
+        monitor_exit(&queue->monitor);
+        queue_budget_release(queue, len + 1);
+        if (str_copy != str) free(str_copy);
         return QUEUE_SHUTDOWN;
     }
     
-    /* Copy string immediately to avoid TOCTOU */
-    char* str_copy = strdup(str);
-    if (!str_copy) {
-        pthread_mutex_unlock(&queue->mutex);
-        errno = ENOMEM;
+    /* Add to queue */
+    queue_append(queue, str_copy, NULL, len + 1, NULL);
+    PROBE_QUEUE_PUSH(queue, queue->size, 1, len);
+    
+    /* Signal that queue is not empty */
+    monitor_cond_signal(&queue->not_empty);
+    
+    monitor_exit(&queue->monitor);
+    return 0;
+}
+
+/**
+ * Push a string onto the queue (blocking if full)
+ */
+int queue_push(queue_t* queue, const char* str) {
+    return queue_push_until(queue, str, NULL);
+}
+
+/**
+ * Push a string, waiting at most timeout_us for room
+ */
+int queue_push_timeout(queue_t* queue, const char* str, uint64_t timeout_us) {
+    struct timespec deadline;
+    monitor_deadline(&deadline, timeout_us);
+    return queue_push_until(queue, str, &deadline);
+}
+
+/* Pop a string, waiting until deadline (NULL for no limit) */
+static int queue_pop_until(queue_t* queue, char** out_str, const struct timespec* deadline) {
+    if (!queue || !out_str) {
+        errno = EINVAL;
         return -1;
     }
     
-    /* Add to queue */
-    queue->buffer[queue->tail] = str_copy;
-    queue->tail = (queue->tail + 1) % queue->capacity;
-    queue->size++;
+    monitor_enter(&queue->monitor);
+    
+    for (;;) {
+        if (queue_wait_not_empty(queue, deadline) == ETIMEDOUT) {
+            monitor_exit(&queue->monitor);
+            *out_str = NULL;
+            return QUEUE_TIMEOUT;
+        }
+        
+        /* If shutdown and empty, return shutdown status */
+        if (queue->shutdown && queue->size == 0) {
+            monitor_exit(&queue->monitor);
+            *out_str = NULL;
+            return QUEUE_SHUTDOWN;
+        }
+        
+        if (queue_skip_markers(queue) > 0) {
+            monitor_cond_broadcast(&queue->not_full);
+        }
+        if (queue->size > 0) {
+            break;
+        }
+    }
     
-    /* Signal that queue is not empty */
-    pthread_cond_signal(&queue->not_empty);
+    /* Remove from queue */
+    int removed;
+    *out_str = queue_take_string(queue, &removed);
+    if (!*out_str) {
+        monitor_exit(&queue->monitor);
+        return -1;
+    }
+    PROBE_QUEUE_POP(queue, queue->size, 1, strlen(*out_str));
     
-    pthread_mutex_unlock(&queue->mutex);
+    /* Signal that queue is not full */
+    if (removed) {
+        monitor_cond_signal(&queue->not_full);
+    }
+    
+    monitor_exit(&queue->monitor);
     return 0;
 }
 
@@ -132,38 +449,277 @@ int queue_push(queue_t* queue, const char* str) {
  * Pop a string from the queue (blocking if empty)
  */
 int queue_pop(queue_t* queue, char** out_str) {
-    if (!queue || !out_str) {
+    return queue_pop_until(queue, out_str, NULL);
+}
+
+/**
+ * Pop a string, waiting at most timeout_us for one
+ */
+int queue_pop_timeout(queue_t* queue, char** out_str, uint64_t timeout_us) {
+    struct timespec deadline;
+    monitor_deadline(&deadline, timeout_us);
+    return queue_pop_until(queue, out_str, &deadline);
+}
+
+/**
+ * Pop up to max strings from the queue in one operation
+ */
+int queue_pop_batch(queue_t* queue, char** out_strs, size_t max, size_t* count) {
+    if (!queue || !out_strs || !count || max == 0) {
+        errno = EINVAL;
+        return -1;
+    }
+    
+    monitor_enter(&queue->monitor);
+    
+    /* Wait for a record; markers in the way are skipped */
+    size_t n = 0, freed = 0;
+    for (;;) {
+        queue_wait_not_empty(queue, NULL);
+        freed += queue_skip_markers(queue);
+        if (queue->size > 0 || queue->shutdown) {
+            break;
+        }
+    }
+    
+    /* If shutdown and empty, return shutdown status */
+    if (queue->size == 0) {
+        if (freed > 0) {
+            monitor_cond_broadcast(&queue->not_full);
+        }
+        monitor_exit(&queue->monitor);
+        *count = 0;
+        return QUEUE_SHUTDOWN;
+    }
+    
+    /* Take everything available, up to max */
+    while (n < max && queue->size > 0) {
+        int removed;
+        char* str = queue_take_string(queue, &removed);
+        if (!str) break;
+        out_strs[n++] = str;
+        freed += removed + queue_skip_markers(queue);
+        PROBE_QUEUE_POP(queue, queue->size, 1, strlen(str));
+    }
+    *count = n;
+    
+    /* Several slots may have opened up, so wake every blocked producer */
+    if (freed > 1) {
+        monitor_cond_broadcast(&queue->not_full);
+    } else if (freed == 1) {
+        monitor_cond_signal(&queue->not_full);
+    }
+    
+    monitor_exit(&queue->monitor);
+    return n > 0 ? 0 : -1;
+}
+
+/**
+ * Push a record batch onto the queue as a single item
+ */
+int queue_push_batch(queue_t* queue, record_batch_t* batch) {
+    if (!queue || !batch) {
+        record_batch_free(batch);
+        errno = EINVAL;
+        return -1;
+    }
+    if (batch->count == 0) {
+        record_batch_free(batch);
+        return 0;
+    }
+    
+    size_t bytes = record_batch_footprint(batch);
+    queue_budget_acquire(queue, bytes, NULL);
+    monitor_enter(&queue->monitor);
+    
+    queue_wait_not_full(queue, NULL);
+    
+    if (queue->shutdown) {
+        monitor_exit(&queue->monitor);
+        queue_budget_release(queue, bytes);
+        record_batch_free(batch);
+        return QUEUE_SHUTDOWN;
+    }
+    
+    queue_append(queue, NULL, batch, bytes, NULL);
+    PROBE_QUEUE_PUSH(queue, queue->size, batch->count, batch->size - batch->count);
+    
+    /* Signal that queue is not empty */
+    monitor_cond_signal(&queue->not_empty);
+    
+    monitor_exit(&queue->monitor);
+    return 0;
+}
+
+/**
+ * Push a control marker behind the items already queued
+ */
+int queue_push_marker(queue_t* queue, const queue_marker_t* marker) {
+    if (!queue || !marker || marker->kind == QUEUE_MARKER_NONE ||
+        marker->kind >= QUEUE_MARKER_END) {
         errno = EINVAL;
         return -1;
     }
     
-    pthread_mutex_lock(&queue->mutex);
+    monitor_enter(&queue->monitor);
     
-    /* Wait while queue is empty */
-    while (queue->size == 0 && !queue->shutdown) {
-        pthread_cond_wait(&queue->not_empty, &queue->mutex);
+    queue_wait_not_full(queue, NULL);
+    
+    if (queue->shutdown) {
+        monitor_exit(&queue->monitor);
+        return QUEUE_SHUTDOWN;
+    }
+    
+    queue_append(queue, NULL, NULL, 0, marker);
+    PROBE_QUEUE_PUSH(queue, queue->size, 0, 0);
+    
+    /* Signal that queue is not empty */
+    monitor_cond_signal(&queue->not_empty);
+    
+    monitor_exit(&queue->monitor);
+    return 0;
+}
+
+/**
+ * Name of a marker kind
+ */
+const char* queue_marker_name(uint32_t kind) {
+    switch (kind) {
+        case QUEUE_MARKER_FLUSH:     return "flush";
+        case QUEUE_MARKER_EPOCH:     return "epoch";
+        case QUEUE_MARKER_WATERMARK: return "watermark";
+        case QUEUE_MARKER_END:       return "end";
+        default:                     return "none";
+    }
+}
+
+/*
+ * Pop the next item, waiting until deadline (NULL for no limit). Inline records are copied into *buf when buf is
+ * given, otherwise into a fresh allocation; out-of-line strings replace
+ * *buf, whose old storage is returned through spent to be freed after
+ * the lock is dropped.
+ */
+static int queue_pop_slot(queue_t* queue, queue_item_t* item, char** buf, size_t* cap,
+                          char** spent, const struct timespec* deadline) {
+    monitor_enter(&queue->monitor);
+    
+    if (queue_wait_not_empty(queue, deadline) == ETIMEDOUT) {
+        monitor_exit(&queue->monitor);
+        item->str = NULL;
+        item->batch = NULL;
+        item->cursor = 0;
+        item->marker.kind = QUEUE_MARKER_NONE;
+        return QUEUE_TIMEOUT;
     }
     
     /* If shutdown and empty, return shutdown status */
     if (queue->shutdown && queue->size == 0) {
-        pthread_mutex_unlock(&queue->mutex);
-        *out_str = NULL;
+        monitor_exit(&queue->monitor);
+        item->str = NULL;
+        item->batch = NULL;
+        item->cursor = 0;
+        item->marker.kind = QUEUE_MARKER_NONE;
         return QUEUE_SHUTDOWN;
     }
     
-    /* Remove from queue */
-    *out_str = queue->buffer[queue->head];
-    queue->buffer[queue->head] = NULL;
-    queue->head = (queue->head + 1) % queue->capacity;
-    queue->size--;
+    queue_slot_t* slot = &queue->buffer[queue->head];
+    if (slot->inlined) {
+        size_t bytes = strlen(slot->text) + 1;
+        char* str = buf ? *buf : malloc(bytes);
+        if (!str) {
+            monitor_exit(&queue->monitor);
+            errno = ENOMEM;
+            return -1;
+        }
+        if (!buf) metrics_count_alloc(bytes);
+        memcpy(str, slot->text, bytes);
+        item->str = str;
+        item->batch = NULL;
+        item->cursor = 0;
+        item->bytes = bytes;
+        item->marker.kind = QUEUE_MARKER_NONE;
+    } else {
+        *item = slot->item;
+        if (buf && item->str) {
+            *spent = *buf;
+            *buf = item->str;
+            *cap = item->bytes;
+        }
+    }
+    queue_remove_head(queue);
+    PROBE_QUEUE_POP(queue, queue->size,
+                    item->batch ? item->batch->count - item->cursor : item->str ? 1 : 0,
+                    item->batch ? item->batch->size - item->batch->offsets[item->cursor]
+                                      - (item->batch->count - item->cursor)
+                                : item->str ? strlen(item->str) : 0);
     
     /* Signal that queue is not full */
-    pthread_cond_signal(&queue->not_full);
+    monitor_cond_signal(&queue->not_full);
+    
+    monitor_exit(&queue->monitor);
     
-    pthread_mutex_unlock(&queue->mutex);
+    /* Records a string consumer already took are not handed out again */
+    if (item->batch && item->cursor > 0) {
+        record_batch_drop_front(item->batch, item->cursor);
+        item->cursor = 0;
+    }
     return 0;
 }
 
+/**
+ * Pop the next item, string or batch
+ */
+int queue_pop_item(queue_t* queue, queue_item_t* item) {
+    if (!queue || !item) {
+        errno = EINVAL;
+        return -1;
+    }
+    return queue_pop_slot(queue, item, NULL, NULL, NULL, NULL);
+}
+
+/* queue_pop_into with an optional deadline */
+static int queue_pop_into_until(queue_t* queue, queue_item_t* item, char** buf, size_t* cap,
+                                const struct timespec* deadline) {
+    if (!queue || !item || !buf || !cap) {
+        errno = EINVAL;
+        return -1;
+    }
+    
+    /* Room for any inline record, grown outside the lock */
+    if (!*buf || *cap < QUEUE_INLINE_MAX + 1) {
+        char* grown = realloc(*buf, QUEUE_INLINE_MAX + 1);
+        if (!grown) {
+            errno = ENOMEM;
+            return -1;
+        }
+        metrics_count_alloc(QUEUE_INLINE_MAX + 1);
+        *buf = grown;
+        *cap = QUEUE_INLINE_MAX + 1;
+    }
+    
+    char* spent = NULL;
+    int ret = queue_pop_slot(queue, item, buf, cap, &spent, deadline);
+    free(spent);
+    return ret;
+}
+
+/**
+ * Pop the next item, copying string records into a reusable buffer
+ */
+int queue_pop_into(queue_t* queue, queue_item_t* item, char** buf, size_t* cap) {
+    return queue_pop_into_until(queue, item, buf, cap, NULL);
+}
+
+/**
+ * queue_pop_into, waiting at most timeout_us for an item
+ */
+int queue_pop_into_timeout(queue_t* queue, queue_item_t* item, char** buf, size_t* cap,
+                           uint64_t timeout_us) {
+    struct timespec deadline;
+    monitor_deadline(&deadline, timeout_us);
+    return queue_pop_into_until(queue, item, buf, cap, &deadline);
+}
+
 /**
  * Initiate queue shutdown
  */
@@ -173,15 +729,21 @@ int queue_shutdown(queue_t* queue) {
         return -1;
     }
     
-    pthread_mutex_lock(&queue->mutex);
+    monitor_enter(&queue->monitor);
     
     queue->shutdown = 1;
+    PROBE_QUEUE_SHUTDOWN(queue, queue->size);
     
     /* Wake up all waiting threads */
-    pthread_cond_broadcast(&queue->not_full);
-    pthread_cond_broadcast(&queue->not_empty);
+    monitor_cond_broadcast(&queue->not_full);
+    monitor_cond_broadcast(&queue->not_empty);
+    
+    monitor_exit(&queue->monitor);
     
-    pthread_mutex_unlock(&queue->mutex);
+    /* Producers blocked on the budget give up too */
+    if (queue->budget) {
+        mem_budget_wake(queue->budget);
+    }
     return 0;
 }
 
@@ -191,9 +753,9 @@ int queue_shutdown(queue_t* queue) {
 int queue_is_full(queue_t* queue) {
     if (!queue) return 0;
     
-    pthread_mutex_lock(&queue->mutex);
+    monitor_enter(&queue->monitor);
     int full = (queue->size >= queue->capacity) && !queue->shutdown;
-    pthread_mutex_unlock(&queue->mutex);
+    monitor_exit(&queue->monitor);
     
     return full;
 }
@@ -204,9 +766,9 @@ int queue_is_full(queue_t* queue) {
 int queue_is_empty(queue_t* queue) {
     if (!queue) return 1;
     
-    pthread_mutex_lock(&queue->mutex);
+    monitor_enter(&queue->monitor);
     int empty = (queue->size == 0);
-    pthread_mutex_unlock(&queue->mutex);
+    monitor_exit(&queue->monitor);
     
     return empty;
 }
@@ -217,9 +779,9 @@ int queue_is_empty(queue_t* queue) {
 size_t queue_size(queue_t* queue) {
     if (!queue) return 0;
     
-    pthread_mutex_lock(&queue->mutex);
+    monitor_enter(&queue->monitor);
     size_t size = queue->size;
-    pthread_mutex_unlock(&queue->mutex);
+    monitor_exit(&queue->monitor);
     
     return size;
 }
\ No newline at end of file
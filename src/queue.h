@@ -4,13 +4,38 @@
  * 
  * This queue provides a thread-safe FIFO data structure with the following features:
  * - Bounded capacity with blocking on full/empty conditions
- * - Producer-consumer pattern with mutex and condition variables
+ * - Producer-consumer pattern on a monitor (monitor.h) with separate
+ *   not_full and not_empty conditions, so producers and consumers never
+ *   wake each other needlessly
  * - Clean shutdown mechanism that unblocks all waiting threads
  * - No busy-waiting - all blocking is done with condition variables
  * - Immediate string copying to avoid TOCTOU issues
+ * - Cache-line ring slots that hold records of up to QUEUE_INLINE_MAX
+ *   bytes inline, so short lines cost no heap allocation on push; longer
+ *   records and batches are referenced from the slot
+ * - queue_pop_into, which copies inline records into a caller buffer that
+ *   is reused from pop to pop, so consumers stop allocating as well
+ * - Record batches carried as a single item (one queue operation per batch)
+ * - Cumulative blocked-on-full and blocked-on-empty time, for bottleneck
+ *   analysis (two clock reads per wait that actually blocks)
+ * - Bytes in flight and their peak, counting each batch's whole footprint
+ * - Relative timeouts for push and pop (queue_push_timeout,
+ *   queue_pop_timeout, queue_pop_into_timeout), measured on
+ *   CLOCK_MONOTONIC, for callers that batch against a deadline
+ * - Optional byte budget shared with other queues (mem_budget.h): pushes
+ *   block while the budget is spent, except into an empty queue
+ * - Control markers (flush, epoch, watermark) queued in order with the
+ *   records, so a consumer knows exactly which records came before one
+ * 
+ * String consumers (queue_pop, queue_pop_batch) see the records of a batch
+ * one by one, so producers can switch to batches without breaking them.
+ * They skip markers, which only item consumers (queue_pop_item,
+ * queue_pop_into) receive.
  * 
  * Thread Safety: All functions are thread-safe and can be called concurrently
- * Memory Management: queue_push copies strings, queue_pop allocates strings (caller must free)
+ * Memory Management: queue_push copies strings, queue_pop allocates strings (caller must free);
+ *                    queue_push_batch takes ownership of the batch, queue_pop_item hands it back;
+ *                    queue_pop_into keeps strings in one caller-freed buffer
  */
 
 #ifndef QUEUE_H
@@ -18,25 +43,84 @@
 
 #include <pthread.h>
 #include <stddef.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include "record_batch.h"
+#include "monitor.h"
+#include "mem_budget.h"
 
 /* Return codes */
 #define QUEUE_SUCCESS    0
 #define QUEUE_ERROR     -1
 #define QUEUE_SHUTDOWN  -2
+#define QUEUE_TIMEOUT   -3
+
+/* Control marker kinds */
+#define QUEUE_MARKER_NONE       0   /* Not a marker */
+#define QUEUE_MARKER_FLUSH      1   /* Emit and flush whatever is held back */
+#define QUEUE_MARKER_EPOCH      2   /* Records before it belong to epochs < value */
+#define QUEUE_MARKER_WATERMARK  3   /* No later record has an event time < value */
+#define QUEUE_MARKER_END        4   /* End of stream; never queued (see stage.h) */
+
+/* Control marker: travels through queues in order with the records */
+typedef struct queue_marker {
+    uint32_t kind;           /* QUEUE_MARKER_* */
+    uint64_t value;          /* Epoch or watermark; 0 for a flush */
+} queue_marker_t;
+
+/* Queue item: one string record, one batch of records or one marker */
+typedef struct queue_item {
+    char* str;               /* String record (caller frees), or NULL */
+    record_batch_t* batch;   /* Record batch (caller frees), or NULL */
+    size_t cursor;           /* Batch records already handed out by queue_pop */
+    size_t bytes;            /* Memory the item holds, for accounting */
+    queue_marker_t marker;   /* Set (kind != 0) when the item is a marker */
+} queue_item_t;
+
+/* Longest string record kept inside its ring slot */
+#define QUEUE_INLINE_MAX 62
+
+/* Size and alignment of a ring slot: one cache line */
+#define QUEUE_SLOT_SIZE 64
+
+/* Ring slot: a short record stored inline, or a heap string or batch.
+ * The flag sits in the last byte, past the end of item. */
+typedef struct queue_slot {
+    union {
+        struct {
+            _Alignas(QUEUE_SLOT_SIZE) char text[QUEUE_INLINE_MAX + 1];  /* Inline record */
+            uint8_t inlined;         /* Set when text is in use */
+        };
+        queue_item_t item;           /* Heap string or batch */
+    };
+} queue_slot_t;
 
 /* Queue structure - opaque to users */
 typedef struct queue {
-    char** buffer;           /* Ring buffer of string pointers */
+    queue_slot_t* buffer;    /* Ring buffer of slots */
     size_t capacity;         /* Maximum number of items */
     size_t size;            /* Current number of items */
     size_t head;            /* Index of next item to remove */
     size_t tail;            /* Index of next item to insert */
     
-    pthread_mutex_t mutex;   /* Protects all queue state */
-    pthread_cond_t not_full; /* Signaled when queue is not full */
-    pthread_cond_t not_empty;/* Signaled when queue is not empty */
+    monitor_t monitor;       /* Protects all queue state */
+    monitor_cond_t not_full; /* Signaled when queue is not full */
+    monitor_cond_t not_empty;/* Signaled when queue is not empty */
+    
+    volatile int shutdown;  /* Flag indicating queue is shutting down */
+    
+    /* Time spent blocked, summed over all waiters; written under the
+     * mutex, readable without it */
+    _Atomic uint64_t wait_full_ns;   /* Producers waiting for room */
+    _Atomic uint64_t wait_empty_ns;  /* Consumers waiting for an item */
+    
+    /* Memory held by queued items and a copy of size, for lock-free
+     * readers; same access rules as the wait times */
+    _Atomic uint64_t bytes;
+    _Atomic uint64_t peak_bytes;
+    _Atomic uint64_t depth;
     
-    int shutdown;           /* Flag indicating queue is shutting down */
+    mem_budget_t* budget;    /* Shared byte budget (not owned), or NULL */
 } queue_t;
 
 /**
@@ -60,6 +144,25 @@ int queue_init(queue_t* queue, size_t capacity);
  */
 void queue_destroy(queue_t* queue);
 
+/**
+ * @brief Name the queue's lock for the lock profile (monitor.h)
+ * 
+ * @param queue Pointer to an initialized queue
+ * @param name Name (copied), or NULL
+ */
+void queue_set_name(queue_t* queue, const char* name);
+
+/**
+ * @brief Charge the queue's items to a shared byte budget
+ * 
+ * @param queue Pointer to an initialized, still unused queue
+ * @param budget Budget shared with other queues, or NULL for none
+ * 
+ * @note Producers then block while the budget is spent, unless the queue
+ *       is empty; the budget must outlive the queue
+ */
+void queue_set_budget(queue_t* queue, mem_budget_t* budget);
+
 /**
  * @brief Push a string onto the queue (blocking if full)
  * 
@@ -73,6 +176,18 @@ void queue_destroy(queue_t* queue);
  */
 int queue_push(queue_t* queue, const char* str);
 
+/**
+ * @brief Push a string, waiting at most timeout_us for room
+ * 
+ * @param queue Pointer to the queue
+ * @param str String to push (will be copied)
+ * @param timeout_us Longest wait in microseconds, for room and for any
+ *                   byte budget together; 0 never blocks
+ * @return 0 on success, QUEUE_TIMEOUT if nothing was pushed in time,
+ *         QUEUE_SHUTDOWN if queue is shutting down, -1 on error
+ */
+int queue_push_timeout(queue_t* queue, const char* str, uint64_t timeout_us);
+
 /**
  * @brief Pop a string from the queue (blocking if empty)
  * 
@@ -87,6 +202,111 @@ int queue_push(queue_t* queue, const char* str);
  */
 int queue_pop(queue_t* queue, char** out_str);
 
+/**
+ * @brief Pop a string, waiting at most timeout_us for one
+ * 
+ * @param queue Pointer to the queue
+ * @param out_str Pointer to store allocated string (caller must free)
+ * @param timeout_us Longest wait in microseconds; 0 never blocks
+ * @return 0 on success, QUEUE_TIMEOUT if the queue stayed empty,
+ *         QUEUE_SHUTDOWN if queue is shutdown and empty, -1 on error
+ */
+int queue_pop_timeout(queue_t* queue, char** out_str, uint64_t timeout_us);
+
+/**
+ * @brief Pop the next item, copying string records into a reusable buffer
+ * 
+ * @param queue Pointer to the queue
+ * @param item Output item; exactly one of item->str, item->batch and
+ *             item->marker.kind is set
+ * @param buf Caller buffer, initially NULL; grown or replaced as needed
+ * @param cap Capacity of *buf, initially 0
+ * @return 0 on success, QUEUE_SHUTDOWN if queue is shutdown and empty, -1 on error
+ * 
+ * @note item->str points into *buf and stays valid (and writable, up to its
+ *       terminator) until the next call; free(*buf) once when done
+ * @note Inline records are copied; a record stored out of line replaces the
+ *       buffer instead, so no record is ever allocated or copied twice
+ * @note Batches are handed over as with queue_pop_item (caller frees)
+ */
+int queue_pop_into(queue_t* queue, queue_item_t* item, char** buf, size_t* cap);
+
+/**
+ * @brief queue_pop_into, waiting at most timeout_us for an item
+ * 
+ * @param queue Pointer to the queue
+ * @param item Output item, as for queue_pop_into
+ * @param buf Caller buffer, as for queue_pop_into
+ * @param cap Capacity of *buf
+ * @param timeout_us Longest wait in microseconds; 0 never blocks
+ * @return 0 on success, QUEUE_TIMEOUT if the queue stayed empty,
+ *         QUEUE_SHUTDOWN if queue is shutdown and empty, -1 on error
+ */
+int queue_pop_into_timeout(queue_t* queue, queue_item_t* item, char** buf, size_t* cap,
+                           uint64_t timeout_us);
+
+/**
+ * @brief Pop up to max strings from the queue in one operation
+ * 
+ * @param queue Pointer to the queue
+ * @param out_strs Array of at least max slots for allocated strings (caller must free each)
+ * @param max Maximum number of strings to pop
+ * @param count Output for the number of strings popped
+ * @return 0 on success, QUEUE_SHUTDOWN if queue is shutdown and empty, -1 on error
+ * 
+ * @note Blocks only until at least one item is available, then takes
+ *       whatever is queued (up to max) under a single lock acquisition
+ * @note Thread-safe: can be called concurrently by multiple consumers
+ */
+int queue_pop_batch(queue_t* queue, char** out_strs, size_t max, size_t* count);
+
+/**
+ * @brief Push a record batch onto the queue as a single item (blocking if full)
+ * 
+ * @param queue Pointer to the queue
+ * @param batch Heap batch from record_batch_create
+ * @return 0 on success, QUEUE_SHUTDOWN if queue is shutting down, -1 on error
+ * 
+ * @note The queue takes ownership of the batch in every case; it is freed
+ *       if the push fails, and empty batches are freed without queueing
+ * @note Counts as one item against the queue capacity
+ */
+int queue_push_batch(queue_t* queue, record_batch_t* batch);
+
+/**
+ * @brief Push a control marker behind the items already queued (blocking if full)
+ * 
+ * @param queue Pointer to the queue
+ * @param marker Marker to copy; kind must be FLUSH, EPOCH or WATERMARK
+ * @return 0 on success, QUEUE_SHUTDOWN if queue is shutting down, -1 on error
+ *         (EINVAL for any other kind)
+ * 
+ * @note Takes one slot of capacity but holds no bytes, so it is never
+ *       held back by the byte budget
+ */
+int queue_push_marker(queue_t* queue, const queue_marker_t* marker);
+
+/**
+ * @brief Pop the next item, string, batch or marker (blocking if empty)
+ * 
+ * @param queue Pointer to the queue
+ * @param item Output item; exactly one of item->str, item->batch and
+ *             item->marker.kind is set
+ * @return 0 on success, QUEUE_SHUTDOWN if queue is shutdown and empty, -1 on error
+ * 
+ * @note Caller owns and must free the returned string or batch
+ *       (free / record_batch_free)
+ */
+int queue_pop_item(queue_t* queue, queue_item_t* item);
+
+/**
+ * @brief Name of a marker kind, e.g. "flush"
+ * 
+ * @param kind QUEUE_MARKER_* value
+ * @return Static string; "none" for an unknown kind
+ */
+const char* queue_marker_name(uint32_t kind);
+
 /**
  * @brief Initiate queue shutdown
  * 
@@ -0,0 +1,269 @@
+/**
+ * @file record_batch.c
+ * @brief Implementation of contiguous record batches
+ */
+
+#include "record_batch.h"
+#include "metrics.h"
+#include "shm_pool.h"
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+/**
+ * Initialize an empty batch
+ */
+int record_batch_init(record_batch_t* batch, size_t records, size_t bytes) {
+    if (!batch) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    memset(batch, 0, sizeof(record_batch_t));
+    if (records == 0) records = 1;
+    if (bytes == 0) bytes = 64;
+
+    batch->offsets = malloc((records + 1) * sizeof(size_t));
+    batch->data = malloc(bytes);
+    if (!batch->offsets || !batch->data) {
+        free(batch->offsets);
+        free(batch->data);
+        batch->offsets = NULL;
+        batch->data = NULL;
+        errno = ENOMEM;
+        return -1;
+    }
+
+    metrics_count_alloc((records + 1) * sizeof(size_t));
+    metrics_count_alloc(bytes);
+    batch->offsets[0] = 0;
+    batch->max_count = records;
+    batch->capacity = bytes;
+    return 0;
+}
+
+/**
+ * Free a batch's buffers
+ */
+void record_batch_destroy(record_batch_t* batch) {
+    if (!batch) return;
+
+    if (batch->pool) {
+        shm_pool_free(batch->pool, batch->data);
+    } else {
+        free(batch->data);
+    }
+    free(batch->offsets);
+    memset(batch, 0, sizeof(record_batch_t));
+}
+
+/**
+ * Allocate and initialize a batch on the heap
+ */
+record_batch_t* record_batch_create(size_t records, size_t bytes) {
+    record_batch_t* batch = malloc(sizeof(record_batch_t));
+    if (!batch) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    metrics_count_alloc(sizeof(record_batch_t));
+
+    if (record_batch_init(batch, records, bytes) != 0) {
+        free(batch);
+        return NULL;
+    }
+    return batch;
+}
+
+/**
+ * Allocate a batch whose arena comes from a shared pool
+ */
+record_batch_t* record_batch_create_in(struct shm_pool* pool, size_t records, size_t bytes) {
+    if (!pool) {
+        return record_batch_create(records, bytes);
+    }
+
+    size_t capacity;
+    char* data = shm_pool_alloc(pool, bytes ? bytes : 64, &capacity);
+    if (!data) {
+        return record_batch_create(records, bytes);
+    }
+
+    /* Start with a token heap arena and swap the pool block in */
+    record_batch_t* batch = record_batch_create(records, 1);
+    if (!batch) {
+        shm_pool_free(pool, data);
+        return NULL;
+    }
+    free(batch->data);
+    metrics_count_alloc(capacity);
+    batch->data = data;
+    batch->capacity = capacity;
+    batch->pool = pool;
+    return batch;
+}
+
+/**
+ * Free a batch created by record_batch_create
+ */
+void record_batch_free(record_batch_t* batch) {
+    if (!batch) return;
+
+    record_batch_destroy(batch);
+    free(batch);
+}
+
+/**
+ * Remove every record, keeping the buffers for reuse
+ */
+void record_batch_reset(record_batch_t* batch) {
+    if (!batch) return;
+
+    batch->count = 0;
+    batch->size = 0;
+    if (batch->offsets) {
+        batch->offsets[0] = 0;
+    }
+}
+
+/**
+ * Make room for more records without further allocation
+ */
+int record_batch_reserve(record_batch_t* batch, size_t records, size_t bytes) {
+    if (!batch) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    if (batch->count + records > batch->max_count) {
+        size_t max = batch->max_count ? batch->max_count : 1;
+        while (max < batch->count + records) max *= 2;
+        size_t* offsets = realloc(batch->offsets, (max + 1) * sizeof(size_t));
+        if (!offsets) {
+            errno = ENOMEM;
+            return -1;
+        }
+        if (!batch->offsets) offsets[0] = 0;
+        metrics_count_alloc((max + 1) * sizeof(size_t));
+        batch->offsets = offsets;
+        batch->max_count = max;
+    }
+
+    if (batch->size + bytes > batch->capacity) {
+        size_t cap = batch->capacity ? batch->capacity : 64;
+        while (cap < batch->size + bytes) cap *= 2;
+        char* data;
+        if (batch->pool) {
+            /* Stay in the pool while it has a block; else move to the heap */
+            size_t block;
+            struct shm_pool* pool = batch->pool;
+            data = shm_pool_alloc(pool, cap, &block);
+            if (data) {
+                cap = block;
+            } else if ((data = malloc(cap))) {
+                batch->pool = NULL;
+            }
+            if (data) {
+                memcpy(data, batch->data, batch->size);
+                shm_pool_free(pool, batch->data);
+            }
+        } else {
+            data = realloc(batch->data, cap);
+        }
+        if (!data) {
+            errno = ENOMEM;
+            return -1;
+        }
+        metrics_count_alloc(cap);
+        batch->data = data;
+        batch->capacity = cap;
+    }
+
+    return 0;
+}
+
+/**
+ * Append a copy of a record
+ */
+int record_batch_append(record_batch_t* batch, const char* str, size_t len) {
+    if (!batch || (!str && len > 0)) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    if (record_batch_reserve(batch, 1, len + 1) != 0) {
+        return -1;
+    }
+
+    char* dst = batch->data + batch->size;
+    if (len > 0) {
+        memcpy(dst, str, len);
+    }
+    dst[len] = '\0';
+
+    batch->size += len + 1;
+    batch->count++;
+    batch->offsets[batch->count] = batch->size;
+    return 0;
+}
+
+/**
+ * Add a record whose bytes are already in the arena
+ */
+int record_batch_commit(record_batch_t* batch, size_t len) {
+    if (!batch || batch->size + len + 1 > batch->capacity) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (record_batch_reserve(batch, 1, 0) != 0) {
+        return -1;
+    }
+
+    batch->size += len + 1;
+    batch->count++;
+    batch->offsets[batch->count] = batch->size;
+    return 0;
+}
+
+/**
+ * Remove the first records, moving the rest to the front
+ */
+void record_batch_drop_front(record_batch_t* batch, size_t n) {
+    if (!batch || n == 0) return;
+    if (n >= batch->count) {
+        record_batch_reset(batch);
+        return;
+    }
+
+    size_t base = batch->offsets[n];
+    size_t remaining = batch->count - n;
+    memmove(batch->data, batch->data + base, batch->size - base);
+    for (size_t i = 0; i <= remaining; i++) {
+        batch->offsets[i] = batch->offsets[i + n] - base;
+    }
+    batch->size -= base;
+    batch->count = remaining;
+}
+
+/**
+ * Replace a batch's contents with a copy of another batch
+ */
+int record_batch_copy(record_batch_t* dst, const record_batch_t* src) {
+    if (!dst || !src) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    record_batch_reset(dst);
+    if (record_batch_reserve(dst, src->count, src->size) != 0) {
+        return -1;
+    }
+
+    memcpy(dst->data, src->data, src->size);
+    memcpy(dst->offsets, src->offsets, (src->count + 1) * sizeof(size_t));
+    dst->size = src->size;
+    dst->count = src->count;
+    dst->ingest_ns = src->ingest_ns;
+    dst->queued_ns = src->queued_ns;
+    return 0;
+}
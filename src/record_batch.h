@@ -0,0 +1,182 @@
+/**
+ * @file record_batch.h
+ * @brief Contiguous batch of string records
+ *
+ * A record batch stores many records in a single arena, back to back and
+ * each NUL-terminated, with an offsets array marking where each starts.
+ * Features include:
+ * - One allocation for the bytes of every record in the batch
+ * - Kernels can run over the whole arena as one long loop
+ * - Records stay usable as ordinary C strings
+ * - Buffers are kept on reset, so a reused batch stops allocating
+ *
+ * Layout: record i occupies data[offsets[i] .. offsets[i + 1] - 1), followed
+ * by its NUL at data[offsets[i + 1] - 1]; offsets[count] == size.
+ *
+ * Batches also travel between pipeline stages as single queue items; a
+ * heap batch from record_batch_create changes owner when it is pushed.
+ * The two timestamps are out-of-band metadata for latency measurement and
+ * are never part of the records.
+ *
+ * Allocations are charged to the calling thread's stage metrics (see
+ * metrics_count_alloc in metrics.h).
+ *
+ * The arena may come from a shared block pool (shm_pool.h) instead of the
+ * heap, so a child process can read and write the records in place; it
+ * moves to the heap if it outgrows the largest pool block or the pool is
+ * used up.
+ *
+ * Thread Safety: Not thread-safe; a batch is owned by one thread at a time
+ * Memory Management: record_batch_destroy frees the arena and offsets;
+ *                    record_batch_free also frees a heap-allocated batch
+ */
+
+#ifndef RECORD_BATCH_H
+#define RECORD_BATCH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+struct shm_pool;
+
+/* Batch structure */
+typedef struct record_batch {
+    char* data;              /* Arena holding every record */
+    size_t size;             /* Bytes used in data */
+    size_t capacity;         /* Bytes allocated for data */
+    size_t* offsets;         /* count + 1 record start offsets */
+    size_t count;            /* Number of records */
+    size_t max_count;        /* Records offsets can describe without growing */
+    uint64_t ingest_ns;      /* When the records entered the pipeline, 0 if unstamped */
+    uint64_t queued_ns;      /* When the batch was handed to its current queue */
+    struct shm_pool* pool;   /* Pool holding data, NULL for the heap */
+} record_batch_t;
+
+/**
+ * @brief Initialize an empty batch
+ *
+ * @param batch Pointer to batch structure to initialize
+ * @param records Initial record capacity (grows on demand)
+ * @param bytes Initial arena capacity in bytes (grows on demand)
+ * @return 0 on success, -1 on error (sets errno)
+ */
+int record_batch_init(record_batch_t* batch, size_t records, size_t bytes);
+
+/**
+ * @brief Free a batch's buffers
+ *
+ * @param batch Pointer to batch to destroy
+ */
+void record_batch_destroy(record_batch_t* batch);
+
+/**
+ * @brief Allocate and initialize a batch on the heap
+ *
+ * @param records Initial record capacity (grows on demand)
+ * @param bytes Initial arena capacity in bytes (grows on demand)
+ * @return Pointer to new batch on success, NULL on error (sets errno)
+ */
+record_batch_t* record_batch_create(size_t records, size_t bytes);
+
+/**
+ * @brief Allocate a batch whose arena comes from a shared pool
+ *
+ * @param pool Pool for the arena (NULL behaves as record_batch_create)
+ * @param records Initial record capacity (grows on demand)
+ * @param bytes Initial arena capacity in bytes (grows on demand)
+ * @return Pointer to new batch on success, NULL on error (sets errno)
+ *
+ * @note Falls back to a heap arena (pool NULL) if the pool cannot
+ *       provide the block
+ */
+record_batch_t* record_batch_create_in(struct shm_pool* pool, size_t records, size_t bytes);
+
+/**
+ * @brief Free a batch created by record_batch_create
+ *
+ * @param batch Pointer to batch (NULL is ignored)
+ */
+void record_batch_free(record_batch_t* batch);
+
+/**
+ * @brief Remove every record, keeping the buffers for reuse
+ *
+ * @param batch Pointer to the batch
+ */
+void record_batch_reset(record_batch_t* batch);
+
+/**
+ * @brief Make room for more records without further allocation
+ *
+ * @param batch Pointer to the batch
+ * @param records Number of additional records
+ * @param bytes Number of additional record bytes (NULs included)
+ * @return 0 on success, -1 on error (sets errno)
+ */
+int record_batch_reserve(record_batch_t* batch, size_t records, size_t bytes);
+
+/**
+ * @brief Append a copy of a record
+ *
+ * @param batch Pointer to the batch
+ * @param str Record bytes (need not be NUL-terminated)
+ * @param len Record length
+ * @return 0 on success, -1 on error (sets errno)
+ */
+int record_batch_append(record_batch_t* batch, const char* str, size_t len);
+
+/**
+ * @brief Add a record whose bytes are already in the arena
+ *
+ * @param batch Pointer to the batch
+ * @param len Record length; the record and its NUL are at data + size
+ * @return 0 on success, -1 on error (sets errno)
+ *
+ * @note For producers that write into the arena directly; the bytes must
+ *       fit the current capacity
+ */
+int record_batch_commit(record_batch_t* batch, size_t len);
+
+/**
+ * @brief Remove the first records, moving the rest to the front
+ *
+ * @param batch Pointer to the batch
+ * @param n Number of records to remove (clamped to count)
+ */
+void record_batch_drop_front(record_batch_t* batch, size_t n);
+
+/**
+ * @brief Replace a batch's contents with a copy of another batch
+ *
+ * @param dst Destination batch
+ * @param src Source batch
+ * @return 0 on success, -1 on error (sets errno)
+ */
+int record_batch_copy(record_batch_t* dst, const record_batch_t* src);
+
+/**
+ * @brief Get a record
+ *
+ * @param batch Pointer to the batch
+ * @param index Record index (must be < count)
+ * @param len Optional output for the record length
+ * @return Pointer to the NUL-terminated record inside the arena
+ */
+static inline char* record_batch_get(const record_batch_t* batch, size_t index, size_t* len) {
+    if (len) {
+        *len = batch->offsets[index + 1] - batch->offsets[index] - 1;
+    }
+    return batch->data + batch->offsets[index];
+}
+
+/**
+ * @brief Memory a heap batch holds, for accounting
+ *
+ * @param batch Pointer to a batch from record_batch_create
+ * @return Bytes of the structure, the arena and the offsets array
+ */
+static inline size_t record_batch_footprint(const record_batch_t* batch) {
+    return sizeof(record_batch_t) + batch->capacity + (batch->max_count + 1) * sizeof(size_t);
+}
+
+#endif /* RECORD_BATCH_H */
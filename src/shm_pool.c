@@ -0,0 +1,146 @@
+/**
+ * @file shm_pool.c
+ * @brief Implementation of the shared block pool
+ */
+
+#include "shm_pool.h"
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+/* Pages the classes table describes; every block starts on one */
+#define SHM_POOL_PAGE SHM_POOL_MIN_BLOCK
+
+/* Marks a page no allocated block starts on */
+#define SHM_POOL_NO_BLOCK 0xFF
+
+static unsigned class_of(size_t bytes) {
+    unsigned k = 0;
+    while (((size_t)SHM_POOL_MIN_BLOCK << k) < bytes) k++;
+    return k;
+}
+
+/**
+ * Map a pool
+ */
+shm_pool_t* shm_pool_create(size_t bytes) {
+    if (bytes == 0 || bytes > SIZE_MAX - SHM_POOL_MAX_BLOCK) {
+        errno = EINVAL;
+        return NULL;
+    }
+    bytes = (bytes + SHM_POOL_MAX_BLOCK - 1) & ~(size_t)(SHM_POOL_MAX_BLOCK - 1);
+
+    shm_pool_t* pool = calloc(1, sizeof(shm_pool_t));
+    if (!pool) {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    size_t pages = bytes / SHM_POOL_PAGE;
+    pool->classes = malloc(pages);
+    int ok = pool->classes != NULL;
+    for (unsigned k = 0; ok && k < SHM_POOL_CLASSES; k++) {
+        pool->free[k] = malloc((bytes / ((size_t)SHM_POOL_MIN_BLOCK << k)) * sizeof(uint64_t));
+        ok = pool->free[k] != NULL;
+    }
+    if (!ok) {
+        shm_pool_destroy(pool);
+        errno = ENOMEM;
+        return NULL;
+    }
+    memset(pool->classes, SHM_POOL_NO_BLOCK, pages);
+
+    void* mem = mmap(NULL, bytes, PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (mem == MAP_FAILED) {
+        int saved = errno;
+        shm_pool_destroy(pool);
+        errno = saved;
+        return NULL;
+    }
+
+    pool->base = mem;
+    pool->size = bytes;
+    pthread_mutex_init(&pool->lock, NULL);
+    return pool;
+}
+
+/**
+ * Unmap a pool and free its bookkeeping
+ */
+void shm_pool_destroy(shm_pool_t* pool) {
+    if (!pool) return;
+
+    if (pool->base) {
+        munmap(pool->base, pool->size);
+        pthread_mutex_destroy(&pool->lock);
+    }
+    for (unsigned k = 0; k < SHM_POOL_CLASSES; k++) {
+        free(pool->free[k]);
+    }
+    free(pool->classes);
+    free(pool);
+}
+
+/**
+ * Allocate a block
+ */
+void* shm_pool_alloc(shm_pool_t* pool, size_t bytes, size_t* capacity) {
+    if (bytes > SHM_POOL_MAX_BLOCK) {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    unsigned k = class_of(bytes);
+    size_t block = (size_t)SHM_POOL_MIN_BLOCK << k;
+    uint64_t offset;
+
+    pthread_mutex_lock(&pool->lock);
+    if (pool->free_count[k] > 0) {
+        offset = pool->free[k][--pool->free_count[k]];
+    } else {
+        /* Blocks are aligned to their size, so the mapping tiles evenly */
+        size_t start = (pool->next + block - 1) & ~(block - 1);
+        if (start + block > pool->size) {
+            pthread_mutex_unlock(&pool->lock);
+            errno = ENOMEM;
+            return NULL;
+        }
+        /* Carve the alignment gap into smaller free blocks */
+        for (size_t gap = pool->next; gap < start; ) {
+            unsigned g = 0;
+            while (g + 1 < k && gap % ((size_t)SHM_POOL_MIN_BLOCK << (g + 1)) == 0 &&
+                   gap + ((size_t)SHM_POOL_MIN_BLOCK << (g + 1)) <= start) {
+                g++;
+            }
+            pool->free[g][pool->free_count[g]++] = gap;
+            gap += (size_t)SHM_POOL_MIN_BLOCK << g;
+        }
+        offset = start;
+        pool->next = start + block;
+    }
+    pool->classes[offset / SHM_POOL_PAGE] = (uint8_t)k;
+    pthread_mutex_unlock(&pool->lock);
+
+    if (capacity) {
+        *capacity = block;
+    }
+    return pool->base + offset;
+}
+
+/**
+ * Return a block to the pool
+ */
+void shm_pool_free(shm_pool_t* pool, void* block) {
+    if (!block) return;
+
+    uint64_t offset = shm_pool_offset(pool, block);
+    pthread_mutex_lock(&pool->lock);
+    unsigned k = pool->classes[offset / SHM_POOL_PAGE];
+    if (k < SHM_POOL_CLASSES) {
+        pool->free[k][pool->free_count[k]++] = offset;
+        pool->classes[offset / SHM_POOL_PAGE] = SHM_POOL_NO_BLOCK;
+    }
+    pthread_mutex_unlock(&pool->lock);
+}
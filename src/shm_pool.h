@@ -0,0 +1,112 @@
+/**
+ * @file shm_pool.h
+ * @brief Block allocator over one shared anonymous mapping
+ *
+ * The pool hands out blocks of a MAP_SHARED mapping, so record batch
+ * arenas allocated from it are visible at the same offsets to a child
+ * process forked afterwards. An isolated stage (isolate.h) can then pass
+ * records to its child as (offset, length) descriptors instead of copying
+ * their bytes through a ring. Features include:
+ * - Power-of-two block classes from SHM_POOL_MIN_BLOCK to SHM_POOL_MAX_BLOCK
+ * - Freed blocks are kept per class and reused, so a running pipeline
+ *   stops carving new space
+ * - All bookkeeping lives in host memory: a child that scribbles over the
+ *   mapping cannot corrupt the allocator
+ * - Untouched pages are never committed, so a generous size costs only
+ *   address space
+ *
+ * The mapping cannot grow once a child has been forked, so allocation
+ * fails when it is used up or the request is larger than the largest
+ * class; callers then fall back to the heap.
+ *
+ * Thread Safety: All functions are thread-safe within the creating
+ *                process; a child only reads and writes block contents
+ * Memory Management: shm_pool_destroy unmaps every block at once
+ */
+
+#ifndef SHM_POOL_H
+#define SHM_POOL_H
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Smallest and largest blocks the pool hands out */
+#define SHM_POOL_MIN_BLOCK 4096
+#define SHM_POOL_MAX_BLOCK (1024 * 1024)
+
+/* Number of block classes between the two */
+#define SHM_POOL_CLASSES 9
+
+/* Pool structure; the blocks live in the shared mapping at base */
+typedef struct shm_pool {
+    char* base;                          /* Start of the shared mapping */
+    size_t size;                         /* Bytes mapped */
+    size_t next;                         /* Offset of space never handed out */
+    pthread_mutex_t lock;                /* Guards next, the free lists and classes */
+    uint64_t* free[SHM_POOL_CLASSES];    /* Offsets of free blocks, per class */
+    size_t free_count[SHM_POOL_CLASSES];
+    uint8_t* classes;                    /* Class of the block starting at each page */
+} shm_pool_t;
+
+/**
+ * @brief Map a pool
+ *
+ * @param bytes Size of the mapping (rounded up to SHM_POOL_MAX_BLOCK)
+ * @return Pointer to the pool on success, NULL on error (sets errno)
+ *
+ * @note Create before fork; the child inherits the mapping
+ */
+shm_pool_t* shm_pool_create(size_t bytes);
+
+/**
+ * @brief Unmap a pool and free its bookkeeping
+ *
+ * @param pool Pointer to the pool (NULL is ignored)
+ *
+ * @note Every block is gone afterwards, allocated or not
+ */
+void shm_pool_destroy(shm_pool_t* pool);
+
+/**
+ * @brief Allocate a block
+ *
+ * @param pool Pointer to the pool
+ * @param bytes Bytes needed
+ * @param capacity Output parameter for the block size (at least bytes)
+ * @return Pointer to the block, NULL if the pool is used up or bytes
+ *         exceeds SHM_POOL_MAX_BLOCK (errno ENOMEM)
+ */
+void* shm_pool_alloc(shm_pool_t* pool, size_t bytes, size_t* capacity);
+
+/**
+ * @brief Return a block to the pool
+ *
+ * @param pool Pointer to the pool
+ * @param block Pointer from shm_pool_alloc (NULL is ignored)
+ */
+void shm_pool_free(shm_pool_t* pool, void* block);
+
+/**
+ * @brief Offset of an address inside the pool
+ *
+ * @param pool Pointer to the pool
+ * @param ptr Address inside an allocated block
+ * @return Offset from the start of the mapping, the same in every process
+ */
+static inline uint64_t shm_pool_offset(const shm_pool_t* pool, const void* ptr) {
+    return (uint64_t)((const char*)ptr - pool->base);
+}
+
+/**
+ * @brief Address of an offset inside the pool
+ *
+ * @param pool Pointer to the pool
+ * @param offset Offset from shm_pool_offset
+ * @return Pointer into the mapping
+ */
+static inline char* shm_pool_at(const shm_pool_t* pool, uint64_t offset) {
+    return pool->base + offset;
+}
+
+#endif /* SHM_POOL_H */
@@ -0,0 +1,221 @@
+/**
+ * @file shm_ring.c
+ * @brief Implementation of the shared-memory SPSC record ring
+ */
+
+#include "shm_ring.h"
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+/* Records start on 16-byte boundaries, so a wrap filler always fits */
+#define SHM_ALIGN 16
+
+static size_t record_size(size_t len) {
+    return (sizeof(shm_record_t) + len + 1 + SHM_ALIGN - 1) & ~(size_t)(SHM_ALIGN - 1);
+}
+
+/* Shared (not FUTEX_PRIVATE) futex ops: the waiter may be another process */
+static void futex_wait(_Atomic uint32_t* addr, uint32_t val, int timeout_ms) {
+    struct timespec ts;
+    struct timespec* tp = NULL;
+    if (timeout_ms >= 0) {
+        ts.tv_sec = timeout_ms / 1000;
+        ts.tv_nsec = (long)(timeout_ms % 1000) * 1000000L;
+        tp = &ts;
+    }
+    syscall(SYS_futex, (uint32_t*)addr, FUTEX_WAIT, val, tp, NULL, 0);
+}
+
+static void futex_wake(_Atomic uint32_t* addr) {
+    syscall(SYS_futex, (uint32_t*)addr, FUTEX_WAKE, 1, NULL, NULL, 0);
+}
+
+static long long now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/*
+ * Sleep until *seq moves or the ready() condition holds. The waiter flag is
+ * set before seq is sampled, and the other side bumps seq before reading the
+ * flag, so either the wake is sent or the recheck sees the new state.
+ */
+#define SHM_WAIT(ring, seq_field, waiting_field, ready, timeout_ms) \
+    do { \
+        atomic_store(&(ring)->waiting_field, 1); \
+        uint32_t seen = atomic_load(&(ring)->seq_field); \
+        if (!(ready)) { \
+            futex_wait(&(ring)->seq_field, seen, (timeout_ms)); \
+        } \
+        atomic_store(&(ring)->waiting_field, 0); \
+    } while (0)
+
+/**
+ * Create a ring in a shared anonymous mapping
+ */
+shm_ring_t* shm_ring_create(size_t capacity) {
+    size_t cap = 4096;
+    while (cap < capacity) {
+        if (cap > SIZE_MAX / 2) {
+            errno = EINVAL;
+            return NULL;
+        }
+        cap *= 2;
+    }
+
+    size_t map_size = sizeof(shm_ring_t) + cap;
+    void* mem = mmap(NULL, map_size, PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (mem == MAP_FAILED) {
+        return NULL;
+    }
+
+    /* Fresh anonymous mappings are zeroed, which is the empty ring */
+    shm_ring_t* ring = mem;
+    ring->capacity = cap;
+    ring->map_size = map_size;
+    return ring;
+}
+
+/**
+ * Unmap a ring
+ */
+void shm_ring_destroy(shm_ring_t* ring) {
+    if (ring) {
+        munmap(ring, ring->map_size);
+    }
+}
+
+/**
+ * Largest record the ring accepts
+ */
+size_t shm_ring_max_record(const shm_ring_t* ring) {
+    /* Half the ring, so a record plus a worst-case wrap filler always fits */
+    return ring->capacity / 2 - sizeof(shm_record_t) - SHM_ALIGN;
+}
+
+/**
+ * Reserve space for a record (producer)
+ */
+shm_record_t* shm_ring_reserve(shm_ring_t* ring, size_t len, int timeout_ms) {
+    if (len > shm_ring_max_record(ring)) {
+        errno = EMSGSIZE;
+        return NULL;
+    }
+
+    uint64_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    uint64_t mask = ring->capacity - 1;
+    uint64_t off = head & mask;
+    size_t need = record_size(len);
+    uint64_t total = need;
+    if (off + need > ring->capacity) {
+        total += ring->capacity - off;
+    }
+
+    long long deadline = timeout_ms >= 0 ? now_ms() + timeout_ms : 0;
+    for (;;) {
+        uint64_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+        if (ring->capacity - (head - tail) >= total) {
+            break;
+        }
+
+        int wait_ms = -1;
+        if (timeout_ms >= 0) {
+            long long left = deadline - now_ms();
+            if (left <= 0) {
+                errno = ETIMEDOUT;
+                return NULL;
+            }
+            wait_ms = (int)left;
+        }
+        SHM_WAIT(ring, space_seq, space_waiting,
+                 ring->capacity - (head - atomic_load(&ring->tail)) >= total, wait_ms);
+    }
+
+    shm_record_t* rec;
+    if (total != need) {
+        /* Not enough room before the end: fill it and start over at 0 */
+        shm_record_t* filler = (shm_record_t*)(ring->data + off);
+        filler->kind = SHM_RECORD_WRAP;
+        filler->len = 0;
+        rec = (shm_record_t*)ring->data;
+    } else {
+        rec = (shm_record_t*)(ring->data + off);
+    }
+
+    ring->pending = head + total;
+    rec->len = (uint32_t)len;
+    rec->kind = 0;
+    rec->value = 0;
+    return rec;
+}
+
+/**
+ * Publish the reserved record (producer)
+ */
+void shm_ring_publish(shm_ring_t* ring) {
+    atomic_store_explicit(&ring->head, ring->pending, memory_order_release);
+    atomic_fetch_add(&ring->data_seq, 1);
+    if (atomic_load(&ring->data_waiting)) {
+        futex_wake(&ring->data_seq);
+    }
+}
+
+/**
+ * Mark the ring closed and wake the consumer (producer)
+ */
+void shm_ring_close(shm_ring_t* ring) {
+    atomic_store(&ring->closed, 1);
+    atomic_fetch_add(&ring->data_seq, 1);
+    futex_wake(&ring->data_seq);
+}
+
+/**
+ * Wait until a record is published at or after a position (consumer)
+ */
+int shm_ring_wait_data(shm_ring_t* ring, uint64_t pos, int timeout_ms) {
+    if (atomic_load_explicit(&ring->head, memory_order_acquire) > pos) {
+        return 1;
+    }
+    if (timeout_ms == 0 || atomic_load(&ring->closed)) {
+        return 0;
+    }
+
+    SHM_WAIT(ring, data_seq, data_waiting,
+             atomic_load(&ring->head) > pos || atomic_load(&ring->closed), timeout_ms);
+    return atomic_load_explicit(&ring->head, memory_order_acquire) > pos;
+}
+
+/**
+ * Get the record at a position (consumer)
+ */
+shm_record_t* shm_ring_at(shm_ring_t* ring, uint64_t pos, uint64_t* next) {
+    uint64_t mask = ring->capacity - 1;
+    shm_record_t* rec = (shm_record_t*)(ring->data + (pos & mask));
+
+    if (rec->kind == SHM_RECORD_WRAP) {
+        pos += ring->capacity - (pos & mask);
+        rec = (shm_record_t*)ring->data;
+    }
+    if (next) {
+        *next = pos + record_size(rec->len);
+    }
+    return rec;
+}
+
+/**
+ * Release space up to a position (consumer)
+ */
+void shm_ring_release(shm_ring_t* ring, uint64_t pos) {
+    atomic_store_explicit(&ring->tail, pos, memory_order_release);
+    atomic_fetch_add(&ring->space_seq, 1);
+    if (atomic_load(&ring->space_waiting)) {
+        futex_wake(&ring->space_seq);
+    }
+}
@@ -0,0 +1,152 @@
+/**
+ * @file shm_ring.h
+ * @brief Single-producer single-consumer record ring in shared memory
+ *
+ * The ring lives in an anonymous MAP_SHARED mapping, so a process forked
+ * after shm_ring_create sees the same ring. It carries variable-length
+ * records, each behind a small header, and is used to connect a stage to
+ * the child process running its plugin (see isolate.h).
+ * Features include:
+ * - Lock-free: the producer owns head, consumers own read and tail
+ * - Records are read in place; the ring itself never copies a record, so
+ *   a consumer copies only what must outlive its slot
+ * - Futex wakeups that work across processes, with timeouts so either
+ *   side can notice the other has died
+ * - Two consumer cursors: "read" (records looked at) and "tail" (space
+ *   released), so records can be read by one party and freed by another
+ *
+ * Positions are 64-bit byte counters that only grow; the offset inside the
+ * ring is the position modulo the capacity.
+ *
+ * Thread Safety: One producer and one consumer, in any two processes
+ * Memory Management: shm_ring_destroy unmaps the ring in the calling process
+ */
+
+#ifndef SHM_RING_H
+#define SHM_RING_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdatomic.h>
+
+/* Record header; the record bytes and a NUL follow it */
+typedef struct shm_record {
+    uint32_t len;            /* Record length excluding the NUL */
+    uint32_t seq;            /* Sequence number chosen by the producer */
+    uint32_t kind;           /* Producer-defined tag (SHM_RECORD_WRAP reserved) */
+    uint32_t value;          /* Producer-defined value */
+} shm_record_t;
+
+/* Kind of the filler record that skips to the start of the ring */
+#define SHM_RECORD_WRAP 0xFFFFFFFFu
+
+/* Ring header; data follows in the same mapping */
+typedef struct shm_ring {
+    _Atomic uint64_t head;           /* End of published records (producer) */
+    _Atomic uint64_t read;           /* End of records read (consumer) */
+    _Atomic uint64_t tail;           /* End of released space (consumer) */
+    uint64_t pending;                /* End of the reserved record (producer) */
+    _Atomic uint32_t data_seq;       /* Futex word bumped on every publish */
+    _Atomic uint32_t space_seq;      /* Futex word bumped on every release */
+    _Atomic uint32_t data_waiting;   /* Consumer is (about to be) asleep */
+    _Atomic uint32_t space_waiting;  /* Producer is (about to be) asleep */
+    _Atomic uint32_t closed;         /* Producer will publish nothing more */
+    uint32_t padding;
+    uint64_t capacity;               /* Data bytes, a power of two */
+    size_t map_size;                 /* Bytes mapped, header included */
+    char data[];
+} shm_ring_t;
+
+/**
+ * @brief Create a ring in a shared anonymous mapping
+ *
+ * @param capacity Data bytes (rounded up to a power of two, at least 4096)
+ * @return Pointer to the ring on success, NULL on error (sets errno)
+ *
+ * @note Create before fork; the child inherits the mapping
+ */
+shm_ring_t* shm_ring_create(size_t capacity);
+
+/**
+ * @brief Unmap a ring
+ *
+ * @param ring Pointer to the ring (NULL is ignored)
+ */
+void shm_ring_destroy(shm_ring_t* ring);
+
+/**
+ * @brief Largest record the ring accepts
+ *
+ * @param ring Pointer to the ring
+ * @return Maximum record length in bytes
+ */
+size_t shm_ring_max_record(const shm_ring_t* ring);
+
+/**
+ * @brief Reserve space for a record (producer)
+ *
+ * @param ring Pointer to the ring
+ * @param len Record length (at most shm_ring_max_record)
+ * @param timeout_ms Longest time to wait for space; negative waits forever
+ * @return Header of the reserved record, NULL on timeout (errno ETIMEDOUT)
+ *         or if len is too large (errno EMSGSIZE)
+ *
+ * @note Fill in the header and the len + 1 bytes after it, then call
+ *       shm_ring_publish; nothing is visible to the consumer before that
+ */
+shm_record_t* shm_ring_reserve(shm_ring_t* ring, size_t len, int timeout_ms);
+
+/**
+ * @brief Publish the record returned by the last shm_ring_reserve (producer)
+ *
+ * @param ring Pointer to the ring
+ */
+void shm_ring_publish(shm_ring_t* ring);
+
+/**
+ * @brief Mark the ring closed and wake the consumer (producer)
+ *
+ * @param ring Pointer to the ring
+ */
+void shm_ring_close(shm_ring_t* ring);
+
+/**
+ * @brief Wait until a record is published at or after a position (consumer)
+ *
+ * @param ring Pointer to the ring
+ * @param pos Consumer position
+ * @param timeout_ms Longest time to wait; 0 polls
+ * @return 1 if a record is available at pos, 0 otherwise
+ *
+ * @note Returns 0 at once if the ring is closed and drained
+ */
+int shm_ring_wait_data(shm_ring_t* ring, uint64_t pos, int timeout_ms);
+
+/**
+ * @brief Get the record at a position (consumer)
+ *
+ * @param ring Pointer to the ring
+ * @param pos Position of a published record
+ * @param next Output parameter for the position after the record
+ * @return Header of the record; its bytes follow the header
+ *
+ * @note Skips wrap fillers; pos must be below head
+ */
+shm_record_t* shm_ring_at(shm_ring_t* ring, uint64_t pos, uint64_t* next);
+
+/**
+ * @brief Release space up to a position (consumer)
+ *
+ * @param ring Pointer to the ring
+ * @param pos New tail; must not move backwards
+ */
+void shm_ring_release(shm_ring_t* ring, uint64_t pos);
+
+/**
+ * @brief Record bytes that follow a header
+ */
+static inline char* shm_record_data(shm_record_t* rec) {
+    return (char*)(rec + 1);
+}
+
+#endif /* SHM_RING_H */
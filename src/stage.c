@@ -0,0 +1,480 @@
+/**
+ * @file stage.c
+ * @brief Implementation of the host-owned processing loop
+ */
+
+#include "stage.h"
+#include "isolate.h"
+#include "trace.h"
+#include "probes.h"
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+#if PIPELINE_PROBES
+/* Semaphores of the transform probes (probes.h) */
+PROBE_SEMAPHORE(transform_begin);
+PROBE_SEMAPHORE(transform_end);
+#endif
+
+/*
+ * Credit one transform call to the stage's metrics: its records and bytes
+ * in and out, and the time since start spread evenly over its records.
+ * Returns the end time used.
+ */
+static uint64_t stage_account(stage_t* stage, uint64_t start, size_t records_in,
+                              size_t bytes_in, size_t records_out, size_t bytes_out) {
+    stage_metrics_t* m = stage->metrics;
+    uint64_t now = metrics_now_ns();
+    metrics_record_time(m, now - start, records_in);
+    metrics_add(&m->records_in, records_in);
+    metrics_add(&m->bytes_in, bytes_in);
+    metrics_add(&m->records_out, records_out);
+    metrics_add(&m->bytes_out, bytes_out);
+    metrics_sample_cpu(m, now);
+    return now;
+}
+
+/**
+ * Run one record through the plugin and forward the result.
+ * Returns the queue_push result, or 0 if nothing was pushed.
+ */
+static int stage_process(stage_t* stage, char* str, plugin_buf_t* scratch) {
+    size_t len = strlen(str);
+    plugin_buf_t in_place = { str, len, len + 1 };
+    plugin_buf_t* out = (stage->flags & PLUGIN_CAP_IN_PLACE) ? &in_place : scratch;
+    uint64_t start = stage->metrics ? metrics_now_ns() : 0;
+    uint64_t traced = trace_begin_sampled();
+
+    out->len = 0;
+    PROBE_TRANSFORM_BEGIN(stage->name, 1, len);
+    int rc = stage->transform(stage->ctx, str, len, out);
+    PROBE_TRANSFORM_END(stage->name, rc == PLUGIN_EMIT || rc == PLUGIN_PASS,
+                        rc == PLUGIN_EMIT ? out->len : rc == PLUGIN_PASS ? len : 0);
+    trace_end(traced, stage->name, "transform", 1);
+    if (stage->metrics) {
+        size_t out_len = rc == PLUGIN_EMIT ? out->len : len;
+        int emitted = rc == PLUGIN_EMIT || rc == PLUGIN_PASS;
+        stage_account(stage, start, 1, len, emitted, emitted ? out_len : 0);
+    }
+    switch (rc) {
+        case PLUGIN_EMIT:
+            out->data[out->len] = '\0';
+            return queue_push(stage->output, out->data);
+        case PLUGIN_PASS:
+            return queue_push(stage->output, str);
+        case PLUGIN_DROP:
+            return 0;
+        default:
+            fprintf(stderr, "%s: transform failed (%d), record dropped\n", stage->name, rc);
+            return 0;
+    }
+}
+
+/**
+ * Run a batch item through the plugin. In-place, length-preserving batch
+ * plugins rewrite the popped batch and it is returned as is; otherwise
+ * results go into the spare batch and the popped batch becomes the next
+ * spare, so steady state never allocates. Takes ownership of batch.
+ * Returns the batch to forward, or NULL if no records are left.
+ */
+static record_batch_t* stage_transform_batch(stage_t* stage, record_batch_t* batch,
+                                             record_batch_t** spare, plugin_buf_t* scratch) {
+    int in_place = (stage->flags & PLUGIN_CAP_IN_PLACE) &&
+                   (stage->flags & PLUGIN_CAP_LENGTH_PRESERVING);
+
+    if (stage->transform_batch && in_place) {
+        int rc = stage->transform_batch(stage->ctx, batch, batch);
+        if (rc < 0) {
+            fprintf(stderr, "%s: batch transform failed (%d), %zu records dropped\n",
+                    stage->name, rc, batch->count);
+            record_batch_free(batch);
+            return NULL;
+        }
+        return batch;
+    }
+
+    record_batch_t* out = *spare;
+    if (!out) {
+        out = record_batch_create_in(stage->pool, batch->count, batch->size);
+        if (!out) {
+            fprintf(stderr, "%s: out of memory, %zu records dropped\n",
+                    stage->name, batch->count);
+            record_batch_free(batch);
+            return NULL;
+        }
+    }
+    record_batch_reset(out);
+
+    if (stage->transform_batch) {
+        int rc = stage->transform_batch(stage->ctx, batch, out);
+        if (rc < 0) {
+            fprintf(stderr, "%s: batch transform failed (%d), %zu records dropped\n",
+                    stage->name, rc, batch->count);
+            record_batch_reset(out);
+        }
+    } else {
+        for (size_t i = 0; i < batch->count; i++) {
+            size_t len;
+            char* str = record_batch_get(batch, i, &len);
+            plugin_buf_t in_place_buf = { str, len, len + 1 };
+            plugin_buf_t* buf = (stage->flags & PLUGIN_CAP_IN_PLACE) ? &in_place_buf : scratch;
+
+            buf->len = 0;
+            int rc = stage->transform(stage->ctx, str, len, buf);
+            int appended = 0;
+            switch (rc) {
+                case PLUGIN_EMIT:
+                    appended = record_batch_append(out, buf->data, buf->len);
+                    break;
+                case PLUGIN_PASS:
+                    appended = record_batch_append(out, str, len);
+                    break;
+                case PLUGIN_DROP:
+                    break;
+                default:
+                    fprintf(stderr, "%s: transform failed (%d), record dropped\n", stage->name, rc);
+                    break;
+            }
+            if (appended != 0) {
+                fprintf(stderr, "%s: out of memory, record dropped\n", stage->name);
+            }
+        }
+    }
+
+    /* The consumed input batch becomes the next output batch */
+    out->ingest_ns = batch->ingest_ns;
+    out->queued_ns = batch->queued_ns;
+    record_batch_reset(batch);
+    *spare = batch;
+    if (out->count == 0) {
+        *spare = out;
+        record_batch_free(batch);
+        return NULL;
+    }
+    return out;
+}
+
+/**
+ * Transform a batch item and forward the result as one batch.
+ * Returns the queue_push_batch result, or 0 if nothing was pushed.
+ */
+static int stage_process_batch(stage_t* stage, record_batch_t* batch,
+                               record_batch_t** spare, plugin_buf_t* scratch) {
+    size_t records = batch->count;
+    size_t bytes = batch->size - batch->count;
+    uint64_t queued = batch->queued_ns;
+    uint64_t start = stage->metrics ? metrics_now_ns() : 0;
+    uint64_t traced = trace_begin_sampled();
+
+    PROBE_TRANSFORM_BEGIN(stage->name, records, bytes);
+    record_batch_t* out = stage_transform_batch(stage, batch, spare, scratch);
+    PROBE_TRANSFORM_END(stage->name, out ? out->count : 0, out ? out->size - out->count : 0);
+    trace_end(traced, stage->name, "transform", records);
+
+    if (stage->metrics) {
+        uint64_t now = stage_account(stage, start, records, bytes,
+                                     out ? out->count : 0, out ? out->size - out->count : 0);
+        /* Residence: waiting in the input queue plus this transform */
+        if (queued && now > queued) {
+            metrics_histogram_record(&stage->metrics->residence, now - queued, records);
+            if (out) out->queued_ns = now;
+        }
+    }
+    return out ? queue_push_batch(stage->output, out) : 0;
+}
+
+/**
+ * Let the plugin react to a marker and forward what it emits, then the
+ * marker itself (END markers stop at the stage). The output batch comes
+ * from and goes back to the spare when nothing is emitted.
+ * Returns the last push result, or 0 if nothing was pushed.
+ */
+static int stage_control(stage_t* stage, const queue_marker_t* marker, record_batch_t** spare) {
+    if (stage->control) {
+        record_batch_t* out = *spare ? *spare :
+                              record_batch_create_in(stage->pool, STAGE_BATCH_MAX, 4096);
+        if (!out) {
+            fprintf(stderr, "%s: out of memory, %s marker output dropped\n",
+                    stage->name, queue_marker_name(marker->kind));
+        } else {
+            *spare = NULL;
+            record_batch_reset(out);
+            out->ingest_ns = out->queued_ns = 0;
+            int rc = stage->control(stage->ctx, marker, out);
+            if (rc < 0) {
+                fprintf(stderr, "%s: %s marker failed (%d), %zu records dropped\n",
+                        stage->name, queue_marker_name(marker->kind), rc, out->count);
+                record_batch_reset(out);
+            }
+            if (out->count == 0) {
+                *spare = out;
+            } else {
+                if (stage->metrics) {
+                    metrics_add(&stage->metrics->records_out, out->count);
+                    metrics_add(&stage->metrics->bytes_out, out->size - out->count);
+                }
+                int ret = queue_push_batch(stage->output, out);
+                if (ret != 0) {
+                    return ret;
+                }
+            }
+        }
+    }
+    return marker->kind == QUEUE_MARKER_END ? 0 : queue_push_marker(stage->output, marker);
+}
+
+/* Append one record to a gathered batch, reporting records it drops */
+static void stage_gather_append(stage_t* stage, record_batch_t* gathered,
+                                const char* str, size_t len) {
+    if (record_batch_append(gathered, str, len) != 0) {
+        fprintf(stderr, "%s: out of memory, record dropped\n", stage->name);
+    }
+}
+
+/**
+ * Micro-batching: starting from a popped item, keep popping for up to
+ * linger_us until STAGE_BATCH_MAX records are gathered, and return them as
+ * one batch. A trickle of single records or small batches then costs one
+ * batch transform and one push per batch, while no record is held back
+ * longer than linger_us. Gathering stops at a marker, which is returned
+ * in *marker for the caller to pass on after the batch. Takes ownership
+ * of item; sets *status to QUEUE_SHUTDOWN if the input closed meanwhile.
+ * Returns NULL (the item's record dropped) only if no batch can be
+ * allocated.
+ */
+static record_batch_t* stage_gather(stage_t* stage, queue_item_t* item, char** record,
+                                    size_t* record_cap, record_batch_t** spare,
+                                    queue_marker_t* marker, int* status) {
+    record_batch_t* gathered = item->batch;
+    if (!gathered) {
+        gathered = *spare ? *spare :
+                   record_batch_create_in(stage->pool, STAGE_BATCH_MAX, 4096);
+        if (!gathered) {
+            fprintf(stderr, "%s: out of memory, record dropped\n", stage->name);
+            return NULL;
+        }
+        *spare = NULL;
+        record_batch_reset(gathered);
+        gathered->ingest_ns = gathered->queued_ns = 0;
+        stage_gather_append(stage, gathered, item->str, strlen(item->str));
+    }
+
+    uint64_t until = metrics_now_ns() + stage->linger_us * 1000;
+    while (gathered->count < STAGE_BATCH_MAX) {
+        uint64_t now = metrics_now_ns();
+        if (now >= until) {
+            break;
+        }
+        queue_item_t next;
+        int ret = queue_pop_into_timeout(stage->input, &next, record, record_cap,
+                                         (until - now + 999) / 1000);
+        if (ret == QUEUE_SHUTDOWN) {
+            *status = ret;
+            break;
+        }
+        if (ret != 0) {
+            break;
+        }
+
+        if (next.marker.kind) {
+            *marker = next.marker;
+            break;
+        }
+        if (!next.batch) {
+            stage_gather_append(stage, gathered, next.str, strlen(next.str));
+            continue;
+        }
+        for (size_t i = 0; i < next.batch->count; i++) {
+            size_t len;
+            const char* str = record_batch_get(next.batch, i, &len);
+            stage_gather_append(stage, gathered, str, len);
+        }
+        /* Latency is measured from the oldest stamped record */
+        if (!gathered->ingest_ns) {
+            gathered->ingest_ns = next.batch->ingest_ns;
+            gathered->queued_ns = next.batch->queued_ns;
+        }
+        if (!*spare) {
+            record_batch_reset(next.batch);
+            *spare = next.batch;
+        } else {
+            record_batch_free(next.batch);
+        }
+    }
+    return gathered;
+}
+
+/**
+ * Stage loop: queue items are single strings, whole batches or markers,
+ * and each is forwarded in the same form it arrived in, unless linger_us
+ * gathers records into batches first.
+ */
+static void* stage_thread(void* arg) {
+    stage_t* stage = (stage_t*)arg;
+    plugin_buf_t scratch = { NULL, 0, 0 };
+    record_batch_t* spare = NULL;
+    queue_item_t item;
+    char* record = NULL;     /* String items are popped into this buffer */
+    size_t record_cap = 0;
+
+    size_t scratch_cap = 0;
+    int drained = 0;         /* The input closed, rather than the output */
+
+    trace_thread_name(stage->name);
+    metrics_thread_stage = stage->metrics;
+    while (!stage->stop_requested) {
+        int ret = queue_pop_into(stage->input, &item, &record, &record_cap);
+        if (ret == QUEUE_SHUTDOWN) {
+            drained = 1;
+            break;
+        }
+        if (ret != 0) {
+            continue;
+        }
+
+        if (item.marker.kind) {
+            ret = stage_control(stage, &item.marker, &spare);
+        } else if (stage->linger_us && !(item.batch && item.batch->count >= STAGE_BATCH_MAX)) {
+            int status = 0;
+            queue_marker_t marker = { QUEUE_MARKER_NONE, 0 };
+            record_batch_t* gathered = stage_gather(stage, &item, &record, &record_cap,
+                                                    &spare, &marker, &status);
+            ret = gathered ? stage_process_batch(stage, gathered, &spare, &scratch) : 0;
+            if (ret != QUEUE_SHUTDOWN && marker.kind) {
+                ret = stage_control(stage, &marker, &spare);
+            }
+            if (status == QUEUE_SHUTDOWN && ret != QUEUE_SHUTDOWN) {
+                drained = 1;
+                ret = QUEUE_SHUTDOWN;
+            }
+        } else if (item.batch) {
+            ret = stage_process_batch(stage, item.batch, &spare, &scratch);
+        } else {
+            ret = stage_process(stage, item.str, &scratch);
+        }
+        if (stage->metrics) {
+            /* Plugins grow the scratch buffer with plugin_buf_reserve */
+            if (scratch.cap != scratch_cap) {
+                metrics_count_alloc(scratch.cap);
+                scratch_cap = scratch.cap;
+            }
+            metrics_set_held(stage->metrics, scratch.cap + record_cap +
+                             (spare ? record_batch_footprint(spare) : 0));
+        }
+        if (ret == QUEUE_SHUTDOWN) {
+            break;
+        }
+    }
+
+    /* Stateful plugins emit their last results before shutdown propagates */
+    if (drained && stage->control && !stage->stop_requested) {
+        queue_marker_t end = { QUEUE_MARKER_END, 0 };
+        stage_control(stage, &end, &spare);
+    }
+
+    free(scratch.data);
+    free(record);
+    record_batch_free(spare);
+    if (stage->metrics) {
+        metrics_update_cpu(stage->metrics);
+        metrics_set_held(stage->metrics, 0);
+    }
+    metrics_thread_stage = NULL;
+
+    /* Propagate shutdown to output queue */
+    queue_shutdown(stage->output);
+    return NULL;
+}
+
+/**
+ * Initialize a stage for a transform plugin
+ */
+int stage_init(stage_t* stage, const plugin_info_t* info,
+               const plugin_interface_t* api, plugin_ctx_t* ctx,
+               queue_t* input, queue_t* output) {
+    if (!stage || !info || !api || !api->transform || !input || !output) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    memset(stage, 0, sizeof(stage_t));
+    stage->name = info->name ? info->name : "stage";
+    stage->flags = info->flags;
+    stage->transform = api->transform;
+    stage->transform_batch = api->transform_batch;
+    stage->control = api->control;
+    stage->ctx = ctx;
+    stage->input = input;
+    stage->output = output;
+    return 0;
+}
+
+/**
+ * Run the stage's plugin in a child process
+ */
+int stage_isolate(stage_t* stage, size_t ring_bytes) {
+    if (!stage || stage->started || stage->iso) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    stage->iso = isolation_create(ring_bytes);
+    return stage->iso ? 0 : -1;
+}
+
+/**
+ * Start the stage thread
+ */
+int stage_start(stage_t* stage) {
+    if (!stage || stage->started) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    if (stage->iso) {
+        if (isolation_start(stage) != 0) {
+            return -1;
+        }
+        stage->started = 1;
+        return 0;
+    }
+
+    int ret = pthread_create(&stage->thread, NULL, stage_thread, stage);
+    if (ret != 0) {
+        errno = ret;
+        return -1;
+    }
+
+    stage->started = 1;
+    return 0;
+}
+
+/**
+ * Request the stage to stop processing
+ */
+void stage_request_stop(stage_t* stage) {
+    if (stage) {
+        stage->stop_requested = 1;
+    }
+}
+
+/**
+ * Wait for the stage thread to exit
+ */
+void stage_join(stage_t* stage) {
+    if (!stage) return;
+
+    if (stage->started) {
+        queue_shutdown(stage->input);
+        if (stage->iso) {
+            isolation_join(stage);
+        } else {
+            pthread_join(stage->thread, NULL);
+        }
+        stage->started = 0;
+    }
+
+    isolation_destroy(stage->iso);
+    stage->iso = NULL;
+}
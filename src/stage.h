@@ -0,0 +1,128 @@
+/**
+ * @file stage.h
+ * @brief Host-owned processing loop for transform plugins
+ *
+ * A stage pops records from its input queue, runs the plugin's transform
+ * callback, and pushes the result to its output queue. Owning the loop in
+ * the host means every transform plugin gets the same threading, shutdown
+ * and buffer handling:
+ * - One thread per stage, started and joined by the host
+ * - Shutdown propagates downstream once the input queue drains
+ * - A reusable output buffer, so transforms never allocate per record
+ * - In-place transforms (PLUGIN_CAP_IN_PLACE) rewrite the popped record
+ * - Record batches stay batches: one queue item in, one queue item out, and
+ *   plugin_transform_batch (if exported) sees the whole batch in one call
+ * - Batches are recycled between input and output, so a running stage
+ *   stops allocating
+ * - Optional micro-batching (linger_us): items arriving within the linger
+ *   time are gathered into batches of up to STAGE_BATCH_MAX records, so a
+ *   trickle of small items is transformed and forwarded in bulk with a
+ *   bounded added latency
+ * - Control markers (queue.h) are forwarded in order: records before a
+ *   marker are transformed and pushed first, then plugin_control (if
+ *   exported) may emit held-back records, then the marker follows. At end
+ *   of stream plugin_control sees a QUEUE_MARKER_END, so stateful plugins
+ *   can emit their last results
+ * - Optional per-stage metrics (metrics.h), written only by the stage thread,
+ *   including the host allocations it makes and the buffers it holds
+ * - Batches it creates take their arena from a shared pool when one is set,
+ *   so they can cross into isolated stages without a copy
+ *
+ * Thread Safety: stage_request_stop may be called from any thread
+ * Memory Management: The stage does not own its queues or plugin context
+ */
+
+#ifndef STAGE_H
+#define STAGE_H
+
+#include "queue.h"
+#include "plugin_common.h"
+#include "metrics.h"
+#include "shm_pool.h"
+#include <pthread.h>
+
+/* Most records producers should pack into one batch item */
+#define STAGE_BATCH_MAX 64
+
+/* Longest linger_us a stage is configured with (one minute) */
+#define STAGE_LINGER_MAX_US 60000000ULL
+
+/* Child-process state for isolated stages (see isolate.h) */
+typedef struct stage_isolation stage_isolation_t;
+
+/* Stage structure */
+typedef struct stage {
+    const char* name;                /* Plugin name, for diagnostics */
+    plugin_ctx_t* ctx;               /* Plugin context from plugin_open (may be NULL) */
+    plugin_transform_fn transform;   /* Per-record transform callback */
+    plugin_transform_batch_fn transform_batch; /* Batch callback (may be NULL) */
+    plugin_control_fn control;       /* Marker callback (may be NULL) */
+    uint32_t flags;                  /* PLUGIN_CAP_* from plugin_info */
+    queue_t* input;                  /* Input queue (not owned) */
+    queue_t* output;                 /* Output queue (not owned) */
+    pthread_t thread;                /* Stage thread */
+    volatile int stop_requested;     /* Set by stage_request_stop */
+    int started;                     /* Thread was created */
+    stage_isolation_t* iso;          /* Set by stage_isolate, else NULL */
+    stage_metrics_t* metrics;        /* Counters (not owned), NULL when off */
+    uint64_t linger_us;              /* Micro-batching wait, 0 when off; set before start */
+    shm_pool_t* pool;                /* Arena pool for new batches (not owned), or NULL */
+} stage_t;
+
+/**
+ * @brief Initialize a stage for a transform plugin
+ *
+ * @param stage Pointer to stage structure to initialize
+ * @param info Plugin description (name and capability flags)
+ * @param api Plugin entry points; transform is required, transform_batch and
+ *            control optional
+ * @param ctx Plugin context passed to every transform call
+ * @param input Queue to read records from
+ * @param output Queue to write results to
+ * @return 0 on success, -1 on error (sets errno)
+ *
+ * @note Does not start the thread; call stage_start
+ */
+int stage_init(stage_t* stage, const plugin_info_t* info,
+               const plugin_interface_t* api, plugin_ctx_t* ctx,
+               queue_t* input, queue_t* output);
+
+/**
+ * @brief Run the stage's plugin in a child process
+ *
+ * @param stage Pointer to initialized, not yet started stage
+ * @param ring_bytes Size of each shared-memory ring (0 for the default)
+ * @return 0 on success, -1 on error (sets errno)
+ *
+ * @note Only for transform plugins; see isolate.h
+ */
+int stage_isolate(stage_t* stage, size_t ring_bytes);
+
+/**
+ * @brief Start the stage thread
+ *
+ * @param stage Pointer to initialized stage
+ * @return 0 on success, -1 on error
+ */
+int stage_start(stage_t* stage);
+
+/**
+ * @brief Request the stage to stop processing
+ *
+ * @param stage Pointer to the stage
+ *
+ * @note Does not block; the thread exits at its next queue operation
+ */
+void stage_request_stop(stage_t* stage);
+
+/**
+ * @brief Wait for the stage thread to exit
+ *
+ * @param stage Pointer to the stage
+ *
+ * @note Shuts down the input queue so a blocked pop returns
+ * @note Safe to call on a stage that was never started
+ */
+void stage_join(stage_t* stage);
+
+#endif /* STAGE_H */
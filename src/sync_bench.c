@@ -0,0 +1,499 @@
+/**
+ * @file sync_bench.c
+ * @brief Microbenchmark for queue_t, monitor_t and barrier_t
+ *
+ * Measures the synchronization primitives the pipeline is built on, so a
+ * replacement can be compared against them on the same machine.
+ * Features include:
+ * - queue_push/queue_pop_into throughput for 1:1, N:1, 1:N and N:M producer and
+ *   consumer counts across a range of capacities
+ * - queue round-trip latency (ping-pong between two threads) percentiles
+ * - monitor_enter/monitor_exit cost, uncontended and contended
+ * - barrier_wait and spin_barrier_wait cost per round, with how often
+ *   spin_barrier waiters were released while spinning and who arrived last
+ * - Threads pinned round-robin to the CPUs the process may use
+ *
+ * Every measurement is printed as one JSON object per line on stdout, so
+ * runs from different commits can be compared with standard tools.
+ *
+ * Thread Safety: Single benchmark per process
+ * Memory Management: Everything is freed before exit
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "barrier.h"
+#include "metrics.h"
+#include "monitor.h"
+#include "queue.h"
+
+#define BENCH_DEFAULT_OPS 200000
+#define BENCH_MAX_THREADS 64
+
+/* Record pushed through the queues; short, like most pipeline lines */
+#define BENCH_PAYLOAD "0123456789abcdef"
+
+/* Benchmark selection and shared settings */
+typedef struct {
+    size_t ops;
+    int pin;
+    int run_queue;
+    int run_latency;
+    int run_monitor;
+    int run_barrier;
+    int cpus[BENCH_MAX_THREADS];
+    int cpu_count;
+} bench_options_t;
+
+/* One benchmark thread: body plus the argument it runs with */
+typedef struct {
+    void* (*body)(void* arg);
+    void* arg;
+    barrier_t* start;
+    int cpu;                    /* -1 for no pinning */
+} bench_thread_t;
+
+static bench_options_t options = {
+    .ops = BENCH_DEFAULT_OPS,
+    .pin = 1,
+    .run_queue = 1,
+    .run_latency = 1,
+    .run_monitor = 1,
+    .run_barrier = 1,
+};
+
+/* CPUs this process may run on, in order */
+static void discover_cpus(void) {
+    cpu_set_t set;
+    options.cpu_count = 0;
+    if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+        for (int cpu = 0; cpu < CPU_SETSIZE && options.cpu_count < BENCH_MAX_THREADS; cpu++) {
+            if (CPU_ISSET(cpu, &set)) {
+                options.cpus[options.cpu_count++] = cpu;
+            }
+        }
+    }
+    if (options.cpu_count == 0) {
+        options.cpus[options.cpu_count++] = 0;
+    }
+}
+
+/* Pin the calling thread, wait for the others, then run the body */
+static void* bench_thread_main(void* arg) {
+    bench_thread_t* t = (bench_thread_t*)arg;
+    if (t->cpu >= 0) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(t->cpu, &set);
+        pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    }
+    barrier_wait(t->start);
+    return t->body(t->arg);
+}
+
+/*
+ * Run count threads; thread i runs bodies[i](args[i]). All of them are
+ * released together and the wall time from release to the last join is
+ * returned in ns. "done" runs after the first "first_join" threads finish,
+ * which lets producers shut a queue before consumers are joined.
+ */
+static uint64_t run_threads(int count, void* (**bodies)(void*), void** args,
+                            int first_join, void (*done)(void*), void* done_arg) {
+    pthread_t tids[BENCH_MAX_THREADS];
+    bench_thread_t threads[BENCH_MAX_THREADS];
+    barrier_t start;
+
+    barrier_init(&start, (unsigned)count + 1);
+    for (int i = 0; i < count; i++) {
+        threads[i].body = bodies[i];
+        threads[i].arg = args[i];
+        threads[i].start = &start;
+        threads[i].cpu = options.pin ? options.cpus[i % options.cpu_count] : -1;
+        if (pthread_create(&tids[i], NULL, bench_thread_main, &threads[i]) != 0) {
+            fprintf(stderr, "Failed to create benchmark thread\n");
+            exit(1);
+        }
+    }
+
+    barrier_wait(&start);
+    uint64_t begin = metrics_now_ns();
+    for (int i = 0; i < count; i++) {
+        pthread_join(tids[i], NULL);
+        if (i + 1 == first_join && done) {
+            done(done_arg);
+        }
+    }
+    uint64_t elapsed = metrics_now_ns() - begin;
+
+    barrier_destroy(&start);
+    return elapsed;
+}
+
+static void print_common(const char* bench, int threads) {
+    printf("{\"bench\":\"%s\",\"threads\":%d,\"pinned\":%d,\"cpus\":%d",
+           bench, threads, options.pin, options.cpu_count);
+}
+
+static void print_rate(size_t ops, uint64_t ns) {
+    printf(",\"ops\":%zu,\"seconds\":%.6f,\"ops_per_s\":%.0f,\"ns_per_op\":%.1f}\n",
+           ops, (double)ns / 1e9,
+           ns ? (double)ops * 1e9 / (double)ns : 0.0,
+           ops ? (double)ns / (double)ops : 0.0);
+}
+
+/* ---- queue throughput ---- */
+
+typedef struct {
+    queue_t* queue;
+    size_t ops;                 /* Producer: records to push */
+    size_t popped;              /* Consumer: records received */
+} queue_worker_t;
+
+static void* queue_producer(void* arg) {
+    queue_worker_t* w = (queue_worker_t*)arg;
+    for (size_t i = 0; i < w->ops; i++) {
+        if (queue_push(w->queue, BENCH_PAYLOAD) != 0) break;
+    }
+    return NULL;
+}
+
+static void* queue_consumer(void* arg) {
+    queue_worker_t* w = (queue_worker_t*)arg;
+    queue_item_t item;
+    char* buf = NULL;
+    size_t cap = 0;
+    while (queue_pop_into(w->queue, &item, &buf, &cap) == 0) {
+        w->popped++;
+    }
+    free(buf);
+    return NULL;
+}
+
+static void queue_done(void* arg) {
+    queue_shutdown((queue_t*)arg);
+}
+
+static void bench_queue_throughput(int producers, int consumers, size_t capacity) {
+    queue_t queue;
+    queue_worker_t workers[BENCH_MAX_THREADS];
+    void* (*bodies[BENCH_MAX_THREADS])(void*);
+    void* args[BENCH_MAX_THREADS];
+    int count = producers + consumers;
+
+    if (queue_init(&queue, capacity) != 0) {
+        fprintf(stderr, "Failed to initialize queue\n");
+        exit(1);
+    }
+
+    /* Producers first, so they are joined (and the queue shut) first */
+    for (int i = 0; i < count; i++) {
+        workers[i].queue = &queue;
+        workers[i].ops = i < producers
+            ? options.ops / producers + ((size_t)i < options.ops % producers)
+            : 0;
+        workers[i].popped = 0;
+        bodies[i] = i < producers ? queue_producer : queue_consumer;
+        args[i] = &workers[i];
+    }
+
+    uint64_t ns = run_threads(count, bodies, args, producers, queue_done, &queue);
+
+    size_t popped = 0;
+    for (int i = producers; i < count; i++) popped += workers[i].popped;
+    if (popped != options.ops) {
+        fprintf(stderr, "queue_throughput: pushed %zu, popped %zu\n", options.ops, popped);
+    }
+
+    print_common("queue_throughput", count);
+    printf(",\"producers\":%d,\"consumers\":%d,\"capacity\":%zu", producers, consumers, capacity);
+    print_rate(popped, ns);
+    queue_destroy(&queue);
+}
+
+/* ---- queue round-trip latency ---- */
+
+typedef struct {
+    queue_t* ping;
+    queue_t* pong;
+    size_t rounds;
+    stage_metrics_t* hist;
+} pingpong_t;
+
+static void* pingpong_client(void* arg) {
+    pingpong_t* p = (pingpong_t*)arg;
+    queue_item_t item;
+    char* buf = NULL;
+    size_t cap = 0;
+    for (size_t i = 0; i < p->rounds; i++) {
+        uint64_t t0 = metrics_now_ns();
+        if (queue_push(p->ping, BENCH_PAYLOAD) != 0) break;
+        if (queue_pop_into(p->pong, &item, &buf, &cap) != 0) break;
+        metrics_record_time(p->hist, metrics_now_ns() - t0, 1);
+    }
+    free(buf);
+    queue_shutdown(p->ping);
+    return NULL;
+}
+
+static void* pingpong_server(void* arg) {
+    pingpong_t* p = (pingpong_t*)arg;
+    queue_item_t item;
+    char* buf = NULL;
+    size_t cap = 0;
+    while (queue_pop_into(p->ping, &item, &buf, &cap) == 0) {
+        if (queue_push(p->pong, item.str) != 0) break;
+    }
+    free(buf);
+    return NULL;
+}
+
+static void bench_queue_latency(size_t capacity) {
+    queue_t ping, pong;
+    stage_metrics_t* hist = stage_metrics_create("round_trip");
+    if (!hist || queue_init(&ping, capacity) != 0 || queue_init(&pong, capacity) != 0) {
+        fprintf(stderr, "Failed to set up latency benchmark\n");
+        exit(1);
+    }
+
+    /* Round trips are much slower than one-way pushes; keep runs short */
+    pingpong_t p = { &ping, &pong, options.ops / 10 + 1, hist };
+    void* (*bodies[2])(void*) = { pingpong_client, pingpong_server };
+    void* args[2] = { &p, &p };
+    uint64_t ns = run_threads(2, bodies, args, 0, NULL, NULL);
+
+    print_common("queue_round_trip", 2);
+    printf(",\"capacity\":%zu,\"p50_ns\":%llu,\"p99_ns\":%llu,\"p999_ns\":%llu,\"max_ns\":%llu",
+           capacity,
+           (unsigned long long)stage_metrics_quantile(hist, 0.50),
+           (unsigned long long)stage_metrics_quantile(hist, 0.99),
+           (unsigned long long)stage_metrics_quantile(hist, 0.999),
+           (unsigned long long)atomic_load(&hist->max_ns));
+    print_rate(p.rounds, ns);
+
+    queue_destroy(&ping);
+    queue_destroy(&pong);
+    stage_metrics_destroy(hist);
+}
+
+/* ---- monitor enter/exit ---- */
+
+typedef struct {
+    monitor_t* monitor;
+    size_t ops;
+    volatile size_t* counter;
+} monitor_worker_t;
+
+static void* monitor_worker(void* arg) {
+    monitor_worker_t* w = (monitor_worker_t*)arg;
+    for (size_t i = 0; i < w->ops; i++) {
+        monitor_enter(w->monitor);
+        (*w->counter)++;
+        monitor_exit(w->monitor);
+    }
+    return NULL;
+}
+
+static void bench_monitor(int threads) {
+    monitor_t monitor;
+    volatile size_t counter = 0;
+    monitor_worker_t workers[BENCH_MAX_THREADS];
+    void* (*bodies[BENCH_MAX_THREADS])(void*);
+    void* args[BENCH_MAX_THREADS];
+
+    if (monitor_init(&monitor) != 0) {
+        fprintf(stderr, "Failed to initialize monitor\n");
+        exit(1);
+    }
+    for (int i = 0; i < threads; i++) {
+        workers[i].monitor = &monitor;
+        workers[i].ops = options.ops / threads;
+        workers[i].counter = &counter;
+        bodies[i] = monitor_worker;
+        args[i] = &workers[i];
+    }
+
+    uint64_t ns = run_threads(threads, bodies, args, 0, NULL, NULL);
+
+    print_common("monitor_enter_exit", threads);
+    print_rate((size_t)counter, ns);
+    monitor_destroy(&monitor);
+}
+
+/* ---- barrier_wait ---- */
+
+typedef struct {
+    barrier_t* barrier;
+    size_t rounds;
+} barrier_worker_t;
+
+static void* barrier_worker(void* arg) {
+    barrier_worker_t* w = (barrier_worker_t*)arg;
+    for (size_t i = 0; i < w->rounds; i++) {
+        barrier_wait(w->barrier);
+    }
+    return NULL;
+}
+
+static void bench_barrier(int threads) {
+    barrier_t barrier;
+    barrier_worker_t worker;
+    void* (*bodies[BENCH_MAX_THREADS])(void*);
+    void* args[BENCH_MAX_THREADS];
+
+    if (barrier_init(&barrier, (unsigned)threads) != 0) {
+        fprintf(stderr, "Failed to initialize barrier\n");
+        exit(1);
+    }
+    /* Every round wakes every thread; keep runs short */
+    worker.barrier = &barrier;
+    worker.rounds = options.ops / 20 + 1;
+    for (int i = 0; i < threads; i++) {
+        bodies[i] = barrier_worker;
+        args[i] = &worker;
+    }
+
+    uint64_t ns = run_threads(threads, bodies, args, 0, NULL, NULL);
+
+    print_common("barrier_wait", threads);
+    print_rate(worker.rounds, ns);
+    barrier_destroy(&barrier);
+}
+
+/* ---- spin_barrier_wait ---- */
+
+typedef struct {
+    spin_barrier_t* barrier;
+    unsigned id;
+    size_t rounds;
+} spin_barrier_worker_t;
+
+static void* spin_barrier_worker(void* arg) {
+    spin_barrier_worker_t* w = (spin_barrier_worker_t*)arg;
+    for (size_t i = 0; i < w->rounds; i++) {
+        spin_barrier_wait(w->barrier, w->id);
+    }
+    return NULL;
+}
+
+static void bench_spin_barrier(int threads) {
+    spin_barrier_t barrier;
+    spin_barrier_worker_t workers[BENCH_MAX_THREADS];
+    void* (*bodies[BENCH_MAX_THREADS])(void*);
+    void* args[BENCH_MAX_THREADS];
+
+    if (spin_barrier_init(&barrier, (unsigned)threads) != 0) {
+        fprintf(stderr, "Failed to initialize spin barrier\n");
+        exit(1);
+    }
+    for (int i = 0; i < threads; i++) {
+        workers[i] = (spin_barrier_worker_t){ &barrier, (unsigned)i, options.ops / 20 + 1 };
+        bodies[i] = spin_barrier_worker;
+        args[i] = &workers[i];
+    }
+
+    uint64_t ns = run_threads(threads, bodies, args, 0, NULL, NULL);
+
+    /* The participant that most often arrived last is the straggler */
+    uint64_t spun = 0, parked = 0;
+    unsigned straggler = 0;
+    for (int i = 0; i < threads; i++) {
+        const spin_barrier_participant_t* p = &barrier.participants[i];
+        spun += p->spun;
+        parked += p->parked;
+        if (p->last > barrier.participants[straggler].last) straggler = (unsigned)i;
+    }
+    print_common("spin_barrier_wait", threads);
+    printf(",\"spin_ns\":%llu,\"spun\":%llu,\"parked\":%llu,\"straggler\":%u,\"straggler_last_pct\":%.1f",
+           (unsigned long long)barrier.spin_ns, (unsigned long long)spun,
+           (unsigned long long)parked, straggler,
+           100.0 * (double)barrier.participants[straggler].last / (double)workers[0].rounds);
+    print_rate(workers[0].rounds, ns);
+    spin_barrier_destroy(&barrier);
+}
+
+static void print_usage(const char* argv0) {
+    fprintf(stderr, "Usage: %s [--ops N] [--no-pin] [--only queue|latency|monitor|barrier]\n", argv0);
+    fprintf(stderr, "  --ops N      operations per measurement (default %d)\n", BENCH_DEFAULT_OPS);
+    fprintf(stderr, "  --no-pin     let the scheduler place threads\n");
+    fprintf(stderr, "  --only NAME  run one group of benchmarks (repeatable)\n");
+    fprintf(stderr, "Results are printed to stdout as one JSON object per line\n");
+}
+
+static int parse_args(int argc, char* argv[]) {
+    int only = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--no-pin") == 0) {
+            options.pin = 0;
+        } else if (strcmp(argv[i], "--ops") == 0 && i + 1 < argc) {
+            char* end;
+            errno = 0;
+            unsigned long long ops = strtoull(argv[++i], &end, 10);
+            if (errno || *end != '\0' || ops == 0) return -1;
+            options.ops = (size_t)ops;
+        } else if (strcmp(argv[i], "--only") == 0 && i + 1 < argc) {
+            const char* name = argv[++i];
+            if (!only) {
+                options.run_queue = options.run_latency = 0;
+                options.run_monitor = options.run_barrier = 0;
+                only = 1;
+            }
+            if (strcmp(name, "queue") == 0) options.run_queue = 1;
+            else if (strcmp(name, "latency") == 0) options.run_latency = 1;
+            else if (strcmp(name, "monitor") == 0) options.run_monitor = 1;
+            else if (strcmp(name, "barrier") == 0) options.run_barrier = 1;
+            else return -1;
+        } else {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int main(int argc, char* argv[]) {
+    static const int shapes[][2] = { { 1, 1 }, { 4, 1 }, { 1, 4 }, { 4, 4 } };
+    static const size_t capacities[] = { 1, 16, 256 };
+    static const int thread_counts[] = { 1, 2, 4 };
+
+    if (parse_args(argc, argv) != 0) {
+        print_usage(argv[0]);
+        return 1;
+    }
+    discover_cpus();
+
+    if (options.run_queue) {
+        for (size_t s = 0; s < sizeof(shapes) / sizeof(shapes[0]); s++) {
+            for (size_t c = 0; c < sizeof(capacities) / sizeof(capacities[0]); c++) {
+                bench_queue_throughput(shapes[s][0], shapes[s][1], capacities[c]);
+                fflush(stdout);
+            }
+        }
+    }
+    if (options.run_latency) {
+        for (size_t c = 0; c < sizeof(capacities) / sizeof(capacities[0]); c++) {
+            bench_queue_latency(capacities[c]);
+            fflush(stdout);
+        }
+    }
+    if (options.run_monitor) {
+        for (size_t t = 0; t < sizeof(thread_counts) / sizeof(thread_counts[0]); t++) {
+            bench_monitor(thread_counts[t]);
+            fflush(stdout);
+        }
+    }
+    if (options.run_barrier) {
+        for (size_t t = 1; t < sizeof(thread_counts) / sizeof(thread_counts[0]); t++) {
+            bench_barrier(thread_counts[t]);
+            fflush(stdout);
+            bench_spin_barrier(thread_counts[t]);
+            fflush(stdout);
+        }
+    }
+    return 0;
+}
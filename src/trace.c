@@ -0,0 +1,199 @@
+/**
+ * @file trace.c
+ * @brief Implementation of per-thread event rings and the JSON writer
+ */
+
+#define _GNU_SOURCE
+#include "trace.h"
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+/* One recorded event */
+typedef struct {
+    uint64_t start_ns;
+    uint64_t dur_ns;
+    const char* name;
+    const char* cat;
+    uint64_t arg;
+} trace_event_t;
+
+/* A thread's ring; only its owner writes, trace_write reads after joins */
+typedef struct trace_ring {
+    struct trace_ring* next;    /* Registry link */
+    char name[TRACE_NAME_MAX];
+    long tid;
+    uint64_t head;              /* Events ever recorded */
+    trace_event_t events[];     /* ring_events entries */
+} trace_ring_t;
+
+volatile int trace_on = 0;
+unsigned trace_sample_every = 1;
+__thread unsigned trace_sample_tick = 0;
+
+static __thread trace_ring_t* local_ring = NULL;
+static __thread char local_name[TRACE_NAME_MAX];
+
+/* Registry of every ring; locked only when a thread creates its ring */
+static pthread_mutex_t registry_lock = PTHREAD_MUTEX_INITIALIZER;
+static trace_ring_t* registry = NULL;
+static size_t ring_events = TRACE_RING_EVENTS;
+static uint64_t trace_origin_ns = 0;
+
+/* The calling thread's ring, created and registered on first use */
+static trace_ring_t* trace_local_ring(void) {
+    if (local_ring) return local_ring;
+
+    trace_ring_t* ring = malloc(sizeof(trace_ring_t) + ring_events * sizeof(trace_event_t));
+    if (!ring) return NULL;
+
+    ring->tid = (long)syscall(SYS_gettid);
+    ring->head = 0;
+    if (local_name[0]) {
+        memcpy(ring->name, local_name, TRACE_NAME_MAX);
+    } else {
+        snprintf(ring->name, TRACE_NAME_MAX, "thread %ld", ring->tid);
+    }
+
+    pthread_mutex_lock(&registry_lock);
+    ring->next = registry;
+    registry = ring;
+    pthread_mutex_unlock(&registry_lock);
+
+    local_ring = ring;
+    return ring;
+}
+
+/**
+ * Append a complete event to the calling thread's ring
+ */
+void trace_record(uint64_t start_ns, uint64_t end_ns, const char* name,
+                  const char* cat, uint64_t arg) {
+    trace_ring_t* ring = trace_local_ring();
+    if (!ring) return;
+
+    trace_event_t* ev = &ring->events[ring->head & (ring_events - 1)];
+    ev->start_ns = start_ns;
+    ev->dur_ns = end_ns > start_ns ? end_ns - start_ns : 0;
+    ev->name = name;
+    ev->cat = cat;
+    ev->arg = arg;
+    ring->head++;
+}
+
+/**
+ * Turn tracing on
+ */
+int trace_start(unsigned sample_every, size_t events) {
+    if (events == 0) events = TRACE_RING_EVENTS;
+    size_t pow2 = 1;
+    while (pow2 < events) {
+        if (pow2 > SIZE_MAX / 2) {
+            errno = EINVAL;
+            return -1;
+        }
+        pow2 <<= 1;
+    }
+
+    ring_events = pow2;
+    trace_sample_every = sample_every ? sample_every : 1;
+    trace_origin_ns = trace_now_ns();
+    trace_on = 1;
+    return 0;
+}
+
+/**
+ * Name the calling thread in the trace
+ */
+void trace_thread_name(const char* name) {
+    if (!trace_on || !name) return;
+
+    snprintf(local_name, TRACE_NAME_MAX, "%s", name);
+    if (local_ring) {
+        memcpy(local_ring->name, local_name, TRACE_NAME_MAX);
+    }
+}
+
+/* Write a JSON string literal */
+static void trace_json_string(FILE* out, const char* s) {
+    fputc('"', out);
+    for (; s && *s; s++) {
+        unsigned char c = (unsigned char)*s;
+        if (c == '"' || c == '\\') {
+            fprintf(out, "\\%c", c);
+        } else if (c < 0x20) {
+            fprintf(out, "\\u%04x", c);
+        } else {
+            fputc(c, out);
+        }
+    }
+    fputc('"', out);
+}
+
+/**
+ * Write every recorded event as Chrome trace JSON
+ */
+int trace_write(const char* path) {
+    if (!path) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    FILE* out = fopen(path, "w");
+    if (!out) return -1;
+
+    long pid = (long)getpid();
+    int first = 1;
+
+    fprintf(out, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+    pthread_mutex_lock(&registry_lock);
+    for (trace_ring_t* ring = registry; ring; ring = ring->next) {
+        uint64_t begin = ring->head > ring_events ? ring->head - ring_events : 0;
+
+        fprintf(out, "%s{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":%ld,\"tid\":%ld,\"args\":{\"name\":",
+                first ? "" : ",\n", pid, ring->tid);
+        trace_json_string(out, ring->name);
+        fprintf(out, ",\"dropped_events\":%llu}}", (unsigned long long)begin);
+        first = 0;
+
+        for (uint64_t i = begin; i < ring->head; i++) {
+            const trace_event_t* ev = &ring->events[i & (ring_events - 1)];
+            uint64_t ts = ev->start_ns > trace_origin_ns ? ev->start_ns - trace_origin_ns : 0;
+
+            fprintf(out, ",\n{\"ph\":\"X\",\"name\":");
+            trace_json_string(out, ev->name);
+            fprintf(out, ",\"cat\":");
+            trace_json_string(out, ev->cat);
+            fprintf(out, ",\"pid\":%ld,\"tid\":%ld,\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"n\":%llu}}",
+                    pid, ring->tid, (double)ts / 1000.0, (double)ev->dur_ns / 1000.0,
+                    (unsigned long long)ev->arg);
+        }
+    }
+    pthread_mutex_unlock(&registry_lock);
+    fprintf(out, "\n]}\n");
+
+    if (fclose(out) != 0) return -1;
+    return 0;
+}
+
+/**
+ * Turn tracing off and free every ring
+ */
+void trace_stop(void) {
+    trace_on = 0;
+
+    pthread_mutex_lock(&registry_lock);
+    while (registry) {
+        trace_ring_t* next = registry->next;
+        free(registry);
+        registry = next;
+    }
+    pthread_mutex_unlock(&registry_lock);
+
+    /* Only the calling thread's cached pointer can be reset here */
+    local_ring = NULL;
+}
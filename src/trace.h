@@ -0,0 +1,139 @@
+/**
+ * @file trace.h
+ * @brief Opt-in event tracing with Chrome trace JSON export
+ *
+ * Records timed events (a transform call, a wait on a full or empty queue)
+ * into a ring buffer owned by the thread that produced them, and writes
+ * them all as Chrome trace JSON at exit, which Perfetto and chrome://tracing
+ * open directly. Features include:
+ * - No locks or shared writes on the recording path: each thread appends
+ *   to its own ring, allocated the first time it records
+ * - Rings keep the most recent events; older ones are overwritten
+ * - Sampling: trace_begin_sampled records one call in every N, so hot
+ *   paths can stay traced at full rate; queue waits are always recorded
+ *   because they only happen on the slow path
+ * - Costs one load and a branch per call site while tracing is off
+ *
+ * Events are written as complete ("X") events, a begin time and duration
+ * in one record, so an overwritten ring never leaves unmatched halves.
+ *
+ * Thread Safety: Recording is thread-safe; trace_start, trace_write and
+ *                trace_stop must not race with threads still recording
+ * Memory Management: Rings are freed by trace_stop. Event names and
+ *                    categories are stored as pointers and must stay valid
+ *                    until trace_write
+ */
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+/* Default events per thread ring (a power of two) */
+#define TRACE_RING_EVENTS 65536
+
+/* Longest thread name kept in the trace */
+#define TRACE_NAME_MAX 32
+
+/* Set while tracing is on; read on every call site */
+extern volatile int trace_on;
+
+/* Calls to skip between sampled events, per thread */
+extern unsigned trace_sample_every;
+extern __thread unsigned trace_sample_tick;
+
+/* Monotonic clock in nanoseconds */
+static inline uint64_t trace_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+/**
+ * @brief Start time for an event that is always recorded
+ *
+ * @return Current time, or 0 when tracing is off (trace_end then ignores it)
+ */
+static inline uint64_t trace_begin(void) {
+    return trace_on ? trace_now_ns() : 0;
+}
+
+/**
+ * @brief Start time for an event recorded once per trace_sample_every calls
+ *
+ * @return Current time for a sampled call, 0 otherwise
+ */
+static inline uint64_t trace_begin_sampled(void) {
+    if (!trace_on) return 0;
+    if (++trace_sample_tick < trace_sample_every) return 0;
+    trace_sample_tick = 0;
+    return trace_now_ns();
+}
+
+/**
+ * @brief Append a complete event to the calling thread's ring
+ *
+ * @param start_ns Begin time from trace_now_ns
+ * @param end_ns End time from trace_now_ns
+ * @param name Event name (must stay valid until trace_write)
+ * @param cat Event category (must stay valid until trace_write)
+ * @param arg Value shown in the event's args (records, queue depth)
+ */
+void trace_record(uint64_t start_ns, uint64_t end_ns, const char* name,
+                  const char* cat, uint64_t arg);
+
+/**
+ * @brief Finish an event started with trace_begin or trace_begin_sampled
+ *
+ * @param start_ns Value returned by trace_begin*; 0 records nothing
+ * @param name Event name
+ * @param cat Event category
+ * @param arg Value shown in the event's args
+ */
+static inline void trace_end(uint64_t start_ns, const char* name, const char* cat, uint64_t arg) {
+    if (start_ns) {
+        trace_record(start_ns, trace_now_ns(), name, cat, arg);
+    }
+}
+
+/**
+ * @brief Turn tracing on
+ *
+ * @param sample_every Record one sampled call in this many (0 or 1: all)
+ * @param ring_events Events kept per thread, rounded up to a power of two
+ *                    (0 selects TRACE_RING_EVENTS)
+ * @return 0 on success, -1 on error (sets errno)
+ *
+ * @note Call before starting the threads to be traced
+ */
+int trace_start(unsigned sample_every, size_t ring_events);
+
+/**
+ * @brief Name the calling thread in the trace
+ *
+ * @param name Thread name (copied, truncated to TRACE_NAME_MAX - 1)
+ *
+ * @note Does nothing while tracing is off
+ */
+void trace_thread_name(const char* name);
+
+/**
+ * @brief Write every recorded event as Chrome trace JSON
+ *
+ * @param path Output file
+ * @return 0 on success, -1 on error (sets errno)
+ *
+ * @note Call once the traced threads have finished
+ */
+int trace_write(const char* path);
+
+/**
+ * @brief Turn tracing off and free every ring
+ *
+ * @note Call once the traced threads have finished
+ */
+void trace_stop(void);
+
+#endif /* TRACE_H */
@@ -0,0 +1,389 @@
+/**
+ * @file utf8.c
+ * @brief Implementation of vectorized UTF-8 validation and repair
+ */
+
+#include "utf8.h"
+#include <pthread.h>
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <immintrin.h>
+#define UTF8_HAVE_X86 1
+#else
+#define UTF8_HAVE_X86 0
+#endif
+
+/* Error classes produced by the nibble lookup tables */
+#define TOO_SHORT       (1 << 0)  /* 11______ 0_______ / 11______ 11______ */
+#define TOO_LONG        (1 << 1)  /* 0_______ 10______ */
+#define OVERLONG_3      (1 << 2)  /* 11100000 100_____ */
+#define TOO_LARGE       (1 << 3)  /* 11110100 1001____ and above */
+#define SURROGATE       (1 << 4)  /* 11101101 101_____ */
+#define OVERLONG_2      (1 << 5)  /* 1100000_ 10______ */
+#define TOO_LARGE_1000  (1 << 6)  /* 11110101 1000____ and above */
+#define OVERLONG_4      (1 << 6)  /* 11110000 1000____ */
+#define TWO_CONTS       (1 << 7)  /* 10______ 10______ */
+#define CARRY           (TOO_SHORT | TOO_LONG | TWO_CONTS)
+
+/* Indexed by the high nibble of the previous byte */
+static const uint8_t byte_1_high_table[16] = {
+    TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG,
+    TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG,
+    TWO_CONTS, TWO_CONTS, TWO_CONTS, TWO_CONTS,
+    TOO_SHORT | OVERLONG_2,
+    TOO_SHORT,
+    TOO_SHORT | OVERLONG_3 | SURROGATE,
+    TOO_SHORT | TOO_LARGE | TOO_LARGE_1000 | OVERLONG_4
+};
+
+/* Indexed by the low nibble of the previous byte */
+static const uint8_t byte_1_low_table[16] = {
+    CARRY | OVERLONG_3 | OVERLONG_2 | OVERLONG_4,
+    CARRY | OVERLONG_2,
+    CARRY,
+    CARRY,
+    CARRY | TOO_LARGE,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000 | SURROGATE,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000
+};
+
+/* Indexed by the high nibble of the current byte */
+static const uint8_t byte_2_high_table[16] = {
+    TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT,
+    TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT,
+    TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE_1000 | OVERLONG_4,
+    TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE,
+    TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE,
+    TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE,
+    TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT
+};
+
+/**
+ * Decode one sequence starting at s[0] using the well-formed byte ranges
+ * of Unicode Table 3-7. Returns the sequence length if it is well-formed,
+ * otherwise 0 with *bad set to the length of the maximal ill-formed subpart.
+ */
+static size_t scalar_sequence(const uint8_t* s, size_t avail, size_t* bad) {
+    uint8_t c = s[0];
+    if (c < 0x80) {
+        return 1;
+    }
+
+    size_t need;
+    uint8_t lo = 0x80, hi = 0xBF;
+    if (c >= 0xC2 && c <= 0xDF) {
+        need = 1;
+    } else if (c >= 0xE0 && c <= 0xEF) {
+        need = 2;
+        if (c == 0xE0) lo = 0xA0;
+        if (c == 0xED) hi = 0x9F;
+    } else if (c >= 0xF0 && c <= 0xF4) {
+        need = 3;
+        if (c == 0xF0) lo = 0x90;
+        if (c == 0xF4) hi = 0x8F;
+    } else {
+        *bad = 1;
+        return 0;
+    }
+
+    size_t k = 1;
+    for (; k <= need && k < avail; k++) {
+        uint8_t b = s[k];
+        if (k == 1 ? (b < lo || b > hi) : ((b & 0xC0) != 0x80)) {
+            break;
+        }
+    }
+    if (k == need + 1) {
+        return k;
+    }
+    *bad = k;
+    return 0;
+}
+
+static int validate_scalar(const uint8_t* s, size_t len) {
+    size_t i = 0, bad;
+    while (i < len) {
+        size_t n = scalar_sequence(s + i, len - i, &bad);
+        if (n == 0) return 0;
+        i += n;
+    }
+    return 1;
+}
+
+static size_t ascii_prefix_scalar(const uint8_t* s, size_t len) {
+    size_t i = 0;
+    for (; i + 8 <= len; i += 8) {
+        uint64_t w;
+        memcpy(&w, s + i, sizeof(w));
+        if (w & 0x8080808080808080ULL) break;
+    }
+    return i;
+}
+
+#if UTF8_HAVE_X86
+
+/* ---------------------------------------------------------------------- */
+/* SSSE3 kernel: 16 bytes per step                                        */
+/* ---------------------------------------------------------------------- */
+
+__attribute__((target("ssse3")))
+static inline __m128i ssse3_check_block(__m128i input, __m128i prev_input) {
+    const __m128i nibble = _mm_set1_epi8(0x0F);
+    const __m128i t1h = _mm_loadu_si128((const __m128i*)byte_1_high_table);
+    const __m128i t1l = _mm_loadu_si128((const __m128i*)byte_1_low_table);
+    const __m128i t2h = _mm_loadu_si128((const __m128i*)byte_2_high_table);
+
+    __m128i prev1 = _mm_alignr_epi8(input, prev_input, 15);
+    __m128i b1h = _mm_shuffle_epi8(t1h, _mm_and_si128(_mm_srli_epi16(prev1, 4), nibble));
+    __m128i b1l = _mm_shuffle_epi8(t1l, _mm_and_si128(prev1, nibble));
+    __m128i b2h = _mm_shuffle_epi8(t2h, _mm_and_si128(_mm_srli_epi16(input, 4), nibble));
+    __m128i sc = _mm_and_si128(_mm_and_si128(b1h, b1l), b2h);
+
+    /* Third and fourth bytes of multi-byte sequences must be continuations */
+    __m128i prev2 = _mm_alignr_epi8(input, prev_input, 14);
+    __m128i prev3 = _mm_alignr_epi8(input, prev_input, 13);
+    __m128i is_third = _mm_subs_epu8(prev2, _mm_set1_epi8((char)(0xE0 - 0x80)));
+    __m128i is_fourth = _mm_subs_epu8(prev3, _mm_set1_epi8((char)(0xF0 - 0x80)));
+    __m128i must23 = _mm_and_si128(_mm_or_si128(is_third, is_fourth),
+                                   _mm_set1_epi8((char)0x80));
+    return _mm_xor_si128(must23, sc);
+}
+
+__attribute__((target("ssse3")))
+static int validate_ssse3(const uint8_t* s, size_t len) {
+    /* Lead bytes in the last three positions still waiting for input */
+    const __m128i max_value = _mm_setr_epi8(
+        -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+        (char)(0xF0 - 1), (char)(0xE0 - 1), (char)(0xC0 - 1));
+    __m128i error = _mm_setzero_si128();
+    __m128i prev_input = _mm_setzero_si128();
+    __m128i prev_incomplete = _mm_setzero_si128();
+    size_t i = 0;
+
+    for (; i + 16 <= len; i += 16) {
+        __m128i input = _mm_loadu_si128((const __m128i*)(s + i));
+        if (_mm_movemask_epi8(input) == 0) {
+            /* ASCII block: only a sequence dangling from before can fail */
+            error = _mm_or_si128(error, prev_incomplete);
+        } else {
+            error = _mm_or_si128(error, ssse3_check_block(input, prev_input));
+            prev_incomplete = _mm_subs_epu8(input, max_value);
+        }
+        prev_input = input;
+    }
+
+    /* Zero-padded tail; the padding also exposes any truncated sequence */
+    uint8_t tail[16] = {0};
+    memcpy(tail, s + i, len - i);
+    __m128i input = _mm_loadu_si128((const __m128i*)tail);
+    error = _mm_or_si128(error, ssse3_check_block(input, prev_input));
+
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(error, _mm_setzero_si128())) == 0xFFFF;
+}
+
+/* ---------------------------------------------------------------------- */
+/* AVX2 kernel: 32 bytes per step                                         */
+/* ---------------------------------------------------------------------- */
+
+__attribute__((target("avx2")))
+static inline __m256i avx2_prev(__m256i input, __m256i prev_input, const int n) {
+    __m256i carried = _mm256_permute2x128_si256(prev_input, input, 0x21);
+    switch (n) {
+        case 1:  return _mm256_alignr_epi8(input, carried, 15);
+        case 2:  return _mm256_alignr_epi8(input, carried, 14);
+        default: return _mm256_alignr_epi8(input, carried, 13);
+    }
+}
+
+__attribute__((target("avx2")))
+static inline __m256i avx2_check_block(__m256i input, __m256i prev_input) {
+    const __m256i nibble = _mm256_set1_epi8(0x0F);
+    const __m256i t1h = _mm256_broadcastsi128_si256(
+        _mm_loadu_si128((const __m128i*)byte_1_high_table));
+    const __m256i t1l = _mm256_broadcastsi128_si256(
+        _mm_loadu_si128((const __m128i*)byte_1_low_table));
+    const __m256i t2h = _mm256_broadcastsi128_si256(
+        _mm_loadu_si128((const __m128i*)byte_2_high_table));
+
+    __m256i prev1 = avx2_prev(input, prev_input, 1);
+    __m256i b1h = _mm256_shuffle_epi8(t1h, _mm256_and_si256(_mm256_srli_epi16(prev1, 4), nibble));
+    __m256i b1l = _mm256_shuffle_epi8(t1l, _mm256_and_si256(prev1, nibble));
+    __m256i b2h = _mm256_shuffle_epi8(t2h, _mm256_and_si256(_mm256_srli_epi16(input, 4), nibble));
+    __m256i sc = _mm256_and_si256(_mm256_and_si256(b1h, b1l), b2h);
+
+    __m256i prev2 = avx2_prev(input, prev_input, 2);
+    __m256i prev3 = avx2_prev(input, prev_input, 3);
+    __m256i is_third = _mm256_subs_epu8(prev2, _mm256_set1_epi8((char)(0xE0 - 0x80)));
+    __m256i is_fourth = _mm256_subs_epu8(prev3, _mm256_set1_epi8((char)(0xF0 - 0x80)));
+    __m256i must23 = _mm256_and_si256(_mm256_or_si256(is_third, is_fourth),
+                                      _mm256_set1_epi8((char)0x80));
+    return _mm256_xor_si256(must23, sc);
+}
+
+__attribute__((target("avx2")))
+static int validate_avx2(const uint8_t* s, size_t len) {
+    const __m256i max_value = _mm256_setr_epi8(
+        -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+        -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+        (char)(0xF0 - 1), (char)(0xE0 - 1), (char)(0xC0 - 1));
+    __m256i error = _mm256_setzero_si256();
+    __m256i prev_input = _mm256_setzero_si256();
+    __m256i prev_incomplete = _mm256_setzero_si256();
+    size_t i = 0;
+
+    for (; i + 32 <= len; i += 32) {
+        __m256i input = _mm256_loadu_si256((const __m256i*)(s + i));
+        if (_mm256_movemask_epi8(input) == 0) {
+            error = _mm256_or_si256(error, prev_incomplete);
+        } else {
+            error = _mm256_or_si256(error, avx2_check_block(input, prev_input));
+            prev_incomplete = _mm256_subs_epu8(input, max_value);
+        }
+        prev_input = input;
+    }
+
+    uint8_t tail[32] = {0};
+    memcpy(tail, s + i, len - i);
+    __m256i input = _mm256_loadu_si256((const __m256i*)tail);
+    error = _mm256_or_si256(error, avx2_check_block(input, prev_input));
+
+    return _mm256_testz_si256(error, error);
+}
+
+__attribute__((target("avx2")))
+static size_t ascii_prefix_avx2(const uint8_t* s, size_t len) {
+    size_t i = 0;
+    /* Four loads OR-ed together: one branch per cache line */
+    for (; i + 128 <= len; i += 128) {
+        __m256i a = _mm256_loadu_si256((const __m256i*)(s + i));
+        __m256i b = _mm256_loadu_si256((const __m256i*)(s + i + 32));
+        __m256i c = _mm256_loadu_si256((const __m256i*)(s + i + 64));
+        __m256i d = _mm256_loadu_si256((const __m256i*)(s + i + 96));
+        __m256i any = _mm256_or_si256(_mm256_or_si256(a, b), _mm256_or_si256(c, d));
+        if (_mm256_movemask_epi8(any) != 0) break;
+    }
+    for (; i + 32 <= len; i += 32) {
+        if (_mm256_movemask_epi8(_mm256_loadu_si256((const __m256i*)(s + i))) != 0) break;
+    }
+    return i;
+}
+
+static size_t ascii_prefix_sse2(const uint8_t* s, size_t len) {
+    size_t i = 0;
+    for (; i + 64 <= len; i += 64) {
+        __m128i a = _mm_loadu_si128((const __m128i*)(s + i));
+        __m128i b = _mm_loadu_si128((const __m128i*)(s + i + 16));
+        __m128i c = _mm_loadu_si128((const __m128i*)(s + i + 32));
+        __m128i d = _mm_loadu_si128((const __m128i*)(s + i + 48));
+        __m128i any = _mm_or_si128(_mm_or_si128(a, b), _mm_or_si128(c, d));
+        if (_mm_movemask_epi8(any) != 0) break;
+    }
+    for (; i + 16 <= len; i += 16) {
+        if (_mm_movemask_epi8(_mm_loadu_si128((const __m128i*)(s + i))) != 0) break;
+    }
+    return i;
+}
+
+#endif /* UTF8_HAVE_X86 */
+
+/* ---------------------------------------------------------------------- */
+/* Runtime dispatch                                                       */
+/* ---------------------------------------------------------------------- */
+
+typedef int (*validate_fn)(const uint8_t* s, size_t len);
+typedef size_t (*ascii_prefix_fn)(const uint8_t* s, size_t len);
+
+static validate_fn validate_impl = validate_scalar;
+static ascii_prefix_fn ascii_prefix_impl = ascii_prefix_scalar;
+static const char* kernel_name = "scalar";
+static pthread_once_t dispatch_once = PTHREAD_ONCE_INIT;
+
+static void select_kernel(void) {
+#if UTF8_HAVE_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        validate_impl = validate_avx2;
+        ascii_prefix_impl = ascii_prefix_avx2;
+        kernel_name = "avx2";
+    } else if (__builtin_cpu_supports("ssse3")) {
+        validate_impl = validate_ssse3;
+        ascii_prefix_impl = ascii_prefix_sse2;
+        kernel_name = "ssse3";
+    } else {
+        ascii_prefix_impl = ascii_prefix_sse2;
+    }
+#endif
+}
+
+/**
+ * Check whether a buffer is well-formed UTF-8
+ */
+int utf8_validate(const char* buf, size_t len) {
+    if (!buf) return len == 0;
+    pthread_once(&dispatch_once, select_kernel);
+
+    const uint8_t* s = (const uint8_t*)buf;
+    size_t skip = ascii_prefix_impl(s, len);
+    if (skip == len) {
+        return 1;
+    }
+    /* Everything before skip is ASCII, so the kernel can start cold there */
+    return validate_impl(s + skip, len - skip);
+}
+
+/**
+ * Check whether a buffer is pure 7-bit ASCII
+ */
+int utf8_is_ascii(const char* buf, size_t len) {
+    if (!buf) return len == 0;
+    pthread_once(&dispatch_once, select_kernel);
+
+    const uint8_t* s = (const uint8_t*)buf;
+    size_t i = ascii_prefix_impl(s, len);
+    for (; i < len; i++) {
+        if (s[i] & 0x80) return 0;
+    }
+    return 1;
+}
+
+/**
+ * Copy a buffer, replacing ill-formed sequences with U+FFFD
+ */
+size_t utf8_repair(const char* in, size_t len, char* out) {
+    const uint8_t* s = (const uint8_t*)in;
+    size_t i = 0, o = 0;
+
+    while (i < len) {
+        size_t bad = 0;
+        size_t n = scalar_sequence(s + i, len - i, &bad);
+        if (n > 0) {
+            memcpy(out + o, s + i, n);
+            o += n;
+            i += n;
+        } else {
+            memcpy(out + o, UTF8_REPLACEMENT, UTF8_REPLACEMENT_LEN);
+            o += UTF8_REPLACEMENT_LEN;
+            i += bad;
+        }
+    }
+    return o;
+}
+
+/**
+ * Name of the validation kernel selected for this CPU
+ */
+const char* utf8_kernel_name(void) {
+    pthread_once(&dispatch_once, select_kernel);
+    return kernel_name;
+}
@@ -0,0 +1,82 @@
+/**
+ * @file utf8.h
+ * @brief Fast UTF-8 well-formedness checking and repair
+ *
+ * Validation uses the vectorized lookup-table algorithm (Keiser & Lemire):
+ * every byte pair is classified through three 16-entry nibble tables and the
+ * results are AND-ed, so a whole register of input is checked with a handful
+ * of shuffles and no per-byte branches. Features include:
+ * - AVX2 (32 bytes/step) and SSSE3 (16 bytes/step) kernels on x86-64
+ * - Runtime CPU dispatch with a portable scalar fallback
+ * - ASCII fast path that only ORs blocks together and tests the high bit
+ * - Repair that replaces each maximal ill-formed subpart with U+FFFD
+ *
+ * Thread Safety: All functions are thread-safe (dispatch is resolved once)
+ * Memory Management: Callers provide all buffers
+ */
+
+#ifndef UTF8_H
+#define UTF8_H
+
+#include <stddef.h>
+
+/* UTF-8 encoding of U+FFFD REPLACEMENT CHARACTER */
+#define UTF8_REPLACEMENT      "\xEF\xBF\xBD"
+#define UTF8_REPLACEMENT_LEN  3
+
+/**
+ * @brief Check whether a buffer is well-formed UTF-8
+ *
+ * @param buf Bytes to check (need not be NUL-terminated)
+ * @param len Number of bytes
+ * @return 1 if the buffer is valid UTF-8, 0 otherwise
+ *
+ * @note Rejects overlongs, surrogates, code points above U+10FFFF and
+ *       truncated sequences, exactly as RFC 3629 requires
+ */
+int utf8_validate(const char* buf, size_t len);
+
+/**
+ * @brief Check whether a buffer is pure 7-bit ASCII
+ *
+ * @param buf Bytes to check
+ * @param len Number of bytes
+ * @return 1 if every byte is below 0x80, 0 otherwise
+ *
+ * @note This is the fast path of utf8_validate and costs about a memory read
+ */
+int utf8_is_ascii(const char* buf, size_t len);
+
+/**
+ * @brief Copy a buffer, replacing ill-formed sequences with U+FFFD
+ *
+ * @param in Input bytes
+ * @param len Number of input bytes
+ * @param out Output buffer, at least utf8_repair_bound(len) bytes
+ * @return Number of bytes written to out (not NUL-terminated)
+ *
+ * @note Each maximal subpart of an ill-formed sequence becomes one U+FFFD,
+ *       matching the W3C/WHATWG decoder and Unicode recommended practice
+ */
+size_t utf8_repair(const char* in, size_t len, char* out);
+
+/**
+ * @brief Worst-case output size of utf8_repair
+ *
+ * @param len Number of input bytes
+ * @return Maximum number of bytes utf8_repair can write
+ */
+static inline size_t utf8_repair_bound(size_t len) {
+    return len * UTF8_REPLACEMENT_LEN;
+}
+
+/**
+ * @brief Name of the validation kernel selected for this CPU
+ *
+ * @return Static string: "avx2", "ssse3" or "scalar"
+ *
+ * @note Primarily useful for diagnostics and benchmarks
+ */
+const char* utf8_kernel_name(void);
+
+#endif /* UTF8_H */
@@ -28,7 +28,8 @@ TOTAL_TESTS=0
 PASSED_TESTS=0
 FAILED_TESTS=0
 
-# Run mode (unit, integration, e2e, all)
+# Run mode (unit, integration, e2e, memory, performance, perf, all);
+# perf is the timing regression gate and is not part of all
 MODE=${1:-all}
 
 # ==========================
@@ -84,6 +85,121 @@ run_unit_tests() {
             TOTAL_TESTS=$((TOTAL_TESTS + 1))
         fi
     fi
+    
+    # UTF-8 Unit Tests
+    if [ -f "build/bin/test_utf8" ]; then
+        echo -e "\n${GREEN}Running UTF-8 Unit Tests...${NC}"
+        if ./build/bin/test_utf8 > /tmp/utf8_test.log 2>&1; then
+            utf8_passed=$(grep -c "✓ PASSED" /tmp/utf8_test.log || echo "0")
+            utf8_total=$(grep "Total tests run:" /tmp/utf8_test.log | awk '{print $4}' || echo "0")
+            if grep -q "ALL TESTS PASSED" /tmp/utf8_test.log; then
+                echo -e "${GREEN}  ✅ UTF-8 Tests: $utf8_passed/$utf8_total passed${NC}"
+                PASSED_TESTS=$((PASSED_TESTS + utf8_passed))
+            else
+                utf8_failed=$(grep -c "❌ FAILED" /tmp/utf8_test.log || echo "0")
+                echo -e "${RED}  ❌ UTF-8 Tests: $utf8_failed tests failed${NC}"
+                grep "❌ FAILED" /tmp/utf8_test.log | head -3
+                FAILED_TESTS=$((FAILED_TESTS + utf8_failed))
+            fi
+            TOTAL_TESTS=$((TOTAL_TESTS + utf8_total))
+        else
+            echo -e "${RED}  ❌ UTF-8 tests crashed${NC}"
+            FAILED_TESTS=$((FAILED_TESTS + 1))
+            TOTAL_TESTS=$((TOTAL_TESTS + 1))
+        fi
+    fi
+    
+    # Plugin Config Unit Tests
+    if [ -f "build/bin/test_plugin_config" ]; then
+        echo -e "\n${GREEN}Running Plugin Config Unit Tests...${NC}"
+        if ./build/bin/test_plugin_config > /tmp/plugin_config_test.log 2>&1; then
+            config_passed=$(grep -c "✓ PASSED" /tmp/plugin_config_test.log || echo "0")
+            config_total=$(grep "Total tests run:" /tmp/plugin_config_test.log | awk '{print $4}' || echo "0")
+            if grep -q "ALL TESTS PASSED" /tmp/plugin_config_test.log; then
+                echo -e "${GREEN}  ✅ Plugin Config Tests: $config_passed/$config_total passed${NC}"
+                PASSED_TESTS=$((PASSED_TESTS + config_passed))
+            else
+                config_failed=$(grep -c "❌ FAILED" /tmp/plugin_config_test.log || echo "0")
+                echo -e "${RED}  ❌ Plugin Config Tests: $config_failed tests failed${NC}"
+                grep "❌ FAILED" /tmp/plugin_config_test.log | head -3
+                FAILED_TESTS=$((FAILED_TESTS + config_failed))
+            fi
+            TOTAL_TESTS=$((TOTAL_TESTS + config_total))
+        else
+            echo -e "${RED}  ❌ Plugin config tests crashed${NC}"
+            FAILED_TESTS=$((FAILED_TESTS + 1))
+            TOTAL_TESTS=$((TOTAL_TESTS + 1))
+        fi
+    fi
+    
+    # Shared Ring Unit Tests
+    if [ -f "build/bin/test_shm_ring" ]; then
+        echo -e "\n${GREEN}Running Shared Ring Unit Tests...${NC}"
+        if ./build/bin/test_shm_ring > /tmp/shm_ring_test.log 2>&1; then
+            ring_passed=$(grep -c "✓ PASSED" /tmp/shm_ring_test.log || echo "0")
+            ring_total=$(grep "Total tests run:" /tmp/shm_ring_test.log | awk '{print $4}' || echo "0")
+            if grep -q "ALL TESTS PASSED" /tmp/shm_ring_test.log; then
+                echo -e "${GREEN}  ✅ Shared Ring Tests: $ring_passed/$ring_total passed${NC}"
+                PASSED_TESTS=$((PASSED_TESTS + ring_passed))
+            else
+                ring_failed=$(grep -c "❌ FAILED" /tmp/shm_ring_test.log || echo "0")
+                echo -e "${RED}  ❌ Shared Ring Tests: $ring_failed tests failed${NC}"
+                grep "❌ FAILED" /tmp/shm_ring_test.log | head -3
+                FAILED_TESTS=$((FAILED_TESTS + ring_failed))
+            fi
+            TOTAL_TESTS=$((TOTAL_TESTS + ring_total))
+        else
+            echo -e "${RED}  ❌ Shared ring tests crashed${NC}"
+            FAILED_TESTS=$((FAILED_TESTS + 1))
+            TOTAL_TESTS=$((TOTAL_TESTS + 1))
+        fi
+    fi
+    
+    # Metrics Unit Tests
+    if [ -f "build/bin/test_metrics" ]; then
+        echo -e "\n${GREEN}Running Metrics Unit Tests...${NC}"
+        if ./build/bin/test_metrics > /tmp/metrics_test.log 2>&1; then
+            metrics_passed=$(grep -c "✓ PASSED" /tmp/metrics_test.log || echo "0")
+            metrics_total=$(grep "Total tests run:" /tmp/metrics_test.log | awk '{print $4}' || echo "0")
+            if grep -q "ALL TESTS PASSED" /tmp/metrics_test.log; then
+                echo -e "${GREEN}  ✅ Metrics Tests: $metrics_passed/$metrics_total passed${NC}"
+                PASSED_TESTS=$((PASSED_TESTS + metrics_passed))
+            else
+                metrics_failed=$(grep -c "❌ FAILED" /tmp/metrics_test.log || echo "0")
+                echo -e "${RED}  ❌ Metrics Tests: $metrics_failed tests failed${NC}"
+                grep "❌ FAILED" /tmp/metrics_test.log | head -3
+                FAILED_TESTS=$((FAILED_TESTS + metrics_failed))
+            fi
+            TOTAL_TESTS=$((TOTAL_TESTS + metrics_total))
+        else
+            echo -e "${RED}  ❌ Metrics tests crashed${NC}"
+            FAILED_TESTS=$((FAILED_TESTS + 1))
+            TOTAL_TESTS=$((TOTAL_TESTS + 1))
+        fi
+    fi
+    
+    # Trace Unit Tests
+    if [ -f "build/bin/test_trace" ]; then
+        echo -e "\n${GREEN}Running Trace Unit Tests...${NC}"
+        if ./build/bin/test_trace > /tmp/trace_test.log 2>&1; then
+            trace_passed=$(grep -c "✓ PASSED" /tmp/trace_test.log || echo "0")
+            trace_total=$(grep "Total tests run:" /tmp/trace_test.log | awk '{print $4}' || echo "0")
+            if grep -q "ALL TESTS PASSED" /tmp/trace_test.log; then
+                echo -e "${GREEN}  ✅ Trace Tests: $trace_passed/$trace_total passed${NC}"
+                PASSED_TESTS=$((PASSED_TESTS + trace_passed))
+            else
+                trace_failed=$(grep -c "❌ FAILED" /tmp/trace_test.log || echo "0")
+                echo -e "${RED}  ❌ Trace Tests: $trace_failed tests failed${NC}"
+                grep "❌ FAILED" /tmp/trace_test.log | head -3
+                FAILED_TESTS=$((FAILED_TESTS + trace_failed))
+            fi
+            TOTAL_TESTS=$((TOTAL_TESTS + trace_total))
+        else
+            echo -e "${RED}  ❌ Trace tests crashed${NC}"
+            FAILED_TESTS=$((FAILED_TESTS + 1))
+            TOTAL_TESTS=$((TOTAL_TESTS + 1))
+        fi
+    fi
 }
 
 # ==========================
@@ -125,6 +241,289 @@ run_integration_tests() {
         fi
     done
     
+    # Test UTF-8 validation plugin
+    TOTAL_TESTS=$((TOTAL_TESTS + 1))
+    echo -n "  Testing validate plugin... "
+    result=$(printf 'caf\xc3\xa9\nbad\xc3(\n<END>\n' | ./build/bin/pipeline ./build/lib/plugins/validate.so 2>/dev/null | grep -v "^Loaded" | tr '\n' '|' || echo "ERROR")
+    expected=$(printf 'caf\xc3\xa9|bad\xef\xbf\xbd(|')
+    if [ "$result" = "$expected" ]; then
+        echo -e "${GREEN}✅${NC}"
+        int_passed=$((int_passed + 1))
+        PASSED_TESTS=$((PASSED_TESTS + 1))
+    else
+        echo -e "${RED}❌ (expected: $expected, got: $result)${NC}"
+        int_failed=$((int_failed + 1))
+        FAILED_TESTS=$((FAILED_TESTS + 1))
+    fi
+    
+    # Test builtin plugins named without a path, mixed with a .so
+    TOTAL_TESTS=$((TOTAL_TESTS + 1))
+    echo -n "  Testing builtin plugins by name... "
+    result=$(echo -e "  hello  \n<END>" | ./build/bin/pipeline trim upper ./build/lib/plugins/reverse.so 2>/dev/null | grep -v "^Loaded" || echo "ERROR")
+    if [ "$result" = "OLLEH" ]; then
+        echo -e "${GREEN}✅${NC}"
+        int_passed=$((int_passed + 1))
+        PASSED_TESTS=$((PASSED_TESTS + 1))
+    else
+        echo -e "${RED}❌ (expected: OLLEH, got: $result)${NC}"
+        int_failed=$((int_failed + 1))
+        FAILED_TESTS=$((FAILED_TESTS + 1))
+    fi
+    
+    # Test per-plugin config strings
+    TOTAL_TESTS=$((TOTAL_TESTS + 1))
+    echo -n "  Testing plugin config strings... "
+    result=$(printf 'ok\nbad\xc3(\n<END>\n' | ./build/bin/pipeline "prefix:text=LOG;" ./build/lib/plugins/validate.so:mode=drop 2>/dev/null | grep -v "^Loaded" || echo "ERROR")
+    if [ "$result" = "LOG;ok" ]; then
+        echo -e "${GREEN}✅${NC}"
+        int_passed=$((int_passed + 1))
+        PASSED_TESTS=$((PASSED_TESTS + 1))
+    else
+        echo -e "${RED}❌ (expected: LOG;ok, got: $result)${NC}"
+        int_failed=$((int_failed + 1))
+        FAILED_TESTS=$((FAILED_TESTS + 1))
+    fi
+    
+    # Test config values containing '/' and escaped ','; an unescaped ',' is rejected
+    TOTAL_TESTS=$((TOTAL_TESTS + 1))
+    echo -n "  Testing plugin config values with '/' and ','... "
+    result=$(echo x | ./build/bin/pipeline 'prefix:text=/var/log/' './build/lib/plugins/suffix.so:text=\,a\,b' 2>/dev/null | grep -v "^Loaded" || echo "ERROR")
+    rejected=$(echo x | ./build/bin/pipeline 'prefix:text=a,b' 2>&1 >/dev/null | grep -c "not key=value")
+    if [ "$result" = "/var/log/x,a,b" ] && [ "$rejected" = "1" ]; then
+        echo -e "${GREEN}✅${NC}"
+        int_passed=$((int_passed + 1))
+        PASSED_TESTS=$((PASSED_TESTS + 1))
+    else
+        echo -e "${RED}❌ (expected: /var/log/x,a,b and a rejection, got: $result, $rejected)${NC}"
+        int_failed=$((int_failed + 1))
+        FAILED_TESTS=$((FAILED_TESTS + 1))
+    fi
+    
+    # Test crash isolation: the crashing record is dropped, the rest survive
+    TOTAL_TESTS=$((TOTAL_TESTS + 1))
+    echo -n "  Testing isolated plugin crash recovery... "
+    result=$(echo -e "a\nCRASH\nb\n<END>" | timeout 10 ./build/bin/pipeline upper --isolate ./build/lib/plugins/test_crash.so 2>/dev/null | grep -v "^Loaded" | tr '\n' '|' || echo "ERROR")
+    if [ "$result" = "A|B|" ]; then
+        echo -e "${GREEN}✅${NC}"
+        int_passed=$((int_passed + 1))
+        PASSED_TESTS=$((PASSED_TESTS + 1))
+    else
+        echo -e "${RED}❌ (expected: A|B|, got: $result)${NC}"
+        int_failed=$((int_failed + 1))
+        FAILED_TESTS=$((FAILED_TESTS + 1))
+    fi
+    
+    # Test the end-of-stream metrics report
+    TOTAL_TESTS=$((TOTAL_TESTS + 1))
+    echo -n "  Testing metrics report... "
+    result=$(echo -e "a\nbb\n<END>" | ./build/bin/pipeline --metrics upper 2>&1 >/dev/null | awk '!done && $1 == "upper" { print $2, $3, $4, $5; done = 1 }')
+    if [ "$result" = "2 2 3 3" ]; then
+        echo -e "${GREEN}✅${NC}"
+        int_passed=$((int_passed + 1))
+        PASSED_TESTS=$((PASSED_TESTS + 1))
+    else
+        echo -e "${RED}❌ (expected: 2 2 3 3, got: $result)${NC}"
+        int_failed=$((int_failed + 1))
+        FAILED_TESTS=$((FAILED_TESTS + 1))
+    fi
+
+    # Test the bottleneck report: one utilization row per stage and a verdict
+    TOTAL_TESTS=$((TOTAL_TESTS + 1))
+    echo -n "  Testing bottleneck report... "
+    result=$(seq 1 20000 | ./build/bin/pipeline --metrics upper trim 2>&1 >/dev/null | awk '$1 == "stage" && $2 == "cpu_pct" { rows = 1; next } rows && NF == 5 { n++ } /^critical stage: / { print n, "critical" }')
+    if [ "$result" = "3 critical" ]; then
+        echo -e "${GREEN}✅${NC}"
+        int_passed=$((int_passed + 1))
+        PASSED_TESTS=$((PASSED_TESTS + 1))
+    else
+        echo -e "${RED}❌ (expected: 3 critical, got: $result)${NC}"
+        int_failed=$((int_failed + 1))
+        FAILED_TESTS=$((FAILED_TESTS + 1))
+    fi
+
+    # Test the Prometheus endpoint while the pipeline is still running
+    TOTAL_TESTS=$((TOTAL_TESTS + 1))
+    echo -n "  Testing metrics endpoint... "
+    (echo -e "a\nb\nc"; sleep 1; echo "<END>") | \
+        ./build/bin/pipeline --metrics-listen=127.0.0.1:19464 upper >/dev/null 2>&1 &
+    local pipeline_pid=$!
+    result=""
+    for attempt in 1 2 3 4 5; do
+        sleep 0.2
+        result=$( (exec 3<>/dev/tcp/127.0.0.1/19464 && printf 'GET /metrics HTTP/1.0\r\n\r\n' >&3 && cat <&3) 2>/dev/null | \
+            grep -E '^pipeline_stage_records_out_total\{stage="upper"\}|^HTTP/1.0' | tr -d '\r' | tr '\n' ' ' || true)
+        [ -n "$result" ] && break
+    done
+    wait $pipeline_pid || true
+    if [ "$result" = 'HTTP/1.0 200 OK pipeline_stage_records_out_total{stage="upper"} 3 ' ]; then
+        echo -e "${GREEN}✅${NC}"
+        int_passed=$((int_passed + 1))
+        PASSED_TESTS=$((PASSED_TESTS + 1))
+    else
+        echo -e "${RED}❌ (expected 200 and 3 records out, got: $result)${NC}"
+        int_failed=$((int_failed + 1))
+        FAILED_TESTS=$((FAILED_TESTS + 1))
+    fi
+
+    # Test that adjacent byte-map stages run as one fused stage
+    TOTAL_TESTS=$((TOTAL_TESTS + 1))
+    echo -n "  Testing byte map fusion... "
+    result=$(echo -e "MiXeD Case\n<END>" | ./build/bin/pipeline --metrics upper lower trim 2>&1 | \
+        grep -E '^mixed case$|^upper\+lower ' | awk '{print $1}' | sort -u | tr '\n' ' ')
+    if [ "$result" = "mixed upper+lower " ]; then
+        echo -e "${GREEN}✅${NC}"
+        int_passed=$((int_passed + 1))
+        PASSED_TESTS=$((PASSED_TESTS + 1))
+    else
+        echo -e "${RED}❌ (expected lowercase output from one upper+lower stage, got: $result)${NC}"
+        int_failed=$((int_failed + 1))
+        FAILED_TESTS=$((FAILED_TESTS + 1))
+    fi
+
+    # Test that a unix metrics path never replaces a file that is not a socket
+    TOTAL_TESTS=$((TOTAL_TESTS + 1))
+    echo -n "  Testing metrics socket path guard... "
+    local guard_file
+    guard_file=$(mktemp)
+    echo keep > "$guard_file"
+    result=$(echo a | ./build/bin/pipeline --metrics-listen="unix:$guard_file" upper 2>&1 >/dev/null | \
+        grep -c 'File exists' || true)
+    if [ "$result" = "1" ] && [ "$(cat "$guard_file")" = "keep" ]; then
+        echo -e "${GREEN}✅${NC}"
+        int_passed=$((int_passed + 1))
+        PASSED_TESTS=$((PASSED_TESTS + 1))
+    else
+        echo -e "${RED}❌ (expected refusal with the file intact, got: $result)${NC}"
+        int_failed=$((int_failed + 1))
+        FAILED_TESTS=$((FAILED_TESTS + 1))
+    fi
+    rm -f "$guard_file"
+
+    # Test that a tiny byte budget throttles but never deadlocks the chain
+    TOTAL_TESTS=$((TOTAL_TESTS + 1))
+    echo -n "  Testing byte budget... "
+    result=$(seq 1 20000 | timeout 20 ./build/bin/pipeline --budget=1K upper trim 2>/dev/null | \
+        grep -c '^[0-9]' || true)
+    if [ "$result" = "20000" ]; then
+        echo -e "${GREEN}✅${NC}"
+        int_passed=$((int_passed + 1))
+        PASSED_TESTS=$((PASSED_TESTS + 1))
+    else
+        echo -e "${RED}❌ (expected 20000 lines, got: $result)${NC}"
+        int_failed=$((int_failed + 1))
+        FAILED_TESTS=$((FAILED_TESTS + 1))
+    fi
+
+    # Test that records trickling in are gathered but none is held back
+    TOTAL_TESTS=$((TOTAL_TESTS + 1))
+    echo -n "  Testing stage linger... "
+    result=$( (echo " a "; sleep 0.2; echo " b "; echo "<END>") | \
+        ./build/bin/pipeline --linger=20000 upper trim 2>/dev/null | grep -v "^Loaded" | tr '\n' ' ' || true)
+    rejected=$(echo x | ./build/bin/pipeline --linger=abc upper 2>&1 | grep -c "Invalid linger")
+    if [ "$result" = "A B " ] && [ "$rejected" = "1" ]; then
+        echo -e "${GREEN}✅${NC}"
+        int_passed=$((int_passed + 1))
+        PASSED_TESTS=$((PASSED_TESTS + 1))
+    else
+        echo -e "${RED}❌ (expected 'A B ' and --linger=abc rejected, got: '$result', $rejected)${NC}"
+        int_failed=$((int_failed + 1))
+        FAILED_TESTS=$((FAILED_TESTS + 1))
+    fi
+
+    # Test the lock profile names every queue lock
+    TOTAL_TESTS=$((TOTAL_TESTS + 1))
+    echo -n "  Testing lock profile... "
+    result=$(seq 1 1000 | ./build/bin/pipeline --lock-profile upper trim 2>&1 >/dev/null | \
+        awk '$1 ~ /^queue>/ {print $1}' | sort | tr '\n' ' ' || true)
+    if [ "$result" = "queue>output queue>trim queue>upper " ]; then
+        echo -e "${GREEN}✅${NC}"
+        int_passed=$((int_passed + 1))
+        PASSED_TESTS=$((PASSED_TESTS + 1))
+    else
+        echo -e "${RED}❌ (expected rows for all three queues, got: $result)${NC}"
+        int_failed=$((int_failed + 1))
+        FAILED_TESTS=$((FAILED_TESTS + 1))
+    fi
+
+    # Test that markers flush a stateful stage in order, with and without linger
+    TOTAL_TESTS=$((TOTAL_TESTS + 1))
+    echo -n "  Testing control markers... "
+    markers="a\nb\n<FLUSH>\nc\n<EPOCH 7>\n<WATERMARK 9>\nd\ne\n<END>\n"
+    expected="flush 0: 2|epoch 7: 1|watermark 9: 0|end 0: 2|"
+    result=$(printf "$markers" | timeout 10 ./build/bin/pipeline upper ./build/lib/plugins/test_count.so 2>/dev/null | grep -v "^Loaded" | tr '\n' '|' || echo "ERROR")
+    lingered=$(printf "$markers" | timeout 10 ./build/bin/pipeline --linger=2000 upper ./build/lib/plugins/test_count.so 2>/dev/null | grep -v "^Loaded" | tr '\n' '|' || echo "ERROR")
+    if [ "$result" = "$expected" ] && [ "$lingered" = "$expected" ]; then
+        echo -e "${GREEN}✅${NC}"
+        int_passed=$((int_passed + 1))
+        PASSED_TESTS=$((PASSED_TESTS + 1))
+    else
+        echo -e "${RED}❌ (expected '$expected', got: '$result' and '$lingered')${NC}"
+        int_failed=$((int_failed + 1))
+        FAILED_TESTS=$((FAILED_TESTS + 1))
+    fi
+
+    # Test that markers cross the rings of isolated stages
+    TOTAL_TESTS=$((TOTAL_TESTS + 1))
+    echo -n "  Testing control markers in isolated stages... "
+    result=$(printf "$markers" | timeout 10 ./build/bin/pipeline --isolate upper --isolate ./build/lib/plugins/test_count.so 2>/dev/null | grep -v "^Loaded" | tr '\n' '|' || echo "ERROR")
+    if [ "$result" = "$expected" ]; then
+        echo -e "${GREEN}✅${NC}"
+        int_passed=$((int_passed + 1))
+        PASSED_TESTS=$((PASSED_TESTS + 1))
+    else
+        echo -e "${RED}❌ (expected '$expected', got: '$result')${NC}"
+        int_failed=$((int_failed + 1))
+        FAILED_TESTS=$((FAILED_TESTS + 1))
+    fi
+
+    # Test trace export: named threads and transform events in the JSON
+    TOTAL_TESTS=$((TOTAL_TESTS + 1))
+    echo -n "  Testing trace export... "
+    rm -f /tmp/pipeline_trace_test.json
+    echo -e "a\nb\nc\n<END>" | ./build/bin/pipeline --trace=/tmp/pipeline_trace_test.json upper >/dev/null 2>&1
+    result=$( (grep -o '"name":"output"\|"ph":"X","name":"upper"' /tmp/pipeline_trace_test.json 2>/dev/null || true) | sort -u | tr '\n' ' ')
+    rejected=$(echo x | ./build/bin/pipeline --trace=/tmp/pipeline_trace_test.json --trace-sample=0 upper 2>&1 | grep -c "Invalid trace sample")
+    if [ "$result" = '"name":"output" "ph":"X","name":"upper" ' ] && [ "$rejected" = "1" ]; then
+        echo -e "${GREEN}✅${NC}"
+        int_passed=$((int_passed + 1))
+        PASSED_TESTS=$((PASSED_TESTS + 1))
+    else
+        echo -e "${RED}❌ (expected output thread, upper events and --trace-sample=0 rejected, got: $result, $rejected)${NC}"
+        int_failed=$((int_failed + 1))
+        FAILED_TESTS=$((FAILED_TESTS + 1))
+    fi
+    rm -f /tmp/pipeline_trace_test.json
+
+    # Test the benchmark harness: every generated line comes out, with latency
+    TOTAL_TESTS=$((TOTAL_TESTS + 1))
+    echo -n "  Testing pipeline_bench... "
+    result=$(./build/bin/pipeline_bench --lines 1000 --len uniform:0:80 --charset utf8 --dup 0.5 upper reverse 2>/dev/null |
+             grep -o '"input_lines":[0-9]*\|"output_lines":[0-9]*\|"latency_us":{"samples":[0-9]*' | awk -F: '{ print $NF }' | tr '\n' ' ')
+    if [ "$result" = "1000 1000 1000 " ]; then
+        echo -e "${GREEN}✅${NC}"
+        int_passed=$((int_passed + 1))
+        PASSED_TESTS=$((PASSED_TESTS + 1))
+    else
+        echo -e "${RED}❌ (expected: 1000 1000 1000, got: $result)${NC}"
+        int_failed=$((int_failed + 1))
+        FAILED_TESTS=$((FAILED_TESTS + 1))
+    fi
+
+    # Test the synchronization microbenchmark: one JSON line per measurement
+    TOTAL_TESTS=$((TOTAL_TESTS + 1))
+    echo -n "  Testing sync_bench... "
+    result=$(./build/bin/sync_bench --ops 2000 --only queue --only barrier 2>&1 |
+             grep -c '^{"bench":".*"ops_per_s":[0-9]*,.*}$')
+    if [ "$result" = "16" ]; then
+        echo -e "${GREEN}✅${NC}"
+        int_passed=$((int_passed + 1))
+        PASSED_TESTS=$((PASSED_TESTS + 1))
+    else
+        echo -e "${RED}❌ (expected: 16 result lines, got: $result)${NC}"
+        int_failed=$((int_failed + 1))
+        FAILED_TESTS=$((FAILED_TESTS + 1))
+    fi
+
     # Test plugin combinations
     echo -e "\n${GREEN}Testing Plugin Combinations...${NC}"
     
@@ -309,6 +708,144 @@ run_performance_test() {
     fi
 }
 
+# ==========================
+# PERFORMANCE REGRESSION GATE
+# ==========================
+# Runs each case of tests/perf_baseline.json several times through
+# pipeline_bench and compares the median lines/s with the baseline. A case
+# fails only when the whole confidence interval of the median lies below
+# the tolerance band, so one noisy run cannot fail the gate.
+# The baseline records the nproc and CPU model it was measured on; on any
+# other host the numbers are not comparable, so the cases still run and
+# report their delta but a miss is only a warning.
+# PERF_RUNS overrides the run count; PERF_UPDATE=1 rewrites the baseline
+# with the measured medians and this host.
+PERF_BASELINE="tests/perf_baseline.json"
+
+# This host as recorded in the baseline: prints "nproc<TAB>cpu model"
+perf_host() {
+    local cpu
+    cpu=$(awk -F: '/^model name/ { sub(/^[ \t]+/, "", $2); print $2; exit }' /proc/cpuinfo 2>/dev/null)
+    printf "%s\t%s\n" "$(nproc 2>/dev/null || echo 0)" "${cpu:-$(uname -m)}"
+}
+
+# Host the baseline was measured on: prints "nproc<TAB>cpu model"
+perf_baseline_host() {
+    awk -F'"' '/"host"/ {
+        n = $0; sub(/.*"nproc": */, "", n); sub(/[^0-9].*/, "", n)
+        for (i = 1; i < NF; i++) if ($i == "cpu") cpu = $(i + 2)
+        printf "%s\t%s\n", n, cpu; exit
+    }' "$PERF_BASELINE"
+}
+
+# Median and order-statistic confidence interval of the median, read from
+# one number per line: prints "median lo hi". The interval is the run
+# values at ranks (n -/+ 1.96*sqrt(n))/2, which is ~95% for large n. For
+# n <= 7 those ranks fall outside the sample and it is simply [min, max],
+# covering the median with probability 1 - 2^(1-n): 98% at the default 7
+# runs, 94% at 5 and only 75% at 3. A case then fails only when every run
+# was below the band.
+perf_median_ci() {
+    sort -n | awk '{ v[NR] = $1 }
+        END {
+            n = NR
+            if (n == 0) { print 0, 0, 0; exit }
+            median = (n % 2) ? v[(n + 1) / 2] : (v[n / 2] + v[n / 2 + 1]) / 2
+            lo = int((n - 1.96 * sqrt(n)) / 2)
+            hi = int(1 + (n + 1.96 * sqrt(n)) / 2 + 0.999999)
+            if (lo < 1) lo = 1
+            if (hi > n) hi = n
+            printf "%.0f %.0f %.0f\n", median, v[lo], v[hi]
+        }'
+}
+
+# Cases from the baseline, one per line: name, args, lines_per_s, tolerance
+perf_cases() {
+    awk -F'"' '
+        !in_cases && /"tolerance_pct"/ { t = $0; sub(/.*"tolerance_pct": */, "", t); sub(/[^0-9.].*/, "", t); tol = t }
+        /"cases"/ { in_cases = 1 }
+        in_cases && /"name"/ {
+            for (i = 1; i < NF; i++) {
+                if ($i == "name") name = $(i + 2)
+                if ($i == "args") args = $(i + 2)
+            }
+            v = $0; sub(/.*"lines_per_s": */, "", v); sub(/[^0-9.].*/, "", v)
+            t = tol
+            if ($0 ~ /"tolerance_pct"/) { t = $0; sub(/.*"tolerance_pct": */, "", t); sub(/[^0-9.].*/, "", t) }
+            printf "%s\t%s\t%s\t%s\n", name, args, v, t
+        }' "$PERF_BASELINE"
+}
+
+run_perf_tests() {
+    echo -e "\n${YELLOW}════════════════════════════════════════════════════════${NC}"
+    echo -e "${YELLOW}              PERFORMANCE REGRESSION GATE               ${NC}"
+    echo -e "${YELLOW}════════════════════════════════════════════════════════${NC}"
+    
+    if [ ! -f "build/bin/pipeline_bench" ] || [ ! -f "$PERF_BASELINE" ]; then
+        echo -e "${RED}  ❌ pipeline_bench or $PERF_BASELINE missing${NC}"
+        FAILED_TESTS=$((FAILED_TESTS + 1))
+        return
+    fi
+    
+    local runs=${PERF_RUNS:-$(awk -F: '/"runs"/ { gsub(/[^0-9]/, "", $2); print $2; exit }' "$PERF_BASELINE")}
+    local medians=/tmp/perf_medians.txt
+    : > "$medians"
+    local host baseline_host gated=1
+    host=$(perf_host)
+    baseline_host=$(perf_baseline_host)
+    if [ "$host" != "$baseline_host" ] && [ "${PERF_UPDATE:-0}" != "1" ]; then
+        gated=0
+        echo -e "  ${YELLOW}⚠️  Baseline is from nproc=${baseline_host%%$'\t'*} '${baseline_host#*$'\t'}',"
+        echo -e "     this host is nproc=${host%%$'\t'*} '${host#*$'\t'}': misses are warnings only."
+        echo -e "     Run PERF_UPDATE=1 $0 perf to take a baseline here.${NC}"
+    fi
+    echo -e "  $runs runs per case; lines/s median [CI of the median] vs baseline\n"
+    
+    while IFS=$'\t' read -r name args baseline tolerance; do
+        TOTAL_TESTS=$((TOTAL_TESTS + 1))
+        printf "  %-16s " "$name"
+        local samples=""
+        for ((r = 0; r < runs; r++)); do
+            # shellcheck disable=SC2086
+            samples+="$(./build/bin/pipeline_bench $args 2>/dev/null | grep -o '"lines_per_s":[0-9]*' | cut -d: -f2)"$'\n'
+        done
+        read -r median lo hi <<< "$(printf "%s" "$samples" | grep . | perf_median_ci)"
+        echo "$name $median" >> "$medians"
+        
+        local verdict
+        verdict=$(awk -v m="$median" -v lo="$lo" -v hi="$hi" -v b="$baseline" -v t="$tolerance" 'BEGIN {
+            if (m == 0) { print "fail no output"; exit }
+            if (b == 0) { print "pass no baseline"; exit }
+            delta = (m - b) * 100 / b
+            if (hi < b * (1 - t / 100)) printf "fail %+.1f%% (beyond -%s%%)\n", delta, t
+            else if (lo > b * (1 + t / 100)) printf "pass %+.1f%% (faster; consider PERF_UPDATE=1)\n", delta
+            else printf "pass %+.1f%%\n", delta
+        }')
+        printf "%12s [%s, %s] vs %s " "$median" "$lo" "$hi" "$baseline"
+        if [ "${verdict%% *}" = "pass" ]; then
+            echo -e "${GREEN}✅ ${verdict#pass }${NC}"
+            PASSED_TESTS=$((PASSED_TESTS + 1))
+        elif [ "$gated" = "0" ] && [ "$median" != "0" ]; then
+            echo -e "${YELLOW}⚠️  ${verdict#fail } (other host)${NC}"
+            PASSED_TESTS=$((PASSED_TESTS + 1))
+        else
+            echo -e "${RED}❌ ${verdict#fail }${NC}"
+            FAILED_TESTS=$((FAILED_TESTS + 1))
+        fi
+    done < <(perf_cases)
+    
+    if [ "${PERF_UPDATE:-0}" = "1" ]; then
+        awk -v nproc="${host%%$'\t'*}" -v cpu="${host#*$'\t'}" 'NR == FNR { median[$1] = $2; next }
+            /"host"/ { sub(/"host":.*/, "\"host\": {\"nproc\": " nproc ", \"cpu\": \"" cpu "\"},") }
+            /"name"/ {
+                split($0, f, "\""); name = f[4]
+                if (name in median) sub(/"lines_per_s": *[0-9.]+/, "\"lines_per_s\": " median[name])
+            }
+            { print }' "$medians" "$PERF_BASELINE" > "$PERF_BASELINE.tmp" && mv "$PERF_BASELINE.tmp" "$PERF_BASELINE"
+        echo -e "\n  ${CYAN}Baseline updated: $PERF_BASELINE${NC}"
+    fi
+}
+
 # ==========================
 # MAIN TEST EXECUTION
 # ==========================
@@ -328,6 +865,9 @@ case $MODE in
     performance)
         run_performance_test
         ;;
+    perf)
+        run_perf_tests
+        ;;
     all)
         run_unit_tests
         run_integration_tests
@@ -337,7 +877,7 @@ case $MODE in
         ;;
     *)
         echo -e "${RED}Unknown mode: $MODE${NC}"
-        echo "Usage: $0 [unit|integration|e2e|memory|performance|all]"
+        echo "Usage: $0 [unit|integration|e2e|memory|performance|perf|all]"
         exit 1
         ;;
 esac
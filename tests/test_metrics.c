@@ -0,0 +1,210 @@
+/**
+ * Unit tests for stage metrics
+ * Tests histogram bucketing, quantiles and the report table
+ */
+
+#include "minunit.h"
+#include "../src/metrics.h"
+#include "../src/queue.h"
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+/* Test counters */
+int tests_run = 0;
+int tests_failed = 0;
+int assertions_run = 0;
+int assertions_failed = 0;
+
+/* Test: Buckets are monotonic, in range, and exact for small values */
+test_result_t test_metrics_buckets(void) {
+    for (uint64_t v = 0; v < METRICS_SUB_COUNT * 2; v++) {
+        mu_assert("small values get their own bucket", metrics_bucket(v) == v);
+    }
+
+    unsigned prev = 0;
+    for (uint64_t v = 1; v < (1ull << 40); v += v / 7 + 1) {
+        unsigned b = metrics_bucket(v);
+        mu_assert("buckets never go down", b >= prev);
+        prev = b;
+    }
+    mu_assert("largest value fits", metrics_bucket(UINT64_MAX) < METRICS_BUCKETS);
+
+    return MU_PASS;
+}
+
+/* Test: Quantiles land within one bucket of the true value */
+test_result_t test_metrics_quantiles(void) {
+    stage_metrics_t* m = stage_metrics_create("test");
+    mu_assert("metrics should be created", m != NULL);
+    mu_assert_int_eq(0, (int)stage_metrics_quantile(m, 0.5));
+
+    /* 1..10000 ns, one sample each */
+    for (uint64_t ns = 1; ns <= 10000; ns++) {
+        metrics_record_time(m, ns, 1);
+    }
+    uint64_t p50 = stage_metrics_quantile(m, 0.50);
+    uint64_t p99 = stage_metrics_quantile(m, 0.99);
+    mu_assert("p50 near 5000", p50 >= 5000 && p50 <= 5000 + 5000 / 8);
+    mu_assert("p99 near 9900", p99 >= 9900 && p99 <= 10000);
+    mu_assert("max is exact", stage_metrics_quantile(m, 1.0) == 10000);
+    mu_assert_int_eq(10000, (int)atomic_load(&m->samples));
+
+    /* A group of records is credited evenly */
+    metrics_record_time(m, 1000, 0);
+    metrics_record_time(m, 64000, 64);
+    mu_assert_int_eq(10064, (int)atomic_load(&m->samples));
+
+    stage_metrics_destroy(m);
+    return MU_PASS;
+}
+
+/* Test: The report has a header and one row per stage */
+test_result_t test_metrics_print(void) {
+    stage_metrics_t* stages[2] = { stage_metrics_create("upper"), stage_metrics_create("trim") };
+    metrics_add(&stages[0]->records_in, 3);
+    metrics_add(&stages[0]->records_out, 3);
+    metrics_add(&stages[0]->bytes_in, 12);
+
+    char* text = NULL;
+    size_t size = 0;
+    FILE* out = open_memstream(&text, &size);
+    metrics_print(out, stages, 2, 1.0);
+    fclose(out);
+
+    mu_assert("header", strncmp(text, "stage", 5) == 0);
+    mu_assert("upper row", strstr(text, "\nupper ") != NULL);
+    mu_assert("trim row", strstr(text, "\ntrim ") != NULL);
+
+    free(text);
+    stage_metrics_destroy(stages[0]);
+    stage_metrics_destroy(stages[1]);
+    return MU_PASS;
+}
+
+/* Test: Residence histograms credit every record the same latency */
+test_result_t test_metrics_histogram(void) {
+    metrics_histogram_t* h = calloc(1, sizeof(metrics_histogram_t));
+    mu_assert("histogram allocated", h != NULL);
+
+    metrics_histogram_record(h, 1000, 90);
+    metrics_histogram_record(h, 50000, 10);
+    metrics_histogram_record(h, 7, 0);
+    mu_assert_int_eq(100, (int)atomic_load(&h->samples));
+    mu_assert_int_eq(90 * 1000 + 10 * 50000, (int)atomic_load(&h->total_ns));
+
+    uint64_t p50 = metrics_histogram_quantile(h, 0.50);
+    mu_assert("p50 near 1000", p50 >= 1000 && p50 <= 1000 + 1000 / 8);
+    mu_assert("p99 is the slow group", metrics_histogram_quantile(h, 0.99) == 50000);
+
+    char* text = NULL;
+    size_t size = 0;
+    FILE* out = open_memstream(&text, &size);
+    metrics_print_end_to_end(out, h);
+    fclose(out);
+    mu_assert("end-to-end line", strncmp(text, "end-to-end latency: 100 records", 31) == 0);
+
+    free(text);
+    free(h);
+    return MU_PASS;
+}
+
+/* Test: Utilization comes from thread CPU time and the stage's queues */
+test_result_t test_metrics_bottleneck(void) {
+    static queue_t queues[4];
+    stage_metrics_t* stages[3] = {
+        stage_metrics_create("parse"), stage_metrics_create("slow"), stage_metrics_create("tail")
+    };
+    mu_assert("metrics allocated", stages[0] && stages[1] && stages[2]);
+
+    static const uint64_t cpu[3] = { 50000000, 800000000, 40000000 };
+    for (int i = 0; i < 3; i++) {
+        atomic_store(&stages[i]->cpu_ns, cpu[i]);
+        atomic_store(&stages[i]->records_in, 1000);
+        stages[i]->input = &queues[i];
+        stages[i]->output = &queues[i + 1];
+    }
+    atomic_store(&queues[1].wait_empty_ns, 100000000);   /* slow starved 10% */
+    atomic_store(&queues[1].wait_full_ns, 700000000);    /* parse blocked 70% */
+
+    metrics_utilization_t util;
+    metrics_utilization(stages[0], 1000000000, &util);
+    mu_assert("parse cpu", util.cpu > 0.049 && util.cpu < 0.051);
+    mu_assert("parse blocked", util.blocked > 0.69 && util.blocked < 0.71);
+    metrics_utilization(stages[1], 1000000000, &util);
+    mu_assert("slow starved", util.starved > 0.09 && util.starved < 0.11);
+
+    char* text = NULL;
+    size_t size = 0;
+    FILE* out = open_memstream(&text, &size);
+    metrics_print_bottleneck(out, stages, 3, 1000000000);
+    fclose(out);
+    mu_assert("critical stage", strstr(text, "critical stage: slow (cpu 80.0%); replicating it x2") != NULL);
+    mu_assert("no fuse across the critical stage", strstr(text, "fuse candidates") == NULL);
+    free(text);
+
+    /* Two idle neighbours can share a thread */
+    atomic_store(&stages[1]->cpu_ns, 100000000);
+    text = NULL;
+    out = open_memstream(&text, &size);
+    metrics_print_bottleneck(out, stages, 3, 1000000000);
+    fclose(out);
+    mu_assert("fuse candidates", strstr(text, "fuse candidates: parse+slow (cpu 15.0%), slow+tail (cpu 14.0%)\n") != NULL);
+    free(text);
+
+    for (int i = 0; i < 3; i++) stage_metrics_destroy(stages[i]);
+    return MU_PASS;
+}
+
+/* Test: Prometheus output has cumulative buckets ending in the count */
+test_result_t test_metrics_prometheus(void) {
+    static queue_t queue;
+    stage_metrics_t* stage = stage_metrics_create("up\"per");
+    mu_assert("metrics allocated", stage != NULL);
+    stage->input = &queue;
+    queue.capacity = 8;
+    atomic_store(&queue.depth, 3);
+    atomic_store(&stage->records_in, 42);
+    metrics_record_time(stage, 500 * 10, 10);       /* 500 ns each */
+    metrics_record_time(stage, 2000000 * 5, 5);     /* 2 ms each */
+
+    char* text = NULL;
+    size_t size = 0;
+    FILE* out = open_memstream(&text, &size);
+    metrics_write_prometheus(out, &stage, 1, NULL);
+    fclose(out);
+
+    mu_assert("depth", strstr(text, "pipeline_queue_depth{stage=\"up\\\"per\"} 3\n") != NULL);
+    mu_assert("capacity", strstr(text, "pipeline_queue_capacity{stage=\"up\\\"per\"} 8\n") != NULL);
+    mu_assert("counter", strstr(text, "pipeline_stage_records_in_total{stage=\"up\\\"per\"} 42\n") != NULL);
+    mu_assert("type line", strstr(text, "# TYPE pipeline_stage_service_seconds histogram\n") != NULL);
+    mu_assert("fast bucket",
+              strstr(text, "pipeline_stage_service_seconds_bucket{stage=\"up\\\"per\",le=\"1e-06\"} 10\n") != NULL);
+    mu_assert("slow bucket",
+              strstr(text, "pipeline_stage_service_seconds_bucket{stage=\"up\\\"per\",le=\"0.001\"} 10\n") != NULL);
+    mu_assert("+Inf bucket",
+              strstr(text, "pipeline_stage_service_seconds_bucket{stage=\"up\\\"per\",le=\"+Inf\"} 15\n") != NULL);
+    mu_assert("count", strstr(text, "pipeline_stage_service_seconds_count{stage=\"up\\\"per\"} 15\n") != NULL);
+    mu_assert("sum", strstr(text, "pipeline_stage_service_seconds_sum{stage=\"up\\\"per\"} 0.010005000\n") != NULL);
+    mu_assert("no end-to-end without a histogram", strstr(text, "end_to_end") == NULL);
+
+    free(text);
+    stage_metrics_destroy(stage);
+    return MU_PASS;
+}
+
+int main(void) {
+    printf("Running Metrics Unit Tests\n");
+    printf("==========================\n\n");
+
+    mu_run_test(test_metrics_buckets);
+    mu_run_test(test_metrics_quantiles);
+    mu_run_test(test_metrics_print);
+    mu_run_test(test_metrics_histogram);
+    mu_run_test(test_metrics_bottleneck);
+    mu_run_test(test_metrics_prometheus);
+
+    mu_print_summary();
+
+    return tests_failed > 0 ? 1 : 0;
+}
@@ -11,6 +11,7 @@
 #include <time.h>
 #include <errno.h>
 #include <stdlib.h>
+#include <string.h>
 
 /* Test counters */
 int tests_run = 0;
@@ -181,8 +182,7 @@ void* timeout_waiter_thread(void* arg) {
     monitor_enter(data->monitor);
     
     struct timespec timeout;
-    clock_gettime(CLOCK_REALTIME, &timeout);
-    timeout.tv_sec += 1; /* 1 second timeout */
+    monitor_deadline(&timeout, 1000000); /* 1 second timeout */
     
     int ret = monitor_wait_timeout(data->monitor, &timeout);
     
@@ -264,6 +264,195 @@ test_result_t test_monitor_mutual_exclusion(void) {
     return MU_PASS;
 }
 
+/* Test: Named conditions wake only their own waiters */
+typedef struct {
+    monitor_t* monitor;
+    monitor_cond_t* cond;
+    int* ready;
+    volatile int done;
+} cond_waiter_data_t;
+
+static int cond_ready(void* arg) {
+    return *(int*)arg;
+}
+
+void* cond_waiter_thread(void* arg) {
+    cond_waiter_data_t* data = (cond_waiter_data_t*)arg;
+    
+    monitor_enter(data->monitor);
+    monitor_cond_wait_for(data->cond, cond_ready, data->ready);
+    data->done = 1;
+    monitor_exit(data->monitor);
+    
+    return NULL;
+}
+
+test_result_t test_monitor_named_conditions(void) {
+    monitor_t monitor;
+    monitor_cond_t first, second;
+    monitor_init(&monitor);
+    mu_assert_int_eq(0, monitor_cond_init(&first, &monitor, "first"));
+    mu_assert_int_eq(0, monitor_cond_init(&second, &monitor, "second"));
+    mu_assert_str_eq("second", second.name);
+    
+    int ready = 0;
+    cond_waiter_data_t a = { &monitor, &first, &ready, 0 };
+    cond_waiter_data_t b = { &monitor, &second, &ready, 0 };
+    pthread_t threads[2];
+    pthread_create(&threads[0], NULL, cond_waiter_thread, &a);
+    pthread_create(&threads[1], NULL, cond_waiter_thread, &b);
+    usleep(100000); /* 100ms for both to block */
+    
+    /* Both predicates now hold, but only the first condition is woken */
+    monitor_enter(&monitor);
+    ready = 1;
+    monitor_cond_broadcast(&first);
+    monitor_exit(&monitor);
+    pthread_join(threads[0], NULL);
+    mu_assert_int_eq(1, a.done);
+    usleep(50000);
+    mu_assert_int_eq(0, b.done);
+    
+    monitor_cond_signal(&second);
+    pthread_join(threads[1], NULL);
+    mu_assert_int_eq(1, b.done);
+    
+    monitor_cond_destroy(&second);
+    monitor_cond_destroy(&first);
+    monitor_destroy(&monitor);
+    
+    return MU_PASS;
+}
+
+/* Test: The lock profile counts contended acquisitions and wait time */
+void* profiled_enter_thread(void* arg) {
+    monitor_t* monitor = (monitor_t*)arg;
+    monitor_enter(monitor);
+    monitor_exit(monitor);
+    return NULL;
+}
+
+test_result_t test_monitor_lock_profile(void) {
+    monitor_t monitor;
+    monitor_profile_enable(1);
+    monitor_init(&monitor);
+    monitor_set_name(&monitor, "profiled");
+    
+    /* Hold the lock while a second thread blocks on it */
+    monitor_enter(&monitor);
+    pthread_t thread;
+    pthread_create(&thread, NULL, profiled_enter_thread, &monitor);
+    usleep(50000); /* 50ms */
+    monitor_exit(&monitor);
+    pthread_join(thread, NULL);
+    
+    mu_assert_int_eq(2, (int)monitor.stats.acquisitions);
+    mu_assert_int_eq(1, (int)monitor.stats.contended);
+    mu_assert("Wait should cover the time the lock was held",
+              monitor.stats.max_wait_ns >= 40000000);
+    mu_assert("Hold should cover the sleep", monitor.stats.max_hold_ns >= 50000000);
+    monitor_destroy(&monitor);
+    monitor_profile_enable(0);
+    
+    /* Destroyed monitors are reported by name */
+    char* report = NULL;
+    size_t len = 0;
+    FILE* out = open_memstream(&report, &len);
+    monitor_profile_report(out);
+    fclose(out);
+    const char* row = strstr(report, "\nprofiled ");
+    mu_assert("Report should have a row for the monitor", row != NULL);
+    unsigned locks = 0, acquired = 0, contended = 0;
+    mu_assert_int_eq(3, sscanf(row, " profiled %u %u %u", &locks, &acquired, &contended));
+    mu_assert_int_eq(1, (int)locks);
+    mu_assert_int_eq(2, (int)acquired);
+    mu_assert_int_eq(1, (int)contended);
+    free(report);
+    
+    return MU_PASS;
+}
+
+/* Test: The spinning barrier separates rounds and finds the straggler */
+#define SPIN_TEST_THREADS 4
+#define SPIN_TEST_ROUNDS 100
+
+typedef struct {
+    spin_barrier_t* barrier;
+    unsigned id;
+    _Atomic int* arrived;        /* Arrivals per round */
+    int errors;
+} spin_test_data_t;
+
+void* spin_barrier_thread(void* arg) {
+    spin_test_data_t* data = (spin_test_data_t*)arg;
+    
+    for (int round = 0; round < SPIN_TEST_ROUNDS; round++) {
+        /* The last participant is always late */
+        if (data->id == SPIN_TEST_THREADS - 1) {
+            usleep(500);
+        }
+        atomic_fetch_add(&data->arrived[round], 1);
+        spin_barrier_wait(data->barrier, data->id);
+        if (atomic_load(&data->arrived[round]) != SPIN_TEST_THREADS) {
+            data->errors++;
+        }
+    }
+    
+    return NULL;
+}
+
+test_result_t test_spin_barrier(void) {
+    spin_barrier_t barrier;
+    mu_assert_int_eq(0, spin_barrier_init(&barrier, SPIN_TEST_THREADS));
+    barrier.spin_ns = 100000; /* Exercise spinning even on one CPU */
+    
+    static _Atomic int arrived[SPIN_TEST_ROUNDS];
+    spin_test_data_t data[SPIN_TEST_THREADS];
+    pthread_t threads[SPIN_TEST_THREADS];
+    for (unsigned i = 0; i < SPIN_TEST_THREADS; i++) {
+        data[i] = (spin_test_data_t){ &barrier, i, arrived, 0 };
+        pthread_create(&threads[i], NULL, spin_barrier_thread, &data[i]);
+    }
+    for (int i = 0; i < SPIN_TEST_THREADS; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    
+    const spin_barrier_participant_t* straggler = &barrier.participants[SPIN_TEST_THREADS - 1];
+    uint64_t released = 0;
+    uint64_t last = 0;
+    uint64_t early_wait[SPIN_TEST_THREADS - 1];
+    for (int i = 0; i < SPIN_TEST_THREADS; i++) {
+        const spin_barrier_participant_t* p = &barrier.participants[i];
+        mu_assert_int_eq(0, data[i].errors);
+        mu_assert_int_eq(SPIN_TEST_ROUNDS, (int)p->rounds);
+        released += p->spun + p->parked;
+        last += p->last;
+        if (i != SPIN_TEST_THREADS - 1) {
+            /* Insertion sort; there are only a few early threads */
+            int j = i;
+            while (j > 0 && early_wait[j - 1] > p->wait_ns) {
+                early_wait[j] = early_wait[j - 1];
+                j--;
+            }
+            early_wait[j] = p->wait_ns;
+        }
+    }
+    /* Compare the typical early thread, not each one: any of them can be
+     * descheduled for a few rounds and arrive late itself */
+    mu_assert("Early arrivals should wait well beyond the straggler",
+              early_wait[(SPIN_TEST_THREADS - 1) / 2] > 2 * straggler->wait_ns);
+    mu_assert_int_eq(0, (int)atomic_load(&barrier.parked));
+    /* Everyone but the last arrival is released once per round */
+    mu_assert_int_eq(SPIN_TEST_ROUNDS * (SPIN_TEST_THREADS - 1), (int)released);
+    mu_assert_int_eq(SPIN_TEST_ROUNDS, (int)last);
+    /* A descheduled early thread can occasionally arrive after the sleeper */
+    mu_assert("The straggler should arrive last in most rounds",
+              straggler->last > SPIN_TEST_ROUNDS / 2);
+    
+    spin_barrier_destroy(&barrier);
+    return MU_PASS;
+}
+
 /* Main test runner */
 int main(void) {
     printf("Running Monitor Unit Tests\n");
@@ -273,12 +462,17 @@ int main(void) {
     mu_run_test(test_monitor_init_destroy);
     mu_run_test(test_monitor_wait_signal_single);
     mu_run_test(test_monitor_broadcast_multiple);
+    mu_run_test(test_monitor_named_conditions);
     
     /* Timeout tests */
     mu_run_test(test_monitor_wait_timeout);
     
     /* Mutual exclusion */
     mu_run_test(test_monitor_mutual_exclusion);
+    mu_run_test(test_monitor_lock_profile);
+    
+    /* Spinning barrier */
+    mu_run_test(test_spin_barrier);
     
     mu_print_summary();
     
@@ -0,0 +1,150 @@
+/**
+ * Unit tests for plugin configuration parsing
+ * Tests key lookup, string copies, size suffixes and malformed values
+ */
+
+#include "minunit.h"
+#include "../src/plugin_config.h"
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <errno.h>
+
+/* Test counters */
+int tests_run = 0;
+int tests_failed = 0;
+int assertions_run = 0;
+int assertions_failed = 0;
+
+/* Test: Keys are matched exactly and values run to the next comma */
+test_result_t test_config_find(void) {
+    const char* config = "text=LOG;,cap=1M,empty=,textual=x";
+    size_t len = 0;
+
+    const char* value = plugin_config_find(config, "text", &len);
+    mu_assert("text should be found", value != NULL);
+    mu_assert_int_eq(4, (int)len);
+    mu_assert("text value", strncmp(value, "LOG;", len) == 0);
+
+    value = plugin_config_find(config, "empty", &len);
+    mu_assert("empty should be found", value != NULL);
+    mu_assert_int_eq(0, (int)len);
+
+    value = plugin_config_find(config, "textual", &len);
+    mu_assert("textual should be found", value != NULL && *value == 'x');
+
+    mu_assert("prefix of a key should not match", plugin_config_find(config, "tex", &len) == NULL);
+    mu_assert("missing key", plugin_config_find(config, "mode", &len) == NULL);
+    mu_assert("NULL config", plugin_config_find(NULL, "text", &len) == NULL);
+    mu_assert("pair without '='", plugin_config_find("flag,text=a", "flag", &len) == NULL);
+
+    mu_assert("equals", plugin_config_equals("mode=drop", "mode", "drop"));
+    mu_assert("equals is exact", !plugin_config_equals("mode=dropped", "mode", "drop"));
+
+    return MU_PASS;
+}
+
+/* Test: String values are copied, with a default when absent */
+test_result_t test_config_strdup(void) {
+    char* s = plugin_config_strdup("a=1,text=hello world", "text", "dflt");
+    mu_assert_str_eq("hello world", s);
+    free(s);
+
+    s = plugin_config_strdup("a=1", "text", "dflt");
+    mu_assert_str_eq("dflt", s);
+    free(s);
+
+    errno = 0;
+    s = plugin_config_strdup(NULL, "text", NULL);
+    mu_assert("absent without default should be NULL", s == NULL);
+    mu_assert_int_eq(ENOENT, errno);
+
+    return MU_PASS;
+}
+
+/* Test: Sizes accept K/M/G suffixes and reject anything else */
+test_result_t test_config_size(void) {
+    size_t v = 7;
+
+    mu_assert_int_eq(0, plugin_config_get_size("a=1", "capacity", &v));
+    mu_assert_int_eq(7, (int)v);
+
+    mu_assert_int_eq(1, plugin_config_get_size("capacity=4096", "capacity", &v));
+    mu_assert("plain size", v == 4096);
+    mu_assert_int_eq(1, plugin_config_get_size("capacity=64k", "capacity", &v));
+    mu_assert("K suffix", v == 64 * 1024);
+    mu_assert_int_eq(1, plugin_config_get_size("x=y,capacity=1M", "capacity", &v));
+    mu_assert("M suffix", v == 1024 * 1024);
+    mu_assert_int_eq(1, plugin_config_get_size("capacity=2G", "capacity", &v));
+    mu_assert("G suffix", v == (size_t)2 << 30);
+
+    v = 7;
+    mu_assert_int_eq(-1, plugin_config_get_size("capacity=", "capacity", &v));
+    mu_assert_int_eq(-1, plugin_config_get_size("capacity=1MB", "capacity", &v));
+    mu_assert_int_eq(-1, plugin_config_get_size("capacity=-1", "capacity", &v));
+    mu_assert_int_eq(-1, plugin_config_get_size("capacity=1T", "capacity", &v));
+    mu_assert_int_eq(EINVAL, errno);
+    mu_assert_int_eq(-1, plugin_config_get_size("capacity=99999999999999999999999", "capacity", &v));
+    mu_assert_int_eq(ERANGE, errno);
+    mu_assert_int_eq(7, (int)v);
+
+    return MU_PASS;
+}
+
+/* Test: The config starts after the path, which ends before any '=' */
+test_result_t test_config_split(void) {
+    const char* spec = "prefix:text=/var/log/";
+    mu_assert("builtin with '/' in a value", plugin_config_split(spec) == spec + 6);
+    spec = "./build/lib/plugins/prefix.so:text=a/b:c";
+    mu_assert("path with '/' and ':' in a value", plugin_config_split(spec) == spec + 29);
+    spec = "/opt/a:b/plugins/upper.so";
+    mu_assert("':' in a directory", plugin_config_split(spec) == NULL);
+    spec = "/opt/a:b/upper.so:mode=x";
+    mu_assert("':' in a directory and a config", plugin_config_split(spec) == spec + 17);
+    mu_assert("bare name", plugin_config_split("upper") == NULL);
+    mu_assert("NULL spec", plugin_config_split(NULL) == NULL);
+    return MU_PASS;
+}
+
+/* Test: Escaped commas stay in values; pairs without '=' are reported */
+test_result_t test_config_escapes(void) {
+    const char* config = "text=a\\,b\\\\,mode=x";
+    size_t len = 0;
+    mu_assert("escaped value", plugin_config_find(config, "text", &len) != NULL);
+    mu_assert_int_eq(6, (int)len);
+
+    char* text = plugin_config_strdup(config, "text", NULL);
+    mu_assert("unescaped copy", text && strcmp(text, "a,b\\") == 0);
+    free(text);
+    mu_assert("pair after an escaped comma", plugin_config_equals(config, "mode", "x"));
+    mu_assert("equals unescapes", plugin_config_equals(config, "text", "a,b\\"));
+    mu_assert("equals needs the whole value", !plugin_config_equals(config, "text", "a,b"));
+
+    const char* bad = NULL;
+    size_t bad_len = 0;
+    mu_assert_int_eq(0, plugin_config_check(config, &bad, &bad_len));
+    mu_assert_int_eq(0, plugin_config_check("", NULL, NULL));
+    mu_assert_int_eq(0, plugin_config_check(NULL, NULL, NULL));
+    errno = 0;
+    mu_assert_int_eq(-1, plugin_config_check("text=a,b", &bad, &bad_len));
+    mu_assert_int_eq(EINVAL, errno);
+    mu_assert("unescaped comma reported", bad_len == 1 && *bad == 'b');
+    mu_assert_int_eq(-1, plugin_config_check("=x", NULL, NULL));
+    mu_assert_int_eq(-1, plugin_config_check("text=a,", NULL, NULL));
+    return MU_PASS;
+}
+
+int main(void) {
+    printf("Running Plugin Config Unit Tests\n");
+    printf("================================\n\n");
+
+    mu_run_test(test_config_find);
+    mu_run_test(test_config_strdup);
+    mu_run_test(test_config_size);
+    mu_run_test(test_config_split);
+    mu_run_test(test_config_escapes);
+
+    mu_print_summary();
+
+    return tests_failed > 0 ? 1 : 0;
+}
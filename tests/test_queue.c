@@ -10,6 +10,7 @@
 #include <unistd.h>
 #include <string.h>
 #include <stdlib.h>
+#include <time.h>
 
 /* Test counters */
 int tests_run = 0;
@@ -417,6 +418,378 @@ test_result_t test_queue_shutdown_unblocks_threads(void) {
     return MU_PASS;
 }
 
+/* Test: Batch pop takes everything queued, up to max, in FIFO order */
+test_result_t test_queue_pop_batch(void) {
+    queue_t queue;
+    queue_init(&queue, 10);
+    
+    const char* items[] = {"a", "b", "c", "d", "e"};
+    for (int i = 0; i < 5; i++) {
+        queue_push(&queue, items[i]);
+    }
+    
+    char* out[4];
+    size_t count = 0;
+    int ret = queue_pop_batch(&queue, out, 4, &count);
+    mu_assert_int_eq(0, ret);
+    mu_assert_int_eq(4, (int)count);
+    for (int i = 0; i < 4; i++) {
+        mu_assert_str_eq(items[i], out[i]);
+        free(out[i]);
+    }
+    
+    ret = queue_pop_batch(&queue, out, 4, &count);
+    mu_assert_int_eq(0, ret);
+    mu_assert_int_eq(1, (int)count);
+    mu_assert_str_eq("e", out[0]);
+    free(out[0]);
+    
+    queue_shutdown(&queue);
+    ret = queue_pop_batch(&queue, out, 4, &count);
+    mu_assert_int_eq(QUEUE_SHUTDOWN, ret);
+    mu_assert_int_eq(0, (int)count);
+    
+    queue_destroy(&queue);
+    
+    return MU_PASS;
+}
+
+/* Helper: heap batch holding the given records */
+static record_batch_t* make_batch(const char** records, int count) {
+    record_batch_t* batch = record_batch_create(count, 64);
+    for (int i = 0; i < count; i++) {
+        record_batch_append(batch, records[i], strlen(records[i]));
+    }
+    return batch;
+}
+
+/* Test: A batch is one queue item and keeps its place among strings */
+test_result_t test_queue_push_batch_item(void) {
+    queue_t queue;
+    queue_init(&queue, 2);
+    
+    const char* records[] = {"one", "", "three"};
+    queue_push(&queue, "before");
+    mu_assert_int_eq(0, queue_push_batch(&queue, make_batch(records, 3)));
+    mu_assert_int_eq(2, (int)queue_size(&queue));
+    
+    /* Empty batches are consumed without taking a slot */
+    mu_assert_int_eq(0, queue_push_batch(&queue, record_batch_create(1, 1)));
+    mu_assert_int_eq(2, (int)queue_size(&queue));
+    
+    queue_item_t item;
+    mu_assert_int_eq(0, queue_pop_item(&queue, &item));
+    mu_assert("First item should be a string", item.str && !item.batch);
+    mu_assert_str_eq("before", item.str);
+    free(item.str);
+    
+    mu_assert_int_eq(0, queue_pop_item(&queue, &item));
+    mu_assert("Second item should be a batch", !item.str && item.batch);
+    mu_assert_int_eq(3, (int)item.batch->count);
+    for (int i = 0; i < 3; i++) {
+        size_t len;
+        const char* str = record_batch_get(item.batch, i, &len);
+        mu_assert_str_eq(records[i], str);
+        mu_assert_int_eq((int)strlen(records[i]), (int)len);
+    }
+    record_batch_free(item.batch);
+    
+    /* Pushing after shutdown still releases the batch */
+    queue_shutdown(&queue);
+    mu_assert_int_eq(QUEUE_SHUTDOWN, queue_push_batch(&queue, make_batch(records, 3)));
+    mu_assert_int_eq(QUEUE_SHUTDOWN, queue_pop_item(&queue, &item));
+    
+    queue_destroy(&queue);
+    
+    return MU_PASS;
+}
+
+/* Test: String consumers read batch records one at a time */
+test_result_t test_queue_batch_to_strings(void) {
+    queue_t queue;
+    queue_init(&queue, 4);
+    
+    const char* records[] = {"a", "b", "c", "d"};
+    queue_push_batch(&queue, make_batch(records, 4));
+    
+    char* str;
+    mu_assert_int_eq(0, queue_pop(&queue, &str));
+    mu_assert_str_eq("a", str);
+    free(str);
+    
+    char* out[2];
+    size_t count = 0;
+    mu_assert_int_eq(0, queue_pop_batch(&queue, out, 2, &count));
+    mu_assert_int_eq(2, (int)count);
+    mu_assert_str_eq("b", out[0]);
+    mu_assert_str_eq("c", out[1]);
+    free(out[0]);
+    free(out[1]);
+    
+    /* The rest of a partly read batch comes back without the taken records */
+    queue_item_t item;
+    mu_assert_int_eq(0, queue_pop_item(&queue, &item));
+    mu_assert("Remainder should be a batch", item.batch != NULL);
+    mu_assert_int_eq(1, (int)item.batch->count);
+    mu_assert_str_eq("d", record_batch_get(item.batch, 0, NULL));
+    record_batch_free(item.batch);
+    
+    /* Batches left in the queue are freed by queue_destroy */
+    queue_push_batch(&queue, make_batch(records, 4));
+    queue_destroy(&queue);
+    
+    return MU_PASS;
+}
+
+/* Test: In-flight bytes follow pushes and pops; the peak is kept */
+test_result_t test_queue_memory_accounting(void) {
+    queue_t queue;
+    queue_init(&queue, 4);
+    
+    const char* records[] = {"a", "b"};
+    record_batch_t* batch = make_batch(records, 2);
+    size_t footprint = record_batch_footprint(batch);
+    
+    queue_push(&queue, "abc");
+    queue_push_batch(&queue, batch);
+    mu_assert_int_eq((int)(4 + footprint), (int)atomic_load(&queue.bytes));
+    
+    /* A batch read as strings holds its memory until its last record goes */
+    char* str;
+    queue_pop(&queue, &str);
+    free(str);
+    queue_pop(&queue, &str);
+    free(str);
+    mu_assert_int_eq((int)footprint, (int)atomic_load(&queue.bytes));
+    queue_pop(&queue, &str);
+    free(str);
+    mu_assert_int_eq(0, (int)atomic_load(&queue.bytes));
+    mu_assert_int_eq((int)(4 + footprint), (int)atomic_load(&queue.peak_bytes));
+    
+    queue_destroy(&queue);
+    return MU_PASS;
+}
+
+/* Test: Short records live in their slot; queue_pop_into reuses one buffer */
+test_result_t test_queue_inline_records(void) {
+    queue_t queue;
+    queue_init(&queue, 4);
+    
+    char longest_inline[QUEUE_INLINE_MAX + 1];
+    char out_of_line[QUEUE_INLINE_MAX + 2];
+    memset(longest_inline, 'a', QUEUE_INLINE_MAX);
+    longest_inline[QUEUE_INLINE_MAX] = '\0';
+    memset(out_of_line, 'b', QUEUE_INLINE_MAX + 1);
+    out_of_line[QUEUE_INLINE_MAX + 1] = '\0';
+    
+    queue_push(&queue, "short");
+    queue_push(&queue, longest_inline);
+    queue_push(&queue, out_of_line);
+    queue_push(&queue, "tail");
+    mu_assert("Short record should be inline", queue.buffer[0].inlined);
+    mu_assert("Record of QUEUE_INLINE_MAX bytes should be inline", queue.buffer[1].inlined);
+    mu_assert("Longer record should be out of line", !queue.buffer[2].inlined);
+    mu_assert_int_eq(6 + QUEUE_INLINE_MAX + 1 + QUEUE_INLINE_MAX + 2 + 5,
+                     (int)atomic_load(&queue.bytes));
+    
+    char* buf = NULL;
+    size_t cap = 0;
+    queue_item_t item;
+    mu_assert_int_eq(0, queue_pop_into(&queue, &item, &buf, &cap));
+    mu_assert_str_eq("short", item.str);
+    mu_assert("Inline record should be copied into the buffer", item.str == buf);
+    char* reused = buf;
+    mu_assert_int_eq(0, queue_pop_into(&queue, &item, &buf, &cap));
+    mu_assert_str_eq(longest_inline, item.str);
+    mu_assert("Buffer should be reused", buf == reused);
+    
+    /* An out-of-line record becomes the buffer instead of being copied */
+    mu_assert_int_eq(0, queue_pop_into(&queue, &item, &buf, &cap));
+    mu_assert_str_eq(out_of_line, item.str);
+    mu_assert("Out-of-line record should replace the buffer", item.str == buf);
+    mu_assert_int_eq(QUEUE_INLINE_MAX + 2, (int)cap);
+    
+    /* queue_pop_item still hands out a string the caller frees */
+    mu_assert_int_eq(0, queue_pop_item(&queue, &item));
+    mu_assert_str_eq("tail", item.str);
+    free(item.str);
+    mu_assert_int_eq(0, (int)atomic_load(&queue.bytes));
+    
+    queue_shutdown(&queue);
+    mu_assert_int_eq(QUEUE_SHUTDOWN, queue_pop_into(&queue, &item, &buf, &cap));
+    free(buf);
+    queue_destroy(&queue);
+    return MU_PASS;
+}
+
+/* Test: Timed push and pop give up after their timeout, and only then */
+static uint64_t elapsed_us_since(const struct timespec* start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)(now.tv_sec - start->tv_sec) * 1000000 +
+           (uint64_t)((now.tv_nsec - start->tv_nsec) / 1000);
+}
+
+void* delayed_push_thread(void* arg) {
+    usleep(20000); /* 20ms */
+    queue_push((queue_t*)arg, "late");
+    return NULL;
+}
+
+test_result_t test_queue_timeouts(void) {
+    queue_t queue;
+    queue_init(&queue, 1);
+    struct timespec start;
+    char* str = NULL;
+    
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    mu_assert_int_eq(QUEUE_TIMEOUT, queue_pop_timeout(&queue, &str, 30000));
+    mu_assert("Pop should wait out its timeout", elapsed_us_since(&start) >= 30000);
+    mu_assert("Timed-out pop should not return a string", str == NULL);
+    
+    /* A zero timeout never blocks */
+    mu_assert_int_eq(0, queue_push_timeout(&queue, "one", 0));
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    mu_assert_int_eq(QUEUE_TIMEOUT, queue_push_timeout(&queue, "two", 30000));
+    mu_assert("Push should wait out its timeout", elapsed_us_since(&start) >= 30000);
+    mu_assert_int_eq(1, (int)queue_size(&queue));
+    mu_assert_int_eq(0, queue_pop_timeout(&queue, &str, 0));
+    mu_assert_str_eq("one", str);
+    free(str);
+    
+    /* An item arriving before the deadline is returned */
+    pthread_t producer;
+    pthread_create(&producer, NULL, delayed_push_thread, &queue);
+    queue_item_t item;
+    char* buf = NULL;
+    size_t cap = 0;
+    mu_assert_int_eq(0, queue_pop_into_timeout(&queue, &item, &buf, &cap, 2000000));
+    mu_assert_str_eq("late", item.str);
+    pthread_join(producer, NULL);
+    
+    queue_shutdown(&queue);
+    mu_assert_int_eq(QUEUE_SHUTDOWN, queue_pop_into_timeout(&queue, &item, &buf, &cap, 30000));
+    mu_assert_int_eq(QUEUE_SHUTDOWN, queue_push_timeout(&queue, "three", 30000));
+    free(buf);
+    queue_destroy(&queue);
+    return MU_PASS;
+}
+
+/* Test: A shared byte budget blocks producers until consumers release it */
+static volatile int budget_pushed = 0;
+
+void* budget_producer_thread(void* arg) {
+    queue_push((queue_t*)arg, "ghi");
+    budget_pushed = 1;
+    return NULL;
+}
+
+test_result_t test_queue_budget_backpressure(void) {
+    mem_budget_t budget;
+    queue_t a, b;
+    mem_budget_init(&budget, 8);
+    queue_init(&a, 10);
+    queue_init(&b, 10);
+    queue_set_budget(&a, &budget);
+    queue_set_budget(&b, &budget);
+    
+    queue_push(&a, "abc");
+    queue_push(&a, "def");
+    mu_assert_int_eq(8, (int)atomic_load(&budget.used));
+    
+    /* An empty queue always admits, so the spent budget cannot stall it */
+    queue_push(&b, "xyz");
+    mu_assert_int_eq(12, (int)atomic_load(&budget.used));
+    
+    pthread_t producer;
+    pthread_create(&producer, NULL, budget_producer_thread, &a);
+    usleep(100000); /* 100ms */
+    mu_assert_int_eq(0, budget_pushed);
+    
+    /* 8 bytes charged still leaves no room for 4 more */
+    char* item = NULL;
+    queue_pop(&b, &item);
+    free(item);
+    usleep(50000);
+    mu_assert_int_eq(0, budget_pushed);
+    
+    queue_pop(&a, &item);
+    free(item);
+    pthread_join(producer, NULL);
+    mu_assert_int_eq(1, budget_pushed);
+    mu_assert_int_eq(8, (int)atomic_load(&budget.used));
+    mu_assert_int_eq(12, (int)atomic_load(&budget.peak));
+    mu_assert_int_eq(1, (int)atomic_load(&budget.waits));
+    
+    /* Destroying a queue returns what it still holds */
+    queue_destroy(&a);
+    queue_destroy(&b);
+    mu_assert_int_eq(0, (int)atomic_load(&budget.used));
+    mem_budget_destroy(&budget);
+    return MU_PASS;
+}
+
+/* Test: Markers keep their place among records; string consumers skip them */
+test_result_t test_queue_markers(void) {
+    queue_t queue;
+    queue_init(&queue, 8);
+    queue_marker_t epoch = { QUEUE_MARKER_EPOCH, 7 };
+    queue_marker_t flush = { QUEUE_MARKER_FLUSH, 0 };
+    queue_marker_t end = { QUEUE_MARKER_END, 0 };
+    const char* records[] = { "b", "c" };
+    
+    mu_assert_int_eq(-1, queue_push_marker(&queue, &end));
+    mu_assert_int_eq(0, queue_push(&queue, "a"));
+    mu_assert_int_eq(0, queue_push_marker(&queue, &epoch));
+    mu_assert_int_eq(0, queue_push_batch(&queue, make_batch(records, 2)));
+    mu_assert_int_eq(0, queue_push_marker(&queue, &flush));
+    mu_assert_int_eq(4, (int)queue_size(&queue));
+    
+    queue_item_t item;
+    char* buf = NULL;
+    size_t cap = 0;
+    mu_assert_int_eq(0, queue_pop_into(&queue, &item, &buf, &cap));
+    mu_assert_str_eq("a", item.str);
+    mu_assert_int_eq(0, (int)item.marker.kind);
+    mu_assert_int_eq(0, queue_pop_into(&queue, &item, &buf, &cap));
+    mu_assert("Marker should carry no record", item.str == NULL && item.batch == NULL);
+    mu_assert_int_eq(QUEUE_MARKER_EPOCH, (int)item.marker.kind);
+    mu_assert_int_eq(7, (int)item.marker.value);
+    mu_assert_int_eq(0, queue_pop_item(&queue, &item));
+    mu_assert_int_eq(2, (int)item.batch->count);
+    record_batch_free(item.batch);
+    mu_assert_int_eq(0, queue_pop_item(&queue, &item));
+    mu_assert_int_eq(QUEUE_MARKER_FLUSH, (int)item.marker.kind);
+    mu_assert_int_eq(0, (int)atomic_load(&queue.bytes));
+    
+    /* String consumers pass over markers, before and after records */
+    queue_push_marker(&queue, &flush);
+    queue_push(&queue, "x");
+    queue_push_marker(&queue, &epoch);
+    queue_push(&queue, "y");
+    queue_push_marker(&queue, &flush);
+    char* str = NULL;
+    mu_assert_int_eq(0, queue_pop(&queue, &str));
+    mu_assert_str_eq("x", str);
+    free(str);
+    char* strs[4];
+    size_t count = 0;
+    mu_assert_int_eq(0, queue_pop_batch(&queue, strs, 4, &count));
+    mu_assert_int_eq(1, (int)count);
+    mu_assert_str_eq("y", strs[0]);
+    free(strs[0]);
+    mu_assert_int_eq(0, (int)queue_size(&queue));
+    
+    queue_push_marker(&queue, &flush);
+    queue_shutdown(&queue);
+    mu_assert_int_eq(QUEUE_SHUTDOWN, queue_pop(&queue, &str));
+    mu_assert_int_eq(QUEUE_SHUTDOWN, queue_push_marker(&queue, &flush));
+    
+    free(buf);
+    queue_destroy(&queue);
+    return MU_PASS;
+}
+
 /* Main test runner */
 int main(void) {
     printf("Running Queue Unit Tests\n");
@@ -441,6 +814,16 @@ int main(void) {
     mu_run_test(test_queue_blocking_when_empty);
     mu_run_test(test_queue_shutdown_unblocks_threads);
     
+    /* Batch tests */
+    mu_run_test(test_queue_pop_batch);
+    mu_run_test(test_queue_push_batch_item);
+    mu_run_test(test_queue_batch_to_strings);
+    mu_run_test(test_queue_memory_accounting);
+    mu_run_test(test_queue_inline_records);
+    mu_run_test(test_queue_timeouts);
+    mu_run_test(test_queue_budget_backpressure);
+    mu_run_test(test_queue_markers);
+    
     mu_print_summary();
     
     return tests_failed > 0 ? 1 : 0;
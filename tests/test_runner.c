@@ -32,6 +32,11 @@ int main(void) {
     
     failures += run_test("Queue Tests", "./build/bin/test_queue");
     failures += run_test("Monitor Tests", "./build/bin/test_monitor");
+    failures += run_test("UTF-8 Tests", "./build/bin/test_utf8");
+    failures += run_test("Plugin Config Tests", "./build/bin/test_plugin_config");
+    failures += run_test("Shared Ring Tests", "./build/bin/test_shm_ring");
+    failures += run_test("Metrics Tests", "./build/bin/test_metrics");
+    failures += run_test("Trace Tests", "./build/bin/test_trace");
     
     printf("\n========================================\n");
     printf("TEST SUMMARY\n");
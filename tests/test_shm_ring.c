@@ -0,0 +1,183 @@
+/**
+ * Unit tests for the shared-memory record ring
+ * Tests record round trips across the wrap point, size limits, timeouts,
+ * a producer in a forked child process, and the shared block pool
+ */
+
+#include "minunit.h"
+#include "../src/shm_ring.h"
+#include "../src/shm_pool.h"
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+/* Test counters */
+int tests_run = 0;
+int tests_failed = 0;
+int assertions_run = 0;
+int assertions_failed = 0;
+
+static void publish(shm_ring_t* ring, const char* str, uint32_t seq) {
+    size_t len = strlen(str);
+    shm_record_t* rec = shm_ring_reserve(ring, len, -1);
+    rec->seq = seq;
+    memcpy(shm_record_data(rec), str, len + 1);
+    shm_ring_publish(ring);
+}
+
+/* Test: Records come back intact and in order, many times around the ring */
+test_result_t test_shm_ring_wrap(void) {
+    shm_ring_t* ring = shm_ring_create(4096);
+    mu_assert("ring should be created", ring != NULL);
+
+    char buf[700];
+    uint64_t pos = 0;
+    for (uint32_t i = 0; i < 200; i++) {
+        size_t len = (i * 37) % sizeof(buf);
+        memset(buf, 'a' + i % 26, len);
+        buf[len] = '\0';
+        publish(ring, buf, i);
+
+        mu_assert("record should be available", shm_ring_wait_data(ring, pos, 0));
+        uint64_t next;
+        shm_record_t* rec = shm_ring_at(ring, pos, &next);
+        mu_assert_int_eq((int)i, (int)rec->seq);
+        mu_assert_int_eq((int)len, (int)rec->len);
+        mu_assert("record bytes", memcmp(shm_record_data(rec), buf, len + 1) == 0);
+        shm_ring_release(ring, next);
+        pos = next;
+    }
+    mu_assert("should be drained", !shm_ring_wait_data(ring, pos, 0));
+
+    shm_ring_destroy(ring);
+    return MU_PASS;
+}
+
+/* Test: Oversized records are refused and a full ring times out */
+test_result_t test_shm_ring_limits(void) {
+    shm_ring_t* ring = shm_ring_create(4096);
+
+    errno = 0;
+    mu_assert("oversized record", shm_ring_reserve(ring, shm_ring_max_record(ring) + 1, 0) == NULL);
+    mu_assert_int_eq(EMSGSIZE, errno);
+
+    /* Two maximum-size records fill the ring */
+    mu_assert("first", shm_ring_reserve(ring, shm_ring_max_record(ring), 0) != NULL);
+    shm_ring_publish(ring);
+    mu_assert("second", shm_ring_reserve(ring, shm_ring_max_record(ring), 0) != NULL);
+    shm_ring_publish(ring);
+
+    errno = 0;
+    mu_assert("full ring", shm_ring_reserve(ring, 1, 20) == NULL);
+    mu_assert_int_eq(ETIMEDOUT, errno);
+
+    shm_ring_close(ring);
+    mu_assert("closed ring still drains", shm_ring_wait_data(ring, 0, 0));
+
+    shm_ring_destroy(ring);
+    return MU_PASS;
+}
+
+/* Test: A forked producer feeds the parent through the shared mapping */
+test_result_t test_shm_ring_cross_process(void) {
+    shm_ring_t* ring = shm_ring_create(4096);
+    const uint32_t count = 5000;
+
+    pid_t pid = fork();
+    mu_assert("fork", pid >= 0);
+    if (pid == 0) {
+        char buf[32];
+        for (uint32_t i = 0; i < count; i++) {
+            snprintf(buf, sizeof(buf), "record-%u", i);
+            publish(ring, buf, i);
+        }
+        shm_ring_close(ring);
+        _exit(0);
+    }
+
+    char expected[32];
+    uint64_t pos = 0;
+    uint32_t received = 0;
+    int in_order = 1;
+    while (shm_ring_wait_data(ring, pos, 1000)) {
+        uint64_t next;
+        shm_record_t* rec = shm_ring_at(ring, pos, &next);
+        snprintf(expected, sizeof(expected), "record-%u", received);
+        if (rec->seq != received || strcmp(shm_record_data(rec), expected) != 0) {
+            in_order = 0;
+        }
+        received++;
+        shm_ring_release(ring, next);
+        pos = next;
+    }
+
+    int status;
+    waitpid(pid, &status, 0);
+    mu_assert("producer exits cleanly", WIFEXITED(status) && WEXITSTATUS(status) == 0);
+    mu_assert_int_eq((int)count, (int)received);
+    mu_assert("records in order", in_order);
+
+    shm_ring_destroy(ring);
+    return MU_PASS;
+}
+
+/* Test: Pool blocks are sized, reused, bounded, and shared with a child */
+test_result_t test_shm_pool_alloc(void) {
+    shm_pool_t* pool = shm_pool_create(2 * SHM_POOL_MAX_BLOCK);
+    mu_assert("pool created", pool != NULL);
+
+    size_t capacity;
+    char* small = shm_pool_alloc(pool, 100, &capacity);
+    mu_assert("small block", small != NULL);
+    mu_assert_int_eq(SHM_POOL_MIN_BLOCK, (int)capacity);
+    char* large = shm_pool_alloc(pool, 5000, &capacity);
+    mu_assert("large block", large != NULL);
+    mu_assert_int_eq(2 * SHM_POOL_MIN_BLOCK, (int)capacity);
+    mu_assert("large block aligned to its size",
+              shm_pool_offset(pool, large) % (2 * SHM_POOL_MIN_BLOCK) == 0);
+
+    shm_pool_free(pool, small);
+    mu_assert("freed block reused", shm_pool_alloc(pool, 10, NULL) == small);
+
+    errno = 0;
+    mu_assert("oversized request refused",
+              shm_pool_alloc(pool, SHM_POOL_MAX_BLOCK + 1, NULL) == NULL && errno == ENOMEM);
+    char* max = shm_pool_alloc(pool, SHM_POOL_MAX_BLOCK, NULL);
+    mu_assert("largest block", max != NULL);
+    errno = 0;
+    mu_assert("exhausted pool refused",
+              shm_pool_alloc(pool, SHM_POOL_MAX_BLOCK, NULL) == NULL && errno == ENOMEM);
+
+    /* A child forked after creation sees the same block at the same offset */
+    uint64_t offset = shm_pool_offset(pool, large);
+    pid_t pid = fork();
+    mu_assert("fork", pid >= 0);
+    if (pid == 0) {
+        strcpy(shm_pool_at(pool, offset), "written by child");
+        _exit(0);
+    }
+    int status;
+    waitpid(pid, &status, 0);
+    mu_assert("child exits cleanly", WIFEXITED(status) && WEXITSTATUS(status) == 0);
+    mu_assert("child write visible", strcmp(large, "written by child") == 0);
+
+    shm_pool_destroy(pool);
+    return MU_PASS;
+}
+
+int main(void) {
+    printf("Running Shared Ring Unit Tests\n");
+    printf("==============================\n\n");
+
+    mu_run_test(test_shm_ring_wrap);
+    mu_run_test(test_shm_ring_limits);
+    mu_run_test(test_shm_ring_cross_process);
+    mu_run_test(test_shm_pool_alloc);
+
+    mu_print_summary();
+
+    return tests_failed > 0 ? 1 : 0;
+}
@@ -0,0 +1,135 @@
+/**
+ * Unit tests for event tracing
+ * Tests sampling, ring overwrite and the Chrome trace JSON output
+ */
+
+#include "minunit.h"
+#include "../src/trace.h"
+#include <pthread.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+
+/* Test counters */
+int tests_run = 0;
+int tests_failed = 0;
+int assertions_run = 0;
+int assertions_failed = 0;
+
+/* Write the trace to a temporary file and read it back */
+static char* write_and_read(void) {
+    char path[] = "/tmp/test_trace_XXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0) return NULL;
+    close(fd);
+
+    char* text = NULL;
+    if (trace_write(path) == 0) {
+        FILE* in = fopen(path, "r");
+        if (in) {
+            text = calloc(1, 1 << 20);
+            if (text && fread(text, 1, (1 << 20) - 1, in) == 0) text[0] = '\0';
+            fclose(in);
+        }
+    }
+    unlink(path);
+    return text;
+}
+
+static size_t count_substr(const char* text, const char* needle) {
+    size_t n = 0;
+    for (const char* p = text; (p = strstr(p, needle)) != NULL; p += strlen(needle)) n++;
+    return n;
+}
+
+/* Test: Nothing is recorded while tracing is off; sampling keeps 1 in N */
+test_result_t test_trace_sampling(void) {
+    mu_assert("off: no start time", trace_begin() == 0);
+    mu_assert("off: no sampled start time", trace_begin_sampled() == 0);
+
+    mu_assert_int_eq(0, trace_start(4, 0));
+    int sampled = 0;
+    for (int i = 0; i < 100; i++) {
+        uint64_t start = trace_begin_sampled();
+        if (start) sampled++;
+        trace_end(start, "work", "test", 1);
+    }
+    mu_assert_int_eq(25, sampled);
+
+    char* text = write_and_read();
+    mu_assert("trace written", text != NULL);
+    mu_assert_int_eq(25, (int)count_substr(text, "\"name\":\"work\""));
+    free(text);
+
+    trace_stop();
+    mu_assert("stopped", trace_begin() == 0);
+    return MU_PASS;
+}
+
+/* Test: A full ring keeps the newest events and reports the rest dropped */
+test_result_t test_trace_ring_overwrite(void) {
+    mu_assert_int_eq(0, trace_start(1, 10));    /* Rounded up to 16 */
+    trace_thread_name("main");
+
+    static const char* names[] = { "old", "new" };
+    for (int i = 0; i < 40; i++) {
+        uint64_t start = trace_begin();
+        trace_end(start, names[i >= 24], "test", (uint64_t)i);
+    }
+
+    char* text = write_and_read();
+    mu_assert("trace written", text != NULL);
+    mu_assert_int_eq(0, (int)count_substr(text, "\"name\":\"old\""));
+    mu_assert_int_eq(16, (int)count_substr(text, "\"name\":\"new\""));
+    mu_assert("thread named", strstr(text, "\"args\":{\"name\":\"main\",\"dropped_events\":24}") != NULL);
+    free(text);
+
+    trace_stop();
+    return MU_PASS;
+}
+
+static void* traced_thread(void* arg) {
+    trace_thread_name((const char*)arg);
+    for (int i = 0; i < 10; i++) {
+        trace_end(trace_begin(), "step", "test", (uint64_t)i);
+    }
+    return NULL;
+}
+
+/* Test: Each thread gets its own ring and name in the output */
+test_result_t test_trace_threads(void) {
+    mu_assert_int_eq(0, trace_start(1, 0));
+
+    pthread_t a, b;
+    pthread_create(&a, NULL, traced_thread, "worker a");
+    pthread_create(&b, NULL, traced_thread, "worker \"b\"");
+    pthread_join(a, NULL);
+    pthread_join(b, NULL);
+
+    char* text = write_and_read();
+    mu_assert("trace written", text != NULL);
+    mu_assert("valid header", strncmp(text, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[", 39) == 0);
+    mu_assert_int_eq(20, (int)count_substr(text, "\"ph\":\"X\""));
+    mu_assert_int_eq(2, (int)count_substr(text, "\"ph\":\"M\""));
+    mu_assert("first thread", strstr(text, "\"name\":\"worker a\"") != NULL);
+    mu_assert("escaped name", strstr(text, "\"name\":\"worker \\\"b\\\"\"") != NULL);
+    mu_assert("closed", strstr(text, "\n]}\n") != NULL);
+    free(text);
+
+    trace_stop();
+    return MU_PASS;
+}
+
+int main(void) {
+    printf("Running Trace Unit Tests\n");
+    printf("========================\n\n");
+
+    mu_run_test(test_trace_sampling);
+    mu_run_test(test_trace_ring_overwrite);
+    mu_run_test(test_trace_threads);
+
+    mu_print_summary();
+
+    return tests_failed > 0 ? 1 : 0;
+}
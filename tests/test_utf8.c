@@ -0,0 +1,180 @@
+/**
+ * Unit tests for the UTF-8 validator and repair routines
+ * Tests every error class of the lookup-table kernel, block boundaries, and
+ * agreement with a straightforward reference decoder
+ */
+
+#include "minunit.h"
+#include "../src/utf8.h"
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+/* Test counters */
+int tests_run = 0;
+int tests_failed = 0;
+int assertions_run = 0;
+int assertions_failed = 0;
+
+/* Reference decoder: deliberately naive, code point based */
+static int reference_validate(const unsigned char* s, size_t len) {
+    size_t i = 0;
+    while (i < len) {
+        unsigned c = s[i];
+        size_t n;
+        unsigned cp;
+        if (c < 0x80) { i++; continue; }
+        else if ((c & 0xE0) == 0xC0) { n = 1; cp = c & 0x1F; }
+        else if ((c & 0xF0) == 0xE0) { n = 2; cp = c & 0x0F; }
+        else if ((c & 0xF8) == 0xF0) { n = 3; cp = c & 0x07; }
+        else return 0;
+        if (i + n >= len) return 0;
+        for (size_t k = 1; k <= n; k++) {
+            if ((s[i + k] & 0xC0) != 0x80) return 0;
+            cp = (cp << 6) | (s[i + k] & 0x3F);
+        }
+        if (n == 1 && cp < 0x80) return 0;
+        if (n == 2 && cp < 0x800) return 0;
+        if (n == 3 && cp < 0x10000) return 0;
+        if (cp > 0x10FFFF) return 0;
+        if (cp >= 0xD800 && cp <= 0xDFFF) return 0;
+        i += n + 1;
+    }
+    return 1;
+}
+
+/* Test: ASCII and empty input */
+test_result_t test_utf8_ascii(void) {
+    mu_assert("empty is valid", utf8_validate("", 0) == 1);
+    mu_assert("short ASCII is valid", utf8_validate("hello", 5) == 1);
+
+    char long_ascii[1000];
+    memset(long_ascii, 'a', sizeof(long_ascii));
+    mu_assert("long ASCII is valid", utf8_validate(long_ascii, sizeof(long_ascii)) == 1);
+    mu_assert("long ASCII is ascii", utf8_is_ascii(long_ascii, sizeof(long_ascii)) == 1);
+
+    long_ascii[777] = (char)0xC3;
+    mu_assert("high byte is not ascii", utf8_is_ascii(long_ascii, sizeof(long_ascii)) == 0);
+
+    return MU_PASS;
+}
+
+/* Test: Well-formed multi-byte sequences of every length */
+test_result_t test_utf8_valid_sequences(void) {
+    const char* valid[] = {
+        "\xC3\xA9",                 /* U+00E9 */
+        "\xE2\x82\xAC",             /* U+20AC */
+        "\xF0\x9F\x98\x80",         /* U+1F600 */
+        "\xEF\xBF\xBD",             /* U+FFFD */
+        "\xF4\x8F\xBF\xBF",         /* U+10FFFF */
+        "\xED\x9F\xBF",             /* U+D7FF, just below surrogates */
+        "caf\xC3\xA9 na\xC3\xAFve \xE2\x82\xAC 100 \xF0\x9F\x98\x80!",
+    };
+    for (size_t i = 0; i < sizeof(valid) / sizeof(valid[0]); i++) {
+        mu_assert("sequence should be valid", utf8_validate(valid[i], strlen(valid[i])) == 1);
+    }
+    return MU_PASS;
+}
+
+/* Test: Each error class of the lookup tables */
+test_result_t test_utf8_invalid_sequences(void) {
+    const char* invalid[] = {
+        "\x80",                     /* lone continuation */
+        "\xC3",                     /* truncated 2-byte */
+        "\xE2\x82",                 /* truncated 3-byte */
+        "\xF0\x9F\x98",             /* truncated 4-byte */
+        "\xC0\xAF",                 /* overlong 2-byte */
+        "\xE0\x80\xAF",             /* overlong 3-byte */
+        "\xF0\x80\x80\xAF",         /* overlong 4-byte */
+        "\xED\xA0\x80",             /* surrogate U+D800 */
+        "\xF4\x90\x80\x80",         /* above U+10FFFF */
+        "\xF5\x80\x80\x80",         /* invalid lead */
+        "\xFF",                     /* invalid byte */
+        "\xC3\xA9\xA9",             /* too many continuations */
+        "a\xE2\x82z",               /* lead followed by ASCII */
+    };
+    for (size_t i = 0; i < sizeof(invalid) / sizeof(invalid[0]); i++) {
+        mu_assert("sequence should be invalid", utf8_validate(invalid[i], strlen(invalid[i])) == 0);
+    }
+    return MU_PASS;
+}
+
+/* Test: Sequences straddling every SIMD block boundary */
+test_result_t test_utf8_block_boundaries(void) {
+    char buf[160];
+    for (size_t pos = 0; pos < 140; pos++) {
+        memset(buf, 'x', sizeof(buf));
+        memcpy(buf + pos, "\xF0\x9F\x98\x80", 4);
+        mu_assert("straddling 4-byte is valid", utf8_validate(buf, pos + 4) == 1);
+        mu_assert("padded 4-byte is valid", utf8_validate(buf, sizeof(buf)) == 1);
+        mu_assert("truncated at end is invalid", utf8_validate(buf, pos + 3) == 0);
+
+        buf[pos + 2] = 'x';
+        mu_assert("broken 4-byte is invalid", utf8_validate(buf, sizeof(buf)) == 0);
+    }
+    return MU_PASS;
+}
+
+/* Test: Random byte strings agree with the reference decoder */
+test_result_t test_utf8_matches_reference(void) {
+    unsigned char buf[96];
+    const unsigned char alphabet[] = {
+        'a', 0x7F, 0x80, 0x8F, 0x90, 0x9F, 0xA0, 0xBF, 0xC0, 0xC2, 0xDF,
+        0xE0, 0xE1, 0xED, 0xEF, 0xF0, 0xF1, 0xF4, 0xF5, 0xFF
+    };
+    srand(12345);
+    for (int iter = 0; iter < 20000; iter++) {
+        size_t len = (size_t)(rand() % (int)sizeof(buf));
+        for (size_t i = 0; i < len; i++) {
+            buf[i] = alphabet[rand() % (int)sizeof(alphabet)];
+        }
+        int expected = reference_validate(buf, len);
+        int actual = utf8_validate((const char*)buf, len);
+        mu_assert_int_eq(expected, actual);
+    }
+    return MU_PASS;
+}
+
+/* Test: Repair replaces maximal subparts and output is valid */
+test_result_t test_utf8_repair(void) {
+    char out[64];
+    size_t n;
+
+    n = utf8_repair("ok", 2, out);
+    out[n] = '\0';
+    mu_assert_str_eq("ok", out);
+
+    /* Truncated 3-byte sequence is one maximal subpart */
+    n = utf8_repair("a\xE2\x82z", 4, out);
+    out[n] = '\0';
+    mu_assert_str_eq("a\xEF\xBF\xBDz", out);
+
+    /* Each byte of an overlong is its own subpart */
+    n = utf8_repair("\xC0\xAF", 2, out);
+    out[n] = '\0';
+    mu_assert_str_eq("\xEF\xBF\xBD\xEF\xBF\xBD", out);
+
+    /* Surrogate: ED is a subpart, then two stray continuations */
+    n = utf8_repair("\xED\xA0\x80", 3, out);
+    mu_assert("repair output is valid", utf8_validate(out, n) == 1);
+    mu_assert("three replacements", n == 3 * UTF8_REPLACEMENT_LEN);
+
+    return MU_PASS;
+}
+
+/* Main test runner */
+int main(void) {
+    printf("Running UTF-8 Unit Tests (kernel: %s)\n", utf8_kernel_name());
+    printf("==========================\n\n");
+
+    mu_run_test(test_utf8_ascii);
+    mu_run_test(test_utf8_valid_sequences);
+    mu_run_test(test_utf8_invalid_sequences);
+    mu_run_test(test_utf8_block_boundaries);
+    mu_run_test(test_utf8_matches_reference);
+    mu_run_test(test_utf8_repair);
+
+    mu_print_summary();
+
+    return tests_failed > 0 ? 1 : 0;
+}